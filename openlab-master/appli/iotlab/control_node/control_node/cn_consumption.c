@@ -36,23 +36,26 @@ struct consumption_config {
 #if 0
     uint32_t meas_period_us;
 #endif
-
-    iotlab_packet_t *pkt;
 };
 
 #define MEASURES_PRIORITY 0
 
-#define CN_CONSO_NUM_PKTS (8)
 #define CN_CONSO_NUM_ACKS (2)
 
-iotlab_packet_t meas_pkts[CN_CONSO_NUM_PKTS];
-iotlab_packet_queue_t measures_queue;
+static struct cn_meas_stream measures_stream = {
+    .type = CONSUMPTION_FRAME,
+    .reserved = 8,
+    .max_pkts = 28,
+    .policy = CN_MEAS_POLICY_DEFAULT,
+};
 
-iotlab_packet_t acks_pkts[CN_CONSO_NUM_ACKS];
-iotlab_packet_queue_t acks_queue;
+static iotlab_packet_t acks_pkts[CN_CONSO_NUM_ACKS];
+static iotlab_packet_queue_t acks_queue;
 
 
 static struct consumption_config cur_config = {0};
+/* Ack of the configuration being applied, sent by the event handler */
+static iotlab_packet_t *config_ack_pkt;
 
 
 static int32_t config_consumption_measures(uint8_t cmd_type,
@@ -79,7 +82,7 @@ static void consumption_measure_handler(handler_arg_t arg,
 void cn_consumption_start()
 {
 
-    iotlab_packet_init_queue(&measures_queue, meas_pkts, CN_CONSO_NUM_PKTS);
+    cn_meas_stream_register(&measures_stream);
     iotlab_packet_init_queue(&acks_queue, acks_pkts, CN_CONSO_NUM_ACKS);
 
     // Stop sampling
@@ -109,6 +112,7 @@ static int parse_consumption_config(uint8_t *data,
 
     /* start or stop */
     conf->enable = (START == status);
+    conf->pw_conf_byte = pw_conf;
 
     /* get power source */
     switch (pw_conf & PW_SRC_MASK) {
@@ -163,11 +167,6 @@ static int parse_consumption_config(uint8_t *data,
     if (conf->enable && invalid_config)
         return 1;
 
-    /* everything fine, alloc frame needed to send config transition */
-    conf->pkt = alloc_pw_ack_frame(pw_conf);
-    if (NULL == conf->pkt)
-        return 1;
-
     return 0;
 }
 
@@ -186,6 +185,11 @@ static int32_t config_consumption_measures(uint8_t cmd_type,
     if (parse_consumption_config(pkt->data, &conf))
         return 1;
 
+    /* everything fine, alloc frame needed to send config transition */
+    config_ack_pkt = alloc_pw_ack_frame(conf.pw_conf_byte);
+    if (NULL == config_ack_pkt)
+        return 1;
+
     /*
      * Stop INA to prevent new measures event
      * Then post an event to the queue to do the config update.
@@ -218,19 +222,19 @@ static void do_config_consumption_measures(handler_arg_t arg)
     flush_current_consumption_measures();
 
     /* Send the update frame */
-    if (iotlab_serial_send_frame(ACK_FRAME, conf->pkt)) {
+    if (iotlab_serial_send_frame(ACK_FRAME, config_ack_pkt)) {
         // ERF that's really bad, config failed
         // send ERROR NOW TODO
         leds_on(RED_LED);
         cn_logger(LOGGER_ERROR, "Invalid ack pkt for consumption");
-        iotlab_packet_call_free(conf->pkt);
+        iotlab_packet_call_free(config_ack_pkt);
         return;
     }
     /* Gateway will now be able to receive new packets */
 
     /* Set the new configuration */
     memcpy(&cur_config, conf, sizeof(struct consumption_config));
-    cur_config.pkt = NULL;
+    measures_stream.measure_size = cur_config.measure_size;
 
     if (cur_config.enable) {
         ina226_configure(cur_config.period, cur_config.average);
@@ -245,15 +249,9 @@ static void consumption_measure_handler(handler_arg_t arg,
         float v, float c, float p, uint32_t measure_time_ticks)
 {
     struct soft_timer_timeval timestamp;
-    iotlab_packet_t *packet;
 
     iotlab_time_extend_relative(&timestamp, measure_time_ticks);
 
-    packet = cn_meas_pkt_lazy_alloc(&measures_queue, cur_config.pkt,
-                                    &timestamp);
-    if ((cur_config.pkt = packet) == NULL)
-        return;  // alloc failed, drop this measure
-
     /* Fill consumption according to config */
     struct cn_meas consumption[4] = {{NULL, 0}};
     int i = 0;
@@ -265,12 +263,8 @@ static void consumption_measure_handler(handler_arg_t arg,
         consumption[i++] = (struct cn_meas){&c, sizeof(float)};
     consumption[i] = (struct cn_meas){NULL, 0};
 
-    /* Add measure time + consumption */
-    int send = cn_meas_pkt_add_measure(packet, &timestamp,
-                                       cur_config.measure_size,
-                                       consumption);
-    if (send)
-        flush_current_consumption_measures();
+    /* Add measure time + consumption, drops are reported in next frame */
+    cn_meas_stream_add(&measures_stream, &timestamp, consumption);
 }
 
 
@@ -291,5 +285,5 @@ static iotlab_packet_t *alloc_pw_ack_frame(uint8_t pw_config)
 
 void flush_current_consumption_measures()
 {
-    cn_meas_pkt_flush(&cur_config.pkt, CONSUMPTION_FRAME);
+    cn_meas_stream_flush(&measures_stream);
 }
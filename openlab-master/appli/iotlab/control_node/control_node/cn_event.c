@@ -9,33 +9,79 @@
 #include "cn_meas_pkt.h"
 
 #define MEASURES_PRIORITY 0
-#define CN_EVENT_NUM_PKTS (8)
+
+/* Number of edges buffered between interrupts and the event queue */
+#ifndef CN_EVENT_RING_SIZE
+#define CN_EVENT_RING_SIZE (64)
+#endif
 
 enum events_t {
-    EVENT_PPS = 0,
+    EVENT_PPS   = 0,
+    EVENT_GPIO1 = 1,
+    EVENT_GPIO2 = 2,
 };
 
 enum config_gpio_t {
-    CONFIG_GPIO_PPS = 1 << 0,
+    CONFIG_GPIO_PPS   = 1 << 0,
+    CONFIG_GPIO_GPIO1 = 1 << 1,
+    CONFIG_GPIO_GPIO2 = 1 << 2,
+};
+
+/*
+ * Event input lines.
+ *
+ * Lines with a timer capture channel are timestamped by the timer when the
+ * edge happens. Others are timestamped in the gpio interrupt.
+ */
+static struct event_line {
+    struct gpio_conf *gpio;
+    uint8_t source;
+    uint8_t config;
+    /* soft_timer counter - capture timer counter */
+    uint16_t capture_offset;
+    int enabled;
+} lines[] = {
+    {&gpio_config[3], EVENT_PPS,   CONFIG_GPIO_PPS,   0, 0},
+    {&gpio_config[1], EVENT_GPIO1, CONFIG_GPIO_GPIO1, 0, 0},
+    {&gpio_config[2], EVENT_GPIO2, CONFIG_GPIO_GPIO2, 0, 0},
 };
+#define NUM_LINES (sizeof(lines) / sizeof(*lines))
 
 
-static iotlab_packet_t* p;
-static uint32_t measure_size = 3 * sizeof(uint32_t);
+static struct cn_meas_stream measures_stream = {
+    .type = EVENT_FRAME,
+    .measure_size = 3 * sizeof(uint32_t),
+    .reserved = 4,
+    .max_pkts = 16,
+    .policy = CN_MEAS_POLICY_DEFAULT,
+};
 
-iotlab_packet_t meas_pkts[CN_EVENT_NUM_PKTS];
-iotlab_packet_queue_t measures_queue;
+/* Edges ring, written in interrupts, read in the event queue */
+static struct {
+    struct {
+        uint32_t ticks;
+        uint8_t source;
+    } edges[CN_EVENT_RING_SIZE];
+    volatile unsigned head;
+    volatile unsigned tail;
+    volatile unsigned overflow;
+    volatile int drain_posted;
+} ring;
 
 static int32_t config_gpio_event(uint8_t cmd_type, iotlab_packet_t* packet);
 static void event_handler(uint32_t ticks, uint32_t value, uint32_t source);
-static void pps_handler_irq(handler_arg_t arg);
-static void pps_handler(handler_arg_t arg);
+static void line_start(struct event_line *line);
+static void line_stop(struct event_line *line);
+static void line_capture_irq(handler_arg_t arg, uint16_t value);
+static void line_handler_irq(handler_arg_t arg);
+static void ring_push(uint32_t ticks, uint8_t source);
+static void ring_drain(handler_arg_t arg);
 
 
 void cn_event_start()
 {
 
-   iotlab_packet_init_queue(&measures_queue, meas_pkts, CN_EVENT_NUM_PKTS);
+   cn_meas_stream_register(&measures_stream);
 
    static iotlab_serial_handler_t handler = {
        .cmd_type = CONFIG_GPIO,
@@ -49,7 +95,7 @@ static int32_t config_gpio_event(uint8_t cmd_type, iotlab_packet_t* packet)
      /*
      * Expected packet format is (length:2B:
      *      * Start / Stop mode         [1B]
-     *      * GPIOs (PPS|GPIO1|GPIO2)    [1B]
+     *      * GPIOs (PPS|GPIO1|GPIO2)    [1B]  0 for PPS only
      */
 
     packet_t* pkt = (packet_t*) packet;
@@ -58,54 +104,130 @@ static int32_t config_gpio_event(uint8_t cmd_type, iotlab_packet_t* packet)
 
     uint8_t mode  = pkt->data[0];
     uint8_t gpios = pkt->data[1];
-    (void)gpios;
+    unsigned i;
 
-    if (mode == STOP) {
-        gpio_disable_irq(&gpio_config[3]);
-        return 0;
-    } else {
-        gpio_enable_irq(&gpio_config[3], IRQ_RISING, pps_handler_irq, NULL);
-        return 0;
+    if (gpios == 0)
+        gpios = CONFIG_GPIO_PPS;  // previous format, gpios was ignored
+
+    for (i = 0; i < NUM_LINES; i++) {
+        line_stop(&lines[i]);
+        if ((mode != STOP) && (gpios & lines[i].config))
+            line_start(&lines[i]);
     }
+    return 0;
+}
+
+static void line_start(struct event_line *line)
+{
+    uint32_t now;
+
+    /* Read the capture timer offset while both counters are stable */
+    do {
+        now = soft_timer_time();
+        if (line->gpio->capture_timer)
+            line->capture_offset = (uint16_t)now -
+                timer_time(line->gpio->capture_timer);
+    } while (now != soft_timer_time());
+
+    if (gpio_enable_capture(line->gpio, IRQ_RISING, line_capture_irq, line))
+        gpio_enable_irq(line->gpio, IRQ_RISING, line_handler_irq, line);
+    line->enabled = 1;
+}
+
+static void line_stop(struct event_line *line)
+{
+    if (!line->enabled)
+        return;
+    line->enabled = 0;
+
+    if (line->gpio->capture_timer)
+        gpio_disable_capture(line->gpio);
+    else
+        gpio_disable_irq(line->gpio);
+}
 
+static void line_capture_irq(handler_arg_t arg, uint16_t value)
+{
+    struct event_line *line = arg;
+    uint32_t now = soft_timer_time();
+    uint16_t capture = value + line->capture_offset;
+
+    /* Extend the 16 bits capture with the soft timer, capture is in the past */
+    ring_push(now - (uint16_t)((uint16_t)now - capture), line->source);
 }
 
-static void pps_handler_irq(handler_arg_t arg)
+static void line_handler_irq(handler_arg_t arg)
 {
-    (void) arg;
-    uint32_t timestamp = soft_timer_time();
-    event_post(EVENT_QUEUE_APPLI, pps_handler, (handler_arg_t)timestamp);
+    struct event_line *line = arg;
+    ring_push(soft_timer_time(), line->source);
 }
 
-static void pps_handler(handler_arg_t arg)
+
+/*
+ * Edges ring
+ */
+static void ring_push(uint32_t ticks, uint8_t source)
 {
-    uint32_t timestamp = (uint32_t)arg;
-    event_handler(timestamp, 1, EVENT_PPS);
+    int post;
+
+    /* Lines interrupts may have different priorities */
+    platform_enter_critical();
+    unsigned head = ring.head;
+    if ((head - ring.tail) >= CN_EVENT_RING_SIZE) {
+        ring.overflow++;
+    } else {
+        ring.edges[head % CN_EVENT_RING_SIZE].ticks = ticks;
+        ring.edges[head % CN_EVENT_RING_SIZE].source = source;
+        ring.head = head + 1;
+    }
+    /* Only one drain event at a time, even at high edge rates */
+    post = !ring.drain_posted;
+    ring.drain_posted = 1;
+    platform_exit_critical();
+
+    if (post && event_post(EVENT_QUEUE_APPLI, ring_drain, NULL))
+        ring.drain_posted = 0;  // retry on next edge
+}
+
+static void ring_drain(handler_arg_t arg)
+{
+    (void)arg;
+    unsigned overflow;
+
+    ring.drain_posted = 0;
+
+    platform_enter_critical();
+    overflow = ring.overflow;
+    ring.overflow = 0;
+    platform_exit_critical();
+    if (overflow)
+        cn_meas_stream_add_dropped(&measures_stream, overflow);
+
+    while (ring.tail != ring.head) {
+        uint32_t ticks = ring.edges[ring.tail % CN_EVENT_RING_SIZE].ticks;
+        uint8_t source = ring.edges[ring.tail % CN_EVENT_RING_SIZE].source;
+        ring.tail++;
+
+        if (source == EVENT_PPS)
+            iotlab_time_pps(ticks);
+        event_handler(ticks, 1, source);
+    }
 }
 
 static void event_handler(uint32_t ticks, uint32_t value, uint32_t source)
 {
     struct soft_timer_timeval timestamp;
-    iotlab_packet_t *packet;
 
     iotlab_time_extend_relative(&timestamp, ticks);
 
-    packet = cn_meas_pkt_lazy_alloc(&measures_queue, p, &timestamp);
-    if ((p = packet) == NULL)
-        return;  // alloc failed, drop this measure
-
     /* Add measure time + event (value|source) */
     struct cn_meas event[] = {{&value, sizeof(uint32_t)},
                               {&source, sizeof(uint32_t)},
                               {NULL, 0}};
-    int send = cn_meas_pkt_add_measure(
-            packet, &timestamp, measure_size, event);
-
-    if (send)
-        flush_current_event();
+    cn_meas_stream_add(&measures_stream, &timestamp, event);
 }
 
 void flush_current_event()
 {
-    cn_meas_pkt_flush(&p, EVENT_FRAME);
+    cn_meas_stream_flush(&measures_stream);
 }
@@ -1,22 +1,125 @@
 #include <string.h>
+#include "platform.h"
+#include "soft_timer.h"
+
+#include "constants.h"
 #include "cn_meas_pkt.h"
+#ifdef CN_SPOOL
+#include "cn_spool.h"
+#endif
 
 enum {
     NUM_PKT_OFFSET = 0,
     TIME_OFFSET = 1,
+    DROPPED_OFFSET = 5,
     SEC = 1000 * 1000,
 };
 
+/* Period of the check for packets kept for too long */
+#define CN_MEAS_PKT_FLUSH_CHECK_MS (100)
+
 
 static void _pkt_inc_measure_count(iotlab_packet_t *packet);
 static void _pkt_add_measure_time(iotlab_packet_t *packet,
                                   struct soft_timer_timeval *timestamp);
 static int _pkt_should_send(iotlab_packet_t *packet, size_t measure_size,
-                            struct soft_timer_timeval *timestamp);
+                            struct soft_timer_timeval *timestamp,
+                            const struct cn_meas_policy *policy);
 
 static uint32_t _us_since_packet_ref(iotlab_packet_t *packet,
                                      struct soft_timer_timeval *timestamp);
 
+static iotlab_packet_t *_stream_alloc(struct cn_meas_stream *stream,
+                                      struct soft_timer_timeval *timestamp);
+static void _stream_pkt_free(iotlab_packet_t *packet);
+static void _flush_timer_handler(handler_arg_t arg);
+static int32_t config_meas_stream(uint8_t cmd_type, iotlab_packet_t *packet);
+#ifdef CN_SPOOL
+static int _pkt_drop(iotlab_packet_t **packet_p);
+#endif
+
+
+static struct {
+    iotlab_packet_t pkts[CN_MEAS_PKT_ARENA_SIZE];
+    iotlab_packet_queue_t queue;
+    /* Stream owning each allocated packet */
+    struct cn_meas_stream *owner[CN_MEAS_PKT_ARENA_SIZE];
+
+    struct cn_meas_stream *first_stream;
+    soft_timer_t flush_timer;
+} arena;
+
+
+void cn_meas_pkt_start()
+{
+    iotlab_packet_init_queue(&arena.queue, arena.pkts, CN_MEAS_PKT_ARENA_SIZE);
+    arena.first_stream = NULL;
+
+    soft_timer_set_handler(&arena.flush_timer, _flush_timer_handler, NULL);
+    soft_timer_start(&arena.flush_timer,
+            soft_timer_ms_to_ticks(CN_MEAS_PKT_FLUSH_CHECK_MS), 1);
+
+    static iotlab_serial_handler_t handler_config_meas_stream = {
+        .cmd_type = CONFIG_MEAS_STREAM,
+        .handler = config_meas_stream,
+    };
+    iotlab_serial_register_handler(&handler_config_meas_stream);
+}
+
+void cn_meas_stream_register(struct cn_meas_stream *stream)
+{
+    stream->pkt = NULL;
+    stream->in_use = 0;
+    stream->dropped = 0;
+
+    // Insert on head
+    stream->next = arena.first_stream;
+    arena.first_stream = stream;
+}
+
+int cn_meas_stream_add(struct cn_meas_stream *stream,
+                       struct soft_timer_timeval *timestamp,
+                       struct cn_meas *measures)
+{
+    if (NULL == stream->pkt)
+        stream->pkt = _stream_alloc(stream, timestamp);
+    if (NULL == stream->pkt) {
+        cn_meas_stream_add_dropped(stream, 1);
+        return 1;  // alloc failed, drop this measure
+    }
+
+    int send = cn_meas_pkt_add_measure(stream->pkt, timestamp,
+                                       stream->measure_size, measures,
+                                       &stream->policy);
+    if (send)
+        cn_meas_stream_flush(stream);
+    return 0;
+}
+
+void cn_meas_stream_flush(struct cn_meas_stream *stream)
+{
+#ifdef CN_SPOOL
+    /* Serial link is late, store to flash */
+    if (stream->pkt && cn_spool_should_store()) {
+        if (0 == cn_spool_store(&stream->pkt, stream->type))
+            return;
+        /* Sending it now would overtake the older frames of the spool */
+        if (cn_spool_pending()) {
+            cn_meas_stream_add_dropped(stream, _pkt_drop(&stream->pkt));
+            return;
+        }
+    }
+#endif
+    int lost = cn_meas_pkt_flush(&stream->pkt, stream->type);
+    cn_meas_stream_add_dropped(stream, lost);
+}
+
+void cn_meas_stream_add_dropped(struct cn_meas_stream *stream, unsigned num)
+{
+    uint32_t dropped = stream->dropped + num;
+    stream->dropped = (dropped > 0xFFFF) ? 0xFFFF : dropped;
+}
+
 
 iotlab_packet_t *cn_meas_pkt_lazy_alloc(
         iotlab_packet_queue_t *queue,
@@ -35,10 +138,13 @@ iotlab_packet_t *cn_meas_pkt_lazy_alloc(
     /* init new measure packet
      * + measure count
      * + timestamp seconds
+     * + dropped measures
      */
+    uint16_t dropped = 0;
     ((packet_t *)packet)->data[NUM_PKT_OFFSET] = 0;  // empty packet
     ((packet_t *)packet)->length  = 1;  // measures number byte
     iotlab_packet_append_data(packet, &timestamp->tv_sec, sizeof(uint32_t));
+    iotlab_packet_append_data(packet, &dropped, sizeof(uint16_t));
 
     return packet;
 }
@@ -47,7 +153,8 @@ int cn_meas_pkt_add_measure(
         iotlab_packet_t *packet,
         struct soft_timer_timeval *timestamp,
         size_t measure_size,
-        struct cn_meas *measures)
+        struct cn_meas *measures,
+        const struct cn_meas_policy *policy)
 {
     _pkt_inc_measure_count(packet);
     _pkt_add_measure_time(packet, timestamp);
@@ -56,19 +163,171 @@ int cn_meas_pkt_add_measure(
     for (meas = measures; meas->addr != NULL; (meas = (++measures)))
         iotlab_packet_append_data(packet, meas->addr, meas->size);
 
-    return _pkt_should_send(packet, measure_size, timestamp);
+    return _pkt_should_send(packet, measure_size, timestamp, policy);
 }
 
-void cn_meas_pkt_flush(iotlab_packet_t **packet_p, uint8_t type)
+int cn_meas_pkt_flush(iotlab_packet_t **packet_p, uint8_t type)
 {
     iotlab_packet_t* packet = *packet_p;
+    int lost = 0;
 
     if (NULL == packet)
-        return;
-    if (iotlab_serial_send_frame(type, packet))
-        iotlab_packet_call_free(packet);  // send fail
+        return 0;
+    if (iotlab_serial_send_frame(type, packet)) {
+        // send fail
+        lost = ((packet_t *)packet)->data[NUM_PKT_OFFSET];
+        iotlab_packet_call_free(packet);
+    }
+
+    *packet_p = NULL;
+    return lost;
+}
+
+#ifdef CN_SPOOL
+static int _pkt_drop(iotlab_packet_t **packet_p)
+{
+    int lost = ((packet_t *)*packet_p)->data[NUM_PKT_OFFSET];
 
+    iotlab_packet_call_free(*packet_p);
     *packet_p = NULL;
+    return lost;
+}
+#endif
+
+
+/*
+ * Arena management
+ */
+
+/*
+ * Packets reserved by other streams and not currently used.
+ * Stream can use an unreserved packet only if more are available.
+ */
+static unsigned _others_unused_reservation(struct cn_meas_stream *stream)
+{
+    struct cn_meas_stream *cur;
+    unsigned unused = 0;
+
+    for (cur = arena.first_stream; cur != NULL; cur = cur->next) {
+        if (cur == stream)
+            continue;
+        if (cur->in_use < cur->reserved)
+            unused += cur->reserved - cur->in_use;
+    }
+    return unused;
+}
+
+static iotlab_packet_t *_stream_alloc(struct cn_meas_stream *stream,
+                                      struct soft_timer_timeval *timestamp)
+{
+    iotlab_packet_t *packet;
+    int admit;
+
+    platform_enter_critical();
+    admit = (stream->in_use < stream->max_pkts) &&
+        ((stream->in_use < stream->reserved) ||
+         ((unsigned)iotlab_packet_fifo_count(&arena.queue) >
+          _others_unused_reservation(stream)));
+    platform_exit_critical();
+
+    if (!admit)
+        return NULL;  // back-pressure
+
+    packet = cn_meas_pkt_lazy_alloc(&arena.queue, NULL, timestamp);
+    if (NULL == packet)
+        return NULL;
+
+    platform_enter_critical();
+    stream->in_use++;
+    platform_exit_critical();
+
+    arena.owner[packet - arena.pkts] = stream;
+    packet->free = _stream_pkt_free;
+    stream->pkt_alloc_time = soft_timer_time();
+
+    /* Report measures dropped since previous frame */
+    memcpy(&((packet_t *)packet)->data[DROPPED_OFFSET], &stream->dropped,
+           sizeof(uint16_t));
+    stream->dropped = 0;
+
+    return packet;
+}
+
+/* Called by the serial TX task after sending or directly on error */
+static void _stream_pkt_free(iotlab_packet_t *packet)
+{
+    struct cn_meas_stream *stream = arena.owner[packet - arena.pkts];
+
+    platform_enter_critical();
+    stream->in_use--;
+    platform_exit_critical();
+
+    iotlab_packet_free(packet);
+}
+
+
+/* Send packets kept for more than their stream max latency */
+static void _flush_timer_handler(handler_arg_t arg)
+{
+    (void)arg;
+    struct cn_meas_stream *stream;
+    uint32_t now = soft_timer_time();
+
+    for (stream = arena.first_stream; stream != NULL; stream = stream->next) {
+        if ((NULL == stream->pkt) || (0 == stream->policy.max_latency_us))
+            continue;
+        if ((now - stream->pkt_alloc_time) >=
+                (uint32_t)soft_timer_us_to_ticks(stream->policy.max_latency_us))
+            cn_meas_stream_flush(stream);
+    }
+}
+
+static int32_t config_meas_stream(uint8_t cmd_type, iotlab_packet_t *packet)
+{
+    /*
+     * Expected packet format is (length:6B):
+     *      * Stream frame type         [1B]
+     *      * Max latency (ms)          [2B]  0 to disable
+     *      * Fill level (bytes)        [1B]  0 for 'packet full'
+     *      * Reserved packets          [1B]
+     *      * Max packets               [1B]
+     */
+    packet_t *pkt = (packet_t *)packet;
+    struct cn_meas_stream *stream, *cur;
+    uint16_t max_latency_ms;
+    unsigned reserved;
+
+    if (6 != pkt->length)
+        return 1;
+
+    for (stream = arena.first_stream; stream != NULL; stream = stream->next) {
+        if (stream->type == pkt->data[0])
+            break;
+    }
+    if (NULL == stream)
+        return 1;
+
+    memcpy(&max_latency_ms, &pkt->data[1], sizeof(uint16_t));
+    if (pkt->data[5] == 0 || pkt->data[4] > pkt->data[5])
+        return 1;
+
+    /* Reservations of all streams must fit in the arena */
+    reserved = pkt->data[4];
+    for (cur = arena.first_stream; cur != NULL; cur = cur->next) {
+        if (cur != stream)
+            reserved += cur->reserved;
+    }
+    if (reserved > CN_MEAS_PKT_ARENA_SIZE)
+        return 1;
+
+    /* Running in the same event queue as measures handlers */
+    cn_meas_stream_flush(stream);
+    stream->policy.max_latency_us = max_latency_ms * 1000;
+    stream->policy.fill_level = pkt->data[3];
+    stream->reserved = pkt->data[4];
+    stream->max_pkts = pkt->data[5];
+
+    return 0;
 }
 
 
@@ -90,7 +349,8 @@ static void _pkt_add_measure_time(iotlab_packet_t *packet,
 }
 
 static int _pkt_should_send(iotlab_packet_t *packet, size_t measure_size,
-                            struct soft_timer_timeval *timestamp)
+                            struct soft_timer_timeval *timestamp,
+                            const struct cn_meas_policy *policy)
 {
 
     uint32_t usecs = _us_since_packet_ref(packet, timestamp);
@@ -99,9 +359,13 @@ static int _pkt_should_send(iotlab_packet_t *packet, size_t measure_size,
     if (iotlab_serial_packet_free_space(packet) < measure_size)
         return 1;
 
-    /* No packet has been sent for a long time:
-     * around one or two seconds */
-    if (usecs > (2 * SEC))
+    /* Fill level reached */
+    if (policy->fill_level &&
+            (((packet_t *)packet)->length >= policy->fill_level))
+        return 1;
+
+    /* No packet has been sent for a long time */
+    if (policy->max_latency_us && (usecs > policy->max_latency_us))
         return 1;
 
     return 0;
@@ -10,6 +10,8 @@
  *
  * - uint8_t:   Num measures
  * - uint32_t:  Base timestamp in seconds
+ * - uint16_t:  Num measures dropped on this stream since the previous frame
+ *              (saturates at 0xFFFF)
  *
  * - measure:   Measure 1
  * - measure:   Measure 2
@@ -27,14 +29,113 @@
  *
  */
 
+enum {
+    /** Num measures + base timestamp + dropped count */
+    CN_MEAS_PKT_HEADER_SIZE = 1 + sizeof(uint32_t) + sizeof(uint16_t),
+};
+
+/*
+ * Number of packets in the arena shared by all measures streams.
+ * Can be overriden from the platform include.cmake
+ */
+#ifndef CN_MEAS_PKT_ARENA_SIZE
+#define CN_MEAS_PKT_ARENA_SIZE (32)
+#endif
+
 struct cn_meas {
     void *addr;
     size_t size;
 };
 
+/**
+ * Policy deciding when a measure packet should be sent.
+ * Packet is sent as soon as one of the conditions is true.
+ */
+struct cn_meas_policy {
+    /**
+     * Max number of µs between the packet base timestamp and a measure,
+     * also max time a packet is kept before being sent. 0 to disable.
+     */
+    uint32_t max_latency_us;
+    /**
+     * Payload size in bytes from which packet is sent.
+     * 0 to send only when packet is full.
+     */
+    uint8_t fill_level;
+};
+
+/** Default policy: send when packet is full, or after around 2 seconds */
+#define CN_MEAS_POLICY_DEFAULT {.max_latency_us = 2000000, .fill_level = 0}
+
+/**
+ * A measures stream, sending measure packets of one frame type.
+ *
+ * Packets are allocated from the shared arena. A stream has 'reserved'
+ * packets always available to it, and cannot hold more than 'max_pkts' at the
+ * same time, including the ones waiting to be sent on the serial link.
+ * Measures that cannot be stored are counted and reported in the next frame.
+ */
+struct cn_meas_stream {
+    /** Frame type used for sent packets */
+    uint8_t type;
+    /** timestamp + measure size == 4 + sizeof(measures) */
+    size_t measure_size;
+    /** Packets of the arena always available to this stream */
+    unsigned reserved;
+    /** Max number of packets used by this stream at the same time */
+    unsigned max_pkts;
+    /** Policy used to decide when to send the packet */
+    struct cn_meas_policy policy;
+
+    /* Internal state, DO NOT MODIFY */
+    iotlab_packet_t *pkt;
+    uint32_t pkt_alloc_time;
+    volatile unsigned in_use;
+    uint16_t dropped;
+    struct cn_meas_stream *next;
+};
+
+/**
+ * Start the measures packets library.
+ * Initialize the shared packets arena and the flush timer
+ */
+void cn_meas_pkt_start();
+
+/**
+ * Register a measures stream.
+ * The structure will be chained internally and must be persistent.
+ */
+void cn_meas_stream_register(struct cn_meas_stream *stream);
+
+/**
+ * Add a new measure to the stream.
+ * Packet is allocated if needed and sent according to stream policy.
+ *
+ * \param stream     measure stream to use
+ * \param timestamp  measure timestamp
+ * \param measures   list of measures, should be {NULL, 0} terminated
+ *
+ * \return 0 on success, 1 if the measure has been dropped
+ */
+int cn_meas_stream_add(struct cn_meas_stream *stream,
+                       struct soft_timer_timeval *timestamp,
+                       struct cn_meas *measures);
+
+/**
+ * Send the current stream packet if any.
+ */
+void cn_meas_stream_flush(struct cn_meas_stream *stream);
+
+/**
+ * Count measures dropped before reaching the stream.
+ * They are reported in the next frame of the stream.
+ */
+void cn_meas_stream_add_dropped(struct cn_meas_stream *stream, unsigned num);
+
 /**
  * Alloc and initialize a new packet in needed.
- * Packet is initialized with 'num measures' == 0 and base timestamp stored.
+ * Packet is initialized with 'num measures' == 0, base timestamp stored and
+ * 'dropped' == 0.
  *
  * \param queue          queue where to alloc packet from
  * \param current_packet Decide if a new one should be alloc in NULL
@@ -54,15 +155,18 @@ iotlab_packet_t *cn_meas_pkt_lazy_alloc(iotlab_packet_queue_t *queue,
  * \param timestamp    measure timestamp
  * \param measure_size timestamp + measure size == 4 + sizeof(measures)
  * \param measures     list of measures, should be {NULL, 0} terminated
+ * \param policy       policy to decide if packet should be sent
  *
  * \return true if packet should be sent. It should be sent if:
  *           Packet is full == cannot contain another measure
- *           timestamp - ref_timestamp_s > 2 seconds
+ *           Payload reached policy 'fill_level'
+ *           timestamp - ref_timestamp_s > policy 'max_latency_us'
  */
 int cn_meas_pkt_add_measure(iotlab_packet_t *packet,
                             struct soft_timer_timeval *timestamp,
                             size_t measure_size,
-                            struct cn_meas *measures);
+                            struct cn_meas *measures,
+                            const struct cn_meas_policy *policy);
 
 /**
  * Send pointed packet with type. If sending fails, packet is freed directly.
@@ -70,7 +174,9 @@ int cn_meas_pkt_add_measure(iotlab_packet_t *packet,
  *
  * \param packet_p pointer to packet to send, it will be set to NULL.
  * \param type     packet data type
+ *
+ * \return number of measures lost if sending failed, 0 otherwise
  */
-void cn_meas_pkt_flush(iotlab_packet_t **packet_p, uint8_t type);
+int cn_meas_pkt_flush(iotlab_packet_t **packet_p, uint8_t type);
 
 #endif//CN_MEAS_PKT_H
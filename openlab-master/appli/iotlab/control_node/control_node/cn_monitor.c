@@ -0,0 +1,105 @@
+#include <string.h>
+#include "platform.h"
+#include "soft_timer_delay.h"
+#include "monitor.h"
+
+#include "iotlab_serial.h"
+
+#include "constants.h"
+#include "cn_monitor.h"
+
+/* One frame at a time, samples are dropped while it is being sent */
+#define CN_MONITOR_NUM_PKTS (1)
+
+/* name, cpu, cpu_max, stack_free */
+#define TASK_SIZE (MONITOR_NAME_LENGTH + 3 * sizeof(uint16_t))
+#define FRAME_MAX_TASKS ((int)((IOTLAB_SERIAL_DATA_MAX_SIZE - 1) / TASK_SIZE))
+
+static struct {
+    iotlab_packet_t pkts[CN_MONITOR_NUM_PKTS];
+    iotlab_packet_queue_t queue;
+} cn_monitor;
+
+static int32_t config_monitor(uint8_t cmd_type, iotlab_packet_t *pkt);
+static void send_tasks(handler_arg_t arg);
+
+
+void cn_monitor_start()
+{
+    iotlab_packet_init_queue(&cn_monitor.queue,
+            cn_monitor.pkts, CN_MONITOR_NUM_PKTS);
+
+    static iotlab_serial_handler_t handler = {
+        .cmd_type = CONFIG_MONITOR,
+        .handler = config_monitor,
+    };
+    iotlab_serial_register_handler(&handler);
+}
+
+static int32_t config_monitor(uint8_t cmd_type, iotlab_packet_t *packet)
+{
+    /*
+     * Expected packet format is (length:2B):
+     *      * Start / Stop mode         [1B]
+     *      * Period in seconds         [1B]
+     */
+    packet_t *pkt = (packet_t *)packet;
+    if (2 != pkt->length)
+        return 1;
+
+    uint8_t mode   = pkt->data[0];
+    uint8_t period = pkt->data[1];
+
+    if (mode == STOP) {
+        monitor_stop();
+        return 0;
+    }
+    // Shorter than the cycle counter wrap around
+    if (period == 0 || period > MONITOR_MAX_PERIOD_S)
+        return 1;
+
+    monitor_start(soft_timer_s_to_ticks(period), send_tasks, NULL);
+    return 0;
+}
+
+static void send_tasks(handler_arg_t arg)
+{
+    (void)arg;
+    /*
+     * Frame format:
+     *      * Number of tasks           [1B]
+     *      * For each task:
+     *          * Name, 0 padded        [8B]
+     *          * CPU share per-mille   [2B]
+     *          * Max CPU share         [2B]
+     *          * Free stack in words   [2B]
+     */
+    monitor_task_t tasks[MONITOR_MAX_TASKS];
+    int i, count;
+
+    iotlab_packet_t *packet = iotlab_serial_packet_alloc(&cn_monitor.queue);
+    if (!packet)
+        return;
+    packet_t *pkt = (packet_t *)packet;
+
+    count = monitor_get_tasks(tasks, MONITOR_MAX_TASKS);
+    if (count > FRAME_MAX_TASKS)
+        count = FRAME_MAX_TASKS;
+
+    pkt->data[0] = count;
+    pkt->length = 1;
+    for (i = 0; i < count; i++) {
+        uint8_t *data = &pkt->data[pkt->length];
+        memcpy(data, tasks[i].name, MONITOR_NAME_LENGTH);
+        data += MONITOR_NAME_LENGTH;
+        memcpy(data, &tasks[i].cpu, sizeof(uint16_t));
+        data += sizeof(uint16_t);
+        memcpy(data, &tasks[i].cpu_max, sizeof(uint16_t));
+        data += sizeof(uint16_t);
+        memcpy(data, &tasks[i].stack_free, sizeof(uint16_t));
+        pkt->length += TASK_SIZE;
+    }
+
+    if (iotlab_serial_send_frame(MONITOR_FRAME, packet))
+        iotlab_packet_call_free(packet);
+}
@@ -0,0 +1,7 @@
+#ifndef CN_MONITOR_H
+#define CN_MONITOR_H
+
+/** Start the tasks monitoring library */
+void cn_monitor_start();
+
+#endif//CN_MONITOR_H
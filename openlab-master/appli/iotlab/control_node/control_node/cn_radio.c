@@ -23,6 +23,7 @@
 static int32_t radio_off(uint8_t cmd_type, iotlab_packet_t *pkt);
 static int32_t radio_polling(uint8_t cmd_type, iotlab_packet_t *pkt);
 static int32_t radio_sniffer(uint8_t cmd_type, iotlab_packet_t *pkt);
+static int32_t radio_scan(uint8_t cmd_type, iotlab_packet_t *pkt);
 
 #if 0
 static int32_t radio_injection(uint8_t cmd_type, iotlab_packet_t *pkt);
@@ -35,10 +36,19 @@ static void schedule_polling_timer();
 
 static void poll_time(handler_arg_t arg);
 static void sniff_rx(void);
+static void scan_time(handler_arg_t arg);
+static void schedule_scan();
 
 enum {
     RSSI_MEASURE_SIZE = sizeof(uint8_t) + sizeof(uint32_t),
     SEC = 1000000,
+
+    /* ED values range in dBm, -91 + PHY_ED_LEVEL register */
+    SCAN_ED_MIN = -91,
+    SCAN_ED_LEVELS = 85,
+    SCAN_NUM_CHANNELS = PHY_2400_MAX_CHANNEL - PHY_2400_MIN_CHANNEL + 1,
+    /* channel + min + median + 90th percentile + max + mean */
+    SCAN_STATS_SIZE = 6 * sizeof(uint8_t),
 };
 
 #define MEASURES_PRIORITY 0
@@ -48,6 +58,7 @@ typedef enum radio_mode {
     RADIO_OFF = 0,
     RADIO_POLLING,
     RADIO_SNIFFER,
+    RADIO_SCAN,
 } radio_mode_t;
 
 struct radio_config {
@@ -55,6 +66,8 @@ struct radio_config {
     uint32_t channels;
     uint32_t num_operations_per_channel;
     uint32_t measure_period;
+    /* Spectrum scan: sweeps per statistics window, 0 for raw ED values */
+    uint32_t scan_window;
 };
 
 static void update_config(struct radio_config *config);
@@ -68,16 +81,23 @@ static struct
     uint32_t current_channel;
     uint8_t  current_op_num_on_channel;
 
-    iotlab_packet_t meas_pkts[CN_RADIO_NUM_PKTS];
-    iotlab_packet_queue_t measures_queue;
-
     /* Radio RX commands */
     struct {
-        iotlab_packet_t *serial_pkt;
+        struct cn_meas_stream stream;
     } rssi;
+    struct {
+        struct cn_meas_stream stream;
+        uint32_t num_sweeps;
+        /* Per channel ED values histogram and sum on the window */
+        uint16_t histogram[SCAN_NUM_CHANNELS][SCAN_ED_LEVELS];
+        int32_t sum[SCAN_NUM_CHANNELS];
+    } scan;
     struct {
         phy_packet_t pkt_buf[2];
         int pkt_index;
+
+        iotlab_packet_t serial_pkts[CN_RADIO_NUM_PKTS];
+        iotlab_packet_queue_t queue;
     } sniff;
 
 #if 0
@@ -103,10 +123,27 @@ static struct radio_config default_config = {
 
 static void radio_init()
 {
-    iotlab_packet_init_queue(&radio.measures_queue,
-            radio.meas_pkts, CN_RADIO_NUM_PKTS);
+    iotlab_packet_init_queue(&radio.sniff.queue,
+            radio.sniff.serial_pkts, CN_RADIO_NUM_PKTS);
+
+    radio.rssi.stream = (struct cn_meas_stream) {
+        .type = RADIO_MEAS_FRAME,
+        .measure_size = RSSI_MEASURE_SIZE,
+        .reserved = 4,
+        .max_pkts = 16,
+        .policy = CN_MEAS_POLICY_DEFAULT,
+    };
+    cn_meas_stream_register(&radio.rssi.stream);
+
+    radio.scan.stream = (struct cn_meas_stream) {
+        .type = RADIO_SCAN_FRAME,
+        .measure_size = RSSI_MEASURE_SIZE,  // set on configuration
+        .reserved = 2,
+        .max_pkts = 16,
+        .policy = CN_MEAS_POLICY_DEFAULT,
+    };
+    cn_meas_stream_register(&radio.scan.stream);
 
-    radio.rssi.serial_pkt = NULL;
     radio.sniff.pkt_index = 0;
     phy_prepare_packet(&radio.sniff.pkt_buf[0]);
     phy_prepare_packet(&radio.sniff.pkt_buf[1]);
@@ -136,6 +173,12 @@ void cn_radio_start()
     };
     iotlab_serial_register_handler(&handler_sniffer);
 
+    static iotlab_serial_handler_t handler_scan = {
+        .cmd_type = CONFIG_RADIO_SCAN,
+        .handler = radio_scan,
+    };
+    iotlab_serial_register_handler(&handler_scan);
+
 #if 0
     static iotlab_serial_handler_t handler_injection = {
         .cmd_type = CONFIG_RADIO_INJECTION,
@@ -198,12 +241,27 @@ static void _set_new_config(struct radio_config *config)
 
         sniff_rx();
         break;
+    case RADIO_SCAN:
+        radio.scan.num_sweeps = 0;
+        memset(radio.scan.histogram, 0, sizeof(radio.scan.histogram));
+        memset(radio.scan.sum, 0, sizeof(radio.scan.sum));
+
+        radio.scan.stream.measure_size = sizeof(uint32_t);
+        if (config->scan_window)
+            radio.scan.stream.measure_size += SCAN_STATS_SIZE;
+        else
+            radio.scan.stream.measure_size += __builtin_popcount(config->channels);
+
+        soft_timer_set_handler(&radio.timer, scan_time, NULL);
+        schedule_scan();
+        break;
     }
 }
 
 void flush_current_rssi_measures()
 {
-    cn_meas_pkt_flush(&radio.rssi.serial_pkt, RADIO_MEAS_FRAME);
+    cn_meas_stream_flush(&radio.rssi.stream);
+    cn_meas_stream_flush(&radio.scan.stream);
 }
 
 static void proper_stop()
@@ -315,7 +373,6 @@ static void poll_time(handler_arg_t arg)
 {
     int32_t ed = 0;
     struct soft_timer_timeval timestamp;
-    iotlab_packet_t *packet;
     uint8_t channel = (uint8_t) radio.current_channel;
 
     if (radio.config.mode != RADIO_POLLING)
@@ -326,22 +383,12 @@ static void poll_time(handler_arg_t arg)
     phy_ed(platform_phy, &ed);
     iotlab_time_extend_relative(&timestamp, soft_timer_time());
 
-    packet = cn_meas_pkt_lazy_alloc(&radio.measures_queue,
-                                    radio.rssi.serial_pkt, &timestamp);
-    if ((radio.rssi.serial_pkt = packet) == NULL)
-        goto poll_time_end;  // alloc failed, drop this measure
-
     /* Add measure time + rssi measure*/
     struct cn_meas rssi[] = {{&channel, sizeof(uint8_t)},
                              {&ed, sizeof(uint8_t)},
                              {NULL, 0}};
-    int send = cn_meas_pkt_add_measure(
-            packet, &timestamp, RSSI_MEASURE_SIZE, rssi);
+    cn_meas_stream_add(&radio.rssi.stream, &timestamp, rssi);
 
-    if (send)
-        flush_current_rssi_measures();
-
-poll_time_end:
     /* Is it time to switch channel ? */
     manage_channel_switch();
 }
@@ -349,6 +396,176 @@ poll_time_end:
 
 
 
+/* ********************** SPECTRUM SCAN **************************** */
+
+static void scan_send_stats(struct soft_timer_timeval *timestamp);
+
+static int32_t radio_scan(uint8_t cmd_type, iotlab_packet_t *packet)
+{
+    /*
+     * Expected packet format is (length:8B):
+     *      * channels                  [4B]
+     *      * Sweep period (ms)         [2B]  0 for back-to-back sweeps
+     *      * Sweeps per window         [2B]  0 for raw ED values
+     */
+    static struct radio_config config = {
+        .mode = RADIO_SCAN,
+    };
+
+    packet_t *pkt = (packet_t *)packet;
+    if (pkt->length != 8)
+        return 1;
+
+    size_t index = 0;
+    uint16_t sweep_period;
+    uint16_t window;
+
+    /** GET values, system endian */
+    memcpy(&config.channels, &pkt->data[index], 4);
+    index += 4;
+    memcpy(&sweep_period, &pkt->data[index], sizeof(uint16_t));
+    index += 2;
+    memcpy(&window, &pkt->data[index], sizeof(uint16_t));
+    index += 2;
+
+    /*
+     * Check arguments validity
+     */
+    config.channels &= PHY_MAP_CHANNEL_2400_ALL;
+    if (config.channels == 0)
+        return 1;
+
+    config.measure_period = soft_timer_ms_to_ticks(sweep_period);
+    config.scan_window = window;
+
+    // Configure from radio event queue
+    if (event_post(EVENT_QUEUE_APPLI, (handler_t)update_config, &config))
+        return 1;  // Could not update configuration
+
+    return 0;
+}
+
+/*
+ * Back-to-back sweeps are posted as events, so that other measures are
+ * handled between two sweeps.
+ */
+static void schedule_scan()
+{
+    if (radio.config.measure_period)
+        soft_timer_start(&radio.timer, radio.config.measure_period, 0);
+    else
+        event_post(EVENT_QUEUE_APPLI, scan_time, NULL);
+}
+
+/*
+ * Measure ED on all the selected channels one after the other.
+ * Each measure takes the radio minimum ED time, a full sweep of the 16
+ * channels takes a few milliseconds.
+ */
+static void scan_time(handler_arg_t arg)
+{
+    (void)arg;
+    int8_t eds[SCAN_NUM_CHANNELS];
+    uint8_t num_eds = 0;
+    struct soft_timer_timeval timestamp;
+    uint32_t channel;
+
+    if (radio.config.mode != RADIO_SCAN)
+        return;
+
+    iotlab_time_extend_relative(&timestamp, soft_timer_time());
+
+    for (channel = PHY_2400_MIN_CHANNEL; channel <= PHY_2400_MAX_CHANNEL;
+            channel++) {
+        int32_t ed = SCAN_ED_MIN;
+
+        if ((radio.config.channels & (1 << channel)) == 0)
+            continue;
+
+        if (channel != radio.current_channel) {
+            phy_idle(platform_phy);
+            phy_set_channel(platform_phy, channel);
+            radio.current_channel = channel;
+        }
+        phy_ed(platform_phy, &ed);
+        eds[num_eds++] = ed;
+
+        if (radio.config.scan_window) {
+            int level = ed - SCAN_ED_MIN;
+            if (level < 0)
+                level = 0;
+            if (level >= SCAN_ED_LEVELS)
+                level = SCAN_ED_LEVELS - 1;
+
+            uint32_t i = channel - PHY_2400_MIN_CHANNEL;
+            radio.scan.histogram[i][level]++;
+            radio.scan.sum[i] += ed;
+        }
+    }
+
+    if (0 == radio.config.scan_window) {
+        /* Add measure time + ED of each channel */
+        struct cn_meas scan[] = {{eds, num_eds},
+                                 {NULL, 0}};
+        cn_meas_stream_add(&radio.scan.stream, &timestamp, scan);
+    } else if (++radio.scan.num_sweeps == radio.config.scan_window) {
+        scan_send_stats(&timestamp);
+    }
+
+    schedule_scan();
+}
+
+/* Value at which 'percent' of the window ED values are lower or equal */
+static int8_t scan_percentile(uint16_t *histogram, uint32_t percent)
+{
+    uint32_t rank = (percent * radio.scan.num_sweeps + 99) / 100;
+    uint32_t count = 0;
+    int level;
+
+    if (rank == 0)
+        rank = 1;
+
+    for (level = 0; level < SCAN_ED_LEVELS - 1; level++) {
+        count += histogram[level];
+        if (count >= rank)
+            break;
+    }
+    return SCAN_ED_MIN + level;
+}
+
+/* One measure per channel with the window statistics, histograms reset */
+static void scan_send_stats(struct soft_timer_timeval *timestamp)
+{
+    uint32_t channel;
+
+    for (channel = PHY_2400_MIN_CHANNEL; channel <= PHY_2400_MAX_CHANNEL;
+            channel++) {
+        uint32_t i = channel - PHY_2400_MIN_CHANNEL;
+        uint8_t chan = channel;
+        int8_t stats[5];
+
+        if ((radio.config.channels & (1 << channel)) == 0)
+            continue;
+
+        stats[0] = scan_percentile(radio.scan.histogram[i], 0);
+        stats[1] = scan_percentile(radio.scan.histogram[i], 50);
+        stats[2] = scan_percentile(radio.scan.histogram[i], 90);
+        stats[3] = scan_percentile(radio.scan.histogram[i], 100);
+        stats[4] = radio.scan.sum[i] / (int32_t)radio.scan.num_sweeps;
+
+        /* Add measure time + channel + stats */
+        struct cn_meas scan[] = {{&chan, sizeof(uint8_t)},
+                                 {stats, sizeof(stats)},
+                                 {NULL, 0}};
+        cn_meas_stream_add(&radio.scan.stream, timestamp, scan);
+    }
+
+    radio.scan.num_sweeps = 0;
+    memset(radio.scan.histogram, 0, sizeof(radio.scan.histogram));
+    memset(radio.scan.sum, 0, sizeof(radio.scan.sum));
+}
+
+
 /* ********************** SNIFFER **************************** */
 
 static void sniff_handle_rx(phy_status_t status);
@@ -443,7 +660,7 @@ static void sniff_handle_rx_appli_queue(handler_arg_t arg)
     if (status != PHY_SUCCESS)
         return;
 
-    iotlab_packet_t *packet = iotlab_serial_packet_alloc(&radio.measures_queue);
+    iotlab_packet_t *packet = iotlab_serial_packet_alloc(&radio.sniff.queue);
     if (packet == NULL)
         return;
 
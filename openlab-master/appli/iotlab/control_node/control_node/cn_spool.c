@@ -0,0 +1,121 @@
+#include "platform.h"
+#include "soft_timer.h"
+#include "n25xxx_log.h"
+
+#include "iotlab_serial.h"
+#include "cn_spool.h"
+
+/* Serial TX FIFO count from which frames are spooled */
+#define CN_SPOOL_TX_HIGH (8)
+/* Spooled frames are sent back while serial TX FIFO count is below */
+#define CN_SPOOL_TX_LOW  (4)
+
+#define CN_SPOOL_PERIOD_MS (10)
+#define CN_SPOOL_NUM_PKTS  (4)
+
+
+static void spool_timer(handler_arg_t arg);
+static void spool_read_next();
+static void spool_read_done(handler_arg_t arg, int32_t len, uint8_t type);
+
+
+static struct {
+    soft_timer_t timer;
+    int reading;
+
+    /* Packets used to send back spooled frames */
+    iotlab_packet_t pkts[CN_SPOOL_NUM_PKTS];
+    iotlab_packet_queue_t queue;
+} spool;
+
+
+void cn_spool_start()
+{
+    spool.reading = 0;
+    iotlab_packet_init_queue(&spool.queue, spool.pkts, CN_SPOOL_NUM_PKTS);
+
+    /* Frames of a previous run are not sent */
+    n25xxx_log_mount(CN_SPOOL_FLASH_START, CN_SPOOL_FLASH_SIZE, 1);
+
+    soft_timer_set_handler(&spool.timer, spool_timer, NULL);
+    soft_timer_start(&spool.timer,
+            soft_timer_ms_to_ticks(CN_SPOOL_PERIOD_MS), 1);
+}
+
+int cn_spool_should_store()
+{
+    /* Keep frames order as long as some are in the spool */
+    if (cn_spool_pending())
+        return 1;
+    return iotlab_serial_tx_fifo_count() >= CN_SPOOL_TX_HIGH;
+}
+
+int cn_spool_pending()
+{
+    return !n25xxx_log_empty();
+}
+
+int cn_spool_store(iotlab_packet_t **packet_p, uint8_t type)
+{
+    packet_t *pkt = (packet_t *)*packet_p;
+
+    /* Copied to the log page buffers, programmed in background */
+    if (n25xxx_log_append(type, pkt->data, pkt->length))
+        return 1;
+
+    iotlab_packet_call_free(*packet_p);
+    *packet_p = NULL;
+    return 0;
+}
+
+
+/* Send back spooled frames while serial link is free */
+static void spool_timer(handler_arg_t arg)
+{
+    (void)arg;
+
+    if (spool.reading || n25xxx_log_empty())
+        return;
+    if (iotlab_serial_tx_fifo_count() >= CN_SPOOL_TX_LOW)
+        return;
+
+    /* Read frames still in RAM too */
+    n25xxx_log_flush();
+    spool_read_next();
+}
+
+static void spool_read_next()
+{
+    iotlab_packet_t *packet = iotlab_serial_packet_alloc(&spool.queue);
+    if (NULL == packet)
+        return;
+
+    spool.reading = 1;
+    if (n25xxx_log_read(((packet_t *)packet)->data,
+                iotlab_serial_packet_free_space(packet),
+                spool_read_done, packet)) {
+        spool.reading = 0;
+        iotlab_packet_call_free(packet);
+    }
+}
+
+static void spool_read_done(handler_arg_t arg, int32_t len, uint8_t type)
+{
+    iotlab_packet_t *packet = arg;
+    packet_t *pkt = (packet_t *)packet;
+
+    spool.reading = 0;
+
+    if (len < 0) {
+        iotlab_packet_call_free(packet);
+        return;
+    }
+
+    pkt->length = len;
+    if (iotlab_serial_send_frame(type, packet))
+        iotlab_packet_call_free(packet);
+
+    /* Chain reads while the link is free, the timer restarts them */
+    if (iotlab_serial_tx_fifo_count() < CN_SPOOL_TX_LOW)
+        spool_read_next();
+}
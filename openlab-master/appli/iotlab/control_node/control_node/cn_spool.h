@@ -0,0 +1,52 @@
+#ifndef CN_SPOOL_H
+#define CN_SPOOL_H
+
+#include "iotlab_serial.h"
+
+/*
+ * Store-and-forward of measures frames to the n25xxx external flash.
+ *
+ * When the serial link falls behind, measures frames are appended to the
+ * n25xxx_log record log instead of waiting in the serial TX FIFO. They are
+ * sent back on the serial link, in order, when the link has free bandwidth.
+ * Frames content is not modified, so measures keep their original timestamps.
+ *
+ * Each frame is a log record, with the frame type as record type.
+ * Frames spooled before a reset are discarded on start.
+ */
+
+/* Flash area used by the spool, a multiple of the 4kB sub-sector size */
+#ifndef CN_SPOOL_FLASH_START
+#define CN_SPOOL_FLASH_START (0x000000)
+#endif
+#ifndef CN_SPOOL_FLASH_SIZE
+#define CN_SPOOL_FLASH_SIZE  (0x1000000)
+#endif
+
+/** Mount the spool log, frames are sent back from a soft timer */
+void cn_spool_start();
+
+/**
+ * Check if frames should be stored in the spool instead of being sent
+ * directly: serial link is congested, or older frames are in the spool.
+ */
+int cn_spool_should_store();
+
+/** Check if older frames are still in the spool, waiting to be sent */
+int cn_spool_pending();
+
+/**
+ * Write the pointed packet in the spool.
+ * Packet is freed once copied, packet pointer is set to NULL.
+ * If the flash log is full or busy, the packet is not modified. It may be
+ * sent directly on the serial link only if no frame is pending in the spool,
+ * see \ref cn_spool_pending, or it would overtake them.
+ *
+ * \param packet_p pointer to the packet to store
+ * \param type     packet frame type
+ *
+ * \return 0 on success, 1 if the packet could not be queued
+ */
+int cn_spool_store(iotlab_packet_t **packet_p, uint8_t type);
+
+#endif//CN_SPOOL_H
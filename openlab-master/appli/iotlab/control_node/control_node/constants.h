@@ -45,6 +45,7 @@ enum frame_type {
     CONFIG_RADIO_STOP    = 0xC0,
     CONFIG_RADIO_MEAS    = 0xC1,
     CONFIG_RADIO_SNIFFER = 0xC3,
+    CONFIG_RADIO_SCAN    = 0xC5,
     /*
      * CONFIG_RADIO_NOISE   = 0xC2,
      * CONFIG_RADIO_INJECTION = 0xC4,
@@ -55,6 +56,10 @@ enum frame_type {
 
     CONFIG_GPIO          = 0xCD,
 
+    CONFIG_MEAS_STREAM   = 0xCE,
+
+    CONFIG_MONITOR       = 0xCB,
+
     /*
      * Asyncronous frames
      */
@@ -65,8 +70,10 @@ enum frame_type {
     // Measures
     RADIO_MEAS_FRAME     = 0xF1,
     RADIO_SNIFFER_FRAME  = 0xF3,
+    RADIO_SCAN_FRAME     = 0xF5,
     CONSUMPTION_FRAME    = 0xFC,
     EVENT_FRAME          = 0xFE,
+    MONITOR_FRAME        = 0xFB,  // tasks CPU share and stacks
 
     LOGGER_FRAME         = 0xEE,  // log messages
 
@@ -17,6 +17,10 @@
 
 #include "cn_logger.h"
 #include "cn_control.h"
+#include "cn_meas_pkt.h"
+#ifdef CN_SPOOL
+#include "cn_spool.h"
+#endif
 #ifdef IOTLAB_CN
 #include "cn_alim.h"
 #include "cn_consumption.h"
@@ -25,6 +29,7 @@
 #endif
 #include "cn_radio.h"
 #include "cn_event.h"
+#include "cn_monitor.h"
 
 int main()
 {
@@ -40,6 +45,10 @@ int main()
     // Start the application libs
     cn_logger_start();
     cn_control_start();
+    cn_meas_pkt_start();
+#ifdef CN_SPOOL
+    cn_spool_start();
+#endif
 
 #ifdef IOTLAB_CN
     cn_alim_start();
@@ -51,6 +60,7 @@ int main()
 
     cn_radio_start();
     cn_event_start();
+    cn_monitor_start();
 
 #ifdef IOTLAB_CN
     //set the open node power to off and disable battery charge
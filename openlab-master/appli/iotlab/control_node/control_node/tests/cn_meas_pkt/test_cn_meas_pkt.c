@@ -70,9 +70,11 @@ static void test_cn_meas_pkt_lazy_alloc()
     /* Now finally check packet content */
     uint32_t t_s = 0;
     ASSERT(content.p.data[0] == 0);  // No measures
-    ASSERT(content.p.length  == 5);  // Num measure + timestamp
+    ASSERT(content.p.length  == 7);  // Num measure + timestamp + dropped
     memcpy(&t_s, &content.p.data[1], 4);
     ASSERT(t_s == 1);                // Timestamp seconds == 1
+    ASSERT(content.p.data[5] == 0);  // No dropped measures
+    ASSERT(content.p.data[6] == 0);
 }
 
 
@@ -105,6 +107,7 @@ static void test_cn_meas_add_measure()
 
     iotlab_packet_t *packet = NULL;
     struct soft_timer_timeval t0 = {1, 500000};
+    const struct cn_meas_policy policy = CN_MEAS_POLICY_DEFAULT;
     int send = 0;
 
 
@@ -116,7 +119,7 @@ static void test_cn_meas_add_measure()
     packet = cn_meas_pkt_lazy_alloc(&free_packets, packet, &t0);
     ASSERT(packet != NULL);
     /* Contains no measures and timestamp == 1 */
-    ASSERT_PKT_EQUALS(packet, ((uint8_t[]){0, 1, 0, 0, 0}), 5);
+    ASSERT_PKT_EQUALS(packet, ((uint8_t[]){0, 1, 0, 0, 0, 0, 0}), 7);
 
     /* Alloc many measures */
     uint32_t forty_two = 42;
@@ -129,37 +132,37 @@ static void test_cn_meas_add_measure()
     /* Measure 1 */
     send = cn_meas_pkt_add_measure(packet,
             (struct soft_timer_timeval[]){{1, 0x927c0}},  // 600000
-            meas_size, measure);
+            meas_size, measure, &policy);
     ASSERT_PKT_EQUALS(packet,
-            ((uint8_t[]){1, 1, 0, 0, 0,
+            ((uint8_t[]){1, 1, 0, 0, 0, 0, 0,
              0xc0, 0x27, 0x09, 0x00, 0x2a, 0, 0, 0, 0xff, 0xff, 0xff, 0xff}),
-            5 + 12);
+            7 + 12);
     ASSERT(send == 0);
 
     /* Measure 2 */
     send = cn_meas_pkt_add_measure(packet,
             (struct soft_timer_timeval[]){{1, 0xaae60}},  // 700000
-            meas_size, measure);
+            meas_size, measure, &policy);
     ASSERT_PKT_EQUALS(packet,
-            ((uint8_t[]){2, 1, 0, 0, 0,
+            ((uint8_t[]){2, 1, 0, 0, 0, 0, 0,
              0xc0, 0x27, 0x09, 0x00, 0x2a, 0, 0, 0, 0xff, 0xff, 0xff, 0xff,
              0x60, 0xae, 0x0a, 0x00, 0x2a, 0, 0, 0, 0xff, 0xff, 0xff, 0xff}),
-            5 + 12 + 12);
+            7 + 12 + 12);
     ASSERT(send == 0);
 
     int i;
     uint32_t meas_t_us = 800000;
-    for (i = 3; i < (IOTLAB_SERIAL_DATA_MAX_SIZE - 5) / 12; i++) {
+    for (i = 3; i < (IOTLAB_SERIAL_DATA_MAX_SIZE - 7) / 12; i++) {
         send = cn_meas_pkt_add_measure(packet,
                 (struct soft_timer_timeval[]){{1, meas_t_us + 10000 * i}},
-                meas_size, measure);
+                meas_size, measure, &policy);
         ASSERT(send == 0);  // Still room
     }
 
     /* Packet full */
     send = cn_meas_pkt_add_measure(packet,
             (struct soft_timer_timeval[]){{1, meas_t_us + 10000 * i}},
-            meas_size, measure);
+            meas_size, measure, &policy);
     ASSERT(send == 1);
     // Cleanup
     iotlab_packet_call_free(packet);
@@ -173,29 +176,54 @@ static void test_cn_meas_add_measure()
     /* Alloc packet */
     packet = cn_meas_pkt_lazy_alloc(&free_packets, packet, &t0);
     ASSERT(packet != NULL);
-    ASSERT_PKT_EQUALS(packet, ((uint8_t[]){0, 1, 0, 0, 0}), 5);
+    ASSERT_PKT_EQUALS(packet, ((uint8_t[]){0, 1, 0, 0, 0, 0, 0}), 7);
     /* Measure 1 */
     send = cn_meas_pkt_add_measure(packet,
             (struct soft_timer_timeval[]){{1, 0x927c0}},  // 600000
-            meas_size, measure);
+            meas_size, measure, &policy);
     ASSERT_PKT_EQUALS(packet,
-            ((uint8_t[]){1, 1, 0, 0, 0,
+            ((uint8_t[]){1, 1, 0, 0, 0, 0, 0,
              0xc0, 0x27, 0x09, 0x00, 0x2a, 0, 0, 0, 0xff, 0xff, 0xff, 0xff}),
-            5 + 12);
+            7 + 12);
     ASSERT(send == 0);
 
     /* Measure 2 */
     send = cn_meas_pkt_add_measure(packet,
             (struct soft_timer_timeval[]){{4, 0}}, // Diff 3s == 0x1e8480 us
-            meas_size, measure);
+            meas_size, measure, &policy);
     ASSERT_PKT_EQUALS(packet,
-            ((uint8_t[]){2, 1, 0, 0, 0,
+            ((uint8_t[]){2, 1, 0, 0, 0, 0, 0,
              0xc0, 0x27, 0x09, 0x00, 0x2a, 0, 0, 0, 0xff, 0xff, 0xff, 0xff,
              0xc0, 0xc6, 0x2d, 0x00, 0x2a, 0, 0, 0, 0xff, 0xff, 0xff, 0xff}),
-            5 + 12 + 12);
+            7 + 12 + 12);
 
     /* 3 > 2s */
     ASSERT(send == 1);
+    // Cleanup
+    iotlab_packet_call_free(packet);
+    packet = NULL;
+
+
+    /*
+     *  Packet reaching policy fill level
+     */
+    const struct cn_meas_policy fill_policy = {
+        .max_latency_us = 0, .fill_level = 7 + 2 * 12};
+
+    packet = cn_meas_pkt_lazy_alloc(&free_packets, packet, &t0);
+    ASSERT(packet != NULL);
+    send = cn_meas_pkt_add_measure(packet,
+            (struct soft_timer_timeval[]){{1, 0x927c0}},
+            meas_size, measure, &fill_policy);
+    ASSERT(send == 0);
+
+    /* Latency check disabled */
+    send = cn_meas_pkt_add_measure(packet,
+            (struct soft_timer_timeval[]){{1, 0x927c0}},
+            meas_size, measure, &fill_policy);
+    ASSERT(send == 1);
+    iotlab_packet_call_free(packet);
+    packet = NULL;
 }
 
 
@@ -209,10 +237,12 @@ static void pkt_free()
 static int iotlab_serial_send_frame_mock_call_count = 0;
 static int32_t iotlab_serial_send_frame_mock_return_value = 0;
 static int iotlab_serial_send_frame_mock_type = 0;
+static iotlab_packet_t *iotlab_serial_send_frame_mock_pkt = NULL;
 int32_t iotlab_serial_send_frame_mock(uint8_t type, iotlab_packet_t *pkt)
 {
     iotlab_serial_send_frame_mock_call_count++;
     iotlab_serial_send_frame_mock_type = type;
+    iotlab_serial_send_frame_mock_pkt = pkt;
     return iotlab_serial_send_frame_mock_return_value;
 };
 
@@ -250,6 +280,60 @@ static void test_cn_meas_pkt_flush()
     ASSERT(pkt == NULL);
 }
 
+static void test_cn_meas_stream()
+{
+    uint32_t forty_two = 42;
+    struct cn_meas measure[] = {{&forty_two, sizeof(uint32_t)},
+                                {NULL, 0}};
+    struct soft_timer_timeval t0 = {1, 0};
+    static struct cn_meas_stream stream = {
+        .type = 42,
+        .measure_size = 2 * sizeof(uint32_t),
+        .reserved = 1,
+        .max_pkts = 1,
+        .policy = CN_MEAS_POLICY_DEFAULT,
+    };
+    iotlab_packet_t *sent;
+    uint16_t dropped;
+
+    cn_meas_pkt_start();
+    cn_meas_stream_register(&stream);
+    iotlab_serial_send_frame_mock_return_value = 0;
+    iotlab_serial_send_frame_mock_call_count = 0;
+
+    /* First measure allocates a packet */
+    ASSERT(cn_meas_stream_add(&stream, &t0, measure) == 0);
+    ASSERT(stream.pkt != NULL);
+    ASSERT(stream.in_use == 1);
+
+    /* Sent packet is still in use until freed by serial TX */
+    cn_meas_stream_flush(&stream);
+    ASSERT(iotlab_serial_send_frame_mock_call_count == 1);
+    sent = iotlab_serial_send_frame_mock_pkt;
+    ASSERT(stream.pkt == NULL);
+    ASSERT(stream.in_use == 1);
+
+    /* Back-pressure, max_pkts reached: measures are dropped and counted */
+    ASSERT(cn_meas_stream_add(&stream, &t0, measure) == 1);
+    ASSERT(cn_meas_stream_add(&stream, &t0, measure) == 1);
+    ASSERT(stream.dropped == 2);
+
+    /* Packet sent, dropped count reported in the next packet header */
+    iotlab_packet_call_free(sent);
+    ASSERT(stream.in_use == 0);
+    ASSERT(cn_meas_stream_add(&stream, &t0, measure) == 0);
+    memcpy(&dropped, &stream.pkt->p.data[5], sizeof(uint16_t));
+    ASSERT(dropped == 2);
+    ASSERT(stream.dropped == 0);
+
+    /* Send failure count measures as dropped */
+    iotlab_serial_send_frame_mock_return_value = 1;
+    cn_meas_stream_flush(&stream);
+    ASSERT(stream.in_use == 0);
+    ASSERT(stream.dropped == 1);
+    iotlab_serial_send_frame_mock_return_value = 0;
+}
+
 
 static void test_app(void *arg)
 {
@@ -258,6 +342,7 @@ static void test_app(void *arg)
     test_cn_meas_pkt_lazy_alloc();
     test_cn_meas_add_measure();
     test_cn_meas_pkt_flush();
+    test_cn_meas_stream();
 
     log_info("Tests finished");
 
@@ -240,6 +240,11 @@ int32_t iotlab_serial_packet_free_space(iotlab_packet_t *packet)
     return IOTLAB_SERIAL_DATA_MAX_SIZE - ((packet_t *)packet)->length;
 }
 
+int iotlab_serial_tx_fifo_count()
+{
+    return iotlab_packet_fifo_count(&ser.tx.fifo);
+}
+
 static void char_rx(handler_arg_t arg, uint8_t c)
 {
     packet_t *pkt;
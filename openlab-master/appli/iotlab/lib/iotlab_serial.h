@@ -92,6 +92,9 @@ int32_t iotlab_serial_send_frame(uint8_t type, iotlab_packet_t *pkt);
 
 int32_t iotlab_serial_packet_free_space(iotlab_packet_t *packet);
 
+/** Number of frames waiting in the TX FIFO */
+int iotlab_serial_tx_fifo_count();
+
 
 
 #endif /* IOTLAB_SERIAL_H_*/
@@ -6,11 +6,29 @@
 //     72000000. / (72000000 / 32768) == 32771.96176604461
 #define SOFT_TIMER_KFREQUENCY_FIX 32771798
 
+/*
+ * Frequency estimation
+ *
+ * Synchronization points (ticks, real time) come from 'set_time' and PPS.
+ * The frequency is the least-squares slope of ticks against real time on
+ * the saved points.
+ */
+/* Number of synchronization points used for the estimation */
+#define NUM_SYNC_POINTS (8)
+/* Min real time between two synchronization points */
+#define SYNC_MIN_SPACING_US (16 * 1000000ull)
+/* Error on real time prediction considered as a time step, history is reset */
+#define SYNC_MAX_ERROR_US (100000)
+/* Estimations further than 200ppm from nominal frequency are rejected */
+#define KFREQUENCY_MAX_DRIFT (SOFT_TIMER_KFREQUENCY_FIX / 5000)
+
 static inline uint32_t get_microseconds(uint64_t timer_tick, uint32_t kfrequency);
 static inline uint32_t get_seconds(uint64_t timer_tick, uint32_t kfrequency);
 static inline void ticks_conversion(struct soft_timer_timeval* time,
         uint64_t timer_tick, uint32_t kfrequency);
 static uint64_t get_extended_time(uint32_t timer_tick, uint64_t timer_tick_64);
+static void iotlab_time_convert(struct soft_timer_timeval *time, uint64_t timer_tick_64);
+static int sync_add_point(uint64_t ticks, uint64_t real_us);
 
 struct iotlab_time_config {
     uint64_t time0;
@@ -20,37 +38,84 @@ struct iotlab_time_config {
 };
 
 /* Number of previous config saved */
-#define NUM_SAVED_CONFIG (1)
+#define NUM_SAVED_CONFIG (3)
 /* Sorted from latest to oldest */
 static struct iotlab_time_config time_config[1 + NUM_SAVED_CONFIG] = {
     [0 ... NUM_SAVED_CONFIG] =
     {0, {0, 0}, SOFT_TIMER_KFREQUENCY_FIX, 0}};
 
+struct sync_point {
+    uint64_t ticks;
+    uint64_t real_us;
+};
+
+/* Synchronization points, sorted from oldest to latest */
+static struct {
+    struct sync_point points[NUM_SYNC_POINTS];
+    int count;
+    uint32_t kfrequency;
+} sync = {.count = 0, .kfrequency = SOFT_TIMER_KFREQUENCY_FIX};
 
-void iotlab_time_set_time(uint32_t t0, struct soft_timer_timeval *time_ref)
+
+static void push_config(uint64_t time0, struct soft_timer_timeval *time_ref,
+        uint64_t now64)
 {
     memmove(time_config + 1, time_config, NUM_SAVED_CONFIG * sizeof(struct iotlab_time_config));
 
-    uint64_t now64 = soft_timer_time_64();
-    uint64_t time0 = get_extended_time(t0, now64);
-
     time_config[0].time0 = time0;
     time_config[0].unix_time_ref = *time_ref;
-    time_config[0].kfrequency = SOFT_TIMER_KFREQUENCY_FIX;
+    time_config[0].kfrequency = sync.kfrequency;
     time_config[0].last_set_time = now64;
 }
 
-static struct iotlab_time_config *select_config(uint64_t timer_tick_64)
+void iotlab_time_set_time(uint32_t t0, struct soft_timer_timeval *time_ref)
 {
-    uint64_t last_set_time = time_config[0].last_set_time;
+    uint64_t now64 = soft_timer_time_64();
+    uint64_t time0 = get_extended_time(t0, now64);
+
+    sync_add_point(time0,
+            time_ref->tv_sec * 1000000ull + time_ref->tv_usec);
+
+    push_config(time0, time_ref, now64);
+}
+
+void iotlab_time_pps(uint32_t pps_tick)
+{
+    struct soft_timer_timeval pps_time;
+    uint64_t now64 = soft_timer_time_64();
+    uint64_t pps_tick_64 = get_extended_time(pps_tick, now64);
+
+    /* PPS edge is on a second boundary, round to the nearest one */
+    iotlab_time_convert(&pps_time, pps_tick_64);
+    if (pps_time.tv_usec >= 500000)
+        pps_time.tv_sec++;
+
+    if (sync_add_point(pps_tick_64, pps_time.tv_sec * 1000000ull))
+        return;  // frequency not updated
+
+    /*
+     * Apply new frequency from now, starting from the current time
+     * so that time stays continuous.
+     */
+    struct soft_timer_timeval now_time;
+    iotlab_time_convert(&now_time, now64);
+    push_config(now64, &now_time, now64);
+}
+
+uint32_t iotlab_time_get_kfrequency()
+{
+    return sync.kfrequency;
+}
 
-    if (timer_tick_64 < last_set_time)
-        return &time_config[1];
+static struct iotlab_time_config *select_config(uint64_t timer_tick_64)
+{
+    int i;
     /* If the timer_tick_64 is equal to the last set time, we use previous config */
-    else if (timer_tick_64 == last_set_time)
-        return &time_config[1];
-    else
-        return &time_config[0];
+    for (i = 0; i < NUM_SAVED_CONFIG; i++) {
+        if (timer_tick_64 > time_config[i].last_set_time)
+            return &time_config[i];
+    }
+    return &time_config[NUM_SAVED_CONFIG];
 }
 
 static void _iotlab_time_convert(struct iotlab_time_config *config, struct soft_timer_timeval *time, uint64_t timer_tick_64)
@@ -88,6 +153,85 @@ void iotlab_time_extend_relative(struct soft_timer_timeval *time,
 }
 
 
+/*
+ * Frequency estimation
+ */
+
+/* Least squares slope of ticks against real time, in 1000 * ticks/s */
+static uint32_t sync_estimate_kfrequency()
+{
+    const struct sync_point *ref = &sync.points[0];
+    double mean_x = 0, mean_y = 0;
+    double sxy = 0, sxx = 0;
+    int i;
+
+    for (i = 0; i < sync.count; i++) {
+        mean_x += (double)(sync.points[i].real_us - ref->real_us);
+        mean_y += (double)(sync.points[i].ticks - ref->ticks);
+    }
+    mean_x /= sync.count;
+    mean_y /= sync.count;
+
+    for (i = 0; i < sync.count; i++) {
+        double dx = (double)(sync.points[i].real_us - ref->real_us) - mean_x;
+        double dy = (double)(sync.points[i].ticks - ref->ticks) - mean_y;
+        sxy += dx * dy;
+        sxx += dx * dx;
+    }
+
+    /* ticks/us to 1000 * ticks/s */
+    return (uint32_t)((sxy / sxx) * 1e9 + 0.5);
+}
+
+/*
+ * Add a new synchronization point and update frequency estimation.
+ * Return 0 if frequency has been updated.
+ */
+static int sync_add_point(uint64_t ticks, uint64_t real_us)
+{
+    if (sync.count) {
+        struct sync_point *last = &sync.points[sync.count - 1];
+        double error_us;
+
+        if ((ticks <= last->ticks) || (real_us <= last->real_us)) {
+            sync.count = 0;  // time went backward, restart
+            goto add_point;
+        }
+
+        /* Detect time steps using current frequency */
+        error_us = (double)(real_us - last->real_us) -
+            (double)(ticks - last->ticks) * 1e9 / sync.kfrequency;
+        if (error_us > SYNC_MAX_ERROR_US || error_us < -SYNC_MAX_ERROR_US) {
+            sync.count = 0;
+            goto add_point;
+        }
+
+        if ((real_us - last->real_us) < SYNC_MIN_SPACING_US)
+            return 1;  // too close, not enough precision
+    }
+
+add_point:
+    if (sync.count == NUM_SYNC_POINTS) {
+        memmove(sync.points, sync.points + 1,
+                (NUM_SYNC_POINTS - 1) * sizeof(struct sync_point));
+        sync.count--;
+    }
+    sync.points[sync.count].ticks = ticks;
+    sync.points[sync.count].real_us = real_us;
+    sync.count++;
+
+    if (sync.count < 2)
+        return 1;
+
+    uint32_t kfrequency = sync_estimate_kfrequency();
+    if (kfrequency > SOFT_TIMER_KFREQUENCY_FIX + KFREQUENCY_MAX_DRIFT ||
+            kfrequency < SOFT_TIMER_KFREQUENCY_FIX - KFREQUENCY_MAX_DRIFT)
+        return 1;  // Invalid estimation, keep previous one
+
+    sync.kfrequency = kfrequency;
+    return 0;
+}
+
 
 /*
  * Extend to 64bit a past 32 bits 'ticks' timer using current 64 ticks timer.
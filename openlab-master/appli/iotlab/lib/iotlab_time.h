@@ -7,6 +7,17 @@
  */
 void iotlab_time_set_time(uint32_t t0, struct soft_timer_timeval *time_ref);
 
+/*
+ * Notify a PPS edge that occured at 'pps_tick'.
+ * It is used with 'set_time' references to estimate the real timer frequency.
+ */
+void iotlab_time_pps(uint32_t pps_tick);
+
+/*
+ * Current estimation of the timer frequency, in 1000 * Hz
+ */
+uint32_t iotlab_time_get_kfrequency();
+
 /*
  * Extend given timer_tick in ticks to a struct soft_timer_timeval
  * whith a value in unix timestamp
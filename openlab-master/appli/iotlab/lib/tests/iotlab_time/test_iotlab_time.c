@@ -129,9 +129,12 @@ static void test_convert_stability()
 static void reset_time_config()
 {
     int i;
-    struct iotlab_time_config null = {0, {0, 0}, 0, SOFT_TIMER_KFREQUENCY_FIX};
+    struct iotlab_time_config null = {0, {0, 0}, SOFT_TIMER_KFREQUENCY_FIX, 0};
     for (i = 0; i < NUM_SAVED_CONFIG + 1; i++)
         time_config[i] = null;
+
+    sync.count = 0;
+    sync.kfrequency = SOFT_TIMER_KFREQUENCY_FIX;
 }
 
 static void test_time_convert()
@@ -153,6 +156,39 @@ static void test_time_convert()
 }
 
 
+static void test_frequency_estimation()
+{
+    reset_time_config();
+
+    /* Timer running 50ppm slower than nominal, 1000 * frequency */
+    uint64_t kfreq = SOFT_TIMER_KFREQUENCY_FIX - SOFT_TIMER_KFREQUENCY_FIX / 20000;
+    uint64_t real_us = 1471960848ull * 1000000;
+    int i;
+
+    /* Too close synchronization points are not used */
+    ASSERT(sync_add_point(0, real_us) == 1);
+    ASSERT(sync_add_point(kfreq / 1000, real_us + 1000000) == 1);
+    ASSERT(sync.count == 1);
+
+    for (i = 1; i <= NUM_SYNC_POINTS; i++) {
+        uint64_t dt_s = i * 20;
+        ASSERT(sync_add_point(dt_s * kfreq / 1000,
+                              real_us + dt_s * 1000000) == 0);
+    }
+    ASSERT(sync.count == NUM_SYNC_POINTS);
+    /* Estimation precision better than 0.1ppm */
+    ASSERT(iotlab_time_get_kfrequency() > kfreq - 4);
+    ASSERT(iotlab_time_get_kfrequency() < kfreq + 4);
+
+    /* Time step resets the estimation, keep previous frequency */
+    ASSERT(sync_add_point(200 * kfreq / 1000, real_us) == 1);
+    ASSERT(sync.count == 1);
+    ASSERT(iotlab_time_get_kfrequency() > kfreq - 4);
+
+    reset_time_config();
+}
+
+
 static void test_app(void *arg)
 {
     (void)arg;
@@ -161,6 +197,7 @@ static void test_app(void *arg)
     test_time_extend();
     test_convert_stability();
     test_time_convert();
+    test_frequency_estimation();
 
     log_info("Tests finished");
 
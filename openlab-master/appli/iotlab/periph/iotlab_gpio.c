@@ -23,6 +23,42 @@ void gpio_disable_irq(struct gpio_conf *gpio)
 }
 
 
+int gpio_enable_capture(struct gpio_conf *gpio, enum irq_trigger edge,
+                timer_handler_t capture_handler, handler_arg_t arg)
+{
+    timer_capture_edge_t capture_edge;
+
+    if (gpio->capture_timer == NULL)
+        return 1;
+
+    switch (edge) {
+        case IRQ_FALLING:
+            capture_edge = TIMER_CAPTURE_EDGE_FALLING;
+            break;
+        case IRQ_BOTH:
+            capture_edge = TIMER_CAPTURE_EDGE_BOTH;
+            break;
+        case IRQ_RISING:
+        default:
+            capture_edge = TIMER_CAPTURE_EDGE_RISING;
+            break;
+    }
+
+    // config gpio pin, timer input is a floating input
+    gpio_set_input(gpio->port, gpio->pin);
+    timer_set_channel_capture(gpio->capture_timer, gpio->capture_channel,
+            capture_edge, capture_handler, arg);
+    return 0;
+}
+
+void gpio_disable_capture(struct gpio_conf *gpio)
+{
+    if (gpio->capture_timer == NULL)
+        return;
+    timer_set_channel_capture(gpio->capture_timer, gpio->capture_channel,
+            TIMER_CAPTURE_EDGE_RISING, NULL, NULL);
+}
+
 void gpio_trigger_irq_rising(struct gpio_conf *output)
 {
     gpio_pin_set(output->port, output->pin);
@@ -95,8 +131,11 @@ struct gpio_conf gpio_config[4] = {
         .exti_line = EXTI_LINE_Px0,
         .afio_port = AFIO_PORT_A,
         .nvic_line = NVIC_IRQ_LINE_EXTI0,
+        .capture_timer   = TIM_2,
+        .capture_channel = TIMER_CHANNEL_1,
     },
     {
+        // PC5 has no timer channel, only irq
         .port      = GPIO_C,
         .pin       = GPIO_PIN_5,
         .exti_line = EXTI_LINE_Px5,
@@ -109,6 +148,8 @@ struct gpio_conf gpio_config[4] = {
         .exti_line = EXTI_LINE_Px6,
         .afio_port = AFIO_PORT_A,
         .nvic_line = NVIC_IRQ_LINE_EXTI9_5,
+        .capture_timer   = TIM_3,
+        .capture_channel = TIMER_CHANNEL_1,
     },
 };
 #endif
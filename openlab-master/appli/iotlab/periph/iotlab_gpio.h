@@ -4,6 +4,7 @@
 #include "stm32f1xx.h"
 #include "exti.h"
 #include "afio.h"
+#include "timer.h"
 
 
 struct gpio_conf {
@@ -12,6 +13,9 @@ struct gpio_conf {
         exti_line_t     exti_line;
         afio_port_t     afio_port;
         nvic_irq_line_t nvic_line;
+        /* Timer input capture channel on the pin, NULL timer if none */
+        openlab_timer_t capture_timer;
+        timer_channel_t capture_channel;
 };
 enum irq_trigger {
         IRQ_RISING  = EXTI_TRIGGER_RISING,
@@ -33,6 +37,18 @@ void gpio_enable_irq(struct gpio_conf *gpio, enum irq_trigger edge,
 void gpio_disable_irq(struct gpio_conf *gpio);
 
 
+/*
+ * Enable timer input capture for gpio line.
+ * 'capture_handler' is called in interrupt with the captured timer value.
+ * Return 1 if the pin has no capture channel.
+ */
+int gpio_enable_capture(struct gpio_conf *gpio, enum irq_trigger edge,
+                timer_handler_t capture_handler, handler_arg_t arg);
+
+/* Disable timer input capture for gpio line */
+void gpio_disable_capture(struct gpio_conf *gpio);
+
+
 /* Trigger a rising interrupt on gpio output line */
 void gpio_trigger_irq_rising(struct gpio_conf *output);
 
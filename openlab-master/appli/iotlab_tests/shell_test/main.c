@@ -7,6 +7,7 @@
 #include "unique_id.h"
 
 #include "shell.h"
+#include "monitor.h"
 
 
 /* Leds Commands */
@@ -105,6 +106,8 @@ struct shell_command commands[] = {
     {"leds_on",    "[leds_flag] Turn given leds on",  cmd_leds_on},
     {"leds_off",   "[leds_flag] Turn given leds off", cmd_leds_off},
     {"leds_blink", "[leds_flag] [time] Blink leds every 'time'. If 'time' == 0 disable", cmd_leds_blink},
+
+    MONITOR_SHELL_COMMAND,
     {NULL, NULL, NULL},
 };
 
@@ -0,0 +1,663 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/*
+ * bench.c
+ *
+ * Microbenchmarks of the core libraries, on the native platform.
+ *
+ * Each benchmark is run BENCH_RUNS times of BENCH_ITERATIONS operations and
+ * the fastest run is reported, with the number of heap allocations per
+ * operation, as CSV lines:
+ *
+ *     bench,<name>,<param>,<iterations>,<ns/op>,<allocs/op>
+ *
+ * The param is the length of the list or queue the operation works on, when
+ * it depends on it. Other lines of the output are the platform logs, the
+ * results are extracted with:
+ *
+ *     ./bench.elf | grep ^bench,
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "platform.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "soft_timer.h"
+#include "event.h"
+#include "packet.h"
+#include "packer.h"
+#include "printf.h"
+#include "debug.h"
+
+#include "iotlab_time.h"
+
+/* Mocks of the serial link, only the measures packets are benchmarked */
+#define iotlab_serial_packet_alloc iotlab_serial_packet_alloc_mock
+#define iotlab_serial_packet_free_space iotlab_serial_packet_free_space_mock
+#define iotlab_serial_register_handler iotlab_serial_register_handler_mock
+#define iotlab_serial_send_frame iotlab_serial_send_frame_mock
+
+#include "cn_meas_pkt.c"
+
+#ifndef BENCH_ITERATIONS
+#define BENCH_ITERATIONS 10000
+#endif
+
+#ifndef BENCH_RUNS
+#define BENCH_RUNS 5
+#endif
+
+/* Operations timed together, for the clock not to weigh on short ones */
+#define BENCH_BATCH 8
+
+/* Timers and packets preloaded for the list lengths params */
+#define BENCH_MAX_TIMERS 256
+#define BENCH_MAX_PACKETS 64
+
+typedef uint64_t (*bench_t)(uint32_t param, uint32_t iterations);
+
+static void bench_task(void *arg);
+
+static uint64_t bench_soft_timer_start(uint32_t timers, uint32_t iterations);
+static uint64_t bench_soft_timer_stop(uint32_t timers, uint32_t iterations);
+static uint64_t bench_event_post(uint32_t param, uint32_t iterations);
+static uint64_t bench_event_dispatch(uint32_t param, uint32_t iterations);
+static uint64_t bench_event_post_dispatch(uint32_t param, uint32_t iterations);
+static uint64_t bench_packet_alloc_free(uint32_t allocated,
+                                        uint32_t iterations);
+static uint64_t bench_iotlab_packet_fifo_prio_append(uint32_t packets,
+        uint32_t iterations);
+static uint64_t bench_iotlab_time_extend_relative(uint32_t param,
+        uint32_t iterations);
+static uint64_t bench_cn_meas_pkt_add_measure(uint32_t param,
+        uint32_t iterations);
+static uint64_t bench_snprintf_int(uint32_t param, uint32_t iterations);
+static uint64_t bench_snprintf_str(uint32_t param, uint32_t iterations);
+static uint64_t bench_packer_uint16(uint32_t param, uint32_t iterations);
+static uint64_t bench_packer_uint32(uint32_t param, uint32_t iterations);
+static uint64_t bench_packer_float(uint32_t param, uint32_t iterations);
+
+/* Heap allocations, counted by the wrappers of the libc allocator */
+static volatile uint32_t allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t num, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    allocs++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t num, size_t size)
+{
+    allocs++;
+    return __real_calloc(num, size);
+}
+
+static soft_timer_t timers[BENCH_MAX_TIMERS + BENCH_BATCH];
+
+static iotlab_packet_t iotlab_packets[BENCH_MAX_PACKETS + BENCH_BATCH];
+static iotlab_packet_queue_t free_queue;
+static iotlab_packet_queue_t fifo_queue;
+
+static iotlab_packet_t meas_packet;
+static iotlab_packet_queue_t meas_queue;
+
+/* Sinks, for the compiler not to remove the benchmarked code */
+static volatile uint32_t sink;
+static volatile uint32_t source = 0x12345678;
+static volatile uint32_t dispatched;
+
+int main()
+{
+    // Initialize the platform
+    platform_init();
+
+    // Initialize the soft timer library and the packet storage
+    soft_timer_init();
+    packet_init();
+
+    // Below the event tasks, for the posted events to be dispatched at once
+    xTaskCreate(bench_task, (const signed char *) "bench",
+                4 * configMINIMAL_STACK_SIZE, NULL, 1, NULL);
+
+    // Run
+    platform_run();
+    return 0;
+}
+
+static uint64_t bench_now()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void bench_run(const char *name, bench_t bench, uint32_t param)
+{
+    uint64_t best = UINT64_MAX;
+    uint32_t allocs_start;
+    uint32_t ns, ops_allocs;
+    int i;
+
+    allocs_start = allocs;
+
+    for (i = 0; i < BENCH_RUNS; i++)
+    {
+        uint64_t elapsed = bench(param, BENCH_ITERATIONS);
+
+        if (elapsed < best)
+        {
+            best = elapsed;
+        }
+    }
+
+    // In 1/1000 of ns and of allocation per operation
+    ns = best * 1000 / BENCH_ITERATIONS;
+    ops_allocs = (uint64_t)(allocs - allocs_start) * 1000
+                 / (BENCH_RUNS * BENCH_ITERATIONS);
+
+    printf("bench,%s,%u,%u,%u.%03u,%u.%03u\n", name, param, BENCH_ITERATIONS,
+           ns / 1000, ns % 1000, ops_allocs / 1000, ops_allocs % 1000);
+}
+
+static void bench_task(void *arg)
+{
+    static const uint32_t timer_lengths[] = {0, 16, 64, 256};
+    static const uint32_t fifo_lengths[] = {0, 8, 64};
+    struct soft_timer_timeval ref = {1000, 0};
+    uint32_t i;
+
+    (void) arg;
+
+    // The queues semaphores are allocated once, out of the measures
+    iotlab_packet_init_queue(&free_queue, iotlab_packets,
+                             BENCH_MAX_PACKETS + BENCH_BATCH);
+    iotlab_packet_init_queue(&fifo_queue, NULL, 0);
+    iotlab_packet_init_queue(&meas_queue, &meas_packet, 1);
+    iotlab_time_set_time(soft_timer_time(), &ref);
+
+    printf("bench,name,param,iterations,ns_per_op,allocs_per_op\n");
+
+    for (i = 0; i < sizeof(timer_lengths) / sizeof(timer_lengths[0]); i++)
+    {
+        bench_run("soft_timer_start", bench_soft_timer_start, timer_lengths[i]);
+        bench_run("soft_timer_stop", bench_soft_timer_stop, timer_lengths[i]);
+    }
+
+    bench_run("event_post", bench_event_post, 0);
+    bench_run("event_dispatch", bench_event_dispatch, 0);
+    bench_run("event_post_dispatch", bench_event_post_dispatch, 0);
+
+    bench_run("packet_alloc_free", bench_packet_alloc_free, 0);
+    bench_run("packet_alloc_free", bench_packet_alloc_free,
+              packet_available() - 1);
+
+    for (i = 0; i < sizeof(fifo_lengths) / sizeof(fifo_lengths[0]); i++)
+    {
+        bench_run("iotlab_packet_fifo_prio_append",
+                  bench_iotlab_packet_fifo_prio_append, fifo_lengths[i]);
+    }
+
+    bench_run("iotlab_time_extend_relative",
+              bench_iotlab_time_extend_relative, 0);
+    bench_run("cn_meas_pkt_add_measure", bench_cn_meas_pkt_add_measure, 0);
+
+    bench_run("snprintf_int", bench_snprintf_int, 0);
+    bench_run("snprintf_str", bench_snprintf_str, 0);
+
+    bench_run("packer_uint16", bench_packer_uint16, 0);
+    bench_run("packer_uint32", bench_packer_uint32, 0);
+    bench_run("packer_float", bench_packer_float, 0);
+
+    exit(0);
+}
+
+/*
+ * Soft timers, started in the middle of a list of 'timers' timers. With no
+ * other timer, they are the first ones and the alarm is processed each time.
+ */
+static void timers_fill(uint32_t timers_num)
+{
+    uint32_t i;
+
+    for (i = 0; i < timers_num; i++)
+    {
+        soft_timer_set_handler(&timers[i], NULL, NULL);
+        soft_timer_start(&timers[i], soft_timer_s_to_ticks(10) + 2 * i, 0);
+    }
+}
+
+static void timers_empty(uint32_t timers_num)
+{
+    uint32_t i;
+
+    for (i = 0; i < timers_num; i++)
+    {
+        soft_timer_stop(&timers[i]);
+    }
+}
+
+static void timers_start_batch(uint32_t timers_num)
+{
+    uint32_t i;
+
+    for (i = 0; i < BENCH_BATCH; i++)
+    {
+        soft_timer_start(&timers[BENCH_MAX_TIMERS + i],
+                         soft_timer_s_to_ticks(10) + timers_num + 2 * i + 1, 0);
+    }
+}
+
+static void timers_stop_batch()
+{
+    uint32_t i;
+
+    for (i = 0; i < BENCH_BATCH; i++)
+    {
+        soft_timer_stop(&timers[BENCH_MAX_TIMERS + i]);
+    }
+}
+
+static uint64_t bench_soft_timer_start(uint32_t timers_num, uint32_t iterations)
+{
+    uint64_t elapsed = 0, t0;
+    uint32_t i;
+
+    timers_fill(timers_num);
+
+    for (i = 0; i < iterations; i += BENCH_BATCH)
+    {
+        t0 = bench_now();
+        timers_start_batch(timers_num);
+        elapsed += bench_now() - t0;
+
+        timers_stop_batch();
+    }
+
+    timers_empty(timers_num);
+    return elapsed;
+}
+
+static uint64_t bench_soft_timer_stop(uint32_t timers_num, uint32_t iterations)
+{
+    uint64_t elapsed = 0, t0;
+    uint32_t i;
+
+    timers_fill(timers_num);
+
+    for (i = 0; i < iterations; i += BENCH_BATCH)
+    {
+        timers_start_batch(timers_num);
+
+        t0 = bench_now();
+        timers_stop_batch();
+        elapsed += bench_now() - t0;
+    }
+
+    timers_empty(timers_num);
+    return elapsed;
+}
+
+/*
+ * Events, posted with the scheduler suspended then dispatched by the event
+ * task when it is resumed, or posted and dispatched one by one.
+ */
+static void event_count(handler_arg_t arg)
+{
+    (void) arg;
+    dispatched++;
+}
+
+static void events_post_batch()
+{
+    uint32_t i;
+
+    for (i = 0; i < BENCH_BATCH; i++)
+    {
+        event_post(EVENT_QUEUE_APPLI, event_count, NULL);
+    }
+}
+
+static uint64_t bench_event_post(uint32_t param, uint32_t iterations)
+{
+    uint64_t elapsed = 0, t0;
+    uint32_t i;
+
+    for (i = 0; i < iterations; i += BENCH_BATCH)
+    {
+        vTaskSuspendAll();
+
+        t0 = bench_now();
+        events_post_batch();
+        elapsed += bench_now() - t0;
+
+        xTaskResumeAll();
+    }
+
+    return elapsed;
+}
+
+static uint64_t bench_event_dispatch(uint32_t param, uint32_t iterations)
+{
+    uint64_t elapsed = 0, t0;
+    uint32_t i;
+
+    for (i = 0; i < iterations; i += BENCH_BATCH)
+    {
+        vTaskSuspendAll();
+        events_post_batch();
+
+        t0 = bench_now();
+        xTaskResumeAll();
+        elapsed += bench_now() - t0;
+    }
+
+    return elapsed;
+}
+
+static uint64_t bench_event_post_dispatch(uint32_t param, uint32_t iterations)
+{
+    uint64_t t0;
+    uint32_t i;
+
+    t0 = bench_now();
+
+    for (i = 0; i < iterations; i++)
+    {
+        event_post(EVENT_QUEUE_APPLI, event_count, NULL);
+    }
+
+    return bench_now() - t0;
+}
+
+/*
+ * Packets, allocated after 'allocated' packets of the storage.
+ */
+static uint64_t bench_packet_alloc_free(uint32_t allocated,
+                                        uint32_t iterations)
+{
+    packet_t *kept[allocated + 1];
+    uint64_t t0, elapsed;
+    uint32_t i;
+
+    for (i = 0; i < allocated; i++)
+    {
+        kept[i] = packet_alloc(0);
+    }
+
+    t0 = bench_now();
+
+    for (i = 0; i < iterations; i++)
+    {
+        packet_free(packet_alloc(0));
+    }
+
+    elapsed = bench_now() - t0;
+
+    for (i = 0; i < allocated; i++)
+    {
+        packet_free(kept[i]);
+    }
+
+    return elapsed;
+}
+
+/*
+ * IoT-LAB packets, appended to a FIFO of 'packets' packets of the same
+ * priority, that are all walked through.
+ */
+static uint64_t bench_iotlab_packet_fifo_prio_append(uint32_t packets,
+        uint32_t iterations)
+{
+    iotlab_packet_t *batch[BENCH_BATCH];
+    uint64_t elapsed = 0, t0;
+    uint32_t i, j;
+
+    for (i = 0; i < packets; i++)
+    {
+        iotlab_packet_fifo_prio_append(&fifo_queue,
+                                       iotlab_packet_alloc(&free_queue, 0));
+    }
+
+    for (i = 0; i < BENCH_BATCH; i++)
+    {
+        batch[i] = iotlab_packet_alloc(&free_queue, 0);
+    }
+
+    for (i = 0; i < iterations; i += BENCH_BATCH)
+    {
+        t0 = bench_now();
+
+        for (j = 0; j < BENCH_BATCH; j++)
+        {
+            iotlab_packet_fifo_prio_append(&fifo_queue, batch[j]);
+        }
+
+        elapsed += bench_now() - t0;
+
+        // Same FIFO length for the next batch
+        for (j = 0; j < BENCH_BATCH; j++)
+        {
+            batch[j] = iotlab_packet_fifo_get(&fifo_queue);
+        }
+    }
+
+    while (iotlab_packet_fifo_count(&fifo_queue))
+    {
+        iotlab_packet_free(iotlab_packet_fifo_get(&fifo_queue));
+    }
+
+    for (i = 0; i < BENCH_BATCH; i++)
+    {
+        iotlab_packet_free(batch[i]);
+    }
+
+    return elapsed;
+}
+
+/*
+ * IoT-LAB time of ticks of the last second.
+ */
+static uint64_t bench_iotlab_time_extend_relative(uint32_t param,
+        uint32_t iterations)
+{
+    struct soft_timer_timeval time;
+    uint32_t now = soft_timer_time();
+    uint64_t t0;
+    uint32_t i;
+
+    t0 = bench_now();
+
+    for (i = 0; i < iterations; i++)
+    {
+        iotlab_time_extend_relative(&time, now - (i & 0x7FFF));
+        sink = time.tv_usec;
+    }
+
+    return bench_now() - t0;
+}
+
+/*
+ * Control node measures of 3 floats, as the consumption ones, until the
+ * packet is full, then the packet is restarted.
+ */
+static uint64_t bench_cn_meas_pkt_add_measure(uint32_t param,
+        uint32_t iterations)
+{
+    static const struct cn_meas_policy policy = CN_MEAS_POLICY_DEFAULT;
+    struct soft_timer_timeval timestamp = {1, 0};
+    float power = 0.1, voltage = 3.3, current = 0.03;
+    struct cn_meas measures[] = {
+        {&power, sizeof(float)},
+        {&voltage, sizeof(float)},
+        {&current, sizeof(float)},
+        {NULL, 0},
+    };
+    size_t measure_size = sizeof(uint32_t) + 3 * sizeof(float);
+    iotlab_packet_t *packet;
+    uint64_t t0;
+    uint32_t i;
+
+    packet = cn_meas_pkt_lazy_alloc(&meas_queue, NULL, &timestamp);
+
+    t0 = bench_now();
+
+    for (i = 0; i < iterations; i++)
+    {
+        timestamp.tv_usec = i & 0xFFFF;
+
+        if (cn_meas_pkt_add_measure(packet, &timestamp, measure_size,
+                                    measures, &policy))
+        {
+            // As a new packet, with no measure
+            ((packet_t *) packet)->length = CN_MEAS_PKT_HEADER_SIZE;
+            ((packet_t *) packet)->data[NUM_PKT_OFFSET] = 0;
+        }
+    }
+
+    t0 = bench_now() - t0;
+
+    iotlab_packet_free(packet);
+    return t0;
+}
+
+iotlab_packet_t *iotlab_serial_packet_alloc_mock(iotlab_packet_queue_t *queue)
+{
+    return iotlab_packet_alloc(queue, IOTLAB_SERIAL_HEADER_SIZE);
+}
+
+int32_t iotlab_serial_packet_free_space_mock(iotlab_packet_t *packet)
+{
+    return IOTLAB_SERIAL_DATA_MAX_SIZE - ((packet_t *)packet)->length;
+}
+
+void iotlab_serial_register_handler_mock(iotlab_serial_handler_t *handler)
+{
+}
+
+int32_t iotlab_serial_send_frame_mock(uint8_t type, iotlab_packet_t *pkt)
+{
+    return 0;
+}
+
+/*
+ * Formatting, of integers as the logs and of strings as the serial commands.
+ */
+static uint64_t bench_snprintf_int(uint32_t param, uint32_t iterations)
+{
+    char buffer[64];
+    uint64_t t0;
+    uint32_t i;
+
+    t0 = bench_now();
+
+    for (i = 0; i < iterations; i++)
+    {
+        snprintf(buffer, sizeof(buffer), "%u: %d %x %08x", i, -(int32_t) i,
+                 source, i);
+    }
+
+    return bench_now() - t0;
+}
+
+static uint64_t bench_snprintf_str(uint32_t param, uint32_t iterations)
+{
+    char buffer[64];
+    uint64_t t0;
+    uint32_t i;
+
+    t0 = bench_now();
+
+    for (i = 0; i < iterations; i++)
+    {
+        snprintf(buffer, sizeof(buffer), "%s %s %c", "config_radio",
+                 "ACK", 'a' + (i & 0xF));
+    }
+
+    return bench_now() - t0;
+}
+
+/*
+ * Packer helpers, each operation is a pack and an unpack.
+ */
+static uint64_t bench_packer_uint16(uint32_t param, uint32_t iterations)
+{
+    uint8_t buffer[2];
+    uint16_t value;
+    uint64_t t0;
+    uint32_t i;
+
+    t0 = bench_now();
+
+    for (i = 0; i < iterations; i++)
+    {
+        packer_uint16_pack(buffer, source + i);
+        packer_uint16_unpack(buffer, &value);
+        sink = value;
+    }
+
+    return bench_now() - t0;
+}
+
+static uint64_t bench_packer_uint32(uint32_t param, uint32_t iterations)
+{
+    uint8_t buffer[4];
+    uint32_t value;
+    uint64_t t0;
+    uint32_t i;
+
+    t0 = bench_now();
+
+    for (i = 0; i < iterations; i++)
+    {
+        packer_uint32_pack(buffer, source + i);
+        packer_uint32_unpack(buffer, &value);
+        sink = value;
+    }
+
+    return bench_now() - t0;
+}
+
+static uint64_t bench_packer_float(uint32_t param, uint32_t iterations)
+{
+    uint8_t buffer[4];
+    float value;
+    uint64_t t0;
+    uint32_t i;
+
+    t0 = bench_now();
+
+    for (i = 0; i < iterations; i++)
+    {
+        packer_float_pack(buffer, (float) (source + i));
+        packer_float_unpack(buffer, &value);
+        sink = (uint32_t) value;
+    }
+
+    return bench_now() - t0;
+}
@@ -0,0 +1,338 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2011-2013 HiKoB.
+ */
+
+
+/*
+ * host_benchmark.c
+ *
+ * FAT32 library benchmark on a disk image file, for the native platform.
+ *
+ * usage: fat32_host_benchmark.elf IMAGE SIZE_MB
+ *
+ * The image is created as a sparse file and formatted, then the benchmark
+ * measures clusters allocation, sequential write, random read and file
+ * create/delete throughputs. host_benchmark.sh runs it on images from
+ * 64MB to 32GB.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "platform.h"
+#include "printf.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "fat32.h"
+#include "fat32/buf_util.h"
+#include "fat32/fs.h"
+#include "fat32/blockdev.h"
+#include "fat32/blockdev_file.h"
+
+#define RESERVED_SECTORS 32
+#define NUM_FAT          2
+
+#define ALLOC_CLUSTERS   20000
+#define WRITE_BYTES      (16 * 1024 * 1024)
+#define WRITE_CHUNK      4096
+#define RANDOM_READS     20000
+#define CREATE_FILES     100
+
+static const char *image_path;
+static uint64_t image_size;
+
+static void vBenchTask(void *pvParameters);
+
+// Cluster size of the Microsoft FAT32 format
+static uint8_t sectors_per_cluster(uint32_t num_sect)
+{
+    if (num_sect <= 532480)
+    {
+        return 1;
+    }
+    else if (num_sect <= 16777216)
+    {
+        return 8;
+    }
+    else if (num_sect <= 33554432)
+    {
+        return 16;
+    }
+
+    return 32;
+}
+
+static int write_sector(int fd, uint32_t sector, uint8_t *buf)
+{
+    return pwrite(fd, buf, 512, (off_t)sector * 512) != 512;
+}
+
+// Create a sparse image file and format it, without partition table
+static int format_image(const char *path, uint64_t size)
+{
+    uint8_t buf[512];
+    uint32_t num_sect = size / 512;
+    uint8_t spc = sectors_per_cluster(num_sect);
+    uint32_t sect_per_fat = (num_sect - RESERVED_SECTORS + (128 * spc + NUM_FAT) - 1) / (128 * spc + NUM_FAT);
+    uint32_t i;
+    int fd, ret = 0;
+
+    if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+    {
+        return 1;
+    }
+
+    if (ftruncate(fd, size) != 0)
+    {
+        close(fd);
+        return 1;
+    }
+
+    // Boot sector, and its backup
+    zero(buf, 512);
+    cpy((uint8_t *)"\353\130\220MSWIN4.1", buf, 11);
+    write16(buf + 0x0B, 512);
+    buf[0x0D] = spc;
+    write16(buf + 0x0E, RESERVED_SECTORS);
+    buf[0x10] = NUM_FAT;
+    buf[0x15] = 0xF8;
+    write32(buf + 0x20, num_sect);
+    write32(buf + 0x24, sect_per_fat);
+    write32(buf + 0x2C, 2);
+    write16(buf + 0x30, 1);
+    write16(buf + 0x32, 6);
+    buf[0x40] = 0x80;
+    buf[0x42] = 0x29;
+    cpy((uint8_t *)"BENCH      FAT32   ", buf + 0x47, 19);
+    buf[0x1FE] = 0x55;
+    buf[0x1FF] = 0xAA;
+    ret |= write_sector(fd, 0, buf);
+    ret |= write_sector(fd, 6, buf);
+
+    // FSInfo sector, the free clusters count is unknown
+    zero(buf, 512);
+    cpy((uint8_t *)"RRaA", buf, 4);
+    cpy((uint8_t *)"rrAa", buf + 0x1E4, 4);
+    write32(buf + 0x1E8, 0xFFFFFFFF);
+    write32(buf + 0x1EC, 3);
+    buf[0x1FE] = 0x55;
+    buf[0x1FF] = 0xAA;
+    ret |= write_sector(fd, 1, buf);
+
+    // First FAT entries: media, reserved and root directory end of chain
+    zero(buf, 512);
+    write32(buf, 0x0FFFFFF8);
+    write32(buf + 4, 0x0FFFFFFF);
+    write32(buf + 8, 0x0FFFFFFF);
+
+    for (i = 0; i < NUM_FAT; i++)
+    {
+        ret |= write_sector(fd, RESERVED_SECTORS + i * sect_per_fat, buf);
+    }
+
+    close(fd);
+
+    printf("Image %s: %u sectors, %u sectors per cluster, %u sectors per FAT\n",
+            path, num_sect, spc, sect_per_fat);
+
+    return ret;
+}
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *name, double start, double count, const char *unit)
+{
+    double t = now() - start;
+
+    // Integer rates, the printf library has no precision nor left alignment
+    printf("%20s %12u %s/s (%u ms)\n", name, (unsigned)(count / t), unit,
+            (unsigned)(t * 1000));
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        printf("usage: %s IMAGE SIZE_MB\n", argv[0]);
+        return 1;
+    }
+
+    image_path = argv[1];
+    image_size = strtoull(argv[2], NULL, 0) * 1024 * 1024;
+
+    if (format_image(image_path, image_size) != 0)
+    {
+        printf("/!\\ Unable to create the image\n");
+        return 1;
+    }
+
+    blockdev_file_set_path(image_path);
+
+    // Initialize the platform
+    platform_init();
+
+    xTaskCreate(vBenchTask, (signed char *)"Bench", 4 * configMINIMAL_STACK_SIZE, NULL, 3, NULL);
+
+    // Start the scheduler
+    platform_run();
+
+    return 0;
+}
+
+static void bench_alloc()
+{
+    static uint32_t clusters[ALLOC_CLUSTERS];
+    uint32_t i, num;
+    double start = now();
+
+    for (num = 0; num < ALLOC_CLUSTERS; num++)
+    {
+        if ((clusters[num] = fat32_find_empty_cluster()) == 1)
+        {
+            break;
+        }
+    }
+
+    report("Cluster allocation", start, num, "clusters");
+
+    for (i = 0; i < num; i++)
+    {
+        fat32_free_cluster(clusters[i]);
+    }
+}
+
+static void bench_write(const char *name, uint8_t *filename, bool stream)
+{
+    static uint8_t fb[512], chunk[WRITE_CHUNK];
+    uint64_t bytes = image_size / 4 < WRITE_BYTES ? image_size / 4 : WRITE_BYTES;
+    uint64_t done;
+    file_t f;
+    double start = now();
+
+    if (file_create(filename, fb, &f) != FAT32_OK)
+    {
+        printf("/!\\ Unable to create %s\n", filename);
+        return;
+    }
+
+    if (stream)
+    {
+        file_stream(f, 64, 0);
+    }
+
+    for (done = 0; done < bytes; done += WRITE_CHUNK)
+    {
+        memset(chunk, done >> 12, WRITE_CHUNK);
+
+        if (file_write(f, chunk, WRITE_CHUNK) != FAT32_OK)
+        {
+            break;
+        }
+    }
+
+    file_close(f);
+    report(name, start, done / 1024., "kB");
+}
+
+static void bench_random_read()
+{
+    uint8_t buf[512];
+    uint32_t i, seed = 1;
+    // Read in the area of the written files, the rest of the image is sparse
+    uint64_t sectors = fat.data_start + 2 * WRITE_BYTES / 512;
+    double start = now();
+
+    if (sectors > blockdev_num_blocks())
+    {
+        sectors = blockdev_num_blocks();
+    }
+
+    for (i = 0; i < RANDOM_READS; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        fs_read(((uint64_t)seed * 7919) % sectors, 0, buf, 512);
+    }
+
+    report("Random read", start, RANDOM_READS, "sectors");
+}
+
+static void bench_create_delete()
+{
+    static uint8_t fb[512];
+    uint8_t filename[13];
+    uint32_t i, created;
+    file_t f;
+    double start = now();
+
+    for (created = 0; created < CREATE_FILES; created++)
+    {
+        snprintf((char *)filename, sizeof(filename), "F%03u.TMP", (unsigned)created);
+
+        if (file_create(filename, fb, &f) != FAT32_OK)
+        {
+            printf("/!\\ Unable to create %s\n", filename);
+            break;
+        }
+
+        file_close(f);
+    }
+
+    for (i = 0; i < created; i++)
+    {
+        snprintf((char *)filename, sizeof(filename), "F%03u.TMP", (unsigned)i);
+
+        if (fat32_delete(filename) != FAT32_OK)
+        {
+            printf("/!\\ Unable to delete %s\n", filename);
+            break;
+        }
+    }
+
+    // Only the files both created and deleted are counted
+    report("Create/delete", start, i, "files");
+}
+
+static void vBenchTask(void *pvParameters)
+{
+    fs_stats_t stats;
+
+    if ((fat32_init() != FAT32_OK) || (fat32_mount() != FAT32_OK))
+    {
+        printf("/!\\ Unable to mount %s\n", image_path);
+        exit(1);
+    }
+
+    bench_alloc();
+    bench_write("Sequential write", (uint8_t *)"SEQ.BIN", false);
+    bench_write("Streaming write", (uint8_t *)"STREAM.BIN", true);
+    bench_random_read();
+    bench_create_delete();
+
+    fs_get_stats(&stats);
+    printf("fs: %u accesses, %u misses, %u read ahead, %u lock ops\n",
+            stats.accesses, stats.misses, stats.read_ahead, stats.lock_ops);
+
+    exit(0);
+}
@@ -0,0 +1,17 @@
+#!/bin/sh
+#
+# Run the fat32 host benchmark on images from 64MB to 32GB
+#
+# usage: host_benchmark.sh BENCHMARK_ELF [IMAGE]
+#
+
+BENCH=$1
+IMAGE=${2:-/tmp/fat32_benchmark.img}
+
+for size in 64 256 1024 4096 16384 32768
+do
+    echo "=== ${size}MB ==="
+    ${BENCH} ${IMAGE} ${size} || exit 1
+done
+
+rm -f ${IMAGE}
@@ -0,0 +1,140 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2011,2012 HiKoB.
+ */
+
+
+/*
+ * pool_benchmark.c
+ *
+ * Benchmark of the fs buffer pool: access rate and number of mutexes
+ * operations per access for typical access patterns.
+ * The card content is not modified, written pages are written back with
+ * the data read from them.
+ */
+#include <stdbool.h>
+#include "platform.h"
+#include "printf.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "fat32/fs.h"
+
+// First page used for the benchmark
+#ifndef POOL_BENCH_PAGE
+#define POOL_BENCH_PAGE 8192
+#endif
+
+#define FAT_PAGES     8
+#define FAT_ACCESSES  20000
+#define SEQ_PAGES     2048
+#define RMW_PAGES     512
+
+static void vBenchTask(void *pvParameters);
+
+int main()
+{
+    // Initialize the platform
+    platform_init();
+
+    printf("\r\n\r\nFS pool benchmark\r\n=================\r\n");
+
+    xTaskCreate(vBenchTask, (signed char *)"Bench", 4 * configMINIMAL_STACK_SIZE, NULL, 3, NULL);
+
+    // Start the scheduler
+    platform_run();
+
+    return 0;
+}
+
+static fs_stats_t start_stats;
+static portTickType start_time;
+
+static void bench_start()
+{
+    fs_get_stats(&start_stats);
+    start_time = xTaskGetTickCount();
+}
+
+static void bench_end(const char *name)
+{
+    fs_stats_t stats;
+    portTickType t = xTaskGetTickCount() - start_time;
+    uint32_t accesses;
+
+    fs_get_stats(&stats);
+    accesses = stats.accesses - start_stats.accesses;
+
+    if (t == 0)
+    {
+        t = 1;
+    }
+
+    printf("%s: %u accesses in %u ticks, %u access/s, %u.%02u lock ops/access, %u misses, %u read ahead\r\n",
+            name, accesses, (unsigned) t, (unsigned)(accesses * configTICK_RATE_HZ / t),
+            (stats.lock_ops - start_stats.lock_ops) / accesses,
+            (stats.lock_ops - start_stats.lock_ops) * 100 / accesses % 100,
+            stats.misses - start_stats.misses,
+            stats.read_ahead - start_stats.read_ahead);
+}
+
+static void vBenchTask(void *pvParameters)
+{
+    static uint8_t page[512];
+    uint8_t entry[4];
+    uint32_t i, seed = 1;
+
+    if (fs_init() != FS_OK)
+    {
+        printf("/!\\ Error initializing the SD card\r\n");
+        vTaskSuspend(NULL);
+    }
+
+    // FAT entries lookups: 4 bytes reads on a few pages
+    bench_start();
+
+    for (i = 0; i < FAT_ACCESSES; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        fs_read(POOL_BENCH_PAGE + (seed >> 16) % FAT_PAGES, ((seed >> 8) & 0x7F) << 2, entry, 4);
+    }
+
+    bench_end("FAT lookups");
+
+    // Sequential pages reads
+    bench_start();
+
+    for (i = 0; i < SEQ_PAGES; i++)
+    {
+        fs_read(POOL_BENCH_PAGE + FAT_PAGES + i, 0, page, 512);
+    }
+
+    bench_end("Sequential reads");
+
+    // Pages read and written back
+    bench_start();
+
+    for (i = 0; i < RMW_PAGES; i++)
+    {
+        fs_read(POOL_BENCH_PAGE + i, 0, page, 512);
+        fs_write(POOL_BENCH_PAGE + i, 0, page, 512);
+    }
+
+    bench_end("Read/write back");
+
+    printf("END\r\n");
+    vTaskSuspend(NULL);
+}
@@ -0,0 +1,90 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/*
+ * l3g4200d_fifo.c
+ *
+ * Read the gyroscope at 800Hz in FIFO stream mode, and print each second the
+ * number of blocks and samples, and the time span of the last block.
+ */
+
+#include <stdint.h>
+#include "platform.h"
+#include "l3g4200d.h"
+#include "soft_timer.h"
+#include "event.h"
+#include "printf.h"
+
+#define WATERMARK 24
+
+static void fifo_block(handler_arg_t arg, const l3g4200d_fifo_block_t *block);
+static void print_stats(handler_arg_t arg);
+
+static soft_timer_t print_timer;
+
+static volatile struct
+{
+    uint32_t blocks;
+    uint32_t samples;
+    uint32_t overruns;
+    uint32_t span;
+    uint8_t num;
+    int16_t rot_speed[3];
+} stats;
+
+int main()
+{
+    // Initialize the platform
+    platform_init();
+
+    printf("# Testing L3G4200D FIFO stream mode\n");
+
+    l3g4200d_gyr_config(L3G4200D_800HZ, L3G4200D_2000DPS, true);
+
+    if (l3g4200d_fifo_start(WATERMARK, fifo_block, NULL))
+    {
+        printf("# Failed to start the FIFO\n");
+    }
+
+    soft_timer_set_handler(&print_timer, print_stats, NULL);
+    soft_timer_start(&print_timer, soft_timer_s_to_ticks(1), 1);
+
+    platform_run();
+    return 0;
+}
+
+static void fifo_block(handler_arg_t arg, const l3g4200d_fifo_block_t *block)
+{
+    stats.blocks++;
+    stats.samples += block->num;
+    stats.overruns += block->overrun;
+    stats.num = block->num;
+    stats.span = block->timestamp[block->num - 1] - block->timestamp[0];
+    stats.rot_speed[0] = block->rot_speed[0][0];
+    stats.rot_speed[1] = block->rot_speed[0][1];
+    stats.rot_speed[2] = block->rot_speed[0][2];
+}
+
+static void print_stats(handler_arg_t arg)
+{
+    printf("blocks %u samples %u overruns %u, last %u samples in %u ticks, "
+           "G: %d %d %d\n", stats.blocks, stats.samples, stats.overruns,
+           stats.num, stats.span, stats.rot_speed[0], stats.rot_speed[1],
+           stats.rot_speed[2]);
+}
@@ -0,0 +1,97 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/*
+ * monitor.c
+ *
+ * Runs tasks with known CPU shares, and prints the tasks samples of the
+ * monitor library every few seconds. Build with -DMONITOR_TASKS=1.
+ *
+ *  Created on: Oct 2013
+ */
+
+#include <stdint.h>
+#include "platform.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "soft_timer.h"
+#include "monitor.h"
+#include "printf.h"
+
+typedef struct
+{
+    /* Busy time, period and start of the busy time in the period, in ms */
+    uint32_t busy;
+    uint32_t period;
+    uint32_t phase;
+} load_t;
+
+/*
+ * About 20% and 2% of the CPU. The busy times are measured with the soft
+ * timer, they must not overlap to be spent by one task only.
+ */
+static load_t loads[] = {{20, 100, 0}, {2, 100, 50}};
+
+static void load_task(void *param);
+static void print(handler_arg_t arg);
+
+int main()
+{
+    // Initialize the platform
+    platform_init();
+
+    // Initialize the soft timer library
+    soft_timer_init();
+
+    xTaskCreate(load_task, (const signed char * const) "heavy",
+            configMINIMAL_STACK_SIZE, &loads[0], 1, NULL);
+    xTaskCreate(load_task, (const signed char * const) "light",
+            configMINIMAL_STACK_SIZE, &loads[1], 1, NULL);
+
+    monitor_start(soft_timer_s_to_ticks(2), print, NULL);
+
+    // Run
+    platform_run();
+    return 0;
+}
+
+static void load_task(void *param)
+{
+    load_t *load = param;
+    portTickType wake;
+
+    vTaskDelay(configTICK_RATE_HZ * load->phase / 1000);
+    wake = xTaskGetTickCount();
+
+    for (;;)
+    {
+        uint32_t start = soft_timer_time();
+
+        while (soft_timer_time() - start < soft_timer_ms_to_ticks(load->busy))
+        {
+        }
+
+        vTaskDelayUntil(&wake, configTICK_RATE_HZ * load->period / 1000);
+    }
+}
+
+static void print(handler_arg_t arg)
+{
+    monitor_print();
+}
@@ -0,0 +1,149 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2011,2012 HiKoB.
+ */
+
+/*
+ * n25xxx_log.c
+ *
+ * Appends records to the log and reads them back, flash accesses use the
+ * n25xxx asynchronous requests.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "platform.h"
+#include "event.h"
+#include "soft_timer.h"
+
+#include "printf.h"
+#include "debug.h"
+
+#include "n25xxx_log.h"
+
+/* Last 64kB of the flash */
+#define LOG_START (0xFF0000)
+#define LOG_SIZE  (0x10000)
+
+#define NUM_RECORDS (2000)
+
+static void append(handler_arg_t arg);
+static void read_next(handler_arg_t arg);
+static void read_done(handler_arg_t arg, int32_t len, uint8_t type);
+static void fill_record(uint32_t num, uint8_t *buf, uint16_t *len);
+
+static soft_timer_t timer;
+static uint32_t num_appended, num_read;
+static uint32_t t_start;
+static uint8_t read_buf[N25XXX_LOG_MAX_RECORD];
+
+int main()
+{
+    // Initialize the platform
+    platform_init();
+
+    // Initialize the soft timer library
+    soft_timer_init();
+
+    printf("# Testing N25XXX log\n");
+
+    n25xxx_log_mount(LOG_START, LOG_SIZE, 1);
+    printf("# Mounted, erase count %u\n", n25xxx_log_erase_count());
+
+    t_start = soft_timer_time();
+    soft_timer_set_handler(&timer, append, NULL);
+    soft_timer_start(&timer, 1, 1);
+
+    platform_run();
+    return 0;
+}
+
+/* Append while the log accepts records, the CPU is never waiting the flash */
+static void append(handler_arg_t arg)
+{
+    uint8_t buf[N25XXX_LOG_MAX_RECORD];
+    uint16_t len;
+
+    while (num_appended < NUM_RECORDS)
+    {
+        fill_record(num_appended, buf, &len);
+        if (n25xxx_log_append(num_appended, buf, len))
+        {
+            break;
+        }
+        num_appended++;
+
+        // Keep room for the appended records, read some back
+        if ((num_appended % 64) == 0)
+        {
+            n25xxx_log_flush();
+            event_post(EVENT_QUEUE_APPLI, read_next, NULL);
+            return;
+        }
+    }
+
+    if (num_appended == NUM_RECORDS)
+    {
+        soft_timer_stop(&timer);
+        n25xxx_log_flush();
+        event_post(EVENT_QUEUE_APPLI, read_next, NULL);
+    }
+}
+
+static void read_next(handler_arg_t arg)
+{
+    n25xxx_log_read(read_buf, sizeof(read_buf), read_done, NULL);
+}
+
+static void read_done(handler_arg_t arg, int32_t len, uint8_t type)
+{
+    uint8_t buf[N25XXX_LOG_MAX_RECORD];
+    uint16_t expected;
+
+    if (len < 0)
+    {
+        if (num_read == NUM_RECORDS)
+        {
+            printf("# %u records in %u ms\n", num_read,
+                    (soft_timer_time() - t_start) * 1000 / SOFT_TIMER_FREQUENCY);
+            printf("Test successfull\n");
+        }
+        return;
+    }
+
+    fill_record(num_read, buf, &expected);
+    if ((len != expected) || (type != (uint8_t)num_read) ||
+            memcmp(buf, read_buf, len))
+    {
+        log_error("Record %u has not the right content...", num_read);
+        return;
+    }
+    num_read++;
+
+    read_next(NULL);
+}
+
+static void fill_record(uint32_t num, uint8_t *buf, uint16_t *len)
+{
+    uint16_t i;
+
+    *len = (num * 37) % (N25XXX_LOG_MAX_RECORD + 1);
+    for (i = 0; i < *len; i++)
+    {
+        buf[i] = num + 3 * i;
+    }
+}
@@ -0,0 +1,162 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/*
+ * ota.c
+ *
+ * Disseminates the running firmware to the neighbours.
+ * Commands on the serial link:
+ *  'p' publishes the running firmware with the next version,
+ *  'i' installs the received image,
+ *  'v' prints the version of the complete image.
+ */
+
+#include <stdint.h>
+#include "platform.h"
+#include "event.h"
+#include "soft_timer.h"
+#include "uart.h"
+
+#include "printf.h"
+#include "debug.h"
+
+#include "mac_csma.h"
+#include "n25xxx.h"
+#include "ota.h"
+
+#define CHANNEL     21
+#define RADIO_POWER PHY_POWER_0dBm
+
+/* Staging area below the last 64kB of the flash */
+#define OTA_START (0xF80000)
+#define OTA_SIZE  (0x70000)
+
+#define FIRMWARE_START (0x08000000)
+
+/* The firmware ends with the initial values of the data section */
+extern uint32_t _etext, _sdata, _edata;
+
+static void char_rx(handler_arg_t arg, uint8_t c);
+static void command(handler_arg_t arg);
+static void copy_next(handler_arg_t arg);
+static void image_complete(handler_arg_t arg, uint16_t version);
+
+static n25xxx_request_t req;
+static uint32_t fw_length, fw_offset;
+static uint8_t chunk[256];
+
+int main()
+{
+    // Initialize the platform
+    platform_init();
+
+    // Initialize the soft timer library
+    soft_timer_init();
+
+    printf("# Testing OTA\n");
+
+    mac_csma_init(CHANNEL, RADIO_POWER);
+    ota_init(OTA_START, OTA_SIZE, image_complete, NULL);
+    uart_set_rx_handler(uart_print, char_rx, NULL);
+
+    platform_run();
+    return 0;
+}
+
+void mac_csma_data_received(uint16_t src_addr, const uint8_t *data,
+        uint8_t length, int8_t rssi, uint8_t lqi)
+{
+    ota_handle_frame(src_addr, data, length);
+}
+
+static void char_rx(handler_arg_t arg, uint8_t c)
+{
+    event_post_from_isr(EVENT_QUEUE_APPLI, command, (handler_arg_t)(uint32_t) c);
+}
+
+static void command(handler_arg_t arg)
+{
+    switch ((uint32_t) arg)
+    {
+        case 'p':
+            fw_length = ((uint32_t) &_etext - FIRMWARE_START)
+                        + ((uint32_t) &_edata - (uint32_t) &_sdata);
+            fw_offset = 0;
+            printf("# Copying %u bytes\n", fw_length);
+            copy_next(NULL);
+            break;
+
+        case 'i':
+            if (ota_install())
+            {
+                printf("# No image to install\n");
+            }
+            break;
+
+        case 'v':
+            printf("# Version %u\n", ota_version());
+            break;
+    }
+}
+
+/* Copy the firmware to the staging area, by erasing and programming */
+static void copy_next(handler_arg_t arg)
+{
+    if (fw_offset >= fw_length)
+    {
+        if (ota_publish(ota_version() + 1, fw_length))
+        {
+            log_error("Failed to publish");
+        }
+        return;
+    }
+
+    req.handler = copy_next;
+
+    if ((fw_offset % 4096) == 0 && req.op != N25XXX_OP_ERASE_SUBSECTOR)
+    {
+        req.op = N25XXX_OP_ERASE_SUBSECTOR;
+        req.address = OTA_START + fw_offset;
+    }
+    else
+    {
+        uint32_t i;
+
+        // Initial values of the data section follow the text
+        for (i = 0; i < sizeof(chunk); i++)
+        {
+            uint32_t offset = fw_offset + i;
+            chunk[i] = (offset < fw_length) ?
+                       *(uint8_t *)(FIRMWARE_START + offset) : 0xFF;
+        }
+
+        req.op = N25XXX_OP_PROGRAM;
+        req.address = OTA_START + fw_offset;
+        req.buf = chunk;
+        req.len = sizeof(chunk);
+        fw_offset += sizeof(chunk);
+    }
+
+    n25xxx_submit(&req);
+}
+
+static void image_complete(handler_arg_t arg, uint16_t version)
+{
+    printf("# Image %u complete\n", version);
+}
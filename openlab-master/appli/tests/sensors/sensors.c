@@ -0,0 +1,108 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/*
+ * sensors.c
+ *
+ * Sample the gyroscope and the accelerometer at 100Hz and the magnetometer at
+ * 25Hz with the sensors library, and print the records by batches.
+ */
+
+#include <stdint.h>
+#include "platform.h"
+#include "printf.h"
+#include "packer.h"
+
+#include "l3g4200d.h"
+#include "lsm303dlhc.h"
+#include "sensors.h"
+
+#define BATCH 10
+
+static void records_ready(handler_arg_t arg);
+
+static uint8_t records[SENSORS_RING_SIZE];
+
+int main()
+{
+    // Initialize the platform
+    platform_init();
+
+    printf("# Testing the sensors library\n");
+
+    l3g4200d_gyr_config(L3G4200D_100HZ, L3G4200D_2000DPS, true);
+    lsm303dlhc_acc_config(LSM303DLHC_ACC_RATE_100HZ, LSM303DLHC_ACC_SCALE_2G,
+            LSM303DLHC_ACC_UPDATE_ON_READ);
+    lsm303dlhc_mag_config(LSM303DLHC_MAG_RATE_30HZ,
+            LSM303DLHC_MAG_SCALE_1_3GAUSS, LSM303DLHC_MAG_MODE_CONTINUOUS,
+            LSM303DLHC_TEMP_MODE_OFF);
+
+    sensors_register((sensors_read_t) l3g4200d_read_rot_speed_async, NULL,
+            6, 100);
+    sensors_register((sensors_read_t) lsm303dlhc_read_acc_async,
+            (sensors_finalize_t) lsm303dlhc_read_acc_async_finalize, 6, 100);
+    sensors_register((sensors_read_t) lsm303dlhc_read_mag_async,
+            (sensors_finalize_t) lsm303dlhc_read_mag_async_finalize, 6, 25);
+
+    sensors_set_ring_handler(BATCH, records_ready, NULL);
+
+    if (sensors_start(100))
+    {
+        printf("# Failed to start the sampling\n");
+    }
+
+    platform_run();
+    return 0;
+}
+
+static void records_ready(handler_arg_t arg)
+{
+    uint16_t length = sensors_read_records(records, sizeof(records));
+    uint16_t offset = 0;
+    sensors_stats_t stats;
+
+    while (offset < length)
+    {
+        const uint8_t *record = records + offset;
+        const int16_t *sample;
+        uint16_t record_length, mask;
+        uint32_t time;
+        int i;
+
+        packer_uint16_unpack(record, &record_length);
+        packer_uint32_unpack(record + 2, &time);
+        packer_uint16_unpack(record + 6, &mask);
+        sample = (const int16_t *) (record + SENSORS_RECORD_HEADER_LENGTH);
+
+        printf("%u %04x", time, mask);
+
+        for (i = 0; i < (record_length - SENSORS_RECORD_HEADER_LENGTH) / 2; i++)
+        {
+            printf(" %d", sample[i]);
+        }
+
+        printf("\n");
+        offset += record_length;
+    }
+
+    sensors_get_stats(&stats);
+    printf("# ticks %u overruns %u errors %u records %u dropped %u\n",
+            stats.ticks, stats.overruns, stats.errors, stats.records,
+            stats.dropped);
+}
@@ -0,0 +1,97 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/*
+ * trace.c
+ *
+ * Records trace points of periodic soft timers and of the application, and
+ * dumps them every few seconds, to be converted by tools/trace2chrome.py.
+ * Build with -DTRACE_POINTS=1.
+ *
+ *  Created on: Oct 2013
+ */
+
+#include <stdint.h>
+#include "platform.h"
+#include "soft_timer.h"
+#include "trace.h"
+#include "printf.h"
+#include "debug.h"
+
+/* Trace points of the application */
+enum
+{
+    TRACE_ID_APP_WORK = TRACE_ID_USER,
+    TRACE_ID_APP_LOOPS = TRACE_ID_USER + 1,
+};
+
+#define TIMERS_NUM 3
+
+/* Busy loops of the timers handlers, longer for the slower timers */
+static uint32_t loops[TIMERS_NUM] = {10000, 20000, 30000};
+
+static soft_timer_t timers[TIMERS_NUM];
+static soft_timer_t dump_timer;
+
+static void work(handler_arg_t arg);
+static void dump(handler_arg_t arg);
+
+int main()
+{
+    uint32_t i;
+
+    // Initialize the platform
+    platform_init();
+
+    // Initialize the soft timer library
+    soft_timer_init();
+
+    for (i = 0; i < TIMERS_NUM; i++)
+    {
+        soft_timer_set_handler(&timers[i], work, (handler_arg_t) &loops[i]);
+        soft_timer_start(&timers[i], soft_timer_ms_to_ticks(10 * (i + 1)), 1);
+    }
+
+    soft_timer_set_handler(&dump_timer, dump, NULL);
+    soft_timer_start(&dump_timer, soft_timer_s_to_ticks(2), 1);
+
+    // Run
+    platform_run();
+    return 0;
+}
+
+static void work(handler_arg_t arg)
+{
+    uint32_t *loop = arg;
+    volatile uint32_t i;
+
+    TRACE_BEGIN(TRACE_ID_APP_WORK, *loop);
+
+    for (i = 0; i < *loop; i++)
+    {
+    }
+
+    TRACE_VALUE(TRACE_ID_APP_LOOPS, i);
+    TRACE_END(TRACE_ID_APP_WORK, *loop);
+}
+
+static void dump(handler_arg_t arg)
+{
+    trace_dump();
+}
@@ -56,12 +56,36 @@ typedef const void *adc_t;
  */
 typedef void (*adc_handler_t)(handler_arg_t arg, uint16_t value);
 
+/**
+ * ADC handler function used to get blocks of scanned samples.
+ *
+ * \param arg the argument provided when starting the scan
+ * \param samples the samples, the channels of each scan in sequence order
+ * \param num_scans the number of scans in the block
+ */
+typedef void (*adc_scan_handler_t)(handler_arg_t arg, const uint16_t *samples,
+                                   uint16_t num_scans);
+
 enum
 {
     ADC_CHANNEL_TEMPERATURE = 16,
     ADC_CHANNEL_VREFINT = 17
 };
 
+/**
+ * External triggers of the scans, as numbered by the STM32F1xx ADC1.
+ */
+typedef enum
+{
+    ADC_TRIGGER_TIM1_CC1 = 0,
+    ADC_TRIGGER_TIM1_CC2 = 1,
+    ADC_TRIGGER_TIM1_CC3 = 2,
+    ADC_TRIGGER_TIM2_CC2 = 3,
+    ADC_TRIGGER_TIM3_TRGO = 4,
+    ADC_TRIGGER_TIM4_CC4 = 5,
+    ADC_TRIGGER_EXTI11 = 6,
+} adc_trigger_t;
+
 /**
  * Enable an ADC.
  *
@@ -138,6 +162,48 @@ void adc_prepare_single(adc_t adc, uint8_t channel);
  */
 void adc_sample_single(adc_t adc);
 
+/**
+ * Configure a scan of several channels, started by an external trigger.
+ *
+ * Each trigger converts all the channels in sequence. The timer generating
+ * the trigger is configured by the caller, for instance with a compare channel
+ * in PWM mode.
+ *
+ * \param adc the ADC to configure
+ * \param channels the channels to convert, in order
+ * \param num_channels the number of channels, from 1 to 16
+ * \param trigger the scan trigger
+ */
+void adc_config_scan(adc_t adc, const uint8_t *channels, uint8_t num_channels,
+                     adc_trigger_t trigger);
+
+/**
+ * Start the configured scan.
+ *
+ * The samples are written by DMA in a buffer used in two halves, in turn. When
+ * a half is full, the handler is called from interrupt context with its
+ * samples while the other half fills. Consecutive scans may be averaged by
+ * groups, the averages are written in place at the start of the half.
+ *
+ * \param adc the ADC to start
+ * \param buffer the buffer, of 2 * num_scans * num_channels samples
+ * \param num_scans the number of scans in a half, a multiple of decimation
+ * \param decimation the number of scans averaged, 1 for none
+ * \param handler the handler of the half buffers
+ * \param arg the argument to provide to the handler
+ * \return 0 if started, 1 if the ADC has no DMA channel
+ */
+int32_t adc_start_scan(adc_t adc, uint16_t *buffer, uint16_t num_scans,
+                       uint8_t decimation, adc_scan_handler_t handler,
+                       handler_arg_t arg);
+
+/**
+ * Stop the scan.
+ *
+ * \param adc the ADC to stop
+ */
+void adc_stop_scan(adc_t adc);
+
 /**
  * Enable VrefINT for sampling it and computing Vcc
  */
@@ -26,9 +26,11 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 #include <errno.h>
 #include <sys/stat.h>
 #include "boot.h"
+#include "crc.h"
 #include "printf.h"
 #include "debug.h"
 #include "cm3_scb_registers.h"
@@ -50,6 +52,16 @@ extern int main();
 extern void __libc_init_array();
 #endif
 
+static void boot_stage();
+
+/* Overridden by the flash drivers supporting firmware staging */
+const boot_staging_t __attribute__((weak)) boot_staging =
+{
+    .start   = 0,
+    .size    = 0,
+    .install = NULL
+};
+
 /**
  * Define the Reset handler.
  * It initializes the bss and data sections of the RAM
@@ -75,6 +87,9 @@ void __attribute__((naked)) reset()
         *dst++ = 0;
     }
 
+    // Install a staged firmware
+    boot_stage();
+
     /* Call CTORS of static objects */
 #ifdef __cplusplus
     __libc_init_array();
@@ -88,6 +103,50 @@ void __attribute__((naked)) reset()
     HALT();
 }
 
+boot_image_t *boot_staged_image()
+{
+    if (boot_staging.size == 0)
+    {
+        return NULL;
+    }
+
+    return (boot_image_t *)(boot_staging.start + boot_staging.size
+                            - sizeof(boot_image_t));
+}
+
+static void boot_stage()
+{
+    const boot_image_t *staged = boot_staged_image();
+    const boot_image_t *running;
+    uint32_t crc;
+
+    if ((staged == NULL) || (staged->magic != BOOT_IMAGE_MAGIC)
+            || (staged->length > boot_staging.size - sizeof(boot_image_t)))
+    {
+        return;
+    }
+
+    // The firmware area is just before the staging one, same layout
+    running = (const boot_image_t *)(boot_staging.start - sizeof(boot_image_t));
+
+    if (memcmp(staged, running, sizeof(boot_image_t)) == 0)
+    {
+        // Already installed
+        return;
+    }
+
+    crc_enable();
+    crc_reset();
+    crc_compute((const uint32_t *) boot_staging.start, (staged->length + 3) / 4);
+    crc = crc_terminate();
+    crc_disable();
+
+    if (crc == staged->crc)
+    {
+        boot_staging.install(staged->length);
+    }
+}
+
 /**
  * Define the default empty handler
  */
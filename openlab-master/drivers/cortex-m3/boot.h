@@ -27,6 +27,8 @@
 #ifndef BOOT_H_
 #define BOOT_H_
 
+#include <stdint.h>
+
 #if defined(RELEASE) && RELEASE==1
 #define DEBUG_HANDLER(isr)\
     void __attribute__((weak)) isr();
@@ -41,4 +43,43 @@ typedef void (*vector_t)();
 
 void debug_handler(const char *name);
 
+/*
+ * Firmware update stage.
+ *
+ * A new firmware image may be staged in a flash area of the same size as the
+ * firmware area, following it. The image header is in the last bytes of the
+ * staging area. At reset, before main, a valid staged image that differs from
+ * the running one is copied over it; the copy includes the header.
+ */
+
+#define BOOT_IMAGE_MAGIC 0x4f544149
+
+/** Header of a staged firmware image */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t length;   /**< image length in bytes */
+    uint32_t crc;      /**< CRC32 of the image, padded with 0xFF to words */
+    uint32_t version;
+} boot_image_t;
+
+/** Staging area of the flash driver */
+typedef struct
+{
+    uint32_t start;
+    uint32_t size;     /**< 0 if firmware staging is not supported */
+    /** Copy the staged image over the firmware, then reset */
+    void (*install)(uint32_t length);
+} boot_staging_t;
+
+/** Provided by the flash drivers supporting firmware staging */
+extern const boot_staging_t boot_staging;
+
+/**
+ * Get the header location of a staged image.
+ *
+ * \return the header, NULL if staging is not supported
+ */
+boot_image_t *boot_staged_image();
+
 #endif /* BOOT_H_ */
@@ -91,6 +91,22 @@ static inline volatile uint8_t *mem_get_reg8(uint32_t addr)
 
 #define CM3_SCB_CPACR_OFFSET        0x88
 
+/* CortexM3 Debug section */
+#define CM3_DEBUG_DEMCR_ADDRESS     0xE000EDFC
+
+// Bits of DEMCR
+#define CM3_DEBUG_DEMCR_TRCENA      BV(24)
+
+/* CortexM3 DWT section */
+#define CM3_DWT_BASE_ADDRESS        0xE0001000
+
+// Offsets for DWT
+#define CM3_DWT_CTRL_OFFSET         0x00
+#define CM3_DWT_CYCCNT_OFFSET       0x04
+
+// Bits of DWT CTRL
+#define CM3_DWT_CTRL_CYCCNTENA      BV(0)
+
 static inline volatile uint32_t* mem_get_bitband(uint32_t reg_addr, uint32_t reg_bit)
 {
 #define BITBAND_PERI_REF 0x40000000
@@ -0,0 +1,46 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/*
+ * dwt.c
+ *
+ *  Created on: Oct 2013
+ */
+
+#include "dwt.h"
+#include "cm3_memmap.h"
+#include "rcc_sysclk.h"
+
+void dwt_enable_cycle_counter()
+{
+    // Enable the trace unit, then the counter
+    *mem_get_reg32(CM3_DEBUG_DEMCR_ADDRESS) |= CM3_DEBUG_DEMCR_TRCENA;
+    *mem_get_reg32(CM3_DWT_BASE_ADDRESS + CM3_DWT_CTRL_OFFSET) |=
+        CM3_DWT_CTRL_CYCCNTENA;
+}
+
+uint32_t dwt_get_cycle_count()
+{
+    return *mem_get_reg32(CM3_DWT_BASE_ADDRESS + CM3_DWT_CYCCNT_OFFSET);
+}
+
+uint32_t dwt_get_cycle_frequency()
+{
+    return rcc_sysclk_get_clock_frequency(RCC_SYSCLK_CLOCK_HCLK);
+}
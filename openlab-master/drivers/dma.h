@@ -133,6 +133,21 @@ void dma_config(dma_t dma, uint32_t peripheral_address,
  **/
 void dma_start(dma_t dma, handler_t done_handler, handler_arg_t handler_arg);
 
+/**
+ * Start a circular DMA transfer, which must have been configured.
+ *
+ * The transfer starts again from the beginning each time it completes, until
+ * it is canceled. The handler is called from interrupt context when half of
+ * the transfers are done, with 0 as result for the first half and 1 for the
+ * second half.
+ *
+ * \param dma the DMA to start;
+ * \param half_handler the function to be called on each half;
+ * \param handler_arg optional argument for the handler;
+ **/
+void dma_start_circular(dma_t dma, result_handler_t half_handler,
+                        handler_arg_t handler_arg);
+
 /**
  * Cancel a DMA transfer.
  *
@@ -0,0 +1,75 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/**
+ * dwt.h
+ *
+ * \date Oct 2013
+ */
+
+#ifndef DWT_H_
+#define DWT_H_
+
+/**
+ * \addtogroup drivers
+ * @{
+ */
+
+/**
+ * \defgroup DWT Cycle Counter
+ *
+ * The cycle counter of the Data Watchpoint and Trace unit of the Cortex-M3
+ * counts the core clock cycles on 32 bits, wrapping around after about a
+ * minute at 72MHz.
+ *
+ * On the native platform, it counts units of 32ns of the host monotonic
+ * clock, as a 31.25MHz core.
+ *
+ *@{
+ */
+
+#include <stdint.h>
+
+/**
+ * Enable the cycle counter, and the trace unit it depends on.
+ *
+ * The counter keeps its value, it is not reset.
+ */
+void dwt_enable_cycle_counter();
+
+/**
+ * Get the cycle counter value.
+ *
+ * \return the number of cycles counted
+ */
+uint32_t dwt_get_cycle_count();
+
+/**
+ * Get the current frequency of the cycle counter, the core clock frequency.
+ *
+ * \return the frequency in Hz
+ */
+uint32_t dwt_get_cycle_frequency();
+
+/**
+ * @}
+ * @}
+ */
+
+#endif /* DWT_H_ */
@@ -57,6 +57,53 @@ typedef enum
     I2C_CLOCK_MODE_FAST,
 } i2c_clock_mode_t;
 
+/**
+ * A queued I2C transaction, a write then a read with a repeated start.
+ *
+ * Either length may be 0. The structure must stay valid until its handler is
+ * called.
+ */
+typedef struct i2c_transfer
+{
+    /** Next transfer in the queue, reserved for the driver */
+    struct i2c_transfer *next;
+    /** Number of retries done, reserved for the driver */
+    uint8_t retries;
+
+    /** I2C slave address */
+    uint8_t addr;
+    /** The buffer to send */
+    const uint8_t *tx_buffer;
+    /** The number of bytes to send */
+    uint16_t tx_length;
+    /** The buffer receiving the bytes */
+    uint8_t *rx_buffer;
+    /** The number of bytes to receive */
+    uint16_t rx_length;
+
+    /** Handler called from interrupt context, with 0 on success */
+    result_handler_t handler;
+    /** Handler argument */
+    handler_arg_t arg;
+} i2c_transfer_t;
+
+/**
+ * Statistics of a I2C bus
+ */
+typedef struct
+{
+    /** Transfers completed successfully */
+    uint32_t transfers;
+    /** Transfers failed after all their retries */
+    uint32_t errors;
+    /** Transfers started again after a bus error */
+    uint32_t retries;
+    /** Bytes sent and received by the completed transfers */
+    uint32_t bytes;
+    /** Receptions done by DMA */
+    uint32_t dma_receptions;
+} i2c_stats_t;
+
 /**
  * Enable a I2C driver
  *
@@ -79,12 +126,38 @@ void i2c_enable(i2c_t i2c, i2c_clock_mode_t mode);
  */
 void i2c_disable(i2c_t i2c);
 
+/**
+ * Queue a transfer.
+ *
+ * Transfers are done in order, the next one is started from interrupt context
+ * when the previous one ends, without the CPU waiting. A transfer failing on a
+ * bus error, an arbitration loss or a missing acknowledge is retried a few
+ * times before its handler is called with an error.
+ *
+ * Receptions of 2 bytes or more use DMA when the bus has a DMA channel.
+ *
+ * \param i2c the I2C driver to use;
+ * \param transfer the transfer to queue.
+ */
+void i2c_submit(i2c_t i2c, i2c_transfer_t *transfer);
+
+/**
+ * Get the statistics of a I2C bus, since it was enabled.
+ *
+ * \param i2c the I2C driver;
+ * \param stats the structure to fill.
+ */
+void i2c_get_stats(i2c_t i2c, i2c_stats_t *stats);
+
 /**
  * Send then receive a given amount of bytes with an I2C driver.
  * Non-blocking call if the given handler is non-NULL.
  * It is then called when the transfer is completed.
  *
  * Note: the handler is called from interrupt context.
+ * The transfer is queued after the submitted ones, a single non-blocking
+ * call may be pending at a time. A blocking call waits for the queued
+ * transfers, it must not be done from a transfer handler.
  *
  * \param i2c the I2C driver to use;
  * \param addr the I2C slave address;
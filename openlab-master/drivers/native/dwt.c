@@ -0,0 +1,49 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/*
+ * dwt.c
+ *
+ *  Created on: Oct 2013
+ */
+
+#include <time.h>
+
+#include "dwt.h"
+
+/* Duration of a cycle, in ns */
+#define NATIVE_CYCLE_NS 32
+
+void dwt_enable_cycle_counter()
+{
+    // Always running
+}
+
+uint32_t dwt_get_cycle_count()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t) now.tv_sec * 1000000000 + now.tv_nsec) / NATIVE_CYCLE_NS;
+}
+
+uint32_t dwt_get_cycle_frequency()
+{
+    return 1000000000 / NATIVE_CYCLE_NS;
+}
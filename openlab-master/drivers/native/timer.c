@@ -24,67 +24,262 @@
  *      Author: Antoine Fraboulet <antoine.fraboulet.at.hikob.com>
  */
 
+#include <string.h>
+#include <time.h>
+
+#include "platform.h"
 #include "timer.h"
 #include "timer_.h"
 #include "printf.h"
+#include "debug.h"
+
+static uint64_t timer_count(const _openlab_timer_t *_timer);
 
-void timer_enable(timer_t timer)
+void timer_enable(openlab_timer_t timer)
 {
+    const _openlab_timer_t *_timer = timer;
+
+    memset(_timer->data, 0, sizeof(*_timer->data));
 }
 
-void timer_disable(timer_t timer)
+void timer_disable(openlab_timer_t timer)
 {
+    const _openlab_timer_t *_timer = timer;
+
+    platform_enter_critical();
+    memset(_timer->data, 0, sizeof(*_timer->data));
+    platform_exit_critical();
 }
 
-void timer_select_internal_clock(timer_t timer, uint16_t prescaler)
+void timer_select_internal_clock(openlab_timer_t timer, uint16_t prescaler)
 {
+    const _openlab_timer_t *_timer = timer;
+
+    _timer->data->frequency = NATIVE_TIMER_INTERNAL_CLOCK / (prescaler + 1);
 }
 
-void timer_select_external_clock(timer_t timer, uint16_t prescaler)
+void timer_select_external_clock(openlab_timer_t timer, uint16_t prescaler)
 {
+    const _openlab_timer_t *_timer = timer;
+
+    _timer->data->frequency = NATIVE_TIMER_EXTERNAL_CLOCK / (prescaler + 1);
 }
 
-void timer_start(timer_t timer, uint16_t update_value,
+void timer_start(openlab_timer_t timer, uint16_t update_value,
                  timer_handler_t update_handler, handler_arg_t update_arg)
 {
+    const _openlab_timer_t *_timer = timer;
+    struct timespec now;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    platform_enter_critical();
+
+    // Store the handler
+    _timer->data->update_handler = update_handler;
+    _timer->data->update_handler_arg = update_arg;
+    _timer->data->period = (uint32_t) update_value + 1;
+
+    // Reset the counter and enable it
+    _timer->data->start = (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+    _timer->data->offset = 0;
+    _timer->data->updates = 0;
+    _timer->data->running = 1;
+
+    for (i = 0; i < NATIVE_TIMER_CHANNELS; i++)
+    {
+        _timer->data->channel[i].count = 0;
+    }
+
+    platform_exit_critical();
 }
 
-void timer_stop(timer_t timer)
+void timer_stop(openlab_timer_t timer)
 {
+    const _openlab_timer_t *_timer = timer;
+
+    platform_enter_critical();
+
+    // Freeze the counter
+    _timer->data->offset = timer_count(_timer);
+    _timer->data->running = 0;
+
+    platform_exit_critical();
 }
 
-uint16_t timer_time(timer_t timer)
+uint16_t timer_time(openlab_timer_t timer)
 {
-    return 0;
+    const _openlab_timer_t *_timer = timer;
+
+    if (_timer->data->period == 0)
+    {
+        return 0;
+    }
+
+    return timer_count(_timer) % _timer->data->period;
 }
 
-uint32_t timer_get_frequency(timer_t timer)
+void timer_tick_update(openlab_timer_t timer, int16_t dt)
 {
-    return 0;
+    const _openlab_timer_t *_timer = timer;
+
+    platform_enter_critical();
+    _timer->data->offset += dt;
+    platform_exit_critical();
 }
 
-uint16_t timer_get_number_of_channels(timer_t timer)
+uint32_t timer_get_frequency(openlab_timer_t timer)
 {
-    return 0;
+    const _openlab_timer_t *_timer = timer;
+
+    if (_timer->data->frequency != 0)
+    {
+        return _timer->data->frequency;
+    }
+
+    // Assume internal clock
+    return NATIVE_TIMER_INTERNAL_CLOCK;
 }
 
-void timer_set_channel_compare(timer_t timer, timer_channel_t channel,
+uint16_t timer_get_number_of_channels(openlab_timer_t timer)
+{
+    return NATIVE_TIMER_CHANNELS;
+}
+
+void timer_set_channel_compare(openlab_timer_t timer, timer_channel_t channel,
                                uint16_t compare_value, timer_handler_t handler, handler_arg_t arg)
 {
+    const _openlab_timer_t *_timer = timer;
+
+    if (channel >= NATIVE_TIMER_CHANNELS)
+    {
+        return;
+    }
+
+    platform_enter_critical();
+
+    _timer->data->channel[channel].handler = handler;
+    _timer->data->channel[channel].arg = arg;
+    _timer->data->channel[channel].value = compare_value;
+    _timer->data->channel[channel].count = timer_count(_timer);
+
+    platform_exit_critical();
 }
 
-void timer_update_channel_compare(timer_t timer, timer_channel_t channel,
+void timer_update_channel_compare(openlab_timer_t timer, timer_channel_t channel,
                                   uint16_t value)
 {
+    const _openlab_timer_t *_timer = timer;
+
+    if (channel >= NATIVE_TIMER_CHANNELS)
+    {
+        return;
+    }
+
+    platform_enter_critical();
+
+    // Match from the current count on, as the hardware comparator
+    _timer->data->channel[channel].value = value;
+    _timer->data->channel[channel].count = timer_count(_timer);
+
+    platform_exit_critical();
+}
+
+void timer_activate_channel_output(openlab_timer_t timer, timer_channel_t channel,
+                                   timer_output_mode_t mode)
+{
+    // No output pins
 }
 
-void timer_set_channel_capture(timer_t timer, timer_channel_t channel,
+void timer_set_channel_capture(openlab_timer_t timer, timer_channel_t channel,
                                timer_capture_edge_t signal_edge, timer_handler_t handler,
                                handler_arg_t arg)
 {
+    // No input pins, nothing is ever captured
+    log_warning("Capture not supported on native timers");
 }
 
-void timer_handle_interrupt(_timer_t *_timer)
+uint32_t timer_get_update_flag(openlab_timer_t timer)
 {
+    const _openlab_timer_t *_timer = timer;
+
+    if (_timer->data->period == 0)
+    {
+        return 0;
+    }
+
+    // Set while an update is not handled
+    return timer_count(_timer) / _timer->data->period != _timer->data->updates;
 }
 
+void timer_handle_interrupt(const _openlab_timer_t *_timer)
+{
+    uint64_t count, updates;
+    int i;
+
+    if (!_timer->data->running || _timer->data->period == 0)
+    {
+        return;
+    }
+
+    count = timer_count(_timer);
+
+    // Update event
+    updates = count / _timer->data->period;
+
+    if (updates != _timer->data->updates)
+    {
+        _timer->data->updates = updates;
+
+        if (_timer->data->update_handler)
+        {
+            _timer->data->update_handler(_timer->data->update_handler_arg,
+                                   _timer->data->period - 1);
+        }
+    }
+
+    // Channel event
+    for (i = 0; i < NATIVE_TIMER_CHANNELS; i++)
+    {
+        uint64_t from = _timer->data->channel[i].count;
+        uint64_t match;
+
+        if (_timer->data->channel[i].handler == NULL || count <= from)
+        {
+            continue;
+        }
+
+        // First count after the last check matching the compare value
+        match = from + 1;
+        match += (_timer->data->channel[i].value + _timer->data->period
+                  - match % _timer->data->period) % _timer->data->period;
+
+        _timer->data->channel[i].count = count;
+
+        if (_timer->data->channel[i].value < _timer->data->period && match <= count)
+        {
+            _timer->data->channel[i].handler(_timer->data->channel[i].arg,
+                                       _timer->data->channel[i].value);
+        }
+    }
+}
+
+static uint64_t timer_count(const _openlab_timer_t *_timer)
+{
+    struct timespec now;
+    uint64_t elapsed;
+
+    if (!_timer->data->running)
+    {
+        return _timer->data->offset;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec - _timer->data->start;
+
+    // Split to avoid overflows at high frequencies
+    return (elapsed / 1000000000) * _timer->data->frequency
+           + (elapsed % 1000000000) * _timer->data->frequency / 1000000000
+           + _timer->data->offset;
+}
@@ -32,63 +32,61 @@
 
 #include "timer.h"
 
+/* Clock of the internal clock source, before the prescaler */
+#define NATIVE_TIMER_INTERNAL_CLOCK 72000000
+/* Clock of the external clock source, the LSE */
+#define NATIVE_TIMER_EXTERNAL_CLOCK 32768
+
+#define NATIVE_TIMER_CHANNELS 4
+
+/*
+ * Timer emulated on the host CLOCK_MONOTONIC clock.
+ *
+ * Counts are 64bit, since the timer start, the 16bit counter being the count
+ * modulo the update period. Interrupts are detected by timer_handle_interrupt,
+ * comparing the count to the count at its previous call, which must be called
+ * periodically by the platform.
+ */
 typedef struct
 {
-#if 0
-    // Base Address of the timer
-    uint32_t base_address;
-    // APB bus number
-    rcc_apb_bus_t apb_bus;
-    // APB bit
-    rcc_apb_bit_t apb_bit;
-    // IRQ line in the NVIC
-    nvic_irq_line_t irq_line;
-
-    // The estimated frequency
+    // Frequency after the prescaler, 0 if no clock is selected
     uint32_t frequency;
-
-    uint8_t number_of_channels;
+    // Update period, the update value plus one
+    uint32_t period;
+
+    // Whether the counter is running
+    uint8_t running;
+    // Monotonic time of the start, in nanoseconds
+    uint64_t start;
+    // Count when started, adjusted by timer_tick_update
+    int64_t offset;
+    // Number of updates handled
+    uint64_t updates;
 
     timer_handler_t update_handler;
     handler_arg_t update_handler_arg;
 
-    timer_handler_t *channel_handlers;
-    handler_arg_t *channel_handler_args;
-#endif
-} _timer_t;
-
-#if 0
-static inline void timer_init(_timer_t *timer, uint32_t base_address, rcc_apb_bus_t apb_bus, rcc_apb_bit_t apb_bit, nvic_irq_line_t irq_line, uint8_t number_of_channels, timer_handler_t *channel_handlers, handler_arg_t *channel_handler_args)
-{
-    timer->base_address = base_address;
-
-    timer->apb_bus = apb_bus;
-    timer->apb_bit = apb_bit;
-    timer->irq_line = irq_line;
-
-    timer->number_of_channels = number_of_channels;
-
-    timer->channel_handlers = channel_handlers;
-    timer->channel_handler_args = channel_handler_args;
-}
-#endif
+    struct
+    {
+        uint16_t value;
+        // Count up to which the compare value was checked
+        uint64_t count;
+        timer_handler_t handler;
+        handler_arg_t arg;
+    } channel[NATIVE_TIMER_CHANNELS];
+} _timer_data_t;
 
-#if 0
-static inline void timer_init_basic(_timer_t *timer, uint32_t base_address, rcc_apb_bus_t apb_bus, rcc_apb_bit_t apb_bit, nvic_irq_line_t irq_line)
+typedef struct
 {
-    // Initialize the timer with zero channel
-    timer_init(timer, base_address, apb_bus, apb_bit, irq_line, 0, NULL, NULL);
-}
-#endif
+    _timer_data_t *data;
+} _openlab_timer_t;
 
-#if 0
-static inline void timer_init_general(_timer_t *timer, uint32_t base_address, rcc_apb_bus_t apb_bus, rcc_apb_bit_t apb_bit, nvic_irq_line_t irq_line, timer_handler_t *channel_handlers, handler_arg_t *channel_handler_args)
-{
-    // Initialize the timer with four channels
-    timer_init(timer, base_address, apb_bus, apb_bit, irq_line, 4, channel_handlers, channel_handler_args);
+#define TIMER_INIT(name) \
+    static _timer_data_t name##_data; \
+    const _openlab_timer_t name = { \
+    .data = &name##_data \
 }
-#endif
 
-void timer_handle_interrupt(_timer_t *timer);
+void timer_handle_interrupt(const _openlab_timer_t *_timer);
 
 #endif /* TIMER__H_ */
@@ -118,7 +118,7 @@ sd_error_t sd_read_single_block(sdio_t sdio, uint32_t addr, uint8_t *buf);
  * Method for reading multiple blocks from SD card
  * /param sdio The SDIO port to read from
  * /param addr The address to read. Is the card is SDHC, addr is a page address, otherwise, it is a byte address
- * /param buf The buffers to fill. Each buffer must be 32-bit aligned
+ * /param buf The buffers to fill. They must be 32-bit aligned and follow each other in memory
  */
 sd_error_t sd_read_multiple_blocks(sdio_t sdio, uint32_t addr, uint8_t **buf, uint32_t nb_blocks);
 
@@ -134,7 +134,7 @@ sd_error_t sd_write_single_block(sdio_t sdio, uint32_t addr, uint8_t *buf);
  * Method for writing multiple blocks to SD card
  * /param sdio The SDIO port to write to
  * /param addr The address to write. Is the card is SDHC, addr is a page address, otherwise, it is a byte address
- * /param buf The buffers to write. Each buffer must be 32-bit aligned
+ * /param buf The buffers to write. They must be 32-bit aligned and follow each other in memory
  */
 sd_error_t sd_write_multiple_blocks(sdio_t sdio, uint32_t addr, uint8_t **buf, uint32_t nb_blocks);
 
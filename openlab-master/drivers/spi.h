@@ -40,7 +40,10 @@
  *@{
  */
 
+#include <stdint.h>
+
 #include "handler.h"
+#include "gpio.h"
 
 /**
  * Abstract representation of a SPI driver.
@@ -58,6 +61,69 @@ typedef enum
     SPI_CLOCK_MODE_IDLE_HIGH_FALLING = 3,
 } spi_clock_mode_t;
 
+/**
+ * Priority levels of the queued requests.
+ */
+typedef enum
+{
+    SPI_PRIORITY_HIGH = 0,
+    SPI_PRIORITY_NORMAL = 1,
+    SPI_PRIORITY_LOW = 2,
+} spi_priority_t;
+
+/**
+ * A slave device on a SPI bus, for the queued requests.
+ */
+typedef struct
+{
+    /** The SPI driver of the bus */
+    spi_t spi;
+    /** The chip select pin, active low */
+    gpio_t cs_gpio;
+    gpio_pin_t cs_pin;
+    /** The device baudrate, 0 to keep the bus configuration */
+    uint32_t baudrate;
+    /** The device clock mode, if the baudrate is not 0 */
+    spi_clock_mode_t clock_mode;
+
+    /** Bus configuration, computed by \ref spi_device_init */
+    uint16_t cr1;
+} spi_device_t;
+
+/**
+ * A queued SPI request.
+ *
+ * The structure must stay valid until its handler is called.
+ */
+typedef struct spi_request
+{
+    /** Next request in the queue, reserved for the driver */
+    struct spi_request *next;
+
+    /** The device to transfer with */
+    const spi_device_t *device;
+    /** The request priority */
+    spi_priority_t priority;
+
+    /** The buffer to send, NULL to send zeros */
+    const uint8_t *tx_buffer;
+    /** The buffer to store the received data, NULL to discard it */
+    uint8_t *rx_buffer;
+    /** The number of bytes to transfer */
+    uint16_t length;
+
+    /**
+     * Keep the chip select low after the transfer, only requests of the same
+     * device are then started until one clears it.
+     */
+    uint8_t keep_cs;
+
+    /** Handler called from interrupt context at the transfer end, may be NULL */
+    handler_t handler;
+    /** Handler argument */
+    handler_arg_t handler_arg;
+} spi_request_t;
+
 /**
  * Enable a SPI driver.
  *
@@ -132,6 +198,34 @@ void spi_transfer_async(spi_t spi, const uint8_t *tx_buffer,
  */
 void spi_async_cancel(spi_t spi);
 
+/**
+ * Initialize a device for the queued requests.
+ *
+ * The chip select pin is configured as an output, high. The device fields
+ * must be set before.
+ *
+ * \param device the device to initialize.
+ */
+void spi_device_init(spi_device_t *device);
+
+/**
+ * Queue a request.
+ *
+ * Requests of a bus are done one at a time, in priority order and in order
+ * within a priority. The device chip select is driven by the driver and the
+ * bus configured for the device. Transfers of a few bytes run with the
+ * interrupts, longer ones with DMA when the bus has channels.
+ *
+ * A started request is never interrupted: a high priority request waits for
+ * the transfer in progress, or for the end of a chip select kept low.
+ *
+ * The direct transfer functions must not be used on a bus while requests
+ * are queued.
+ *
+ * \param request the request to queue.
+ */
+void spi_submit(spi_request_t *request);
+
 /**
  * @}
  * @}
@@ -91,6 +91,7 @@ void dma_start(dma_t dma, handler_t handler, handler_arg_t handler_arg)
     // Store the handlers
     _dma->data->handler = handler;
     _dma->data->handler_arg = handler_arg;
+    _dma->data->half_handler = NULL;
 
     // Enable the transfer complete interrupt
     *dma_get_CCRx(_dma) |= DMA_CCR__TCIE;
@@ -99,6 +100,23 @@ void dma_start(dma_t dma, handler_t handler, handler_arg_t handler_arg)
     *dma_get_CCRx(_dma) |= DMA_CCR__EN;
 }
 
+void dma_start_circular(dma_t dma, result_handler_t half_handler,
+                        handler_arg_t handler_arg)
+{
+    const _dma_t *_dma = dma;
+
+    // Store the handlers
+    _dma->data->handler = NULL;
+    _dma->data->handler_arg = handler_arg;
+    _dma->data->half_handler = half_handler;
+
+    // Enable circular mode, half transfer and transfer complete interrupts
+    *dma_get_CCRx(_dma) |= DMA_CCR__CIRC | DMA_CCR__HTIE | DMA_CCR__TCIE;
+
+    // Set the EN bit to start the channel
+    *dma_get_CCRx(_dma) |= DMA_CCR__EN;
+}
+
 int32_t dma_cancel(dma_t dma)
 {
     const _dma_t *_dma = dma;
@@ -132,6 +150,28 @@ void dma_handle_interrupt(const _dma_t *_dma)
 
     isr = *dma_get_ISR(_dma);
 
+    if (*dma_get_CCRx(_dma) & DMA_CCR__CIRC)
+    {
+        isr >>= _dma->channel * DMA_ISR__CHANNEL_OFFSET;
+
+        // Clear the interrupt flags, the channel goes on
+        *dma_get_IFCR(_dma) = (DMA_IFCR__CGIFx | DMA_IFCR__CHTIFx
+                               | DMA_IFCR__CTCIFx) << (_dma->channel
+                                       * DMA_IFCR__CHANNEL_OFFSET);
+
+        if ((isr & DMA_ISR__HTIFx) && _dma->data->half_handler)
+        {
+            _dma->data->half_handler(_dma->data->handler_arg, 0);
+        }
+
+        if ((isr & DMA_ISR__TCIFx) && _dma->data->half_handler)
+        {
+            _dma->data->half_handler(_dma->data->handler_arg, 1);
+        }
+
+        return;
+    }
+
     // Check if the transfer complete interrupt flag is set for this channel
     if (isr & (DMA_ISR__TCIFx << (_dma->channel * DMA_ISR__CHANNEL_OFFSET)))
     {
@@ -67,6 +67,8 @@ typedef struct
     // The handler for transfer done
     handler_t handler;
     handler_arg_t handler_arg;
+    // The handler of the circular transfer halves
+    result_handler_t half_handler;
 } _dma_data_t;
 
 typedef struct
@@ -25,12 +25,15 @@
  *      Author: Damien Hedde        <damien.hedde.at.hikob.com>
  */
 
+#include <string.h>
+
 #include "rcc.h"
 #include "gpio.h"
 #include "i2c.h"
 #include "i2c_.h"
 #include "i2c_registers.h"
 #include "nvic_.h"
+#include "platform.h"
 
 #ifdef I2C__SLAVE_SUPPORT
 #include "i2c_slave.h"
@@ -76,11 +79,15 @@ struct i2c_dbg_struct * volatile i2c_dbg_struct = NULL;
 #define I2C_DEBUG_LOG(a,b,c)
 #endif
 
-static void tx_rx_start(const _i2c_t *_i2c, uint8_t addr, const uint8_t *tx_buffer,
-                   uint16_t tx_length, uint8_t *rx_buffer, uint16_t rx_length,
-                   result_handler_t handler, handler_arg_t arg);
+/* Number of times a transfer is started again after an error */
+#define I2C_MAX_RETRIES 2
+/* Max loops waiting for the STOP of the previous transfer */
+#define I2C_STOP_WAIT 1000
+
+static void tx_rx_start(const _i2c_t *_i2c, i2c_transfer_t *transfer);
 static void tx_rx_end(const _i2c_t *_i2c, i2c_state_t state);
-static uint32_t tx_rx_wait(const _i2c_t *_i2c);
+static void sync_done(handler_arg_t arg, unsigned result);
+static void dma_rx_done(handler_arg_t arg);
 static void test_ready(const _i2c_t *_i2c);
 
 void i2c_enable(i2c_t i2c, i2c_clock_mode_t mode)
@@ -163,7 +170,10 @@ void i2c_enable(i2c_t i2c, i2c_clock_mode_t mode)
     _i2c->data->len_recv = 0;
     _i2c->data->cpt_send = 0;
     _i2c->data->cpt_recv = 0;
-    _i2c->data->transfer_handler = NULL;
+    _i2c->data->queue_head = NULL;
+    _i2c->data->queue_tail = NULL;
+    _i2c->data->direct_pending = 0;
+    memset(&_i2c->data->stats, 0, sizeof(_i2c->data->stats));
 
     // Enable I2C EV and ERR interrupt line in the NVIC
     nvic_enable_interrupt_line(_i2c->irq_line_ev);
@@ -184,23 +194,95 @@ void i2c_disable(i2c_t i2c)
     *i2c_get_CR2(_i2c) = 0;
 }
 
+void i2c_submit(i2c_t i2c, i2c_transfer_t *transfer)
+{
+    const _i2c_t *_i2c = i2c;
+    _i2c_data_t *const data = _i2c->data;
+    int start = 0;
+
+    transfer->next = NULL;
+    transfer->retries = 0;
+
+    // Interrupt handlers submit too, from the transfer handlers
+    platform_enter_critical();
+
+    if (data->queue_tail)
+    {
+        // Started when the previous transfers end
+        data->queue_tail->next = transfer;
+    }
+    else
+    {
+        data->queue_head = transfer;
+        start = 1;
+    }
+
+    data->queue_tail = transfer;
+    platform_exit_critical();
+
+    if (start)
+    {
+        tx_rx_start(_i2c, transfer);
+    }
+}
+
+void i2c_get_stats(i2c_t i2c, i2c_stats_t *stats)
+{
+    const _i2c_t *_i2c = i2c;
+
+    platform_enter_critical();
+    *stats = _i2c->data->stats;
+    platform_exit_critical();
+}
+
 unsigned i2c_tx_rx_async(i2c_t i2c, uint8_t addr, const uint8_t *tx_buffer,
                    uint16_t tx_length, uint8_t *rx_buffer, uint16_t rx_length,
                    result_handler_t handler, handler_arg_t arg)
 {
     const _i2c_t *_i2c = i2c;
-    uint32_t res = 0;
+    _i2c_data_t *const data = _i2c->data;
+    i2c_transfer_t transfer, *t = &transfer;
+    volatile unsigned result = ~0u;
+
+    if (handler)
+    {
+        if (data->direct_pending)
+        {
+            log_error("I2C transfer already pending");
+            return 1;
+        }
+
+        // Released before its handler is called
+        data->direct_pending = 1;
+        t = &data->direct;
+        t->handler = handler;
+        t->arg = arg;
+    }
+    else
+    {
+        t->handler = sync_done;
+        t->arg = (handler_arg_t) &result;
+    }
+
+    t->addr = addr;
+    t->tx_buffer = tx_buffer;
+    t->tx_length = tx_length;
+    t->rx_buffer = rx_buffer;
+    t->rx_length = rx_length;
 
-    // Start the transfer
-    tx_rx_start(_i2c, addr, tx_buffer, tx_length, rx_buffer, rx_length, handler, arg);
+    i2c_submit(i2c, t);
 
-    // Eventually wait for the transfer to be completed
-    if (handler == NULL)
+    if (handler)
+    {
+        return 0;
+    }
+
+    // Wait for the queued transfers and this one
+    while (result == ~0u)
     {
-        res = tx_rx_wait(_i2c);
     }
 
-    return res;
+    return result;
 }
 
 #ifdef I2C__SLAVE_SUPPORT
@@ -262,8 +344,19 @@ void i2c_handle_ev_interrupt(const _i2c_t *_i2c)
             // Send address in order to receive data
             *i2c_get_DR(_i2c) = data->address | 1;
 
+            if (data->dma_channel_rx && data->len_recv >= 2)
+            {
+                // The DMA reads DR, NACK is set before the last byte (LAST)
+                dma_config(data->dma_channel_rx, (uint32_t) i2c_get_DR(_i2c),
+                           (uint32_t) data->buf_recv, data->len_recv,
+                           DMA_SIZE_8bit, DMA_DIRECTION_FROM_PERIPHERAL,
+                           DMA_INCREMENT_ON);
+                dma_start(data->dma_channel_rx, dma_rx_done,
+                          (handler_arg_t) _i2c);
+                *i2c_get_CR2(_i2c) |= I2C_CR2__DMAEN | I2C_CR2__LAST;
+            }
             // In the case of a 2-byte reception we need to set POS bit
-            if (data->len_recv == 2)
+            else if (data->len_recv == 2)
             {
                 *i2c_get_CR1(_i2c) |= I2C_CR1__POS;
             }
@@ -338,6 +431,12 @@ void i2c_handle_ev_interrupt(const _i2c_t *_i2c)
                 // instead, we'll wait for BTF (which lower the transfer speed)
             }
         }
+        else if (*i2c_get_CR2(_i2c) & I2C_CR2__DMAEN)
+        {
+            // Clear the flag by reading SR2, the DMA takes the bytes
+            sr2 = *i2c_get_SR2(_i2c);
+            data->state = I2C_RECEIVING_DMA;
+        }
         else
         {
             switch (data->len_recv)
@@ -739,30 +838,35 @@ void i2c_handle_er_interrupt(const _i2c_t *_i2c)
 /*
  * Start a transfer
  */
-static void tx_rx_start(const _i2c_t *_i2c, uint8_t addr, const uint8_t *tx_buffer,
-                   uint16_t tx_length, uint8_t *rx_buffer, uint16_t rx_length,
-                   result_handler_t handler, handler_arg_t arg)
+static void tx_rx_start(const _i2c_t *_i2c, i2c_transfer_t *transfer)
 {
     _i2c_data_t *const data = _i2c->data;
+    uint32_t i;
+
+    // The START must not be set before the STOP of the previous transfer
+    for (i = 0; i < I2C_STOP_WAIT; i++)
+    {
+        if (!(*i2c_get_CR1(_i2c) & I2C_CR1__STOP)
+                && !(*i2c_get_SR2(_i2c) & I2C_SR2__BUSY))
+        {
+            break;
+        }
+    }
 
     // Do the before-transfer test
     test_ready(_i2c);
 
-    // Save the handler
-    data->transfer_handler = handler;
-    data->transfer_handler_arg = arg;
-
     // Copy the data to send, data to read. Set the current state for the
     // I2C state machine and the issue the start condition.
-    data->address = addr;
+    data->address = transfer->addr;
 
-    data->len_send = tx_length;
+    data->len_send = transfer->tx_length;
     data->cpt_send = 0;
-    data->buf_send = tx_buffer;
+    data->buf_send = transfer->tx_buffer;
 
-    data->len_recv = rx_length;
+    data->len_recv = transfer->rx_length;
     data->cpt_recv = 0;
-    data->buf_recv = rx_buffer;
+    data->buf_recv = transfer->rx_buffer;
 
     // Ensure POS bit is cleared
     *i2c_get_CR1(_i2c) &= ~I2C_CR1__POS;
@@ -777,46 +881,99 @@ static void tx_rx_start(const _i2c_t *_i2c, uint8_t addr, const uint8_t *tx_buff
 }
 
 /*
- * Wait for the end of a transfer
+ * End of a blocking transfer
  */
-static uint32_t tx_rx_wait(const _i2c_t *_i2c)
+static void sync_done(handler_arg_t arg, unsigned result)
 {
-    _i2c_data_t *const data = _i2c->data;
-    uint32_t result;
+    *(volatile unsigned *) arg = result;
+}
 
-    while ((data->state != I2C_IDLE) && (data->state != I2C_ERROR))
-    {
-    }
+/*
+ * End of a DMA reception, the last byte has been NACKed
+ */
+static void dma_rx_done(handler_arg_t arg)
+{
+    const _i2c_t *_i2c = arg;
 
-    // Wait until busy is cleared
-    while (*i2c_get_SR2(_i2c) & I2C_SR2__BUSY)
-    {
-    }
+    // Program STOP
+    *i2c_get_CR1(_i2c) |= I2C_CR1__STOP;
+    *i2c_get_CR2(_i2c) &= ~(I2C_CR2__DMAEN | I2C_CR2__LAST);
 
-    // Get result
-    result = (data->state != I2C_IDLE);
+    _i2c->data->stats.dma_receptions++;
 
-    data->state = I2C_IDLE;
-    return result;
+    // Indicate that there is nothing else to receive
+    _i2c->data->len_recv = 0;
+    _i2c->data->cpt_recv = 0;
+
+    // The transfer is complete
+    tx_rx_end(_i2c, I2C_IDLE);
 }
 
 /*
- * Signal the transfer is completed
+ * Signal the transfer is completed, start the next one
  */
 static void tx_rx_end(const _i2c_t *_i2c, i2c_state_t state)
 {
     _i2c_data_t *const data = _i2c->data;
+    i2c_transfer_t *transfer = data->queue_head;
+
+    if (*i2c_get_CR2(_i2c) & I2C_CR2__DMAEN)
+    {
+        // Ended by an error
+        dma_cancel(data->dma_channel_rx);
+        *i2c_get_CR2(_i2c) &= ~(I2C_CR2__DMAEN | I2C_CR2__LAST);
+    }
 
-    if (data->transfer_handler)
+    data->state = I2C_IDLE;
+
+    if (transfer == NULL)
+    {
+        return;
+    }
+
+    if (state != I2C_IDLE && transfer->retries < I2C_MAX_RETRIES)
     {
-        result_handler_t hdl = data->transfer_handler;
-        data->transfer_handler = NULL;
-        data->state = I2C_IDLE;
-        hdl(data->transfer_handler_arg, (state != I2C_IDLE));
+        // Try again, the STOP has been programmed
+        transfer->retries++;
+        data->stats.retries++;
+        tx_rx_start(_i2c, transfer);
+        return;
+    }
+
+    if (state == I2C_IDLE)
+    {
+        data->stats.transfers++;
+        data->stats.bytes += transfer->tx_length + transfer->rx_length;
     }
     else
     {
-        data->state = state;
+        data->stats.errors++;
+    }
+
+    platform_enter_critical();
+    data->queue_head = transfer->next;
+
+    if (data->queue_head == NULL)
+    {
+        data->queue_tail = NULL;
+    }
+
+    platform_exit_critical();
+
+    if (transfer == &data->direct)
+    {
+        data->direct_pending = 0;
+    }
+
+    if (transfer->handler)
+    {
+        transfer->handler(transfer->arg, (state != I2C_IDLE));
+    }
+
+    // Not started by the handler
+    if (data->queue_head && data->state == I2C_IDLE)
+    {
+        tx_rx_start(_i2c, data->queue_head);
     }
 }
 
@@ -33,6 +33,7 @@
 #include "rcc.h"
 #include "nvic.h"
 #include "gpio.h"
+#include "dma.h"
 #include "handler.h"
 
 #ifdef I2C__SLAVE_SUPPORT
@@ -48,6 +49,7 @@ typedef enum
     I2C_RECEIVING_DATA = 4,
     I2C_SENDING_RESTART = 5,
     I2C_ERROR = 6,
+    I2C_RECEIVING_DMA = 7,
 #ifdef I2C__SLAVE_SUPPORT
     I2C_SL_TX,
     I2C_SL_RX,
@@ -68,9 +70,14 @@ typedef struct
     uint32_t len_recv;
     uint32_t cpt_recv;
     uint8_t *buf_recv;
-    // Non-blocking end-transfer handler
-    result_handler_t transfer_handler;
-    handler_arg_t transfer_handler_arg;
+    // Transfer queue, the head is in progress
+    i2c_transfer_t *queue_head, *queue_tail;
+    // Transfer used by the direct calls
+    i2c_transfer_t direct;
+    volatile int direct_pending;
+    // DMA channel for the receptions of 2 bytes or more, may be NULL
+    dma_t dma_channel_rx;
+    i2c_stats_t stats;
 #ifdef I2C__SLAVE_SUPPORT
     i2c_slave_handler_t slave_handler;
 #endif
@@ -96,6 +103,11 @@ typedef struct
     .data = &name##_data \
 }
 
+static inline void i2c_set_dma(const _i2c_t* _i2c, dma_t dma_rx)
+{
+    _i2c->data->dma_channel_rx = dma_rx;
+}
+
 void i2c_handle_ev_interrupt(const _i2c_t *_i2c);
 void i2c_handle_er_interrupt(const _i2c_t *_i2c);
 
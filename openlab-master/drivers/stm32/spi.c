@@ -42,6 +42,16 @@ static inline void cancel_interrupt(const _spi_t *_spi);
 
 static void transfer_done(const _spi_t *spi);
 
+static uint16_t config_cr1(const _spi_t *_spi, uint32_t baudrate,
+                           spi_clock_mode_t clock_mode);
+static void queue_next(const _spi_t *_spi);
+static void request_done(handler_arg_t arg);
+
+/* Requests shorter than this are transferred with the interrupts */
+#ifndef SPI_DMA_MIN_LENGTH
+#define SPI_DMA_MIN_LENGTH 8
+#endif
+
 void spi_enable(spi_t spi, uint32_t baudrate, spi_clock_mode_t clock_mode)
 {
     const _spi_t *_spi = spi;
@@ -58,6 +68,20 @@ void spi_enable(spi_t spi, uint32_t baudrate, spi_clock_mode_t clock_mode)
     // Enable interrupts in NVIC
     nvic_enable_interrupt_line(_spi->irq_line);
 
+    // Set baudrate, clock polarity, and master mode, soft NSS
+    _spi->data->cr1 = config_cr1(_spi, baudrate, clock_mode);
+    *spi_get_CR1(_spi) = _spi->data->cr1;
+
+    // Set CRC 7
+    *spi_get_CRCPR(_spi) = 7;
+
+    // Enable SPI
+    *spi_get_CR1(_spi) |= SPI_CR1__SPE;
+}
+
+static uint16_t config_cr1(const _spi_t *_spi, uint32_t baudrate,
+                           spi_clock_mode_t clock_mode)
+{
     // Compute divider
     uint16_t divider;
     uint32_t pclk;
@@ -83,15 +107,7 @@ void spi_enable(spi_t spi, uint32_t baudrate, spi_clock_mode_t clock_mode)
     // Set register value
     divider <<= 3;
 
-    // Set baudrate, clock polarity, and master mode, soft NSS
-    *spi_get_CR1(_spi) = SPI_CR1__SSM | SPI_CR1__SSI | divider | SPI_CR1__MSTR
-                         | clock_mode;
-
-    // Set CRC 7
-    *spi_get_CRCPR(_spi) = 7;
-
-    // Enable SPI
-    *spi_get_CR1(_spi) |= SPI_CR1__SPE;
+    return SPI_CR1__SSM | SPI_CR1__SSI | divider | SPI_CR1__MSTR | clock_mode;
 }
 void spi_disable(spi_t spi)
 {
@@ -209,6 +225,164 @@ void spi_async_cancel(spi_t spi)
     }
 }
 
+void spi_device_init(spi_device_t *device)
+{
+    device->cr1 = 0;
+
+    if (device->baudrate)
+    {
+        device->cr1 = config_cr1(device->spi, device->baudrate,
+                                 device->clock_mode);
+    }
+
+    gpio_enable(device->cs_gpio);
+    gpio_set_output(device->cs_gpio, device->cs_pin);
+    gpio_pin_set(device->cs_gpio, device->cs_pin);
+}
+
+void spi_submit(spi_request_t *request)
+{
+    const _spi_t *_spi = request->device->spi;
+    _spi_data_t *data = _spi->data;
+
+    request->next = NULL;
+
+    // Handlers submit from interrupt context
+    platform_enter_critical();
+
+    if (data->queue_tail[request->priority])
+    {
+        data->queue_tail[request->priority]->next = request;
+    }
+    else
+    {
+        data->queue_head[request->priority] = request;
+    }
+
+    data->queue_tail[request->priority] = request;
+    platform_exit_critical();
+
+    queue_next(_spi);
+}
+
+/*
+ * Start the first request of the highest priority, if the bus is free
+ */
+static void queue_next(const _spi_t *_spi)
+{
+    _spi_data_t *data = _spi->data;
+    spi_request_t *req = NULL, *prev;
+    uint16_t cr1;
+    int p;
+
+    platform_enter_critical();
+
+    for (p = 0; (p < SPI_PRIORITY_NUM) && !data->current && !req; p++)
+    {
+        for (prev = NULL, req = data->queue_head[p]; req;
+                prev = req, req = req->next)
+        {
+            // While a chip select is low, the other devices wait
+            if (!data->locked || (req->device == data->locked))
+            {
+                break;
+            }
+        }
+
+        if (req == NULL)
+        {
+            continue;
+        }
+
+        // Remove from the queue
+        if (prev)
+        {
+            prev->next = req->next;
+        }
+        else
+        {
+            data->queue_head[p] = req->next;
+        }
+
+        if (data->queue_tail[p] == req)
+        {
+            data->queue_tail[p] = prev;
+        }
+
+        data->current = req;
+    }
+
+    platform_exit_critical();
+
+    if (req == NULL)
+    {
+        return;
+    }
+
+    // Configure the bus for the device, SPE cleared while changing
+    cr1 = req->device->cr1 ? req->device->cr1 : data->cr1;
+
+    if ((*spi_get_CR1(_spi) & ~SPI_CR1__SPE) != cr1)
+    {
+        *spi_get_CR1(_spi) = cr1;
+        *spi_get_CR1(_spi) = cr1 | SPI_CR1__SPE;
+    }
+
+    gpio_pin_clear(req->device->cs_gpio, req->device->cs_pin);
+
+    if (req->length == 0)
+    {
+        request_done((handler_arg_t) _spi);
+        return;
+    }
+
+    data->transfer_handler = request_done;
+    data->transfer_handler_arg = (handler_arg_t) _spi;
+
+    // Notify of ongoing underground transfer
+    platform_prevent_low_power();
+
+    if (data->dma_channel_rx && data->dma_channel_tx
+            && (req->length >= SPI_DMA_MIN_LENGTH))
+    {
+        transfer_dma(_spi, req->tx_buffer, req->rx_buffer, req->length);
+    }
+    else
+    {
+        transfer_interrupt(_spi, req->tx_buffer, req->rx_buffer, req->length);
+    }
+}
+
+/*
+ * End of the request in progress, start the next one
+ */
+static void request_done(handler_arg_t arg)
+{
+    const _spi_t *_spi = arg;
+    _spi_data_t *data = _spi->data;
+    spi_request_t *req = data->current;
+
+    if (req->keep_cs)
+    {
+        data->locked = req->device;
+    }
+    else
+    {
+        gpio_pin_set(req->device->cs_gpio, req->device->cs_pin);
+        data->locked = NULL;
+    }
+
+    data->transfer_handler = NULL;
+    data->current = NULL;
+
+    if (req->handler)
+    {
+        req->handler(req->handler_arg);
+    }
+
+    queue_next(_spi);
+}
+
 static inline void transfer_dma(const _spi_t *_spi, const uint8_t *tx_buffer,
                                 uint8_t *rx_buffer, uint16_t length)
 {
@@ -37,6 +37,9 @@
 #include "dma.h"
 #include "handler.h"
 
+/* Number of request priority levels */
+#define SPI_PRIORITY_NUM 3
+
 typedef struct
 {
     // For DMA based asynchronous transfer, record the DMAs.
@@ -51,6 +54,14 @@ typedef struct
     handler_t transfer_handler;
     handler_arg_t transfer_handler_arg;
 
+    // Queued requests by priority, and the request in progress
+    spi_request_t *queue_head[SPI_PRIORITY_NUM], *queue_tail[SPI_PRIORITY_NUM];
+    spi_request_t *current;
+    // Device keeping its chip select low
+    const spi_device_t *locked;
+    // Configuration given to spi_enable
+    uint16_t cr1;
+
 } _spi_data_t;
 
 typedef struct
@@ -163,7 +163,7 @@ inline void usb_set_next_data_callback(uint8_t endp, usb_data_callback_t cb)
     data_callback[endp] = cb;
 }
 
-static void usb_write_pma(uint8_t addr, const uint8_t *buf, uint16_t len)
+static void usb_copy_to_pma(uint32_t pma, const uint8_t *buf, uint16_t len)
 {
     uint16_t i;
     uint16_t m;
@@ -172,7 +172,7 @@ static void usb_write_pma(uint8_t addr, const uint8_t *buf, uint16_t len)
 
     // cast to void to ignore warning: cast increases required alignment of target type
     data          = (const void *)buf; 
-    packet_memory = usb_get_packet_memory(*usb_get_ADDRn_TX(addr));
+    packet_memory = usb_get_packet_memory(pma);
 
     // upper bound 
     m = (len / 2) + (len & 1); 
@@ -184,6 +184,11 @@ static void usb_write_pma(uint8_t addr, const uint8_t *buf, uint16_t len)
     }
 }
 
+static void usb_write_pma(uint8_t addr, const uint8_t *buf, uint16_t len)
+{
+    usb_copy_to_pma(*usb_get_ADDRn_TX(addr), buf, len);
+}
+
 uint16_t usb_write_packet(uint8_t endp, const uint8_t *buf, uint16_t len)
 {
     usb_write_pma(endp, buf, len);
@@ -195,7 +200,7 @@ uint16_t usb_write_packet(uint8_t endp, const uint8_t *buf, uint16_t len)
     return len;
 }
 
-static void usb_read_pma(uint8_t endp, uint8_t *buf, uint16_t len)
+static void usb_copy_from_pma(uint32_t pma, uint8_t *buf, uint16_t len)
 {
     uint16_t i;
     uint16_t m;
@@ -204,7 +209,7 @@ static void usb_read_pma(uint8_t endp, uint8_t *buf, uint16_t len)
 
     // cast to void to ignore warning: cast increases required alignment of target type
     data          = (void *)buf; 
-    packet_memory = usb_get_packet_memory(*usb_get_ADDRn_RX(endp & 0x7));
+    packet_memory = usb_get_packet_memory(pma);
 
     // lower bound 
     m = (len / 2);
@@ -221,6 +226,11 @@ static void usb_read_pma(uint8_t endp, uint8_t *buf, uint16_t len)
     }
 }
 
+static void usb_read_pma(uint8_t endp, uint8_t *buf, uint16_t len)
+{
+    usb_copy_from_pma(*usb_get_ADDRn_RX(endp & 0x7), buf, len);
+}
+
 void usb_recv(uint8_t endp, uint8_t *buf, uint16_t len)
 {
     //! \todo do some additional check
@@ -333,12 +343,122 @@ void usb_send_set_status(uint8_t endp, stat_bits_t stat)
     usb_set_stat_tx(endp,stat);
 }
 
+/*
+ * Double buffered endpoints
+ *
+ * Buffer 0 uses the ADDRn_TX / COUNTn_TX entries and buffer 1 the
+ * ADDRn_RX / COUNTn_RX entries, for both directions. The peripheral
+ * uses the buffer selected by DTOG and the application the one
+ * selected by SW_BUF (DTOG_RX for IN endpoints, DTOG_TX for OUT
+ * endpoints). When DTOG == SW_BUF the peripheral NAKs the host until
+ * the application toggles SW_BUF.
+ */
+
+static bool usb_dbl_buffer(uint8_t endp, bool in)
+{
+    return (*usb_get_EPnR(endp) & (in ? USB_EPnR__DTOG_RX : USB_EPnR__DTOG_TX)) != 0;
+}
+
+static bool usb_dbl_owned(uint8_t endp)
+{
+    uint32_t reg = *usb_get_EPnR(endp);
+    return ((reg & USB_EPnR__DTOG_TX) != 0) == ((reg & USB_EPnR__DTOG_RX) != 0);
+}
+
+void usb_dbl_send(uint8_t endp, const uint8_t *buf, uint16_t len)
+{
+    endp &= 0x7F;
+
+    if (usb_dbl_buffer(endp, true))
+    {
+        usb_copy_to_pma(*usb_get_ADDRn_RX(endp), buf, len);
+        *usb_get_COUNTn_RX(endp) = len;
+    }
+    else
+    {
+        usb_copy_to_pma(*usb_get_ADDRn_TX(endp), buf, len);
+        *usb_get_COUNTn_TX(endp) = len;
+    }
+}
+
+void usb_dbl_send_release(uint8_t endp)
+{
+    usb_toggle_dtog_rx(endp & 0x7F);
+}
+
+bool usb_dbl_send_pending(uint8_t endp)
+{
+    return !usb_dbl_owned(endp & 0x7F);
+}
+
+bool usb_dbl_recv_pending(uint8_t endp)
+{
+    return usb_dbl_owned(endp & 0x7F);
+}
+
+void usb_dbl_recv_release(uint8_t endp)
+{
+    usb_toggle_dtog_tx(endp & 0x7F);
+}
+
+uint16_t usb_dbl_recv_get_len(uint8_t endp)
+{
+    endp &= 0x7F;
+
+    if (usb_dbl_buffer(endp, false))
+    {
+        return (*usb_get_COUNTn_RX(endp)) & USB_COUNTn_RX__COUNTn_RX_MASK;
+    }
+    return (*usb_get_COUNTn_TX(endp)) & USB_COUNTn_RX__COUNTn_RX_MASK;
+}
+
+void usb_dbl_recv(uint8_t endp, uint8_t *buf, uint16_t len)
+{
+    endp &= 0x7F;
+
+    if (usb_dbl_buffer(endp, false))
+    {
+        usb_copy_from_pma(*usb_get_ADDRn_RX(endp), buf, len);
+    }
+    else
+    {
+        usb_copy_from_pma(*usb_get_ADDRn_TX(endp), buf, len);
+    }
+}
+
 uint16_t usb_get_max_packet_size(uint8_t endp)
 {
     return descriptor_max_pkt_size[endp & 0x7f];
 }
 
-static void usb_endpoint_init(uint8_t endp, usb_endp_type_t type, uint16_t len, usb_endpoint_callback_t callback)
+/* COUNTn_RX value for a reception buffer of len bytes */
+static uint16_t usb_rx_count(uint16_t len)
+{
+    uint16_t l = len;
+
+    if (l >= 63)
+    {
+        if (l & 0x1F)
+        {
+            l += 32;
+        }
+
+        l = 0x8000 | ((l & 0xFFE0) << 5);
+    }
+    else
+    {
+        if (l & 0x1)
+        {
+            l++;
+        }
+
+        l <<= 9;
+    }
+
+    return l;
+}
+
+static void usb_endpoint_init(uint8_t endp, usb_endp_type_t type, uint16_t len, bool double_buffered, usb_endpoint_callback_t callback)
 {
     uint8_t dir = endp & 0x80, addr = endp & 0x7F;
     uint16_t l = len;
@@ -374,13 +494,23 @@ static void usb_endpoint_init(uint8_t endp, usb_endp_type_t type, uint16_t len,
     }
 
     log_info("Endpoint init: 0x%02x (type: %d), start: %d len: %d, callback: 0x%X", endp, type, memory_start, len, callback);
-    if (memory_start >= USB_PMA_SIZE)
+    if ((memory_start + (double_buffered ? 2 * len : len)) > USB_PMA_SIZE)
     {
 	log_error("USB memory exceeded, new start address is at %d",memory_start);
     }
 
     *usb_get_EPnR(addr) = ((*usb_get_EPnR(addr)) & 0x8980) | t | addr;
 
+    if (type == USB_ENDPOINT_BULK)
+    {
+        // EP_KIND is DBL_BUF for bulk endpoints
+        usb_set_ep_kind(addr, double_buffered);
+    }
+    else
+    {
+        double_buffered = false;
+    }
+
     if (type == USB_ENDPOINT_CONTROL)
     {
         *usb_get_ADDRn_TX(addr) = memory_start;
@@ -388,26 +518,7 @@ static void usb_endpoint_init(uint8_t endp, usb_endp_type_t type, uint16_t len,
         *usb_get_ADDRn_RX(addr) = memory_start;
         memory_start += len;
 
-        if (l >= 63)
-        {
-            if (l & 0x1F)
-            {
-                l += 32;
-            }
-
-            l = 0x8000 | ((l & 0xFFE0) << 5);
-        }
-        else
-        {
-            if (l & 0x1)
-            {
-                l++;
-            }
-
-            l <<= 9;
-        }
-
-        *usb_get_COUNTn_RX(addr) = l;
+        *usb_get_COUNTn_RX(addr) = usb_rx_count(l);
         *usb_get_COUNTn_TX(addr) = 0;
 
         usb_set_stat_tx(addr, STAT_TX_NAK);
@@ -416,6 +527,37 @@ static void usb_endpoint_init(uint8_t endp, usb_endp_type_t type, uint16_t len,
         usb_set_dtog_tx(addr, 0);
         usb_set_dtog_rx(addr, 0);
     }
+    else if (double_buffered)
+    {
+        // Buffer 0 in the TX entries, buffer 1 in the RX entries
+        *usb_get_ADDRn_TX(addr) = memory_start;
+        memory_start += len;
+        *usb_get_ADDRn_RX(addr) = memory_start;
+        memory_start += len;
+
+        usb_set_dtog_tx(addr, 0);
+        usb_set_dtog_rx(addr, 0);
+
+        if (dir)
+        {
+            // SW_BUF == DTOG_TX: both buffers belong to the application
+            *usb_get_COUNTn_TX(addr) = 0;
+            *usb_get_COUNTn_RX(addr) = 0;
+            usb_set_stat_rx(addr, STAT_RX_DISABLED);
+            usb_set_stat_tx(addr, STAT_TX_VALID);
+        }
+        else
+        {
+            // SW_BUF != DTOG_RX: the peripheral receives in buffer 0
+            *usb_get_COUNTn_TX(addr) = usb_rx_count(l);
+            *usb_get_COUNTn_RX(addr) = usb_rx_count(l);
+            usb_set_dtog_tx(addr, 1);
+            usb_set_stat_tx(addr, STAT_TX_DISABLED);
+            usb_set_stat_rx(addr, STAT_RX_VALID);
+        }
+
+        endpoint_callback[addr - 1] = callback;
+    }
     else
     {
         if (dir)
@@ -430,27 +572,7 @@ static void usb_endpoint_init(uint8_t endp, usb_endp_type_t type, uint16_t len,
         else
         {
             *usb_get_ADDRn_RX(addr) = memory_start;
-
-            if (l >= 63)
-            {
-                if (l & 0x1F)
-                {
-                    l += 32;
-                }
-
-                l = 0x8000 | ((l & 0xFFE0) << 5);
-            }
-            else
-            {
-                if (l & 0x1)
-                {
-                    l++;
-                }
-
-                l <<= 9;
-            }
-
-            *usb_get_COUNTn_RX(addr) = l;
+            *usb_get_COUNTn_RX(addr) = usb_rx_count(l);
 
             usb_set_stat_tx(addr, STAT_TX_NAK);
             usb_set_stat_rx(addr, STAT_RX_VALID);
@@ -565,7 +687,7 @@ static void register_enpoint_callbacks()
             {
                 endpoint = &(interface->endpoint_descriptors[k]);
 
-                usb_endpoint_init(endpoint->bEndpointAddress, endpoint->bmAttributes, endpoint->wMaxPacketSize, endpoint->endpoint_callback);
+                usb_endpoint_init(endpoint->bEndpointAddress, endpoint->bmAttributes, endpoint->wMaxPacketSize, endpoint->double_buffered, endpoint->endpoint_callback);
             }
         }
     }
@@ -1068,9 +1190,14 @@ static inline void usb_correct_transfer()
         rx = endp_reg & USB_EPnR__CTR_RX;
         tx = endp_reg & USB_EPnR__CTR_TX;
 
-        // Set both status to NAK
-        usb_set_stat_tx(endp, STAT_TX_NAK);
-        usb_set_stat_rx(endp, STAT_RX_NAK);
+        // Set both status to NAK, double buffered endpoints flow control
+        // is done by the buffer toggles and they must stay valid
+        if ((endp_reg & (USB_EPnR__EP_TYPE_MASK | USB_EPnR__EP_KIND))
+                != USB_EPnR__EP_KIND)
+        {
+            usb_set_stat_tx(endp, STAT_TX_NAK);
+            usb_set_stat_rx(endp, STAT_RX_NAK);
+        }
 
         if (endp == 0)
         {
@@ -1156,7 +1283,7 @@ void usb_handle_interrupt()
 
         // As a reset occured we must enable the USB function
         // and implement the default control endpoint (endpoint 0)
-        usb_endpoint_init(0, USB_ENDPOINT_CONTROL, usb_profile->device_descriptor->bMaxPacketSize0, (usb_endpoint_callback_t)0);
+        usb_endpoint_init(0, USB_ENDPOINT_CONTROL, usb_profile->device_descriptor->bMaxPacketSize0, false, (usb_endpoint_callback_t)0);
 
 	// Set default configuration / interface
 	usb_configuration = 0;
@@ -173,6 +173,21 @@ static inline void usb_set_dtog_rx(uint8_t addr, uint8_t bit)
     *usb_get_EPnR(addr) = ((*usb_get_EPnR(addr)) & ((~USB_EPnR__ALL_TOGGLE) | USB_EPnR__DTOG_RX)) ^(bit ? USB_EPnR__DTOG_RX : 0); // DTOG_RX = bit
 }
 
+static inline void usb_toggle_dtog_tx(uint8_t addr)
+{
+    *usb_get_EPnR(addr) = ((*usb_get_EPnR(addr)) & (~USB_EPnR__ALL_TOGGLE)) | USB_EPnR__DTOG_TX; // DTOG_TX ^= 1
+}
+
+static inline void usb_toggle_dtog_rx(uint8_t addr)
+{
+    *usb_get_EPnR(addr) = ((*usb_get_EPnR(addr)) & (~USB_EPnR__ALL_TOGGLE)) | USB_EPnR__DTOG_RX; // DTOG_RX ^= 1
+}
+
+static inline void usb_set_ep_kind(uint8_t addr, uint8_t bit)
+{
+    *usb_get_EPnR(addr) = ((*usb_get_EPnR(addr)) & ~(USB_EPnR__ALL_TOGGLE | USB_EPnR__EP_KIND)) | (bit ? USB_EPnR__EP_KIND : 0); // EP_KIND = bit
+}
+
 static inline uint16_t usb_get_rx_len(uint8_t addr)
 {
     return (*usb_get_COUNTn_RX(addr)) & USB_COUNTn_RX__COUNTn_RX_MASK;
@@ -27,6 +27,8 @@
 #include "adc_.h"
 #include "adc_registers.h"
 
+static void scan_half(handler_arg_t arg, unsigned half);
+
 void adc_enable(adc_t adc)
 {
     const _adc_t *_adc = adc;
@@ -108,6 +110,120 @@ void adc_sample_single(adc_t adc)
     *adc_get_CR2(_adc) |= ADCx_CR2__ADON;
 }
 
+void adc_config_scan(adc_t adc, const uint8_t *channels, uint8_t num_channels,
+                     adc_trigger_t trigger)
+{
+    const _adc_t *_adc = adc;
+    uint32_t sqr[3] = {0, 0, 0};
+    uint32_t cr2;
+    uint8_t i;
+
+    // Sequences of 6 channels per register, SQR3 first
+    for (i = 0; i < num_channels; i++)
+    {
+        sqr[i / 6] |= (channels[i] & 0x1F) << (5 * (i % 6));
+    }
+
+    *adc_get_JSQR(_adc) = 0;
+    *adc_get_SQRx(_adc, 3) = sqr[0];
+    *adc_get_SQRx(_adc, 2) = sqr[1];
+    *adc_get_SQR1(_adc) = sqr[2] | ((num_channels - 1) << 20);
+
+    // Scan mode, the DMA takes the conversions, no interrupt
+    *adc_get_CR1(_adc) = ADCx_CR1__SCAN;
+
+    // Power up before changing the configuration, not to start a conversion
+    cr2 = (*adc_get_CR2(_adc) & ADCx_CR2__TSVREFE) | ADCx_CR2__ADON;
+    *adc_get_CR2(_adc) = cr2;
+    *adc_get_CR2(_adc) = cr2 | ADCx_CR2__DMA | ADCx_CR2__EXTTRIG
+                         | ((trigger << 17) & ADCx_CR2__EXTSEL_MASK);
+
+    _adc->data->num_channels = num_channels;
+}
+
+int32_t adc_start_scan(adc_t adc, uint16_t *buffer, uint16_t num_scans,
+                       uint8_t decimation, adc_scan_handler_t handler,
+                       handler_arg_t arg)
+{
+    const _adc_t *_adc = adc;
+    _adc_data_t *data = _adc->data;
+
+    if (data->dma_channel == NULL)
+    {
+        return 1;
+    }
+
+    data->scan_buffer = buffer;
+    data->num_scans = num_scans;
+    data->decimation = decimation ? decimation : 1;
+    data->scan_handler = handler;
+    data->scan_handler_arg = arg;
+
+    dma_config(data->dma_channel, (uint32_t) adc_get_DR(_adc),
+               (uint32_t) buffer, 2 * num_scans * data->num_channels,
+               DMA_SIZE_16bit, DMA_DIRECTION_FROM_PERIPHERAL, DMA_INCREMENT_ON);
+    dma_start_circular(data->dma_channel, scan_half, (handler_arg_t) _adc);
+
+    return 0;
+}
+
+void adc_stop_scan(adc_t adc)
+{
+    const _adc_t *_adc = adc;
+
+    // Ignore the triggers, then stop the DMA
+    *adc_get_CR2(_adc) &= ~(ADCx_CR2__EXTTRIG | ADCx_CR2__DMA);
+
+    if (_adc->data->dma_channel)
+    {
+        dma_cancel(_adc->data->dma_channel);
+    }
+}
+
+/*
+ * A half buffer is full, average the groups of scans and give it
+ */
+static void scan_half(handler_arg_t arg, unsigned half)
+{
+    const _adc_t *_adc = arg;
+    _adc_data_t *data = _adc->data;
+    uint16_t *samples = data->scan_buffer
+                        + half * data->num_scans * data->num_channels;
+    uint16_t num_scans = data->num_scans;
+
+    if (data->decimation > 1)
+    {
+        uint16_t scan, c;
+        uint8_t d;
+
+        num_scans /= data->decimation;
+
+        // Each average is written before the samples it uses
+        for (scan = 0; scan < num_scans; scan++)
+        {
+            const uint16_t *group = samples
+                                    + scan * data->decimation * data->num_channels;
+
+            for (c = 0; c < data->num_channels; c++)
+            {
+                uint32_t sum = 0;
+
+                for (d = 0; d < data->decimation; d++)
+                {
+                    sum += group[d * data->num_channels + c];
+                }
+
+                samples[scan * data->num_channels + c] = sum / data->decimation;
+            }
+        }
+    }
+
+    if (data->scan_handler)
+    {
+        data->scan_handler(data->scan_handler_arg, samples, num_scans);
+    }
+}
+
 void adc_handle_interrupt(const _adc_t *_adc)
 {
     // Read the SR register
@@ -31,6 +31,7 @@
 #include "rcc.h"
 #include "nvic.h"
 #include "timer.h"
+#include "dma.h"
 
 typedef struct
 {
@@ -41,6 +42,17 @@ typedef struct
     adc_handler_t handler;
     /** The conversion handler argument. */
     handler_arg_t handler_arg;
+
+    /** The DMA channel for the scans, may be NULL */
+    dma_t dma_channel;
+    /** The scan configuration */
+    uint8_t num_channels;
+    uint8_t decimation;
+    uint16_t num_scans;
+    uint16_t *scan_buffer;
+    /** The scan handler */
+    adc_scan_handler_t scan_handler;
+    handler_arg_t scan_handler_arg;
 } _adc_data_t;
 
 typedef struct
@@ -67,6 +79,11 @@ typedef struct
     .data = &name##_data \
 }
 
+static inline void adc_set_dma(const _adc_t *_adc, dma_t dma)
+{
+    _adc->data->dma_channel = dma;
+}
+
 /**
  * Handle an interrupt.
  */
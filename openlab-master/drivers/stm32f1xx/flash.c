@@ -26,10 +26,13 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
 
 #include "rcc.h"
 #include "flash.h"
+#include "flash_ram.h"
 #include "flash_registers.h"
+#include "boot.h"
 #include "printf.h"
 
 enum
@@ -146,11 +149,138 @@ flash_status_t flash_write_memory_half_word(uint32_t address, uint16_t half_word
     return FLASH_OK;
 }
 
-void flash_copy_upper_to_lower()
+flash_status_t flash_erase_page(uint32_t address)
 {
-    //! \todo implement copy from upper to lower flash area
+    bool hsi_enabled = rcc_is_hsi_enabled();
+    uint32_t sr;
+
+    // Check the address is a page border
+    if (address % FLASH_SIZE_PAGE)
+    {
+        return FLASH_ERR_INVALID_ADDRESS;
+    }
+
+    // According to PM0075 HSI must be enable when erasing
+    if (!hsi_enabled)
+    {
+        rcc_hsi_enable();
+    }
+
+    unlock_program_memory();
+
+    // Clear previous errors, flags are cleared by writing 1
+    *flash_get_SR() = FLASH_SR__PGERR | FLASH_SR__WRPRTERR | FLASH_SR__EOP;
+
+    *flash_get_CR() = FLASH_CR__PER;
+    *flash_get_AR() = address;
+    *flash_get_CR() = FLASH_CR__PER | FLASH_CR__STRT;
+
+    while (*flash_get_SR() & FLASH_SR__BSY)
+    {
+    }
+
+    sr = *flash_get_SR();
+    *flash_get_CR() = 0;
+    lock_program_memory();
+
+    if (!hsi_enabled)
+    {
+        rcc_hsi_disable();
+    }
+
+    return (sr & FLASH_SR__WRPRTERR) ? FLASH_ERR_PROGRAM : FLASH_OK;
+}
+
+flash_status_t flash_program(uint32_t address, const uint32_t *words,
+        uint32_t word_number)
+{
+    bool hsi_enabled = rcc_is_hsi_enabled();
+    uint32_t sr = 0;
+    uint32_t i;
+
+    if (address % 4)
+    {
+        return FLASH_ERR_INVALID_ADDRESS;
+    }
+
+    // According to PM0075 HSI must be enable when writing
+    if (!hsi_enabled)
+    {
+        rcc_hsi_enable();
+    }
+
+    unlock_program_memory();
+    *flash_get_SR() = FLASH_SR__PGERR | FLASH_SR__WRPRTERR | FLASH_SR__EOP;
+    *flash_get_CR() = FLASH_CR__PG;
+
+    // Program by half words, interrupts are served between two of them
+    for (i = 0; i < 2 * word_number; i++)
+    {
+        *mem_get_reg16(address + 2 * i) = ((const uint16_t *) words)[i];
+
+        while (*flash_get_SR() & FLASH_SR__BSY)
+        {
+        }
+
+        sr = *flash_get_SR();
+        if (sr & (FLASH_SR__PGERR | FLASH_SR__WRPRTERR))
+        {
+            break;
+        }
+    }
+
+    *flash_get_CR() = 0;
+    lock_program_memory();
+
+    if (!hsi_enabled)
+    {
+        rcc_hsi_disable();
+    }
+
+    return (sr & (FLASH_SR__PGERR | FLASH_SR__WRPRTERR)) ?
+           FLASH_ERR_PROGRAM : FLASH_OK;
 }
 
+void flash_copy_upper_to_lower(uint32_t length)
+{
+    // Round to pages
+    length = (length + FLASH_SIZE_PAGE - 1) & ~(FLASH_SIZE_PAGE - 1);
+
+    // Disable interrupts, the copy ends with a reset
+    asm volatile("cpsid i\n");
+
+    // According to PM0075 HSI must be enable when writing
+    rcc_hsi_enable();
+    unlock_program_memory();
+
+#define RAM_CODE_LENGTH ((uint32_t) flash_ram_copy_all_end - (uint32_t) flash_ram_copy_all)
+    uint8_t ram_code[RAM_CODE_LENGTH + 3];
+
+    void (*ram_func)(uint32_t length) =
+        (void( *)(uint32_t))(((uint32_t) ram_code + 3) & ~0x3);
+
+    uint32_t func_i, copy_i;
+    func_i = ((uint32_t) ram_func) & ~0x3;
+    copy_i = ((uint32_t) flash_ram_copy_all) & ~0x3;
+
+    // Copy
+    memcpy((void *) func_i, (void *) copy_i, RAM_CODE_LENGTH);
+
+    // Set pointer
+    ram_func = (void( *)(uint32_t))(func_i | 0x1);
+
+    // Call, does not return
+    ram_func(length);
+}
+
+/* Firmware staging area, installed by the boot stage */
+const boot_staging_t boot_staging =
+{
+    .start   = FLASH_MEMORY_UPPER,
+    .size    = FLASH_MEMORY_HALF_SIZE,
+    .install = flash_copy_upper_to_lower
+};
+
 static void unlock_program_memory()
 {
     // Unlock FPEC
@@ -50,7 +50,8 @@ typedef enum
     FLASH_OK                   = 0,
     FLASH_ERR_INVALID_ADDRESS  = 1,
     FLASH_ERR_INVALID_LENGTH   = 2,
-    FLASH_ERR_VALUE_NOT_COPIED = 3
+    FLASH_ERR_VALUE_NOT_COPIED = 3,
+    FLASH_ERR_PROGRAM          = 4
 } flash_status_t;
 
 void flash_set_wait_cycle(flash_wait_cycle_t cycles);
@@ -59,7 +60,13 @@ void flash_set_wait_cycle(flash_wait_cycle_t cycles);
 flash_status_t flash_erase_memory_page(uint32_t address);
 flash_status_t flash_write_memory_half_word(uint32_t address, uint16_t half_word);
 
-/* Full memory copy */
-void flash_copy_upper_to_lower();
+/* Block write, the memory is unlocked once and the data is not read back */
+flash_status_t flash_erase_page(uint32_t address);
+flash_status_t flash_program(uint32_t address, const uint32_t *words,
+        uint32_t word_number);
+
+/* Copy of the first length bytes of the upper half, and of its last page,
+ * over the lower half, then reset */
+void flash_copy_upper_to_lower(uint32_t length);
 
 #endif /* FLASH_H_ */
@@ -0,0 +1,81 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2012 HiKoB.
+ */
+
+/*
+ * flash_ram.c
+ */
+#include <stdint.h>
+#include "flash.h"
+#include "flash_ram.h"
+#include "flash_registers.h"
+#include "cm3_memmap.h"
+
+#define FLASH_REG(offset) (*((volatile uint32_t *)(FLASH_BASE_ADDRESS + (offset))))
+
+void flash_ram_copy_all(uint32_t length)
+{
+    uint32_t offset, i;
+
+    for (offset = 0; offset < FLASH_MEMORY_HALF_SIZE; offset += FLASH_SIZE_PAGE)
+    {
+        // The last page holds the image header
+        if ((offset >= length)
+                && (offset != FLASH_MEMORY_HALF_SIZE - FLASH_SIZE_PAGE))
+        {
+            continue;
+        }
+
+        // Erase the lower page
+        FLASH_REG(FLASH_CR_OFFSET) = FLASH_CR__PER;
+        FLASH_REG(FLASH_AR_OFFSET) = FLASH_MEMORY_LOWER + offset;
+        FLASH_REG(FLASH_CR_OFFSET) = FLASH_CR__PER | FLASH_CR__STRT;
+
+        while (FLASH_REG(FLASH_SR_OFFSET) & FLASH_SR__BSY)
+        {
+        }
+
+        // Program it by half words
+        FLASH_REG(FLASH_CR_OFFSET) = FLASH_CR__PG;
+
+        for (i = 0; i < FLASH_SIZE_PAGE / 2; i++)
+        {
+            ((volatile uint16_t *)(FLASH_MEMORY_LOWER + offset))[i] =
+                ((const uint16_t *)(FLASH_MEMORY_UPPER + offset))[i];
+
+            while (FLASH_REG(FLASH_SR_OFFSET) & FLASH_SR__BSY)
+            {
+            }
+        }
+
+        FLASH_REG(FLASH_CR_OFFSET) = 0;
+    }
+
+    // Force reset
+    *((volatile uint32_t *)(CM3_SCB_BASE_ADDRESS + CM3_SCB_AIRCR_OFFSET))
+    = 0x05FA0004;
+
+    while (1)
+    {
+    }
+}
+
+void flash_ram_copy_all_end()
+{
+    asm volatile("nop");
+}
@@ -0,0 +1,41 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2012 HiKoB.
+ */
+
+/*
+ * flash_ram.h
+ */
+
+#ifndef FLASH_RAM_H_
+#define FLASH_RAM_H_
+
+#include <stdint.h>
+
+/**
+ * Copy the first pages of the upper flash half and its last page over the
+ * lower half, then reset.
+ *
+ * This function is copied to RAM before being called, it must not call any
+ * other function. The flash must be unlocked.
+ *
+ * \param length the length to copy, a multiple of the page size
+ */
+void flash_ram_copy_all(uint32_t length);
+void flash_ram_copy_all_end();
+
+#endif /* FLASH_RAM_H_ */
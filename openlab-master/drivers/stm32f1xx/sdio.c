@@ -40,6 +40,11 @@
 #define MAX_VOLT_TRY   10000
 #define MAX_CMD_TRY    10
 #define MAX_WRITE_WAIT 10000
+
+// Data timeout for multiple blocks transfers, 250ms at 25MHz
+#define MULTI_BLOCK_DTIMER (25000000 / 4)
+// Max number of blocks in one DMA transfer (65535 words)
+#define MAX_DMA_BLOCKS 511
 //#define DEBUG
 
 typedef enum
@@ -52,14 +57,18 @@ typedef enum
     SD_SEND_IF_COND         =  8,  // CMD8
     SD_SEND_CSD             =  9,  // CMD9
     SD_SEND_CID             =  10, // CMD10
+    SD_STOP_TRANSMISSION    =  12, // CMD12
     SD_SEND_STATUS          =  13, // CMD13
     SD_SET_BLOCKLEN         =  16, // CMD16
     SD_READ_SINGLE_BLOCK    =  17, // CMD17
+    SD_READ_MULTIPLE_BLOCK  =  18, // CMD18
     SD_WRITE_SINGLE_BLOCK   =  24, // CMD24
+    SD_WRITE_MULTIPLE_BLOCK =  25, // CMD25
     SD_APP_CMD              =  55, // CMD55
 
     // ACMD
     SD_SET_BUS_WIDTH        = 106, // ACMD6
+    SD_SET_WR_BLK_ERASE_CNT = 123, // ACMD23
     SD_SEND_OP_COND         = 141  // ACMD41
 } sd_command_t;
 
@@ -644,17 +653,9 @@ sd_error_t sd_get_status(sdio_t sdio_)
     return sd_get_R1(_sdio);
 }
 
-sd_error_t sd_read_single_block(sdio_t sdio_, uint32_t addr, uint8_t *buf)
+static sd_error_t sd_wait_tran_state(_sdio_t *_sdio)
 {
     sd_error_t ret;
-    _sdio_t *_sdio = sdio_;
-
-    // Reset DPSM configuration
-    *sdio_get_DCTRL()  = 0;
-    *sdio_get_DLEN()   = 0;
-    *sdio_get_DTIMER() = 0xFFFF; //! \todo compute the best data timeout value
-
-    *sdio_get_DLEN() = 512;
 
     // Wait for card to be transfer state
     while (true)
@@ -674,13 +675,27 @@ sd_error_t sd_read_single_block(sdio_t sdio_, uint32_t addr, uint8_t *buf)
 
         if (_sdio->sd_state == SD_STATE_TRAN)
         {
-            break;
-        }
-        else
-        {
-            ret = SD_TRAN_TIMEOUT;
+            return SD_NO_ERROR;
         }
     }
+}
+
+sd_error_t sd_read_single_block(sdio_t sdio_, uint32_t addr, uint8_t *buf)
+{
+    sd_error_t ret;
+    _sdio_t *_sdio = sdio_;
+
+    // Reset DPSM configuration
+    *sdio_get_DCTRL()  = 0;
+    *sdio_get_DLEN()   = 0;
+    *sdio_get_DTIMER() = 0xFFFF; //! \todo compute the best data timeout value
+
+    *sdio_get_DLEN() = 512;
+
+    if ((ret = sd_wait_tran_state(_sdio)) != SD_NO_ERROR)
+    {
+        return ret;
+    }
 
     /***** CMD17 (READ_SINGLE_BLOCK) *****/
     ret = sd_send_command(_sdio, SD_READ_SINGLE_BLOCK, addr, SHORT_RESPONSE);
@@ -717,9 +732,98 @@ sd_error_t sd_read_single_block(sdio_t sdio_, uint32_t addr, uint8_t *buf)
     return SD_NO_ERROR;
 }
 
+/*
+ * Check that the buffers follow each other in memory, the DMA is given them
+ * at once. Re-arming it between blocks would let the FIFO overrun or underrun
+ * while the card clock keeps running.
+ */
+static bool sd_buffers_contiguous(uint8_t **buf, uint32_t nb_blocks)
+{
+    uint32_t i;
+
+    if (nb_blocks > MAX_DMA_BLOCKS)
+    {
+        return false;
+    }
+
+    for (i = 1; i < nb_blocks; i++)
+    {
+        if (buf[i] != buf[i - 1] + 512)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void sd_start_multiple_transfer(_sdio_t *_sdio, uint8_t *buf, uint32_t nb_blocks, dma_direction_t direction, uint32_t dctrl, uint32_t mask)
+{
+    _sdio->multi_block = true;
+
+    // Configure DPSM (Data Path State Machine)
+    *sdio_get_DCTRL() = dctrl;
+
+    // Clear and enable interrupts, only at the end of the whole transfer
+    *sdio_get_ICR() = SDIO_ICR__ALL;
+    *sdio_get_MASK() = mask;
+
+    // Configure DMA
+    dma_config(_sdio->dma_channel, (uint32_t)sdio_get_FIFO(), (uint32_t)buf, nb_blocks * 512 / 4, DMA_SIZE_32bit, direction, DMA_INCREMENT_ON);
+
+    // Enable SDIO interrupt line
+    *sdio_get_ICR() = SDIO_ICR__ALL;
+    nvic_enable_interrupt_line(NVIC_IRQ_LINE_SDIO);
+
+    // Enable and start DMA
+    dma_start(_sdio->dma_channel, NULL, NULL);
+    *sdio_get_DCTRL() |= SDIO_DCTRL__DMAEN;
+}
+
 sd_error_t sd_read_multiple_blocks(sdio_t sdio_, uint32_t addr, uint8_t **buf, uint32_t nb_blocks)
 {
-    //! \todo implement multiple blocks reading
+    sd_error_t ret;
+    _sdio_t *_sdio = sdio_;
+
+    if (nb_blocks == 1)
+    {
+        return sd_read_single_block(sdio_, addr, buf[0]);
+    }
+
+    if (!sd_buffers_contiguous(buf, nb_blocks))
+    {
+        return SD_UNKNOWN_ERROR;
+    }
+
+    // Reset DPSM configuration
+    *sdio_get_DCTRL()  = 0;
+    *sdio_get_DLEN()   = 0;
+    *sdio_get_DTIMER() = MULTI_BLOCK_DTIMER;
+
+    *sdio_get_DLEN() = nb_blocks * 512;
+
+    if ((ret = sd_wait_tran_state(_sdio)) != SD_NO_ERROR)
+    {
+        return ret;
+    }
+
+    /***** CMD18 (READ_MULTIPLE_BLOCK) *****/
+    ret = sd_send_command(_sdio, SD_READ_MULTIPLE_BLOCK, addr, SHORT_RESPONSE);
+
+    if (ret != SD_NO_ERROR)
+    {
+        return ret;
+    }
+
+    if ((ret = sd_get_R1(_sdio)) != SD_NO_ERROR)
+    {
+        return ret;
+    }
+
+    // 512-bytes blocks, from card to controller and data transfert enabled
+    sd_start_multiple_transfer(_sdio, buf[0], nb_blocks, DMA_DIRECTION_FROM_PERIPHERAL,
+            SDIO_DCTRL__DBLOCKSIZE_512 | SDIO_DCTRL__DTDIR | SDIO_DCTRL__DTEN,
+            SDIO_MASK__DCRCFAILIE | SDIO_MASK__DTIMEOUTIE | SDIO_MASK__DATAENDIE | SDIO_MASK__RXOVERRIE | SDIO_MASK__STBITERRIE);
 
     return SD_NO_ERROR;
 }
@@ -736,30 +840,9 @@ sd_error_t sd_write_single_block(sdio_t sdio_, uint32_t addr, uint8_t *buf)
 
     *sdio_get_DLEN() = 512;
 
-    // Wait for card to be transfer state
-    while (true)
+    if ((ret = sd_wait_tran_state(_sdio)) != SD_NO_ERROR)
     {
-        /***** CMD13 (SEND_STATUS) *****/
-        ret = sd_send_command(_sdio, SD_SEND_STATUS, _sdio->rca, SHORT_RESPONSE);
-
-        if (ret != SD_NO_ERROR)
-        {
-            return ret;
-        }
-
-        if ((ret = sd_get_R1(_sdio)) != SD_NO_ERROR)
-        {
-            return ret;
-        }
-
-        if (_sdio->sd_state == SD_STATE_TRAN)
-        {
-            break;
-        }
-        else
-        {
-            ret = SD_TRAN_TIMEOUT;
-        }
+        return ret;
     }
 
     /***** CMD24 (WRITE_SINGLE_BLOCK) *****/
@@ -799,7 +882,62 @@ sd_error_t sd_write_single_block(sdio_t sdio_, uint32_t addr, uint8_t *buf)
 
 sd_error_t sd_write_multiple_blocks(sdio_t sdio_, uint32_t addr, uint8_t **buf, uint32_t nb_blocks)
 {
-    //! \todo implement multiple blocks writing
+    sd_error_t ret;
+    _sdio_t *_sdio = sdio_;
+
+    if (nb_blocks == 1)
+    {
+        return sd_write_single_block(sdio_, addr, buf[0]);
+    }
+
+    if (!sd_buffers_contiguous(buf, nb_blocks))
+    {
+        return SD_UNKNOWN_ERROR;
+    }
+
+    // Reset DPSM configuration
+    *sdio_get_DCTRL()  = 0;
+    *sdio_get_DLEN()   = 0;
+    *sdio_get_DTIMER() = MULTI_BLOCK_DTIMER;
+
+    *sdio_get_DLEN() = nb_blocks * 512;
+
+    if ((ret = sd_wait_tran_state(_sdio)) != SD_NO_ERROR)
+    {
+        return ret;
+    }
+
+    // Tell the card how many blocks will be written, so that it can pre-erase them
+    /***** ACMD23 (SET_WR_BLK_ERASE_COUNT) *****/
+    ret = sd_send_command(_sdio, SD_SET_WR_BLK_ERASE_CNT, nb_blocks, SHORT_RESPONSE);
+
+    if (ret != SD_NO_ERROR)
+    {
+        return ret;
+    }
+
+    if ((ret = sd_get_R1(_sdio)) != SD_NO_ERROR)
+    {
+        return ret;
+    }
+
+    /***** CMD25 (WRITE_MULTIPLE_BLOCK) *****/
+    ret = sd_send_command(_sdio, SD_WRITE_MULTIPLE_BLOCK, addr, SHORT_RESPONSE);
+
+    if (ret != SD_NO_ERROR)
+    {
+        return ret;
+    }
+
+    if ((ret = sd_get_R1(_sdio)) != SD_NO_ERROR)
+    {
+        return ret;
+    }
+
+    // 512-bytes blocks, data transfert enabled
+    sd_start_multiple_transfer(_sdio, buf[0], nb_blocks, DMA_DIRECTION_TO_PERIPHERAL,
+            SDIO_DCTRL__DBLOCKSIZE_512 | SDIO_DCTRL__DTEN,
+            SDIO_MASK__DCRCFAILIE | SDIO_MASK__DTIMEOUTIE | SDIO_MASK__DATAENDIE | SDIO_MASK__TXUNDERRIE | SDIO_MASK__STBITERRIE);
 
     return SD_NO_ERROR;
 }
@@ -838,6 +976,25 @@ void sdio_handle_interrupt(sdio_t sdio_)
     *sdio_get_ICR() = SDIO_ICR__ALL;
     nvic_disable_interrupt_line(NVIC_IRQ_LINE_SDIO);
 
+    if (_sdio->multi_block)
+    {
+        _sdio->multi_block = false;
+
+        // Stop the DMA transfer on error
+        if (transfer_error != SD_NO_ERROR)
+        {
+            dma_cancel(_sdio->dma_channel);
+        }
+
+        // Multiple blocks transfers are ended by the host
+        /***** CMD12 (STOP_TRANSMISSION) *****/
+        if ((sd_send_command(_sdio, SD_STOP_TRANSMISSION, 0, SHORT_RESPONSE) != SD_NO_ERROR)
+                && (transfer_error == SD_NO_ERROR))
+        {
+            transfer_error = SD_UNKNOWN_ERROR;
+        }
+    }
+
     if (_sdio->transfer_handler)
     {
         _sdio->transfer_handler((handler_arg_t)transfer_error);
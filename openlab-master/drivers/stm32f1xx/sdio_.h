@@ -68,6 +68,9 @@ typedef struct
     dma_t dma_channel;
     handler_t transfer_handler;
 
+    // Multiple blocks transfer, ended with CMD12
+    bool multi_block;
+
     // Card state and description
     sd_card_description_t sd_desc;
     sd_card_type_t sd_type;
@@ -92,6 +95,7 @@ static inline void sdio_init(_sdio_t *_sdio, gpio_t *gpio, gpio_pin_t *pin, gpio
 
     _sdio->dma_channel = dma_channel;
     _sdio->transfer_handler = NULL;
+    _sdio->multi_block = false;
 
     _sdio->sd_state = SD_STATE_UNKNOWN;
     _sdio->rca = 0;
@@ -37,6 +37,8 @@ GPIO_INIT(_gpioF, GPIO_BASE_ADDRESS + GPIOF_OFFSET, RCC_APB_BIT_GPIOF);
 GPIO_INIT(_gpioG, GPIO_BASE_ADDRESS + GPIOG_OFFSET, RCC_APB_BIT_GPIOG);
 
 /* Real DMAs */
+DMA_INIT(_dma1_ch1, DMA1_BASE_ADDRESS, RCC_AHB_BIT_DMA1, DMA_CHANNEL_1,
+         NVIC_IRQ_LINE_DMA1_CH1);
 DMA_INIT(_dma1_ch2, DMA1_BASE_ADDRESS, RCC_AHB_BIT_DMA1, DMA_CHANNEL_2,
          NVIC_IRQ_LINE_DMA1_CH2);
 DMA_INIT(_dma1_ch3, DMA1_BASE_ADDRESS, RCC_AHB_BIT_DMA1, DMA_CHANNEL_3,
@@ -45,6 +47,8 @@ DMA_INIT(_dma1_ch4, DMA1_BASE_ADDRESS, RCC_AHB_BIT_DMA1, DMA_CHANNEL_4,
         NVIC_IRQ_LINE_DMA1_CH4);
 DMA_INIT(_dma1_ch5, DMA1_BASE_ADDRESS, RCC_AHB_BIT_DMA1, DMA_CHANNEL_5,
         NVIC_IRQ_LINE_DMA1_CH5);
+DMA_INIT(_dma1_ch7, DMA1_BASE_ADDRESS, RCC_AHB_BIT_DMA1, DMA_CHANNEL_7,
+        NVIC_IRQ_LINE_DMA1_CH7);
 DMA_INIT(_dma2_ch4, DMA2_BASE_ADDRESS, RCC_AHB_BIT_DMA2, DMA_CHANNEL_4,
         NVIC_IRQ_LINE_DMA2_CH4_5);
 
@@ -37,6 +37,7 @@
 #include "platform.h"
 
 #include "cm3_scb_registers.h"
+#include "boot.h"
 
 enum
 {
@@ -189,6 +190,9 @@ flash_status_t flash_memory_erase_page(uint32_t address)
     {
     }
 
+    // Back to word programming
+    *flash_get_PECR() &= ~(FLASH_PECR__ERASE | FLASH_PECR__PROG);
+
     // Lock program memory
     lock_program_memory();
 
@@ -277,6 +281,9 @@ flash_status_t flash_memory_write_half_pages(uint32_t address,
     // Call
     ram_func((uint32_t *) address, words, words_number);
 
+    // Back to word programming
+    *flash_get_PECR() &= ~(FLASH_PECR__FPRG | FLASH_PECR__PROG);
+
     // Lock the program memory
     lock_program_memory();
 
@@ -285,6 +292,62 @@ flash_status_t flash_memory_write_half_pages(uint32_t address,
 
     return FLASH_OK;
 }
+flash_status_t flash_erase_page(uint32_t address)
+{
+    flash_status_t ret;
+
+    // Clear previous errors, flags are cleared by writing 1
+    *flash_get_SR() = FLASH_SR__WRPERR | FLASH_SR__PGAERR | FLASH_SR__SIZERR;
+
+    ret = flash_memory_erase_page(address);
+
+    if ((ret == FLASH_OK) && (*flash_get_SR() & FLASH_SR__WRPERR))
+    {
+        ret = FLASH_ERR_PROGRAM;
+    }
+
+    return ret;
+}
+
+flash_status_t flash_program(uint32_t address, const uint32_t *words,
+        uint32_t word_number)
+{
+    if (address % 4)
+    {
+        return FLASH_ERR_INVALID_ADDRESS;
+    }
+
+    *flash_get_SR() = FLASH_SR__WRPERR | FLASH_SR__PGAERR | FLASH_SR__SIZERR;
+
+    while (word_number)
+    {
+        uint32_t n = 1;
+
+        // Interrupts are disabled by half page, not for the whole block
+        if (((address % (FLASH_SIZE_PAGE / 2)) == 0) && (word_number >= 32))
+        {
+            n = 32;
+            flash_memory_write_half_pages(address, words, n);
+        }
+        else
+        {
+            flash_memory_write_word(address, *words);
+        }
+
+        if (*flash_get_SR() & (FLASH_SR__WRPERR | FLASH_SR__PGAERR
+                               | FLASH_SR__SIZERR))
+        {
+            return FLASH_ERR_PROGRAM;
+        }
+
+        address += 4 * n;
+        words += n;
+        word_number -= n;
+    }
+
+    return FLASH_OK;
+}
+
 void flash_memory_copy_upper_to_lower()
 {
     // Disable interrupts during write
@@ -332,6 +395,21 @@ void flash_memory_copy_upper_to_lower()
     platform_exit_critical();
 }
 
+static void copy_staged_image(uint32_t length)
+{
+    // The whole half is copied
+    (void) length;
+    flash_memory_copy_upper_to_lower();
+}
+
+/* Firmware staging area, installed by the boot stage */
+const boot_staging_t boot_staging =
+{
+    .start   = FLASH_MEMORY_UPPER,
+    .size    = FLASH_MEMORY_HALF_SIZE,
+    .install = copy_staged_image
+};
+
 void flash_set_1ws()
 {
     // Set 1 wait state, 64bit access
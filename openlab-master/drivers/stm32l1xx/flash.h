@@ -40,7 +40,8 @@ enum
 
 typedef enum
 {
-    FLASH_OK = 0, FLASH_ERR_INVALID_ADDRESS = 1, FLASH_ERR_INVALID_LENGTH = 2
+    FLASH_OK = 0, FLASH_ERR_INVALID_ADDRESS = 1, FLASH_ERR_INVALID_LENGTH = 2,
+    FLASH_ERR_PROGRAM = 4
 } flash_status_t;
 
 /* Flash Write */
@@ -49,6 +50,12 @@ flash_status_t flash_memory_write_word(uint32_t address, uint32_t word);
 flash_status_t flash_memory_write_half_pages(uint32_t address,
         const uint32_t *words, uint32_t word_number);
 
+/* Block write, half pages are used when aligned, interrupts are enabled
+ * between two half pages */
+flash_status_t flash_erase_page(uint32_t address);
+flash_status_t flash_program(uint32_t address, const uint32_t *words,
+        uint32_t word_number);
+
 /* Full memory copy */
 void flash_memory_copy_upper_to_lower();
 
@@ -117,6 +117,9 @@ typedef struct
 
     // Endpoint callback
     usb_endpoint_callback_t endpoint_callback;
+
+    // Double buffered packet memory, bulk endpoints only, see usb_dbl_*
+    bool double_buffered;
 } __attribute__((packed)) usb_endp_desc_t;
 
 typedef struct
@@ -289,6 +292,34 @@ uint16_t usb_recv_get_len(uint8_t endp);
 void     usb_recv(uint8_t endp, uint8_t *buf, uint16_t len);
 void     usb_recv_set_status(uint8_t endp, stat_bits_t stat);
 
+/**
+ * USB Send and Receive on double buffered bulk endpoints
+ *
+ * The application owns one of the two packet buffers while the
+ * peripheral transfers the other one.
+ *
+ * IN endpoints: usb_dbl_send() writes a packet in the application
+ * buffer, usb_dbl_send_release() hands it to the peripheral. Only one
+ * packet may be released at a time: the next one can be written while
+ * the previous one is sent, and released once usb_dbl_send_pending()
+ * is false, usually from the endpoint callback.
+ *
+ * OUT endpoints: when usb_dbl_recv_pending() is true, a packet has been
+ * received and the host is NAKed. usb_dbl_recv_release() takes the
+ * received packet and lets the peripheral receive the next one in the
+ * other buffer, the packet is then read with usb_dbl_recv_get_len() and
+ * usb_dbl_recv().
+ */
+
+void     usb_dbl_send(uint8_t endp, const uint8_t *buf, uint16_t len);
+void     usb_dbl_send_release(uint8_t endp);
+bool     usb_dbl_send_pending(uint8_t endp);
+
+bool     usb_dbl_recv_pending(uint8_t endp);
+void     usb_dbl_recv_release(uint8_t endp);
+uint16_t usb_dbl_recv_get_len(uint8_t endp);
+void     usb_dbl_recv(uint8_t endp, uint8_t *buf, uint16_t len);
+
 /**
  * Internal USB active function and interface
  */ 
@@ -38,6 +38,7 @@
 #include "debug.h"
 
 #include "soft_timer.h"
+#include "trace.h"
 
 #ifndef EVENT_QUEUE_LENGTH
 #define EVENT_QUEUE_LENGTH 12
@@ -65,6 +66,9 @@ static queue_entry_t current_entries[2];
 
 void event_init(void)
 {
+    // Every platform starts the event library, trace with it
+    TRACE_INIT();
+
     if (queues[0] == NULL)
     {
         // Create the 1st Queue
@@ -188,7 +192,9 @@ static void event_task(void *param)
         if (xQueueReceive(queue, entry, portMAX_DELAY) == pdTRUE)
         {
             // Call the event
+            TRACE_BEGIN(TRACE_ID_EVENT_APPLI + num, entry->event);
             entry->event(entry->event_arg);
+            TRACE_END(TRACE_ID_EVENT_APPLI + num, entry->event);
         }
         else
         {
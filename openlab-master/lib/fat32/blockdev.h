@@ -0,0 +1,75 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2011-2013 HiKoB.
+ */
+
+
+/**
+ * \file blockdev.h
+ *
+ * Block device under the fs buffer pool, blocks are 512 bytes long.
+ *
+ * Transfers are asynchronous: the transfer handler is called with the
+ * transfer result as argument when the transfer ends, possibly before the
+ * read or write function returns.
+ *
+ * The backend is selected at link time: blockdev_sdio on platforms with an
+ * SD card, blockdev_file on the native platform.
+ */
+
+#ifndef BLOCKDEV_H_
+#define BLOCKDEV_H_
+
+#include <stdint.h>
+#include "handler.h"
+
+#define BLOCKDEV_OK 0
+
+/**
+ * Initialize the block device, may be called again to recover from errors.
+ *
+ * \return BLOCKDEV_OK or a device error code
+ */
+int blockdev_init();
+
+/** Number of blocks of the device, 0 if not initialized */
+uint32_t blockdev_num_blocks();
+
+/** Set the handler called at the end of each transfer */
+void blockdev_set_transfer_handler(handler_t handler);
+
+/**
+ * Start reading 'num' consecutive blocks
+ *
+ * \param block the first block number
+ * \param buf the buffers receiving each block
+ * \param num the number of blocks
+ * \return BLOCKDEV_OK if the transfer is started, a device error code otherwise
+ */
+int blockdev_read(uint32_t block, uint8_t **buf, uint32_t num);
+
+/**
+ * Start writing 'num' consecutive blocks
+ *
+ * \param block the first block number
+ * \param buf the buffers holding each block
+ * \param num the number of blocks
+ * \return BLOCKDEV_OK if the transfer is started, a device error code otherwise
+ */
+int blockdev_write(uint32_t block, uint8_t **buf, uint32_t num);
+
+#endif
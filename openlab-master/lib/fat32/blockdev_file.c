@@ -0,0 +1,144 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2011-2013 HiKoB.
+ */
+
+
+/**
+ * \file blockdev_file.c
+ *
+ * Block device on a disk image file of the host, for the native platform.
+ * The image is mapped in memory, transfers end before the read or write
+ * function returns.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "blockdev.h"
+#include "blockdev_file.h"
+
+enum
+{
+    BLOCKDEV_FILE_NO_IMAGE = 1,
+    BLOCKDEV_FILE_OUT_OF_RANGE = 2,
+};
+
+static const char *image_path = NULL;
+static uint8_t *image = NULL;
+static uint64_t image_blocks = 0;
+static handler_t transfer_handler = NULL;
+
+void blockdev_file_set_path(const char *path)
+{
+    image_path = path;
+}
+
+uint32_t blockdev_num_blocks()
+{
+    // Block numbers are 32 bits long, the end of larger images is not used
+    return (image_blocks > UINT32_MAX) ? UINT32_MAX : image_blocks;
+}
+
+int blockdev_init()
+{
+    struct stat st;
+    const char *path = image_path;
+    int fd;
+
+    // Already mapped, nothing to recover
+    if (image != NULL)
+    {
+        return BLOCKDEV_OK;
+    }
+
+    if (path == NULL)
+    {
+        path = getenv("FS_IMAGE");
+    }
+
+    if ((path == NULL) || ((fd = open(path, O_RDWR)) < 0))
+    {
+        return BLOCKDEV_FILE_NO_IMAGE;
+    }
+
+    if ((fstat(fd, &st) != 0) || (st.st_size < 512))
+    {
+        close(fd);
+        return BLOCKDEV_FILE_NO_IMAGE;
+    }
+
+    image = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (image == MAP_FAILED)
+    {
+        image = NULL;
+        return BLOCKDEV_FILE_NO_IMAGE;
+    }
+
+    image_blocks = st.st_size / 512;
+
+    return BLOCKDEV_OK;
+}
+
+void blockdev_set_transfer_handler(handler_t handler)
+{
+    transfer_handler = handler;
+}
+
+static int transfer(uint32_t block, uint8_t **buf, uint32_t num, int write)
+{
+    uint32_t i;
+
+    if ((image == NULL) || (((uint64_t)block + num) > image_blocks))
+    {
+        return BLOCKDEV_FILE_OUT_OF_RANGE;
+    }
+
+    for (i = 0; i < num; i++)
+    {
+        if (write)
+        {
+            memcpy(image + ((uint64_t)block + i) * 512, buf[i], 512);
+        }
+        else
+        {
+            memcpy(buf[i], image + ((uint64_t)block + i) * 512, 512);
+        }
+    }
+
+    if (transfer_handler)
+    {
+        transfer_handler((handler_arg_t)BLOCKDEV_OK);
+    }
+
+    return BLOCKDEV_OK;
+}
+
+int blockdev_read(uint32_t block, uint8_t **buf, uint32_t num)
+{
+    return transfer(block, buf, num, 0);
+}
+
+int blockdev_write(uint32_t block, uint8_t **buf, uint32_t num)
+{
+    return transfer(block, buf, num, 1);
+}
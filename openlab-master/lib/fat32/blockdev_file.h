@@ -0,0 +1,38 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2011-2013 HiKoB.
+ */
+
+
+/**
+ * \file blockdev_file.h
+ *
+ * Disk image file block device, native platform only
+ */
+
+#ifndef BLOCKDEV_FILE_H_
+#define BLOCKDEV_FILE_H_
+
+#include <stdint.h>
+
+/**
+ * Set the disk image file path, to call before fs_init.
+ * When not set, the path is read from the FS_IMAGE environment variable.
+ */
+void blockdev_file_set_path(const char *path);
+
+#endif
@@ -0,0 +1,166 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2011-2013 HiKoB.
+ */
+
+
+/**
+ * \file blockdev_sdio.c
+ *
+ * Block device on the platform SD card
+ */
+
+#include <string.h>
+
+#include "sdio.h"
+#include "blockdev.h"
+
+/*
+ * Blocks of the buffer gathering transfers to buffers that do not follow each
+ * other in memory. The SDIO DMA is given each transfer at once, re-arming it
+ * between blocks would let its FIFO overrun or underrun.
+ */
+#ifndef BLOCKDEV_SDIO_BOUNCE_BLOCKS
+#define BLOCKDEV_SDIO_BOUNCE_BLOCKS 8
+#endif
+
+extern sdio_t sdio;
+
+static uint8_t bounce[BLOCKDEV_SDIO_BOUNCE_BLOCKS][512] __attribute__((aligned(4)));
+static uint8_t *bounce_blocks[BLOCKDEV_SDIO_BOUNCE_BLOCKS];
+
+// Buffers filled from the bounce buffer at the end of a read, or NULL
+static uint8_t **bounce_read_buf;
+static uint32_t bounce_read_num;
+
+static handler_t transfer_handler;
+
+// Standard capacity cards are byte addressed, high capacity ones block addressed
+static inline uint32_t address(uint32_t block)
+{
+    return (sd_get_type(sdio) != SDHC) ? block * 512ul : block;
+}
+
+static int contiguous(uint8_t **buf, uint32_t num)
+{
+    uint32_t i;
+
+    for (i = 1; i < num; i++)
+    {
+        if (buf[i] != buf[i - 1] + 512)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void sdio_transfer_handler(handler_arg_t arg)
+{
+    uint32_t i;
+
+    if (bounce_read_buf && ((sd_error_t)(intptr_t)arg == SD_NO_ERROR))
+    {
+        for (i = 0; i < bounce_read_num; i++)
+        {
+            memcpy(bounce_read_buf[i], bounce[i], 512);
+        }
+    }
+
+    bounce_read_buf = NULL;
+
+    if (transfer_handler)
+    {
+        transfer_handler(arg);
+    }
+}
+
+int blockdev_init()
+{
+    uint32_t i;
+
+    for (i = 0; i < BLOCKDEV_SDIO_BOUNCE_BLOCKS; i++)
+    {
+        bounce_blocks[i] = bounce[i];
+    }
+
+    bounce_read_buf = NULL;
+
+    return sd_init(sdio);
+}
+
+uint32_t blockdev_num_blocks()
+{
+    return sd_get_size(sdio);
+}
+
+void blockdev_set_transfer_handler(handler_t handler)
+{
+    transfer_handler = handler;
+    sd_set_transfer_handler(sdio, sdio_transfer_handler);
+}
+
+int blockdev_read(uint32_t block, uint8_t **buf, uint32_t num)
+{
+    int ret;
+
+    if (contiguous(buf, num))
+    {
+        return sd_read_multiple_blocks(sdio, address(block), buf, num);
+    }
+
+    if (num > BLOCKDEV_SDIO_BOUNCE_BLOCKS)
+    {
+        return SD_UNKNOWN_ERROR;
+    }
+
+    // The transfer may end before the read call returns
+    bounce_read_buf = buf;
+    bounce_read_num = num;
+
+    ret = sd_read_multiple_blocks(sdio, address(block), bounce_blocks, num);
+
+    if (ret != SD_NO_ERROR)
+    {
+        bounce_read_buf = NULL;
+    }
+
+    return ret;
+}
+
+int blockdev_write(uint32_t block, uint8_t **buf, uint32_t num)
+{
+    uint32_t i;
+
+    if (contiguous(buf, num))
+    {
+        return sd_write_multiple_blocks(sdio, address(block), buf, num);
+    }
+
+    if (num > BLOCKDEV_SDIO_BOUNCE_BLOCKS)
+    {
+        return SD_UNKNOWN_ERROR;
+    }
+
+    for (i = 0; i < num; i++)
+    {
+        memcpy(bounce[i], buf[i], 512);
+    }
+
+    return sd_write_multiple_blocks(sdio, address(block), bounce_blocks, num);
+}
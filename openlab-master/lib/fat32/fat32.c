@@ -33,8 +33,50 @@
 #include "fs.h"
 #include "debug.h"
 
+/* Number of FAT sectors kept decoded in RAM */
+#ifndef FAT32_FAT_CACHE_SIZE
+#define FAT32_FAT_CACHE_SIZE 2
+#endif
+
+/* Number of clusters covered by the free clusters bitmap, must be a multiple of 32 */
+#ifndef FAT32_FREE_MAP_CLUSTERS
+#define FAT32_FREE_MAP_CLUSTERS 4096
+#endif
+
+#define FAT_ENTRIES_PER_SECTOR 128
+#define FAT_ENTRY_MASK         0x0FFFFFFF
+#define FSINFO_UNKNOWN         0xFFFFFFFF
+
+typedef struct
+{
+    // Decoded FAT entries, declared first to keep the buffer 4-bytes aligned
+    uint32_t entries[FAT_ENTRIES_PER_SECTOR];
+
+    // FAT sector location on the SD card
+    uint32_t sector;
+
+    // Last access date, for LRU replacement
+    uint32_t stamp;
+
+    bool valid;
+} fat_sector_t;
+
 fat32_t fat;
-static uint32_t last_free_cluster = 0;
+
+static fat_sector_t fat_cache[FAT32_FAT_CACHE_SIZE];
+static uint32_t fat_cache_stamp = 0;
+
+// Free clusters bitmap of a chunk of the FAT, a set bit means a free cluster
+static struct
+{
+    uint32_t bits[FAT32_FREE_MAP_CLUSTERS / 32];
+    uint32_t first;     // First cluster of the chunk
+    uint32_t free;      // Number of free clusters in the chunk
+    bool valid;
+} free_map;
+
+static fat32_error_t read_fsinfo();
+static void fat_cache_invalidate();
 
 fat32_error_t fat32_init()
 {
@@ -168,53 +210,364 @@ fat32_error_t fat32_mount()
     // Compute the maximum cluster index
     fat.max_clust = (fat.num_sect - fat.data_start + fat.boot_sect) / fat.sect_per_clust + 2;
 
+    // Drop FAT information of a previously mounted file system
+    fat_cache_invalidate();
+
+    // Read the free clusters information from the FSInfo sector
+    if (read_fsinfo() != FAT32_OK)
+    {
+        return FAT32_FS_ERROR;
+    }
+
     return FAT32_OK;
 }
 
-uint32_t fat32_get_next_cluster(uint32_t cluster)
+fat32_error_t fat32_sync()
 {
-    uint8_t buf[4];
+    uint8_t buf[8];
 
-    // If the requested cluster is not allowed, return an error value
-    if ((cluster < 2) || (cluster > fat.max_clust))
+    if (!fat.fsinfo_dirty)
     {
-        return 1;
+        return FAT32_OK;
     }
 
-    // Read the address of the next cluster
+    write32(buf, fat.free_count);
+    write32(buf + 4, fat.next_free);
+
+    if (fs_write(fat.fsinfo_sect, 0x1E8, buf, 8) != 8)
+    {
+        return FAT32_FS_ERROR;
+    }
+
+    fat.fsinfo_dirty = false;
+
+    return FAT32_OK;
+}
+
+static fat32_error_t read_fsinfo()
+{
+    uint8_t buf[8];
+
+    fat.fsinfo_sect = 0;
+    fat.free_count = FSINFO_UNKNOWN;
+    fat.next_free = FSINFO_UNKNOWN;
+    fat.fsinfo_dirty = false;
+
+    // Read the FSInfo sector number, relative to the boot sector
+    if (fs_read(fat.boot_sect, 0x30, buf, 2) != 2)
+    {
+        return FAT32_FS_ERROR;
+    }
+
+    if ((read16(buf) == 0) || (read16(buf) == 0xFFFF))
+    {
+        // No FSInfo sector, free clusters information will stay unknown
+        return FAT32_OK;
+    }
+
+    fat.fsinfo_sect = fat.boot_sect + read16(buf);
+
+    // Check the lead signature and the structure signature
+    if ((fs_read(fat.fsinfo_sect, 0, buf, 4) != 4) || (fs_read(fat.fsinfo_sect, 0x1E4, buf + 4, 4) != 4))
+    {
+        return FAT32_FS_ERROR;
+    }
+
+    if (!cmp(buf, (uint8_t *)"RRaArrAa", 8))
+    {
+        fat.fsinfo_sect = 0;
+        return FAT32_OK;
+    }
+
+    // Read the free cluster count and the next free cluster hint
+    if (fs_read(fat.fsinfo_sect, 0x1E8, buf, 8) != 8)
+    {
+        return FAT32_FS_ERROR;
+    }
+
+    // Both values are only hints, ignore them if they are out of range
+    if (read32(buf) <= fat.max_clust)
+    {
+        fat.free_count = read32(buf);
+    }
+
+    if ((read32(buf + 4) >= 2) && (read32(buf + 4) < fat.max_clust))
+    {
+        fat.next_free = read32(buf + 4);
+    }
+
+    return FAT32_OK;
+}
+
+/*
+ * FAT sectors cache
+ *
+ * Whole FAT sectors are read at once and decoded, cluster chains walks and
+ * free clusters search do not go through the buffer pool for every entry.
+ * The cache is write-through, the buffer pool still delays SD card writes.
+ */
+static void fat_cache_invalidate()
+{
+    uint16_t i;
+
+    for (i = 0; i < FAT32_FAT_CACHE_SIZE; i++)
+    {
+        fat_cache[i].valid = false;
+    }
+
+    free_map.valid = false;
+}
+
+static fat_sector_t *fat_cache_lookup(uint32_t sector)
+{
+    uint16_t i;
+
+    for (i = 0; i < FAT32_FAT_CACHE_SIZE; i++)
+    {
+        if (fat_cache[i].valid && (fat_cache[i].sector == sector))
+        {
+            return &fat_cache[i];
+        }
+    }
+
+    return NULL;
+}
+
+static fat_sector_t *fat_cache_get(uint32_t sector)
+{
+    fat_sector_t *s = fat_cache_lookup(sector);
+    uint16_t i;
+
+    if (s == NULL)
+    {
+        // Replace an empty slot or the least recently used one
+        s = &fat_cache[0];
+
+        for (i = 1; (i < FAT32_FAT_CACHE_SIZE) && s->valid; i++)
+        {
+            if (!fat_cache[i].valid || (fat_cache[i].stamp < s->stamp))
+            {
+                s = &fat_cache[i];
+            }
+        }
+
+        s->valid = false;
+
+        if (fs_read(sector, 0, (uint8_t *)s->entries, 512) != 512)
+        {
+            return NULL;
+        }
+
+        // Decode the sector in place, each entry is read before being written
+        for (i = 0; i < FAT_ENTRIES_PER_SECTOR; i++)
+        {
+            s->entries[i] = read32((uint8_t *)&s->entries[i]);
+        }
+
+        s->sector = sector;
+        s->valid = true;
+    }
+
+    s->stamp = ++fat_cache_stamp;
+    return s;
+}
+
+static fat32_error_t fat_read_entry(uint32_t cluster, uint32_t *value)
+{
     // A cluster with id n is located in (n / 128) th sector of the FAT
-    // In this sector it locate at index (n % 128) * 4
-    if (fs_read(fat.start + (cluster >> 7), (cluster & 0x7F) << 2, buf, 4) != 4)
+    // In this sector it locate at index (n % 128)
+    fat_sector_t *s = fat_cache_get(fat.start + (cluster >> 7));
+
+    if (s == NULL)
     {
-        return 1;
+        return FAT32_FS_ERROR;
     }
 
-    return read32(buf);
+    *value = s->entries[cluster & 0x7F] & FAT_ENTRY_MASK;
+    return FAT32_OK;
 }
 
-fat32_error_t fat32_set_next_cluster(uint32_t cluster, uint32_t next_cluster)
+/*
+ * Free clusters bitmap
+ *
+ * The bitmap only covers one chunk of FAT32_FREE_MAP_CLUSTERS clusters, it is
+ * built when the allocation reaches a new chunk. Allocating consecutive
+ * clusters scans each FAT sector only once.
+ */
+static inline bool free_map_covers(uint32_t cluster)
+{
+    return free_map.valid && (cluster >= free_map.first) && ((cluster - free_map.first) < FAT32_FREE_MAP_CLUSTERS);
+}
+
+static void free_map_update(uint32_t cluster, bool is_free)
+{
+    uint32_t idx, mask;
+
+    if (!free_map_covers(cluster))
+    {
+        return;
+    }
+
+    idx = cluster - free_map.first;
+    mask = 1 << (idx & 0x1F);
+
+    if (is_free && !(free_map.bits[idx >> 5] & mask))
+    {
+        free_map.bits[idx >> 5] |= mask;
+        free_map.free++;
+    }
+    else if (!is_free && (free_map.bits[idx >> 5] & mask))
+    {
+        free_map.bits[idx >> 5] &= ~mask;
+        free_map.free--;
+    }
+}
+
+static fat32_error_t free_map_build(uint32_t first)
+{
+    uint32_t cluster, value, end = first + FAT32_FREE_MAP_CLUSTERS;
+
+    free_map.valid = false;
+    free_map.first = first;
+    free_map.free = 0;
+    zero((uint8_t *)free_map.bits, sizeof(free_map.bits));
+
+    if (end > fat.max_clust)
+    {
+        end = fat.max_clust;
+    }
+
+    // Clusters 0 and 1 are reserved and never free
+    for (cluster = (first < 2) ? 2 : first; cluster < end; cluster++)
+    {
+        if (fat_read_entry(cluster, &value) != FAT32_OK)
+        {
+            return FAT32_FS_ERROR;
+        }
+
+        if (value == 0)
+        {
+            free_map.bits[(cluster - first) >> 5] |= 1 << ((cluster - first) & 0x1F);
+            free_map.free++;
+        }
+    }
+
+    free_map.valid = true;
+    return FAT32_OK;
+}
+
+// Return the first free cluster in the chunk from 'cluster', 0 if none
+static uint32_t free_map_find(uint32_t cluster)
+{
+    uint32_t idx = cluster - free_map.first;
+    uint32_t w = idx >> 5;
+    uint32_t bits = free_map.bits[w] & (0xFFFFFFFF << (idx & 0x1F));
+
+    while (bits == 0)
+    {
+        if (++w == (FAT32_FREE_MAP_CLUSTERS / 32))
+        {
+            return 0;
+        }
+
+        bits = free_map.bits[w];
+    }
+
+    for (idx = w << 5; !(bits & 1); idx++)
+    {
+        bits >>= 1;
+    }
+
+    return free_map.first + idx;
+}
+
+/*
+ * Write a FAT entry, updating the cache, the free clusters bitmap and the
+ * free clusters count
+ */
+static fat32_error_t fat_write_entry(uint32_t cluster, uint32_t value)
 {
     uint8_t buf[4];
+    uint32_t previous = 0;
+    fat_sector_t *s;
 
-    // Check if both parameters are correct
-    if (((cluster != 0) && ((cluster < 2) || (cluster > fat.max_clust))) || (next_cluster == 1) || (next_cluster > fat.max_clust))
+    if ((cluster >= 2) && (fat_read_entry(cluster, &previous) != FAT32_OK))
     {
-        return FAT32_WRONG_CLUSTER;
+        return FAT32_FS_ERROR;
     }
 
     // Write the address of the next cluster
     // A cluster with id n is located in (n / 128) th sector of the FAT
     // In this sector it locate at index (n % 128) * 4
-    write32(buf, next_cluster);
+    write32(buf, value);
 
     if (fs_write(fat.start + (cluster >> 7), (cluster & 0x7F) << 2, buf, 4) != 4)
     {
+        // The sector may have been partially written, read it again next time
+        fat_cache_invalidate();
         return FAT32_FS_ERROR;
     }
 
+    if ((s = fat_cache_lookup(fat.start + (cluster >> 7))) != NULL)
+    {
+        s->entries[cluster & 0x7F] = value;
+    }
+
+    if (cluster < 2)
+    {
+        return FAT32_OK;
+    }
+
+    value &= FAT_ENTRY_MASK;
+    free_map_update(cluster, value == 0);
+
+    if ((fat.free_count != FSINFO_UNKNOWN) && ((previous == 0) != (value == 0)))
+    {
+        if (value == 0)
+        {
+            fat.free_count++;
+        }
+        else if (fat.free_count > 0)
+        {
+            fat.free_count--;
+        }
+
+        fat.fsinfo_dirty = (fat.fsinfo_sect != 0);
+    }
+
     return FAT32_OK;
 }
 
+uint32_t fat32_get_next_cluster(uint32_t cluster)
+{
+    uint32_t next_cluster;
+
+    // If the requested cluster is not allowed, return an error value
+    if ((cluster < 2) || (cluster > fat.max_clust))
+    {
+        return 1;
+    }
+
+    // Read the address of the next cluster
+    if (fat_read_entry(cluster, &next_cluster) != FAT32_OK)
+    {
+        return 1;
+    }
+
+    return next_cluster;
+}
+
+fat32_error_t fat32_set_next_cluster(uint32_t cluster, uint32_t next_cluster)
+{
+    // Check if both parameters are correct
+    if (((cluster != 0) && ((cluster < 2) || (cluster > fat.max_clust))) || (next_cluster == 1) || (next_cluster > fat.max_clust))
+    {
+        return FAT32_WRONG_CLUSTER;
+    }
+
+    return fat_write_entry(cluster, next_cluster);
+}
+
 inline fat32_error_t fat32_free_cluster(uint32_t cluster)
 {
     // Freeing a cluster is equivalent to set its successor to 0
@@ -223,64 +576,129 @@ inline fat32_error_t fat32_free_cluster(uint32_t cluster)
 
 uint32_t fat32_find_empty_cluster()
 {
-    uint32_t current_sector = fat.start;
-    uint16_t i, idx = 0;
-    uint8_t buf[4];
-
-    // If we know the last free cluster, there is no need to scan the whole FAT,
-    // we will scan from this point to improve the global search time.
-    // To ensure the best performance, we must ensure that the disk is not fragmented,
-    // in that case the search time is constant
-    if (last_free_cluster != 0)
+    uint32_t start = 2, cluster, first;
+    uint32_t num_chunks = (fat.max_clust + FAT32_FREE_MAP_CLUSTERS - 1) / FAT32_FREE_MAP_CLUSTERS;
+    uint32_t i;
+
+    // Start from the next free cluster hint, it is kept just after the last
+    // allocated cluster. As long as the disk is not fragmented, the search
+    // time is constant
+    if (fat.next_free != FSINFO_UNKNOWN)
     {
-        current_sector = fat.start + (last_free_cluster >> 7);
-        idx = (last_free_cluster & 0x7F) << 2;
+        start = fat.next_free;
     }
 
-    // Scan the file allocation table to find an empty cluster
-    // Look in every sector of the file allocation table
-    while (current_sector < ((uint32_t)fat.start) + fat.sect_per_fat)
+    // Look in every chunk, the first one is looked twice to check clusters
+    // before the hint
+    first = start - start % FAT32_FREE_MAP_CLUSTERS;
+
+    for (i = 0; i <= num_chunks; i++)
     {
-        // In each sector scan successors for every cluster
-        for (i = idx; i < 512; i += 4)
+        if (!free_map.valid || (free_map.first != first))
         {
-            // Read the cluster successor, if there is an error while reading return a forbidden value
-            if (fs_read(current_sector, i, buf, 4) != 4)
+            if (free_map_build(first) != FAT32_OK)
             {
-                last_free_cluster = 0;
                 return 1;
             }
+        }
 
-            // If the successor is 0, then it means that the cluster is free
-            if (read32(buf) == 0)
+        if ((free_map.free != 0) && ((cluster = free_map_find((i == 0) ? start : first)) != 0))
+        {
+            // Reserve it and indicate that it has no successor
+            if (fat_write_entry(cluster, 0x0FFFFFF8) != FAT32_OK)
             {
-                // Reserve it and indicate that it has no successor
-                write32(buf, 0x0FFFFFF8);
-
-                // Write the new successor value, if there is an error while writing return a forbidden value
-                if (fs_write(current_sector, i, buf, 4) != 4)
-                {
-                    last_free_cluster = 0;
-                    return 1;
-                }
-
-                // Return the cluster index
-                return last_free_cluster;
+                return 1;
             }
 
-            last_free_cluster++;
+            fat.next_free = (cluster + 1 < fat.max_clust) ? cluster + 1 : 2;
+            fat.fsinfo_dirty = (fat.fsinfo_sect != 0);
+
+            // Return the cluster index
+            return cluster;
         }
 
-        idx = 0;
-        current_sector++;
+        first += FAT32_FREE_MAP_CLUSTERS;
+
+        if (first >= fat.max_clust)
+        {
+            first = 0;
+        }
     }
 
     // If we got out of the loop it means that the file system is full
     // Indicates the error by returning an error value
-    last_free_cluster = 0;
     return 1;
 }
 
+/*
+ * Append up to 'count' clusters to the chain ending with 'cluster'. Clusters
+ * right after 'cluster' are used first so that the chain stays contiguous.
+ * Return the number of clusters actually appended.
+ */
+uint32_t fat32_extend_chain(uint32_t cluster, uint32_t count)
+{
+    uint32_t next, i;
+
+    if ((cluster + 1) < fat.max_clust)
+    {
+        fat.next_free = cluster + 1;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        next = fat32_find_empty_cluster();
+
+        if (next == 1)
+        {
+            break;
+        }
+
+        if (fat32_set_next_cluster(cluster, next) != FAT32_OK)
+        {
+            fat32_free_cluster(next);
+            break;
+        }
+
+        cluster = next;
+    }
+
+    return i;
+}
+
+/*
+ * Make 'cluster' the last one of its chain, the following clusters are freed
+ */
+fat32_error_t fat32_truncate_chain(uint32_t cluster)
+{
+    uint32_t next;
+    fat32_error_t ret;
+
+    if ((cluster < 2) || (cluster > fat.max_clust))
+    {
+        return FAT32_WRONG_CLUSTER;
+    }
+
+    next = fat32_get_next_cluster(cluster);
+
+    if ((ret = fat_write_entry(cluster, 0x0FFFFFF8)) != FAT32_OK)
+    {
+        return ret;
+    }
+
+    while ((next >= 2) && (next <= fat.max_clust))
+    {
+        cluster = next;
+        next = fat32_get_next_cluster(cluster);
+
+        if ((ret = fat32_free_cluster(cluster)) != FAT32_OK)
+        {
+            return ret;
+        }
+    }
+
+    return FAT32_OK;
+}
+
 static fat32_error_t fat32_find(uint8_t *name, uint8_t *ext, uint32_t *sector, uint16_t *index, dir_entry_t *dir)
 {
     uint32_t current_cluster = 2, s;
@@ -334,7 +752,7 @@ static fat32_error_t fat32_find(uint8_t *name, uint8_t *ext, uint32_t *sector, u
 
         current_cluster = fat32_get_next_cluster(current_cluster);
     }
-    while ((*sector & 0x0FFFFFF8) != 0x0FFFFFF8);
+    while ((current_cluster >= 2) && (current_cluster <= fat.max_clust));
 
     return FAT32_FILE_NOT_FOUND;
 }
@@ -379,7 +797,7 @@ fat32_error_t fat32_get_volume_name(uint8_t *name)
 
         current_cluster = fat32_get_next_cluster(current_cluster);
     }
-    while ((current_sector & 0x0FFFFFF8) != 0x0FFFFFF8);
+    while ((current_cluster >= 2) && (current_cluster <= fat.max_clust));
 
     return FAT32_FILE_NOT_FOUND;
 }
@@ -569,7 +987,7 @@ fat32_error_t fat32_delete(uint8_t *filename)
     }
     while ((current_cluster & 0x0FFFFFF8) != 0x0FFFFFF8);
 
-    return FAT32_OK;
+    return fat32_sync();
 }
 
 fat32_error_t fat32_create(uint8_t *filename, uint32_t *sector, uint16_t *index, dir_entry_t *dir)
@@ -578,7 +996,7 @@ fat32_error_t fat32_create(uint8_t *filename, uint32_t *sector, uint16_t *index,
     uint8_t name[9] = {0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0};
     uint8_t buf[32];
     uint16_t i;
-    uint32_t current_cluster = 2, start;
+    uint32_t current_cluster = 2, last_cluster = 2, start, offset;
     bool found = false;
 
     // Check if file already exists
@@ -624,9 +1042,33 @@ fat32_error_t fat32_create(uint8_t *filename, uint32_t *sector, uint16_t *index,
             break;
         }
 
+        last_cluster = current_cluster;
         current_cluster = fat32_get_next_cluster(current_cluster);
     }
-    while ((*sector & 0x0FFFFFF8) != 0x0FFFFFF8);
+    while ((current_cluster >= 2) && (current_cluster <= fat.max_clust));
+
+    // The root directory is full, extend it by an empty cluster
+    if (!found)
+    {
+        if (fat32_extend_chain(last_cluster, 1) != 1)
+        {
+            return FAT32_NO_FREE_CLUSTER;
+        }
+
+        current_cluster = fat32_get_next_cluster(last_cluster);
+        *sector = fat.root_start + fat.sect_per_clust * (current_cluster - 2);
+        zero(buf, 32);
+
+        for (offset = 0; offset < fat.sect_per_clust * 512u; offset += 32)
+        {
+            if (fs_write(*sector + offset / 512, offset % 512, buf, 32) != 32)
+            {
+                return FAT32_FS_ERROR;
+            }
+        }
+
+        *index = 0;
+    }
 
     start = fat32_find_empty_cluster();
 
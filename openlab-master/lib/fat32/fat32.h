@@ -41,6 +41,11 @@ typedef struct
     uint16_t start;          // FAT start sector
     uint32_t root_start;     // Start sector of root directory
     uint32_t data_start;     // Start sector of data
+
+    uint32_t fsinfo_sect;    // FSInfo sector, 0 if none
+    uint32_t free_count;     // Number of free clusters, 0xFFFFFFFF if unknown
+    uint32_t next_free;      // Hint for the next free cluster
+    bool fsinfo_dirty;       // FSInfo must be written on sync
 } fat32_t;
 
 typedef struct
@@ -76,6 +81,7 @@ extern fat32_t fat;
 fat32_error_t fat32_init();
 
 fat32_error_t fat32_mount();
+fat32_error_t fat32_sync();
 
 fat32_error_t fat32_get_volume_name(uint8_t *name);
 
@@ -93,6 +99,8 @@ uint32_t fat32_get_next_cluster(uint32_t cluster);
 fat32_error_t fat32_set_next_cluster(uint32_t cluster, uint32_t next_cluster);
 uint32_t fat32_find_empty_cluster();
 fat32_error_t fat32_free_cluster(uint32_t cluster);
+uint32_t fat32_extend_chain(uint32_t cluster, uint32_t count);
+fat32_error_t fat32_truncate_chain(uint32_t cluster);
 
 uint32_t fat32_first_sector(uint32_t cluster);
 
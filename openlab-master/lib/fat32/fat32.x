@@ -1,11 +1,11 @@
 define show_pool
 	set $i = 0
-	set $pool_size = 14
+	set $pool_size = 30
 
 	printf "Pool content\n"
 	printf "============\n"
 	while $i < $pool_size
-		printf "pool[%2d] --> dirty: %d\t\tpage: %7d\t\tuse: %3d\n", $i, pool[$i].dirty, pool[$i].page, pool[$i].use
+		printf "pool[%2d] --> valid: %d\tdirty: %d\tpage: %7d\treferenced: %d\tloading: %d\twriting: %d\n", $i, pool[$i].valid, pool[$i].dirty, pool[$i].page, pool[$i].referenced, pool[$i].loading, pool[$i].writing
 		set $i = $i + 1
 	end
 end
@@ -21,7 +21,7 @@ define show_buffer
 	printf "Buffer content\n"
 	printf "==============\n"
 	printf "pool[%d]:\n", $i
-	printf "\tdirty: %d   page: %d   use: %d\n", pool[$i].dirty, pool[$i].page, pool[$i].use
+	printf "\tvalid: %d   dirty: %d   page: %d   referenced: %d\n", pool[$i].valid, pool[$i].dirty, pool[$i].page, pool[$i].referenced
 	printf "\tcontent:"
 	while $j < 512
 		if $j % 16 == 0
@@ -42,8 +42,17 @@ typedef struct
     uint16_t descriptor_index;
 
     dir_entry_t dir;
+
+    // Streaming mode, see file_stream()
+    bool stream;
+    uint32_t prealloc;
+    uint32_t checkpoint;
+    uint32_t sectors_since_checkpoint;
 } _file_t;
 
+static fat32_error_t file_next_cluster(_file_t *file);
+static fat32_error_t file_write_size(_file_t *file);
+
 fat32_error_t file_create_next(uint8_t *basename, uint8_t *ext, uint8_t *buffer, file_t *f)
 {
     uint8_t cpt = 0;
@@ -94,6 +103,7 @@ fat32_error_t file_create(uint8_t *filename, uint8_t *page_buffer, file_t *f)
     file->sector_index = 0;
     file->pbuf = page_buffer;
     file->buffer_index = 0;
+    file->stream = false;
 
     *f = file;
 
@@ -116,17 +126,33 @@ fat32_error_t file_open(uint8_t *filename, uint8_t *page_buffer, file_t *f)
     file->sector_index = 0;
     file->pbuf = page_buffer;
     file->buffer_index = 0;
+    file->stream = false;
 
     *f = file;
 
     return FAT32_OK;
 }
 
+fat32_error_t file_stream(file_t f, uint32_t prealloc, uint32_t checkpoint)
+{
+    _file_t *file = (_file_t*)f;
+
+    if (prealloc == 0)
+    {
+        return FAT32_WRONG_CLUSTER;
+    }
+
+    file->stream = true;
+    file->prealloc = prealloc;
+    file->checkpoint = checkpoint;
+    file->sectors_since_checkpoint = 0;
+
+    return FAT32_OK;
+}
+
 fat32_error_t file_write(file_t f, uint8_t *buf, uint16_t size)
 {
-    uint32_t tmp;
     uint16_t max, l;
-    uint8_t t[4];
     fat32_error_t ret;
     _file_t *file = (_file_t*)f;
     uint8_t *b = file->pbuf + file->buffer_index;
@@ -146,28 +172,25 @@ fat32_error_t file_write(file_t f, uint8_t *buf, uint16_t size)
             return FAT32_FS_ERROR;
         }
 
-        // This write updates the file size
-        write32(t, file->dir.size);
-
-        if (fs_write(file->descriptor_sector, file->descriptor_index + 28, t, 4) != 4)
+        // In streaming mode the file size is only updated on checkpoints
+        if (!file->stream || ((file->checkpoint != 0) && (++file->sectors_since_checkpoint >= file->checkpoint)))
         {
-            return FAT32_FS_ERROR;
+            file->sectors_since_checkpoint = 0;
+
+            if ((ret = file_write_size(file)) != FAT32_OK)
+            {
+                return ret;
+            }
         }
 
         file->sector_index++;
 
         if (file->sector_index == fat.sect_per_clust)
         {
-            tmp = fat32_find_empty_cluster();
-
-            if ((ret = fat32_set_next_cluster(file->current_cluster, tmp)) != FAT32_OK)
+            if ((ret = file_next_cluster(file)) != FAT32_OK)
             {
                 return ret;
             }
-
-            file->current_cluster = tmp;
-            file->current_sector = fat32_first_sector(tmp);
-            file->sector_index = 0;
         }
         else
         {
@@ -237,15 +260,53 @@ fat32_error_t file_read(file_t f, uint8_t *buf, uint16_t *size)
     return FAT32_OK;
 }
 
-fat32_error_t file_close(file_t f)
+// Move the file to the next cluster of its chain, allocating it if needed
+static fat32_error_t file_next_cluster(_file_t *file)
 {
-    uint8_t buf[4];
-    _file_t *file = (_file_t*)f;
+    uint32_t tmp;
+    fat32_error_t ret;
 
-    if (fs_write(file->current_sector, 0, file->pbuf, 512) != 512)
+    if (file->stream)
     {
-        return FAT32_FS_ERROR;
+        // Use the preallocated clusters, and preallocate a new run at its end
+        tmp = fat32_get_next_cluster(file->current_cluster);
+
+        if ((tmp & 0x0FFFFFF8) == 0x0FFFFFF8)
+        {
+            if (fat32_extend_chain(file->current_cluster, file->prealloc) == 0)
+            {
+                return FAT32_NO_FREE_CLUSTER;
+            }
+
+            tmp = fat32_get_next_cluster(file->current_cluster);
+        }
+
+        if (tmp == 1)
+        {
+            return FAT32_FS_ERROR;
+        }
     }
+    else
+    {
+        tmp = fat32_find_empty_cluster();
+
+        if ((ret = fat32_set_next_cluster(file->current_cluster, tmp)) != FAT32_OK)
+        {
+            return ret;
+        }
+    }
+
+    file->current_cluster = tmp;
+    file->current_sector = fat32_first_sector(tmp);
+    file->sector_index = 0;
+
+    return FAT32_OK;
+}
+
+// Write the file size in the directory entry
+static fat32_error_t file_write_size(_file_t *file)
+{
+    uint8_t buf[4];
 
     write32(buf, file->dir.size);
 
@@ -257,6 +318,31 @@ fat32_error_t file_close(file_t f)
     return FAT32_OK;
 }
 
+fat32_error_t file_close(file_t f)
+{
+    fat32_error_t ret;
+    _file_t *file = (_file_t*)f;
+
+    if (fs_write(file->current_sector, 0, file->pbuf, 512) != 512)
+    {
+        return FAT32_FS_ERROR;
+    }
+
+    // Release the preallocated clusters that have not been used
+    if (file->stream && ((ret = fat32_truncate_chain(file->current_cluster)) != FAT32_OK))
+    {
+        return ret;
+    }
+
+    if ((ret = file_write_size(file)) != FAT32_OK)
+    {
+        return ret;
+    }
+
+    // Save the free clusters information
+    return fat32_sync();
+}
+
 fat32_error_t file_rename(file_t f, uint8_t *filename)
 {
     _file_t *file = (_file_t*)f;
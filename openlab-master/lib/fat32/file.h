@@ -116,6 +116,26 @@ fat32_error_t file_close(file_t f);
  */
 fat32_error_t file_write(file_t f, uint8_t *buf, uint16_t size);
 
+/** Switch a file to streaming mode
+ * In streaming mode, clusters are preallocated by contiguous runs of prealloc clusters, so that the chain
+ * is extended once per run instead of at each cluster boundary. The FAT entries of a run are still
+ * written one per cluster, but they share the same FAT sectors, which the buffer pool writes back together.
+ * Data sectors are written sequentially, which lets the buffer pool send them with multiple blocks writes.
+ * The file size in the directory entry is only updated every checkpoint written sectors and on file_close,
+ * which releases the unused preallocated clusters.
+ * \note Crash consistency: after a reset without file_close, the file size is the one of the last checkpoint,
+ * data written after it is lost. The preallocated clusters stay in the file clusters chain and are only
+ * recovered by a file system check. As FAT, directory and data sectors are written back asynchronously by
+ * the buffer pool, a checkpoint may reach the device before the data it covers.
+ *
+ * \param f The file descriptor of a file created with file_create
+ * \param prealloc The number of clusters preallocated at once, must not be 0
+ * \param checkpoint The number of written sectors between two updates of the file size, 0 to update it
+ * only on close
+ * \return FAT32_OK in case of success or FAT32_WRONG_CLUSTER if prealloc is 0
+ */
+fat32_error_t file_stream(file_t f, uint32_t prealloc, uint32_t checkpoint);
+
 /** Sequencial read 
  * This function reads a buffer of data from the device. All read operations are sequencial.
  *
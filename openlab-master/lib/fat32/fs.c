@@ -27,39 +27,56 @@
 #include "semphr.h"
 #include "task.h"
 #include "platform.h"
-#include "sdio.h"
+#include "blockdev.h"
 #include "buf_util.h"
 #include "fs.h"
 #include "printf.h"
 #include "debug.h"
 
-/**
- * \todo verify that when scanning the pool to find the less used buffer,
- * the result is consistent (i.e. after the loop the result is indeed the
- * less used buffer). Maybe it does not matter
- */
+#define FS_POOL_SIZE  30
 
-extern sdio_t sdio;
+// Number of buckets of the page index, must be a power of two
+#define FS_HASH_SIZE  32
 
-#define FS_POOL_SIZE  30
+// Max number of consecutive dirty pages written with one command
+#define FS_MAX_WRITE_BATCH 8
+
+// Number of pages read with one command on sequential read misses
+#ifndef FS_READ_AHEAD
+#define FS_READ_AHEAD 4
+#endif
 
 #define MAX_RETRY          3
 #define MAX_FAILED_ATTEMPT 10
 
-#define MAX_USE            254
+#define HASH(page) ((page) & (FS_HASH_SIZE - 1))
+
+typedef enum {LOAD_OK, LOAD_NO_BUFFER, LOAD_FAILED} load_result_t;
 
 // Buffer pool itself
 static buffer_t pool[FS_POOL_SIZE];
 
+// Page index, first buffer of each bucket or -1
+static int8_t bucket[FS_HASH_SIZE];
+
+// Lock protecting the buffers status, the page index and the clock hand
+static xSemaphoreHandle pool_mutex;
+
+// Eviction clock hand
+static uint8_t clock_hand;
+
+// Last page read on a miss, to detect sequential reads
+static uint32_t last_miss;
+
 // Semaphore indicating how much dirty buffers there is
 static xSemaphoreHandle dirty_sem;
 
 // Mutexes for resource management
 static xSemaphoreHandle sd_access_mutex, sd_transfer_mutex;
 
-// Mutex for thread waiting for a clean buffer to be available
+// Semaphore for thread waiting for a clean buffer to be available,
+// the number of waiting threads is protected by the pool lock
 static xSemaphoreHandle waiting_for_clean_mutex;
-static xSemaphoreHandle waiting_mutex;
 static uint16_t num_waiting;
 
 // Prototype for write task function
@@ -68,8 +85,11 @@ static void vWriteTask(void *pvParameters);
 // Error recovery
 static uint16_t failed_attempt;
 
-// SD card error
-static sd_error_t transfer_error;
+// Block device transfer error
+static int transfer_error;
+
+// Statistics, protected by the pool lock
+static fs_stats_t stats;
 
 #define min(a,b) ((a)<(b)?(a):(b))
 
@@ -77,7 +97,7 @@ void transfer_handler(handler_arg_t arg)
 {
     signed portBASE_TYPE pxHigherPriorityTaskWoken;
 
-    transfer_error = (sd_error_t)arg;
+    transfer_error = (int)(intptr_t)arg;
 
     xSemaphoreGiveFromISR(sd_transfer_mutex, &pxHigherPriorityTaskWoken);
 
@@ -101,81 +121,181 @@ fs_error_t fs_init()
     sd_access_mutex = xSemaphoreCreateMutex();
     sd_transfer_mutex = xSemaphoreCreateCounting(1, 0);
 
-    // Initialize the "waiting for clean buffer" mutex
+    // Initialize the "waiting for clean buffer" semaphore
     waiting_for_clean_mutex = xSemaphoreCreateCounting(1, 0);
-    waiting_mutex = xSemaphoreCreateMutex();
     num_waiting = 0;
 
     failed_attempt = 0;
 
-    // Create all buffers mutexes and initializes the buffer descriptors
+    // Initialize the pool lock, the page index and the buffer descriptors
+    pool_mutex = xSemaphoreCreateMutex();
+    clock_hand = 0;
+    last_miss = 0;
+
+    for (i = 0; i < FS_HASH_SIZE; i++)
+    {
+        bucket[i] = -1;
+    }
+
     for (i = 0; i < FS_POOL_SIZE; i++)
     {
-        pool[i].vMutex = xSemaphoreCreateMutex();
         pool[i].vContentMutex = xSemaphoreCreateMutex();
-        pool[i].dirty = false;
         pool[i].page = 0;
-        pool[i].use = 0;
+        pool[i].valid = false;
+        pool[i].dirty = false;
+        pool[i].loading = false;
+        pool[i].writing = false;
+        pool[i].referenced = false;
+        pool[i].next = -1;
     }
 
-    if (sd_init(sdio) != SD_NO_ERROR)
+    if (blockdev_init() != BLOCKDEV_OK)
     {
         return FS_MEDIUM_INIT_ERROR;
     }
 
-    sd_set_transfer_handler(sdio, transfer_handler);
+    blockdev_set_transfer_handler(transfer_handler);
 
     xTaskCreate(vWriteTask, (signed char *)"SDWrite", configMINIMAL_STACK_SIZE, NULL, 2, NULL);
 
     return FS_OK;
 }
 
-buffer_t *reserve_buffer()
+void fs_get_stats(fs_stats_t *s)
 {
-    int i, j = -1;
-    uint8_t use_min = MAX_USE + 1;
+    xSemaphoreTake(pool_mutex, portMAX_DELAY);
+    *s = stats;
+    xSemaphoreGive(pool_mutex);
+}
 
-    // Find the less used and not dirty buffer
-    for (i = 0; i < FS_POOL_SIZE; i++)
-    {
-        // Lock the buffer while we are examining it
-        xSemaphoreTake(pool[i].vMutex, portMAX_DELAY);
+inline static void pool_lock()
+{
+    xSemaphoreTake(pool_mutex, portMAX_DELAY);
+    stats.lock_ops++;
+}
 
-        // Only try if the buffer is not dirty, otherwise
-        // it needs to be written on the micro SD card
-        if (!pool[i].dirty)
-        {
-            // If the buffer is less used than the previous one...
-            if (pool[i].use < use_min)
-            {
-                use_min = pool[i].use;
+inline static void pool_unlock()
+{
+    stats.lock_ops++;
+    xSemaphoreGive(pool_mutex);
+}
 
-                // Release the previous buffer as we found a better one
-                if (j != -1)
-                {
-                    xSemaphoreGive(pool[j].vMutex);
-                }
+/*
+ * Page index, all functions are called with the pool lock held
+ */
+static buffer_t *lookup(uint32_t page)
+{
+    int8_t i;
 
-                j = i;
-                // Do not release the chosen buffer
-                continue;
-            }
+    for (i = bucket[HASH(page)]; i != -1; i = pool[i].next)
+    {
+        if (pool[i].page == page)
+        {
+            return &(pool[i]);
         }
-
-        // Release the buffer as it is not interesting (either dirty or more used)
-        xSemaphoreGive(pool[i].vMutex);
     }
 
-    if (j != -1)
+    return NULL;
+}
+
+static void index_insert(buffer_t *b, uint32_t page)
+{
+    b->page = page;
+    b->valid = true;
+    b->next = bucket[HASH(page)];
+    bucket[HASH(page)] = b - pool;
+}
+
+static void index_remove(buffer_t *b)
+{
+    int8_t *i = &(bucket[HASH(b->page)]);
+
+    while (*i != -1)
     {
-        // Return the chose buffer, it is still locked
-        return &(pool[j]);
+        if (&(pool[*i]) == b)
+        {
+            *i = b->next;
+            break;
+        }
+
+        i = &(pool[*i].next);
     }
-    else
+
+    b->valid = false;
+    b->next = -1;
+}
+
+/*
+ * Find a clean buffer to evict with the CLOCK algorithm, buffers accessed
+ * since the last turn of the hand get a second chance.
+ * Called with the pool lock held, return NULL if all buffers are dirty or busy.
+ */
+static buffer_t *reserve_buffer()
+{
+    int i;
+    buffer_t *b;
+
+    // After one turn every reference bit is cleared
+    for (i = 0; i < 2 * FS_POOL_SIZE; i++)
     {
-        // If all buffers were dirty, return NULL
-        return NULL;
+        b = &(pool[clock_hand]);
+        clock_hand = (clock_hand + 1) % FS_POOL_SIZE;
+
+        // Dirty buffers need to be written on the micro SD card first
+        if (b->dirty || b->loading)
+        {
+            continue;
+        }
+
+        if (b->referenced)
+        {
+            b->referenced = false;
+            continue;
+        }
+
+        if (b->valid)
+        {
+            index_remove(b);
+        }
+
+        return b;
     }
+
+    return NULL;
+}
+
+/*
+ * Wait for the end of the transfer of a buffer content.
+ * Called with the pool lock held, it is released while waiting.
+ */
+static void wait_transfer(buffer_t *b)
+{
+    stats.lock_ops += 2;
+    pool_unlock();
+
+    xSemaphoreTake(b->vContentMutex, portMAX_DELAY);
+    xSemaphoreGive(b->vContentMutex);
+
+    pool_lock();
+}
+
+/*
+ * Wait for the writing thread to clean a buffer.
+ * Called with the pool lock held, it is released while waiting.
+ */
+static void wait_clean_buffer()
+{
+    // All buffers are dirty, so we need to wait until one clean buffer
+    // is available. The buffer allocation will be hopefully done in the
+    // next iteration
+    log_warning("No buffer available");
+    num_waiting++;
+    pool_unlock();
+
+    xSemaphoreTake(waiting_for_clean_mutex, portMAX_DELAY);
+
+    pool_lock();
+    num_waiting--;
 }
 
 inline static void failed()
@@ -188,7 +308,7 @@ inline static void failed()
         failed_attempt = 0;
         xSemaphoreTake(sd_access_mutex, portMAX_DELAY);
 
-        if (sd_init(sdio) != SD_NO_ERROR)
+        if (blockdev_init() != BLOCKDEV_OK)
         {
             log_error("Cannot reinit SD card");
 
@@ -206,382 +326,385 @@ inline static void passed()
     failed_attempt = 0;
 }
 
-inline static sd_error_t safe_read(uint32_t page, uint8_t *buf)
+// Read 'num' buffers of consecutive pages, starting at buffers[0] page
+inline static int safe_read(buffer_t **buffers, int num)
 {
-    sd_error_t ret;
+    int ret;
+    uint8_t *content[FS_READ_AHEAD];
+    uint32_t page = buffers[0]->page;
+    int i;
+
+    for (i = 0; i < num; i++)
+    {
+        content[i] = buffers[i]->content;
+    }
 
     // Take medium access lock
     xSemaphoreTake(sd_access_mutex, portMAX_DELAY);
 
-    if (sd_get_type(sdio) != SDHC)
+    ret = blockdev_read(page, content, num);
+
+    if (ret == BLOCKDEV_OK)
     {
-        ret = sd_read_single_block(sdio, page * 512ul, buf);
+        // Wait for DMA transfer to be completed
+        xSemaphoreTake(sd_transfer_mutex, portMAX_DELAY);
+
+        // Check if no error occured during transfer
+        if (transfer_error != BLOCKDEV_OK)
+        {
+            ret = transfer_error;
+        }
     }
-    else
+
+    // Realease medium access lock
+    xSemaphoreGive(sd_access_mutex);
+
+    return ret;
+}
+
+// Write 'num' buffers holding consecutive pages, starting at buffers[0] page
+inline static int safe_write(buffer_t **buffers, int num)
+{
+    int ret;
+    uint8_t *content[FS_MAX_WRITE_BATCH];
+    uint32_t page = buffers[0]->page;
+    int i;
+
+    for (i = 0; i < num; i++)
     {
-        ret = sd_read_single_block(sdio, page, buf);
+        content[i] = buffers[i]->content;
     }
 
-    if (ret == SD_NO_ERROR)
+    xSemaphoreTake(sd_access_mutex, portMAX_DELAY);
+
+    ret = blockdev_write(page, content, num);
+
+    if (ret == BLOCKDEV_OK)
     {
         // Wait for DMA transfer to be completed
         xSemaphoreTake(sd_transfer_mutex, portMAX_DELAY);
 
         // Check if no error occured during transfer
-        if (transfer_error != SD_NO_ERROR)
+        if (transfer_error != BLOCKDEV_OK)
         {
-            ret = FS_READ_FAILED;
+            ret = transfer_error;
         }
     }
 
-    // Realease medium access lock
     xSemaphoreGive(sd_access_mutex);
 
     return ret;
 }
 
-inline static sd_error_t safe_write(buffer_t *buffer)
+/*
+ * Load 'page' in the pool, with the following ones if reads are sequential.
+ * Called with the pool lock held, it is released during the transfer.
+ */
+static load_result_t load_pages(uint32_t page)
 {
-    sd_error_t ret = SD_NO_ERROR;
+    buffer_t *batch[FS_READ_AHEAD];
+    int i, num = 1;
+    int ret = BLOCKDEV_OK;
+    uint32_t size;
 
-    xSemaphoreTake(sd_access_mutex, portMAX_DELAY);
+    if (page == last_miss + 1)
+    {
+        num = FS_READ_AHEAD;
+    }
+
+    // Do not read ahead past the end of the device
+    size = blockdev_num_blocks();
 
-    if (sd_get_type(sdio) != SDHC)
+    if ((page < size) && ((uint32_t)num > size - page))
     {
-        ret = sd_write_single_block(sdio, buffer->page * 512ul, buffer->content);
+        num = size - page;
     }
-    else
+
+    for (i = 0; i < num; i++)
     {
-        ret = sd_write_single_block(sdio, buffer->page, buffer->content);
+        // Stop on pages already loaded or when there is no clean buffer left
+        if (((i != 0) && (lookup(page + i) != NULL)) || ((batch[i] = reserve_buffer()) == NULL))
+        {
+            break;
+        }
+
+        // Pages read ahead are evicted first if they are not used
+        index_insert(batch[i], page + i);
+        batch[i]->loading = true;
+        batch[i]->referenced = (i == 0);
+
+        // Nobody else takes the content lock of a clean buffer
+        xSemaphoreTake(batch[i]->vContentMutex, portMAX_DELAY);
     }
 
-    if (ret == SD_NO_ERROR)
+    if ((num = i) == 0)
     {
-        // As we wrote the page on the micro SD card, the flash page is
-        // consistent with the buffer, so the page is not dirty anymore
-        buffer->dirty = false;
-        buffer->use = 1;
+        return LOAD_NO_BUFFER;
+    }
 
-        // Wait for DMA transfer to be completed
-        xSemaphoreTake(sd_transfer_mutex, portMAX_DELAY);
+    last_miss = page + num - 1;
+    stats.misses++;
+    stats.read_ahead += num - 1;
+    stats.lock_ops += 2 * num;
+    pool_unlock();
 
-        // Check if no error occured during transfer
-        if (transfer_error != SD_NO_ERROR)
+    // Read the pages
+    for (i = 0; i < MAX_RETRY; i++)
+    {
+        if ((ret = safe_read(batch, num)) == BLOCKDEV_OK)
         {
-            ret = transfer_error;
+            passed();
+            break;
         }
+
+        log_warning("Read attempt #%d failed: %d", i, ret);
+        failed();
     }
 
-    xSemaphoreGive(sd_access_mutex);
+    pool_lock();
 
-    return ret;
+    for (i = 0; i < num; i++)
+    {
+        batch[i]->loading = false;
+
+        if (ret != BLOCKDEV_OK)
+        {
+            index_remove(batch[i]);
+        }
+
+        xSemaphoreGive(batch[i]->vContentMutex);
+    }
+
+    return (ret == BLOCKDEV_OK) ? LOAD_OK : LOAD_FAILED;
 }
 
 uint16_t fs_write(uint32_t page, uint16_t offset, uint8_t *buf, uint16_t size)
 {
-    uint32_t i;
     uint16_t s = min(size, 512 - offset);
     buffer_t *b;
-    sd_error_t ret;
+    load_result_t ret;
+
+    pool_lock();
+    stats.accesses++;
 
     while (true)
     {
         // Lookup for the page in the pool
-        for (i = 0; i < FS_POOL_SIZE; i++)
-        {
-            // Wait for the header to be readable
-            xSemaphoreTake(pool[i].vMutex, portMAX_DELAY);
+        b = lookup(page);
 
-            if (page == pool[i].page)
+        if ((b == NULL) && (s == 512))
+        {
+            // The whole page is written, it does not need to be loaded
+            if ((b = reserve_buffer()) == NULL)
             {
-                // If the buffer was not dirty, signal to the writing
-                // thread that there is a new dirty buffer
-                if (!pool[i].dirty)
-                {
-                    // If the buffer is not dirty, the writing thread is not using it
-                    // so there is no need to take the content mutex
-                    pool[i].dirty = true;
-
-                    if (pool[i].use < MAX_USE)
-                    {
-                        pool[i].use++;
-                    }
-
-                    cpy(buf, pool[i].content + offset, s);
-
-                    // Signal to the writing thread that there is a new dirty buffer
-                    xSemaphoreGive(dirty_sem);
-
-                    // Release the header lock
-                    xSemaphoreGive(pool[i].vMutex);
-                }
-                else
-                {
-                    // The buffer is dirty, so the writing thread might be being
-                    // writing it to the flash card. We need to take the content lock
-                    xSemaphoreTake(pool[i].vContentMutex, portMAX_DELAY);
-
-                    // If we got through the lock, we need to check if the buffer is
-                    // still dirty, if not, it means that it has been written down to
-                    // the flash card by the writing thread
-                    if (pool[i].use < MAX_USE)
-                    {
-                        pool[i].use++;
-                    }
-
-                    cpy(buf, pool[i].content + offset, s);
-
-                    // The buffer might not be dirty anymore as the writing thread
-                    // might have written the buffer down to the flash while we were
-                    // waiting on the vContentMutex
-                    if (!pool[i].dirty)
-                    {
-                        pool[i].dirty = true;
-                        // Signal to the writing thread that there is a new dirty buffer
-                        xSemaphoreGive(dirty_sem);
-                    }
-
-                    // Release both mutexes
-                    xSemaphoreGive(pool[i].vContentMutex);
-                    xSemaphoreGive(pool[i].vMutex);
-                }
-
-                return s;
+                wait_clean_buffer();
+                continue;
             }
 
-            xSemaphoreGive(pool[i].vMutex);
+            index_insert(b, page);
         }
 
-        // If we end up here, it means that the page is not loaded
-        // First reserve a buffer
-        b = reserve_buffer();
-
-        if (b != NULL)
+        if (b == NULL)
         {
-            // If b is not NULL it means that we successfully allocated a buffer
-
-            if (s != 512)
+            // The page has to be loaded first
+            if ((ret = load_pages(page)) == LOAD_FAILED)
             {
-                for (i = 0; i < MAX_RETRY; i++)
-                {
-                    // In this case, the page has to be loaded first
-                    if ((ret = safe_read(page, b->content)) == SD_NO_ERROR)
-                    {
-                        passed();
-                        break;
-                    }
-
-                    log_warning("Read attempt #%d failed: %d", i, ret);
-                    failed();
-                }
-
-                if (ret != SD_NO_ERROR)
-                {
-                    // If there is an error, report it by telling the
-                    // caller that no byte has been read
-                    s = 0;
-                }
+                // If there is an error, report it by telling the
+                // caller that no byte has been written
+                s = 0;
+                break;
             }
 
-            if (s != 0)
+            if (ret == LOAD_NO_BUFFER)
             {
-                // The buffer is already locked, just update the information
-                b->page = page;
-                b->dirty = true;
-                b->use = 1;
-                cpy(buf, b->content + offset, s);
-
-                // Signal to the writing thread that there is a new dirty buffer
-                xSemaphoreGive(dirty_sem);
+                wait_clean_buffer();
             }
 
-            // After updating the buffer, release the lock
-            xSemaphoreGive(b->vMutex);
+            continue;
+        }
 
-            return s;
+        // The writing thread might be writing the buffer down to the flash,
+        // wait for it to end before modifying the content
+        if (b->loading || b->writing)
+        {
+            wait_transfer(b);
+            continue;
         }
-        else
+
+        cpy(buf, b->content + offset, s);
+        b->referenced = true;
+
+        // If the buffer was not dirty, signal to the writing
+        // thread that there is a new dirty buffer
+        if (!b->dirty)
         {
-            // If b is NULL we've got a problem...
-            // All buffers are dirty, so we need to wait until one clean buffer
-            // is available. The buffer allocation will be hopefully done in the
-            // next iteration
-            log_warning("No buffer available");
-            xSemaphoreTake(waiting_mutex, portMAX_DELAY);
-            num_waiting++;
-            xSemaphoreGive(waiting_mutex);
-
-            xSemaphoreTake(waiting_for_clean_mutex, portMAX_DELAY);
-
-            xSemaphoreTake(waiting_mutex, portMAX_DELAY);
-            num_waiting--;
-            xSemaphoreGive(waiting_mutex);
+            b->dirty = true;
+            xSemaphoreGive(dirty_sem);
         }
+
+        break;
     }
 
-    return 0;
+    pool_unlock();
+    return s;
 }
 
 uint16_t fs_read(uint32_t page, uint16_t offset, uint8_t *buf, uint16_t size)
 {
-    uint32_t i;
     uint16_t s = min(size, 512 - offset);
     buffer_t *b;
-    sd_error_t ret;
+    load_result_t ret;
+
+    pool_lock();
+    stats.accesses++;
 
     while (true)
     {
         // Lookup for the page in the pool
-        for (i = 0; i < FS_POOL_SIZE; i++)
+        b = lookup(page);
+
+        if (b == NULL)
         {
-            xSemaphoreTake(pool[i].vMutex, portMAX_DELAY);
+            // If the page is not already loaded, load it
+            if ((ret = load_pages(page)) == LOAD_FAILED)
+            {
+                // Signal the error
+                s = 0;
+                break;
+            }
 
-            if ((page == pool[i].page) && (pool[i].use != 0))
+            if (ret == LOAD_NO_BUFFER)
             {
-                if (pool[i].use < MAX_USE)
-                {
-                    pool[i].use++;
-                }
-
-                cpy(pool[i].content + offset, buf, s);
-                xSemaphoreGive(pool[i].vMutex);
-                return s;
+                wait_clean_buffer();
             }
 
-            xSemaphoreGive(pool[i].vMutex);
+            continue;
         }
 
-        // If the page is not already loaded, load it
-        b = reserve_buffer();
-
-        if (b != NULL)
+        if (b->loading)
         {
-            // The buffer is already locked, just update the information
-            b->page = page;
-            b->dirty = false;
-            b->use = 1;
-
-            // Read the page
-            for (i = 0; i < MAX_RETRY; i++)
-            {
-                if ((ret = safe_read(page, b->content)) == SD_NO_ERROR)
-                {
-                    // If the page is successfully read, copy the data
-                    cpy(b->content + offset, buf, s);
+            wait_transfer(b);
+            continue;
+        }
 
-                    passed();
-                    break;
-                }
+        // Content is not modified while written on the flash, it can be read
+        cpy(b->content + offset, buf, s);
+        b->referenced = true;
+        break;
+    }
 
-                log_warning("Read attempt #%d failed: %d", i, ret);
-                failed();
-            }
+    pool_unlock();
+    return s;
+}
 
-            if (ret != SD_NO_ERROR)
-            {
-                // Else signal the error
-                s = 0;
-            }
+/*
+ * Find the dirty buffer to write, its page starts a run of dirty pages.
+ * Called with the pool lock held.
+ */
+static buffer_t *select_dirty()
+{
+    buffer_t *b = NULL, *prev;
+    int i;
 
-            // After updating the buffer, release the lock
-            xSemaphoreGive(b->vMutex);
-        }
-        else
+    // Prefer buffers not accessed recently, they are less likely to be written again soon
+    for (i = 0; i < FS_POOL_SIZE; i++)
+    {
+        if (pool[i].dirty && !pool[i].writing && ((b == NULL) || (b->referenced && !pool[i].referenced)))
         {
-            // If b is NULL we've got a problem...
-            // All buffers are dirty, so we need to wait until one clean buffer
-            // is available. The buffer allocation will be hopefully done in the
-            // next iteration
-            log_warning("No buffer available");
-            xSemaphoreTake(waiting_mutex, portMAX_DELAY);
-            num_waiting++;
-            xSemaphoreGive(waiting_mutex);
-
-            xSemaphoreTake(waiting_for_clean_mutex, portMAX_DELAY);
-
-            xSemaphoreTake(waiting_mutex, portMAX_DELAY);
-            num_waiting--;
-            xSemaphoreGive(waiting_mutex);
+            b = &(pool[i]);
         }
     }
 
-    return s;
+    // Go back to the first dirty page of the run
+    while ((b != NULL) && ((prev = lookup(b->page - 1)) != NULL) && prev->dirty && !prev->writing)
+    {
+        b = prev;
+    }
+
+    return b;
 }
 
 void vWriteTask(void *pvParameters)
 {
-    int i, j;
-    uint8_t use_min;
-    sd_error_t ret;
+    int i, num;
+    int ret;
+    buffer_t *b, *batch[FS_MAX_WRITE_BATCH];
 
     while (true)
     {
         // Wait for a buffer to become dirty
         xSemaphoreTake(dirty_sem, portMAX_DELAY);
 
-        j = -1;
-        use_min = MAX_USE + 1;
+        pool_lock();
 
-        // Find the less used and dirty buffer
-        for (i = 0; i < FS_POOL_SIZE; i++)
+        // The semaphore is given back on failed writes, buffers may be clean
+        if ((b = select_dirty()) == NULL)
         {
-            // Lock the buffer while we are examining it
-            xSemaphoreTake(pool[i].vMutex, portMAX_DELAY);
+            pool_unlock();
+            continue;
+        }
 
-            // Only try if the buffer is dirty
-            if (pool[i].dirty)
-            {
-                // If the buffer is less used than the previous one...
-                if (pool[i].use < use_min)
-                {
-                    use_min = pool[i].use;
-
-                    // Release the previous buffer as we found a better one
-                    if (j != -1)
-                    {
-                        xSemaphoreGive(pool[j].vMutex);
-                    }
-
-                    j = i;
-                    // Do not release the chosen buffer
-                    continue;
-                }
-            }
+        // Write the following dirty pages with the same command
+        batch[0] = b;
+        num = 1;
+
+        while ((num < FS_MAX_WRITE_BATCH) && ((b = lookup(batch[0]->page + num)) != NULL) && b->dirty && !b->writing)
+        {
+            // Each dirty buffer gave the semaphore once
+            xSemaphoreTake(dirty_sem, 0);
+            batch[num++] = b;
+        }
 
-            // Release the buffer as it is not interesting (either not dirty or more used than the previous one)
-            xSemaphoreGive(pool[i].vMutex);
+        // Lock buffers content, writers will wait for the end of the write
+        for (i = 0; i < num; i++)
+        {
+            batch[i]->writing = true;
+            xSemaphoreTake(batch[i]->vContentMutex, portMAX_DELAY);
         }
 
-        // Lock buffer content before unlocking buffer header
-        xSemaphoreTake(pool[j].vContentMutex, portMAX_DELAY);
-        xSemaphoreGive(pool[j].vMutex);
+        stats.lock_ops += 2 * num;
+        pool_unlock();
 
-        // We found the best buffer to write on the micro SD card
-        if ((ret = safe_write(&(pool[j]))) != SD_NO_ERROR)
-        {
-            // If write failed leave the buffer dirty and wait for another attempt
-            xSemaphoreGive(dirty_sem);
+        // We found the best buffers to write on the micro SD card
+        ret = safe_write(batch, num);
 
-            log_warning("Write attempt failed on buffer %d (page: %d): %d", j, pool[j].page, ret);
-            failed();
+        pool_lock();
+
+        for (i = 0; i < num; i++)
+        {
+            // As we wrote the pages on the micro SD card, the flash pages are
+            // consistent with the buffers, so the pages are not dirty anymore
+            batch[i]->writing = false;
+            batch[i]->dirty = (ret != BLOCKDEV_OK);
+            xSemaphoreGive(batch[i]->vContentMutex);
         }
-        else
+
+        if (ret != BLOCKDEV_OK)
         {
-            passed();
+            // If write failed leave the buffers dirty and wait for another attempt
+            for (i = 0; i < num; i++)
+            {
+                xSemaphoreGive(dirty_sem);
+            }
 
+            log_warning("Write attempt failed on page %d (%d pages): %d", batch[0]->page, num, ret);
+        }
+        else if (num_waiting > 0)
+        {
             // Signal the thread waiting for a clean buffer (if any)
             // to be available that we just released one
-            xSemaphoreTake(waiting_mutex, portMAX_DELAY);
+            xSemaphoreGive(waiting_for_clean_mutex);
+        }
 
-            if (num_waiting > 0)
-            {
-                xSemaphoreGive(waiting_for_clean_mutex);
-            }
+        pool_unlock();
 
-            xSemaphoreGive(waiting_mutex);
+        if (ret != BLOCKDEV_OK)
+        {
+            failed();
+        }
+        else
+        {
+            passed();
         }
-
-        // Do not forget to unlock the buffer content
-        xSemaphoreGive(pool[j].vContentMutex);
     }
 }
@@ -37,26 +37,36 @@ typedef struct
     // aligned on 4-bytes boundaries. Otherwise the DMA will give crappy results
     uint8_t content[512];
 
-    // Mutex for mutal exclusion on buffer access
-    xSemaphoreHandle vMutex;
-
-    // Mutex for content access lock
+    // Mutex held while the content is transferred with the SD card
     xSemaphoreHandle vContentMutex;
 
-    // Buffer status
-    bool dirty;
-
     // Page location on the SD card
     uint32_t page;
 
-    // Used only for read buffer
-    uint8_t use;
+    // Buffer status, protected by the pool lock
+    bool valid;         // Buffer holds 'page' and is in the page index
+    bool dirty;
+    bool loading;       // Content is being read from the SD card
+    bool writing;       // Content is being written on the SD card
+    bool referenced;    // Accessed since the eviction clock hand last passed
+
+    // Next buffer in the same page index bucket, -1 for none
+    int8_t next;
 } buffer_t __attribute__((aligned(8)));
 
+typedef struct
+{
+    uint32_t accesses;      // Number of fs_read and fs_write calls
+    uint32_t misses;        // Number of pages read on request from the SD card
+    uint32_t read_ahead;    // Number of pages read ahead of sequential reads
+    uint32_t lock_ops;      // Number of mutexes operations on the buffer pool
+} fs_stats_t;
+
 typedef enum {FS_OK, FS_MEDIUM_INIT_ERROR, FS_READ_FAILED} fs_error_t;
 
 fs_error_t fs_init();
 uint16_t fs_write(uint32_t page, uint16_t offset, uint8_t *buf, uint16_t size);
 uint16_t fs_read(uint32_t page, uint16_t offset, uint8_t *buf, uint16_t size);
+void fs_get_stats(fs_stats_t *stats);
 
 #endif
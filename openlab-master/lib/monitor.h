@@ -0,0 +1,134 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/**
+ * \file monitor.h
+ *
+ * \date Oct 2013
+ */
+
+#ifndef MONITOR_H_
+#define MONITOR_H_
+
+/**
+ * \addtogroup lib
+ * @{
+ */
+
+/**
+ * \defgroup monitor Tasks monitoring
+ *
+ * CPU share and stack usage of the FreeRTOS tasks, to size their stacks and
+ * find the tasks hogging the CPU.
+ *
+ * The kernel run time statistics are enabled by building with
+ * -DMONITOR_TASKS=1 given to cmake. The tasks run time is then counted with
+ * the cycle counter, see monitor/monitor_hooks.h; the interrupts are counted
+ * in the run time of the task they interrupt.
+ *
+ * Once started, the tasks are sampled periodically: the CPU share of each
+ * task over the last period, and the stack never used since the task start,
+ * given by uxTaskGetStackHighWaterMark. The period is at most
+ * \ref MONITOR_MAX_PERIOD_S, shorter than the cycle counter wrap around:
+ * 59s on the 72MHz STM32F1, 25s on the 168MHz STM32F4.
+ *
+ * Without MONITOR_TASKS, no task is known.
+ *
+ * @{
+ */
+
+#include <stdint.h>
+#include "handler.h"
+
+/** Maximum number of tasks monitored, the others are ignored */
+#ifndef MONITOR_MAX_TASKS
+#define MONITOR_MAX_TASKS 16
+#endif
+
+/** Longest sampling period, in seconds */
+#define MONITOR_MAX_PERIOD_S 20
+
+/** Size of the task names, truncated, including the terminating 0 */
+#define MONITOR_NAME_LENGTH 8
+
+typedef struct
+{
+    char name[MONITOR_NAME_LENGTH];
+    /** CPU share over the last period, in per-mille */
+    uint16_t cpu;
+    /** Highest CPU share of the periods since the start */
+    uint16_t cpu_max;
+    /** Stack never used since the task start, in words */
+    uint16_t stack_free;
+} monitor_task_t;
+
+/**
+ * Start sampling the tasks periodically.
+ *
+ * The handler is called from the event queue after each sample, to read the
+ * samples with \ref monitor_get_tasks.
+ *
+ * \param period the sampling period, in soft timer ticks, longer ones are
+ *      limited to \ref MONITOR_MAX_PERIOD_S
+ * \param handler the handler called after each sample, or NULL
+ * \param arg the argument of the handler
+ */
+void monitor_start(uint32_t period, handler_t handler, handler_arg_t arg);
+
+/**
+ * Stop sampling the tasks.
+ */
+void monitor_stop();
+
+/**
+ * Get the last samples of the tasks.
+ *
+ * \param tasks the array to fill
+ * \param max the size of the array
+ * \return the number of tasks filled
+ */
+int monitor_get_tasks(monitor_task_t *tasks, int max);
+
+/**
+ * Print the last samples of the tasks, one line per task.
+ */
+void monitor_print();
+
+/**
+ * Shell command printing the tasks samples, and starting the monitoring with
+ * the period in seconds given as argument, up to \ref MONITOR_MAX_PERIOD_S,
+ * or 0 to stop it.
+ */
+int monitor_shell_command(int argc, char **argv);
+
+#define MONITOR_STR(x) #x
+#define MONITOR_XSTR(x) MONITOR_STR(x)
+
+/** Entry of \ref monitor_shell_command for a shell commands table */
+#define MONITOR_SHELL_COMMAND \
+    {"tasks", "[period] Print tasks CPU share and free stack, sample every " \
+        "'period' seconds, up to " MONITOR_XSTR(MONITOR_MAX_PERIOD_S) \
+        ". If 'period' == 0 stop", monitor_shell_command}
+
+/**
+ * @}
+ * @}
+ */
+
+#endif /* MONITOR_H_ */
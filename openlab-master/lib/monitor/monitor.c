@@ -0,0 +1,280 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/*
+ * monitor.c
+ *
+ *  Created on: Oct 2013
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "monitor.h"
+#include "monitor/monitor_kernel.h"
+#include "dwt.h"
+#include "soft_timer.h"
+#include "soft_timer_delay.h"
+#include "printf.h"
+
+typedef struct
+{
+    /** Task handle, NULL if the entry is free */
+    void *task;
+    /** Kernel run time of the task, at its last switch out */
+    unsigned long runtime;
+    /** Run time at the last sample */
+    unsigned long sampled;
+
+    monitor_task_t stats;
+} monitor_entry_t;
+
+static struct
+{
+    monitor_entry_t entries[MONITOR_MAX_TASKS];
+    /** Tasks created while the table was full */
+    uint32_t ignored;
+
+    /** Cycle counter at the last sample */
+    uint32_t sample_time;
+
+    soft_timer_t timer;
+    handler_t handler;
+    handler_arg_t handler_arg;
+} monitor;
+
+static void monitor_sample(handler_arg_t arg);
+
+static monitor_entry_t *find_entry(void *task)
+{
+    int i;
+
+    for (i = 0; i < MONITOR_MAX_TASKS; i++)
+    {
+        if (monitor.entries[i].task == task)
+        {
+            return &monitor.entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+void monitor_task_created(void *task, const signed char *name)
+{
+    monitor_entry_t *entry = find_entry(NULL);
+
+    if (entry == NULL)
+    {
+        monitor.ignored++;
+        return;
+    }
+
+    memset(entry, 0, sizeof(*entry));
+    strncpy(entry->stats.name, (const char *) name, MONITOR_NAME_LENGTH - 1);
+    entry->task = task;
+}
+
+void monitor_task_deleted(void *task)
+{
+    monitor_entry_t *entry = find_entry(task);
+
+    if (entry)
+    {
+        entry->task = NULL;
+    }
+}
+
+void monitor_task_switched_out(void *task, unsigned long runtime)
+{
+    monitor_entry_t *entry = find_entry(task);
+
+    if (entry)
+    {
+        entry->runtime = runtime;
+    }
+}
+
+void monitor_start(uint32_t period, handler_t handler, handler_arg_t arg)
+{
+    int i;
+
+    soft_timer_stop(&monitor.timer);
+
+    if (period > (uint32_t) soft_timer_s_to_ticks(MONITOR_MAX_PERIOD_S))
+    {
+        period = soft_timer_s_to_ticks(MONITOR_MAX_PERIOD_S);
+    }
+
+    /*
+     * Start the periods from now, and restart the highest shares.
+     * This may be called before the scheduler starts, the run times are
+     * only written word by word by the kernel hooks.
+     */
+    monitor.sample_time = dwt_get_cycle_count();
+    for (i = 0; i < MONITOR_MAX_TASKS; i++)
+    {
+        monitor.entries[i].sampled = monitor.entries[i].runtime;
+        monitor.entries[i].stats.cpu_max = 0;
+    }
+
+    monitor.handler = handler;
+    monitor.handler_arg = arg;
+
+    soft_timer_set_handler(&monitor.timer, monitor_sample, NULL);
+    soft_timer_start(&monitor.timer, period, 1);
+}
+
+void monitor_stop()
+{
+    soft_timer_stop(&monitor.timer);
+}
+
+static void monitor_sample(handler_arg_t arg)
+{
+    (void) arg;
+    uint32_t now, elapsed;
+    int i;
+
+    // Neither task switches nor tasks creations while sampling
+    vTaskSuspendAll();
+
+    now = dwt_get_cycle_count();
+    elapsed = now - monitor.sample_time;
+    monitor.sample_time = now;
+
+    for (i = 0; i < MONITOR_MAX_TASKS; i++)
+    {
+        monitor_entry_t *entry = &monitor.entries[i];
+        uint32_t runtime;
+
+        if (entry->task == NULL)
+        {
+            continue;
+        }
+
+        runtime = entry->runtime - entry->sampled;
+        entry->sampled = entry->runtime;
+
+        // The last slices of the period may be counted in the next one
+        entry->stats.cpu = elapsed ? ((uint64_t) runtime * 1000) / elapsed : 0;
+        if (entry->stats.cpu > 1000)
+        {
+            entry->stats.cpu = 1000;
+        }
+        if (entry->stats.cpu > entry->stats.cpu_max)
+        {
+            entry->stats.cpu_max = entry->stats.cpu;
+        }
+
+#if MONITOR_TASKS
+        entry->stats.stack_free = uxTaskGetStackHighWaterMark(entry->task);
+#endif
+    }
+
+    xTaskResumeAll();
+
+    if (monitor.handler)
+    {
+        monitor.handler(monitor.handler_arg);
+    }
+}
+
+int monitor_get_tasks(monitor_task_t *tasks, int max)
+{
+    int i, count = 0;
+
+    vTaskSuspendAll();
+    for (i = 0; i < MONITOR_MAX_TASKS && count < max; i++)
+    {
+        if (monitor.entries[i].task)
+        {
+            tasks[count++] = monitor.entries[i].stats;
+        }
+    }
+    xTaskResumeAll();
+
+    return count;
+}
+
+void monitor_print()
+{
+    monitor_task_t tasks[MONITOR_MAX_TASKS];
+    int i, count;
+
+#if !MONITOR_TASKS
+    printf("Tasks monitoring disabled, build with MONITOR_TASKS=1\n");
+#endif
+
+    count = monitor_get_tasks(tasks, MONITOR_MAX_TASKS);
+
+    printf("    Task   CPU%%   Max%%  Free stack\n");
+    for (i = 0; i < count; i++)
+    {
+        printf("%8s %3u.%u %3u.%u %6u\n", tasks[i].name,
+                tasks[i].cpu / 10, tasks[i].cpu % 10,
+                tasks[i].cpu_max / 10, tasks[i].cpu_max % 10,
+                tasks[i].stack_free);
+    }
+
+    if (monitor.ignored)
+    {
+        printf("%u tasks not monitored\n", monitor.ignored);
+    }
+}
+
+int monitor_shell_command(int argc, char **argv)
+{
+    unsigned long period;
+    char *end;
+
+    if (argc == 1)
+    {
+        monitor_print();
+        return 0;
+    }
+
+    if (argc != 2)
+    {
+        return 1;
+    }
+
+    period = strtoul(argv[1], &end, 10);
+    if (*end != '\0' || end == argv[1] || period > MONITOR_MAX_PERIOD_S)
+    {
+        return 1;
+    }
+
+    if (period)
+    {
+        monitor_start(soft_timer_s_to_ticks(period), NULL, NULL);
+        printf("%s %u\n", argv[0], (unsigned) period);
+    }
+    else
+    {
+        monitor_stop();
+        printf("%s stop\n", argv[0]);
+    }
+
+    return 0;
+}
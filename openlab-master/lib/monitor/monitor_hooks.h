@@ -0,0 +1,57 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/*
+ * monitor_hooks.h
+ *
+ * FreeRTOS configuration of the tasks monitoring, included at the end of the
+ * platforms FreeRTOSConfig.h when building with MONITOR_TASKS, and only
+ * there.
+ *
+ * The kernel run time statistics count with the cycle counter, and the kernel
+ * tells the monitor library when tasks are created, deleted and switched out.
+ * The hooks run in the kernel critical sections and context switch, they
+ * only update the library tasks table.
+ *
+ *  Created on: Oct 2013
+ */
+
+#ifndef MONITOR_HOOKS_H_
+#define MONITOR_HOOKS_H_
+
+#include "dwt.h"
+#include "monitor/monitor_kernel.h"
+
+#undef configGENERATE_RUN_TIME_STATS
+#define configGENERATE_RUN_TIME_STATS   1
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS() dwt_enable_cycle_counter()
+#define portGET_RUN_TIME_COUNTER_VALUE() dwt_get_cycle_count()
+
+#undef INCLUDE_uxTaskGetStackHighWaterMark
+#define INCLUDE_uxTaskGetStackHighWaterMark 1
+
+#define traceTASK_CREATE(pxNewTCB) \
+    monitor_task_created((pxNewTCB), (pxNewTCB)->pcTaskName)
+#define traceTASK_DELETE(pxTCB) \
+    monitor_task_deleted(pxTCB)
+/* The run time of the task being switched out excludes its last slice */
+#define traceTASK_SWITCHED_OUT() \
+    monitor_task_switched_out(pxCurrentTCB, pxCurrentTCB->ulRunTimeCounter)
+
+#endif /* MONITOR_HOOKS_H_ */
@@ -0,0 +1,36 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/*
+ * monitor_kernel.h
+ *
+ * Functions of the monitor library called by the kernel hooks of
+ * monitor_hooks.h.
+ *
+ *  Created on: Oct 2013
+ */
+
+#ifndef MONITOR_KERNEL_H_
+#define MONITOR_KERNEL_H_
+
+void monitor_task_created(void *task, const signed char *name);
+void monitor_task_deleted(void *task);
+void monitor_task_switched_out(void *task, unsigned long runtime);
+
+#endif /* MONITOR_KERNEL_H_ */
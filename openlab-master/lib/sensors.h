@@ -0,0 +1,189 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/**
+ * \file sensors.h
+ *
+ * Synchronised sampling of several sensors.
+ */
+
+#ifndef SENSORS_H_
+#define SENSORS_H_
+
+/**
+ * \addtogroup lib
+ * @{
+ */
+
+/**
+ * \defgroup sensors Sensors sampling library
+ *
+ * Sensors are registered with their target rate, rounded to a divider of a
+ * common base rate. On each tick of the base rate, the sensors due are read
+ * one after the other, the asynchronous reads following each other on the bus
+ * without waiting, and their samples are packed in a single record stored in
+ * a ring. Sensors with the same rate are always sampled on the same tick.
+ *
+ * A record is made of, in network byte order for the header:
+ * - its length, 2 bytes, header included
+ * - its time, 4 bytes, the soft timer time of the tick
+ * - the mask of the sensors sampled, 2 bytes, bit i for the sensor of index i
+ * - the samples, in the sensors index order, as given by their read function
+ *
+ * A sensor whose read fails is left out of the record.
+ *
+ * Consumers drain the ring by batches of records, when notified that enough
+ * records are available.
+ *
+ * @{
+ */
+
+#include <stdint.h>
+#include "handler.h"
+
+/** Maximum number of sensors */
+#define SENSORS_MAX 16
+
+/** Maximum length of a sample */
+#define SENSORS_SAMPLE_MAX_LENGTH 32
+
+/** Length of a record header */
+#define SENSORS_RECORD_HEADER_LENGTH 8
+
+#ifndef SENSORS_RING_SIZE
+/** Size of the records ring */
+#define SENSORS_RING_SIZE 1024
+#endif
+
+/**
+ * Function reading a sample.
+ *
+ * The read is done asynchronously and the handler called with 0 on success,
+ * usually from interrupt context, or the read is done before returning and
+ * the handler called before returning.
+ * Functions like \ref lsm303dlhc_read_acc_async may be used directly.
+ *
+ * \param sample the buffer receiving the sample, 32bit aligned
+ * \param handler the handler to call when the read is done
+ * \param arg the handler argument
+ * \return 0 if the read is started, non zero otherwise
+ */
+typedef unsigned (*sensors_read_t)(void *sample, result_handler_t handler,
+        handler_arg_t arg);
+
+/**
+ * Function called on a sample after a successful read, before storing it.
+ *
+ * \param sample the sample
+ */
+typedef void (*sensors_finalize_t)(void *sample);
+
+/** Statistics of the sampling */
+typedef struct
+{
+    /** Number of ticks with sensors due */
+    uint32_t ticks;
+    /** Number of ticks skipped because the previous reads were not done */
+    uint32_t overruns;
+    /** Number of failed reads */
+    uint32_t errors;
+    /** Number of records stored */
+    uint32_t records;
+    /** Number of records lost because the ring was full */
+    uint32_t dropped;
+} sensors_stats_t;
+
+/**
+ * Register a sensor.
+ *
+ * Sensors can only be registered while the sampling is stopped.
+ *
+ * \param read the function reading a sample
+ * \param finalize the function called on a sample after it is read, may be
+ * NULL
+ * \param length the sample length, at most \ref SENSORS_SAMPLE_MAX_LENGTH
+ * \param rate the target rate in Hz, rounded to a divider of the base rate
+ * \return the sensor index, its bit in the records mask, or -1 on error
+ */
+int sensors_register(sensors_read_t read, sensors_finalize_t finalize,
+        uint8_t length, uint32_t rate);
+
+/**
+ * Start the sampling.
+ *
+ * The ring is emptied.
+ *
+ * \param base_rate the rate of the ticks in Hz, typically the highest sensor
+ * rate
+ * \return 0 on success, 1 if no sensor is registered or the rate is invalid
+ */
+int sensors_start(uint32_t base_rate);
+
+/**
+ * Stop the sampling.
+ *
+ * The reads of the current tick are still completed and recorded.
+ */
+void sensors_stop();
+
+/**
+ * Set the handler notified when records are available.
+ *
+ * The handler is posted to the \ref EVENT_QUEUE_APPLI event queue once the
+ * ring holds at least the given number of records, and again only after a
+ * call to \ref sensors_read_records.
+ *
+ * \param batch the number of records to notify, at least 1
+ * \param handler the handler, NULL to disable the notifications
+ * \param arg the handler argument
+ */
+void sensors_set_ring_handler(uint16_t batch, handler_t handler,
+        handler_arg_t arg);
+
+/**
+ * Read records from the ring.
+ *
+ * As many complete records as the buffer can hold are read, oldest first.
+ *
+ * \param buffer the buffer receiving the records
+ * \param size the buffer size
+ * \return the number of bytes read
+ */
+uint16_t sensors_read_records(uint8_t *buffer, uint16_t size);
+
+/**
+ * Get the number of records in the ring.
+ *
+ * \return the number of records
+ */
+uint16_t sensors_records_count();
+
+/**
+ * Get the sampling statistics, since the last start.
+ *
+ * \param stats the structure to fill
+ */
+void sensors_get_stats(sensors_stats_t *stats);
+
+/**
+ * @}
+ * @}
+ */
+
+#endif /* SENSORS_H_ */
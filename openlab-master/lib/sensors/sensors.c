@@ -0,0 +1,411 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/*
+ * sensors.c
+ *
+ * Synchronised sampling of several sensors.
+ */
+
+#include <string.h>
+
+#include "platform.h"
+#include "soft_timer.h"
+#include "event.h"
+#include "packer.h"
+#include "sensors.h"
+
+#define LOG_LEVEL LOG_LEVEL_WARNING
+#include "printf.h"
+#include "debug.h"
+
+#define RECORD_MAX_LENGTH (SENSORS_RECORD_HEADER_LENGTH \
+        + SENSORS_MAX * SENSORS_SAMPLE_MAX_LENGTH)
+
+static void tick(handler_arg_t arg);
+static void read_next(handler_arg_t arg);
+static void read_done(handler_arg_t arg, unsigned result);
+static void read_end();
+static void record_store();
+static void ring_write(const uint8_t *data, uint16_t length);
+static uint16_t ring_read(uint16_t tail, uint8_t *data, uint16_t length);
+
+static struct
+{
+    struct
+    {
+        sensors_read_t read;
+        sensors_finalize_t finalize;
+        uint8_t length;
+        uint32_t rate;
+        uint32_t divider;
+    } sensor[SENSORS_MAX];
+    uint8_t num;
+
+    soft_timer_t timer;
+    uint8_t running;
+
+    // Tick number and time
+    uint32_t tick;
+    uint32_t time;
+    uint32_t period;
+
+    // Reads of the current tick
+    volatile uint8_t reading;
+    uint16_t due;
+    int8_t current;
+    volatile uint8_t in_read;
+    volatile uint8_t read_ended;
+    volatile unsigned result;
+    uint32_t sample[SENSORS_SAMPLE_MAX_LENGTH / 4];
+
+    // The record being built
+    uint8_t record[RECORD_MAX_LENGTH];
+    uint16_t record_length;
+    uint16_t record_mask;
+
+    // The records ring, written from the event task only
+    uint8_t ring[SENSORS_RING_SIZE];
+    volatile uint16_t ring_head;
+    volatile uint16_t ring_tail;
+    volatile uint16_t ring_records;
+
+    uint16_t batch;
+    handler_t handler;
+    handler_arg_t handler_arg;
+    volatile uint8_t notified;
+
+    sensors_stats_t stats;
+} sensors;
+
+int sensors_register(sensors_read_t read, sensors_finalize_t finalize,
+        uint8_t length, uint32_t rate)
+{
+    int index = sensors.num;
+
+    if (sensors.running || index == SENSORS_MAX || read == NULL
+            || length == 0 || length > SENSORS_SAMPLE_MAX_LENGTH || rate == 0)
+    {
+        return -1;
+    }
+
+    sensors.sensor[index].read = read;
+    sensors.sensor[index].finalize = finalize;
+    sensors.sensor[index].length = length;
+    sensors.sensor[index].rate = rate;
+    sensors.num++;
+
+    return index;
+}
+
+int sensors_start(uint32_t base_rate)
+{
+    int i;
+
+    if (sensors.running || sensors.num == 0 || base_rate == 0
+            || base_rate > SOFT_TIMER_FREQUENCY)
+    {
+        return 1;
+    }
+
+    // Round each rate to the closest divider of the base rate
+    for (i = 0; i < sensors.num; i++)
+    {
+        uint32_t rate = sensors.sensor[i].rate;
+        uint32_t divider = (base_rate + rate / 2) / rate;
+
+        sensors.sensor[i].divider = divider ? divider : 1;
+    }
+
+    sensors.ring_head = 0;
+    sensors.ring_tail = 0;
+    sensors.ring_records = 0;
+    sensors.notified = 0;
+    memset(&sensors.stats, 0, sizeof(sensors.stats));
+
+    sensors.period = SOFT_TIMER_FREQUENCY / base_rate;
+    sensors.tick = 0;
+    sensors.time = soft_timer_time() + sensors.period;
+    sensors.running = 1;
+
+    soft_timer_set_handler(&sensors.timer, tick, NULL);
+    soft_timer_start(&sensors.timer, sensors.period, 1);
+
+    return 0;
+}
+
+void sensors_stop()
+{
+    soft_timer_stop(&sensors.timer);
+    sensors.running = 0;
+}
+
+void sensors_set_ring_handler(uint16_t batch, handler_t handler,
+        handler_arg_t arg)
+{
+    sensors.handler = NULL;
+    sensors.batch = batch ? batch : 1;
+    sensors.handler_arg = arg;
+    sensors.notified = 0;
+    sensors.handler = handler;
+}
+
+uint16_t sensors_read_records(uint8_t *buffer, uint16_t size)
+{
+    uint16_t length = 0, num = 0;
+
+    while (sensors.ring_records - num)
+    {
+        uint8_t header[2];
+        uint16_t record_length;
+
+        // Peek the record length
+        ring_read(sensors.ring_tail, header, 2);
+        packer_uint16_unpack(header, &record_length);
+
+        if (length + record_length > size)
+        {
+            break;
+        }
+
+        // Free the space once the record is copied
+        sensors.ring_tail = ring_read(sensors.ring_tail, buffer + length,
+                                      record_length);
+        length += record_length;
+        num++;
+    }
+
+    platform_enter_critical();
+    sensors.ring_records -= num;
+    sensors.notified = 0;
+    platform_exit_critical();
+
+    return length;
+}
+
+uint16_t sensors_records_count()
+{
+    return sensors.ring_records;
+}
+
+void sensors_get_stats(sensors_stats_t *stats)
+{
+    *stats = sensors.stats;
+}
+
+static void tick(handler_arg_t arg)
+{
+    uint32_t time = sensors.time;
+    uint16_t due = 0;
+    int i;
+
+    (void) arg;
+
+    for (i = 0; i < sensors.num; i++)
+    {
+        if (sensors.tick % sensors.sensor[i].divider == 0)
+        {
+            due |= 1 << i;
+        }
+    }
+
+    sensors.tick++;
+    sensors.time += sensors.period;
+
+    if (due == 0 || !sensors.running)
+    {
+        return;
+    }
+
+    if (sensors.reading)
+    {
+        // The reads are longer than the tick period
+        sensors.stats.overruns++;
+        return;
+    }
+
+    sensors.stats.ticks++;
+    sensors.reading = 1;
+    sensors.due = due;
+    sensors.current = -1;
+
+    packer_uint32_pack(sensors.record + 2, time);
+    sensors.record_length = SENSORS_RECORD_HEADER_LENGTH;
+    sensors.record_mask = 0;
+
+    read_next(NULL);
+}
+
+/*
+ * Read the due sensors one after the other, from the event task.
+ * A read done synchronously is followed directly by the next one, otherwise
+ * the read handler posts the next one.
+ */
+static void read_next(handler_arg_t arg)
+{
+    (void) arg;
+
+    if (sensors.current >= 0)
+    {
+        read_end();
+    }
+
+    while (++sensors.current < sensors.num)
+    {
+        int ended;
+
+        if (!(sensors.due & (1 << sensors.current)))
+        {
+            continue;
+        }
+
+        sensors.in_read = 1;
+        sensors.read_ended = 0;
+
+        if (sensors.sensor[sensors.current].read(sensors.sample, read_done,
+                NULL))
+        {
+            sensors.result = 1;
+            sensors.read_ended = 1;
+        }
+
+        platform_enter_critical();
+        sensors.in_read = 0;
+        ended = sensors.read_ended;
+        platform_exit_critical();
+
+        if (!ended)
+        {
+            // Continued by the read handler
+            return;
+        }
+
+        read_end();
+    }
+
+    record_store();
+    sensors.reading = 0;
+}
+
+static void read_done(handler_arg_t arg, unsigned result)
+{
+    (void) arg;
+
+    sensors.result = result;
+    sensors.read_ended = 1;
+
+    if (!sensors.in_read)
+    {
+        event_post_from_isr(EVENT_QUEUE_APPLI, read_next, NULL);
+    }
+}
+
+static void read_end()
+{
+    int i = sensors.current;
+
+    if (sensors.result)
+    {
+        sensors.stats.errors++;
+        return;
+    }
+
+    if (sensors.sensor[i].finalize)
+    {
+        sensors.sensor[i].finalize(sensors.sample);
+    }
+
+    memcpy(sensors.record + sensors.record_length, sensors.sample,
+            sensors.sensor[i].length);
+    sensors.record_length += sensors.sensor[i].length;
+    sensors.record_mask |= 1 << i;
+}
+
+static void record_store()
+{
+    uint16_t used = (sensors.ring_head + SENSORS_RING_SIZE - sensors.ring_tail)
+                    % SENSORS_RING_SIZE;
+    int notify;
+
+    if (sensors.record_mask == 0)
+    {
+        return;
+    }
+
+    if (used + sensors.record_length >= SENSORS_RING_SIZE)
+    {
+        sensors.stats.dropped++;
+        log_warning("Sensors ring full");
+        return;
+    }
+
+    packer_uint16_pack(sensors.record, sensors.record_length);
+    packer_uint16_pack(sensors.record + 6, sensors.record_mask);
+    ring_write(sensors.record, sensors.record_length);
+    sensors.stats.records++;
+
+    platform_enter_critical();
+    sensors.ring_records++;
+    notify = sensors.handler && !sensors.notified
+             && sensors.ring_records >= sensors.batch;
+
+    if (notify)
+    {
+        sensors.notified = 1;
+    }
+
+    platform_exit_critical();
+
+    if (notify)
+    {
+        event_post(EVENT_QUEUE_APPLI, sensors.handler, sensors.handler_arg);
+    }
+}
+
+static void ring_write(const uint8_t *data, uint16_t length)
+{
+    uint16_t head = sensors.ring_head;
+    uint16_t chunk = SENSORS_RING_SIZE - head;
+
+    if (chunk > length)
+    {
+        chunk = length;
+    }
+
+    memcpy(sensors.ring + head, data, chunk);
+    memcpy(sensors.ring, data + chunk, length - chunk);
+
+    // Published once the data is written
+    sensors.ring_head = (head + length) % SENSORS_RING_SIZE;
+}
+
+static uint16_t ring_read(uint16_t tail, uint8_t *data, uint16_t length)
+{
+    uint16_t chunk = SENSORS_RING_SIZE - tail;
+
+    if (chunk > length)
+    {
+        chunk = length;
+    }
+
+    memcpy(data, sensors.ring + tail, chunk);
+    memcpy(data + chunk, sensors.ring, length - chunk);
+
+    return (tail + length) % SENSORS_RING_SIZE;
+}
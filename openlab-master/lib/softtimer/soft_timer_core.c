@@ -31,6 +31,7 @@
 #include "timer.h"
 #include "event.h"
 #include "soft_timer.h"
+#include "trace.h"
 
 #define LOG_LEVEL LOG_LEVEL_ERROR
 #include "printf.h"
@@ -356,7 +357,9 @@ static void process(handler_arg_t arg)
         log_error("Failed to get soft timer mutex");
         HALT();
     }
-    
+
+    TRACE_BEGIN(TRACE_ID_SOFTTIM_PROCESS, 0);
+
     // Clear posted flag (having the mutex)
     softtim.alarm_posted = 0;
     softtim.alarm_scheduled = 0;
@@ -399,6 +402,7 @@ static void process(handler_arg_t arg)
             // Call timer handler
             if (x->handler)
             {
+                TRACE_POINT(TRACE_ID_SOFTTIM_FIRE, x->handler);
                 event_post(x->priority, x->handler, x->handler_arg);
             }
         }
@@ -430,6 +434,8 @@ static void process(handler_arg_t arg)
         }
     }
 
+    TRACE_END(TRACE_ID_SOFTTIM_PROCESS, 0);
+
     // Release mutex
     xSemaphoreGive(softtim_mutex);
 }
@@ -441,6 +447,8 @@ static void timer_alarm(handler_arg_t arg, uint16_t count)
         return;
     }
 
+    TRACE_POINT(TRACE_ID_SOFTTIM_ALARM, count);
+
     // Post an event to process this timer
     softtim.process_posted = 1;
     event_post_from_isr(softtim.priority, process, NULL);
@@ -0,0 +1,187 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/**
+ * \file trace.h
+ *
+ * \date Oct 2013
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+/**
+ * \addtogroup lib
+ * @{
+ */
+
+/**
+ * \defgroup trace Trace points
+ *
+ * Timing traces, light enough not to change the timings they show, unlike the
+ * logs.
+ *
+ * Each trace point records its id, the cycle counter and an argument in a RAM
+ * ring, from a task or an interrupt service routine, without taking any lock.
+ * The ring holds the last \ref TRACE_RING_LENGTH records; it is printed by
+ * \ref trace_dump, or read from the \ref trace_buffer variable by a debugger:
+ *
+ *     (gdb) dump binary value trace.bin trace_buffer
+ *
+ * tools/trace2chrome.py converts either of them to a Chrome trace, to be
+ * viewed in chrome://tracing or Perfetto.
+ *
+ * The trace points are compiled in by building with -DTRACE_POINTS=1 given
+ * to cmake, and are empty otherwise; the ring is then not linked in, and the
+ * cycle counter is not started. The event dispatch, the soft timers and
+ * the PHY state machines have trace points, applications define theirs from
+ * \ref TRACE_ID_USER on.
+ *
+ * @{
+ */
+
+#include <stdint.h>
+
+/**
+ * Trace points ids.
+ *
+ * Their names, without the TRACE_ID_ prefix, are read from this file by the
+ * tools; the first word of the name is the track of the trace point.
+ */
+typedef enum
+{
+    /* Event handlers, argument is the handler */
+    TRACE_ID_EVENT_APPLI = 0x01,
+    TRACE_ID_EVENT_NETWORK = 0x02,
+
+    /* Soft timers processing, alarm interrupt and handlers posted */
+    TRACE_ID_SOFTTIM_PROCESS = 0x10,
+    TRACE_ID_SOFTTIM_ALARM = 0x11,
+    TRACE_ID_SOFTTIM_FIRE = 0x12,
+
+    /* PHY state, radio interrupt, frame read and RX end, in soft timer ticks */
+    TRACE_ID_PHY_STATE = 0x20,
+    TRACE_ID_PHY_IRQ = 0x21,
+    TRACE_ID_PHY_RX_READ = 0x22,
+    TRACE_ID_PHY_RX_END = 0x23,
+
+    /** First id of the applications trace points */
+    TRACE_ID_USER = 0x100,
+} trace_id_t;
+
+/** Kind of trace point, stored in the upper bits of the id */
+typedef enum
+{
+    TRACE_KIND_POINT = 0,
+    TRACE_KIND_BEGIN = 1,
+    TRACE_KIND_END = 2,
+    TRACE_KIND_VALUE = 3,
+} trace_kind_t;
+
+#define TRACE_KIND_SHIFT 14
+#define TRACE_ID_MASK ((1 << TRACE_KIND_SHIFT) - 1)
+
+/** Number of records of the ring, a power of 2 */
+#ifndef TRACE_RING_LENGTH
+#define TRACE_RING_LENGTH 256
+#endif
+
+/** Identifies the trace buffer in a memory dump, "TRCE" */
+#define TRACE_MAGIC 0x45435254
+
+typedef struct
+{
+    /** Cycle counter */
+    uint32_t cycles;
+    /** Argument of the trace point */
+    uint32_t arg;
+    /** Trace point id and kind */
+    uint16_t id;
+    /** Lower bits of the record number, written last */
+    uint16_t number;
+} trace_record_t;
+
+typedef struct
+{
+    uint32_t magic;
+    /** Cycle counter frequency, in Hz */
+    uint32_t frequency;
+    uint32_t length;
+    /** Number of records, the next one is at count % length */
+    volatile uint32_t count;
+    /** Set while dumping */
+    volatile uint32_t paused;
+
+    trace_record_t ring[TRACE_RING_LENGTH];
+} trace_buffer_t;
+
+/** The trace buffer, for the debuggers */
+extern trace_buffer_t trace_buffer;
+
+#if TRACE_POINTS
+#define TRACE_INIT() trace_init()
+#define TRACE_RECORD(kind, id, arg) \
+    trace_record(((kind) << TRACE_KIND_SHIFT) | (id), (uint32_t) (uintptr_t) (arg))
+#else
+#define TRACE_INIT() do {} while (0)
+#define TRACE_RECORD(kind, id, arg) do {} while (0)
+#endif
+
+/** Record an instant, with an argument */
+#define TRACE_POINT(id, arg) TRACE_RECORD(TRACE_KIND_POINT, id, arg)
+/** Record the start of a duration on the id track */
+#define TRACE_BEGIN(id, arg) TRACE_RECORD(TRACE_KIND_BEGIN, id, arg)
+/** Record the end of the last duration started on the id track */
+#define TRACE_END(id, arg) TRACE_RECORD(TRACE_KIND_END, id, arg)
+/** Record a new value of a counter */
+#define TRACE_VALUE(id, value) TRACE_RECORD(TRACE_KIND_VALUE, id, value)
+
+/**
+ * Start the cycle counter and clear the ring.
+ *
+ * This is done by the event library initialization, with TRACE_INIT.
+ */
+void trace_init();
+
+/**
+ * Record a trace point, use the TRACE_ macros instead.
+ *
+ * \param id the trace point id, and its kind in the upper bits
+ * \param arg the argument of the trace point
+ */
+void trace_record(uint16_t id, uint32_t arg);
+
+/**
+ * Print the records of the ring, from the oldest, pausing the trace points.
+ *
+ * The header line gives the frequency, the length of the ring and the number
+ * of records, then one line per record gives its number, cycles, and its id
+ * and argument in hexadecimal:
+ *
+ *     trace,<frequency>,<length>,<count>
+ *     trace,<number>,<cycles>,<id>,<arg>
+ */
+void trace_dump();
+
+/**
+ * @}
+ * @}
+ */
+
+#endif /* TRACE_H_ */
@@ -0,0 +1,103 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/*
+ * trace.c
+ *
+ *  Created on: Oct 2013
+ */
+
+#include <stdint.h>
+#include "trace.h"
+#include "dwt.h"
+
+#include "printf.h"
+
+#if (TRACE_RING_LENGTH & (TRACE_RING_LENGTH - 1))
+#error "TRACE_RING_LENGTH must be a power of 2"
+#endif
+
+trace_buffer_t trace_buffer;
+
+void trace_init()
+{
+    dwt_enable_cycle_counter();
+
+    trace_buffer.magic = TRACE_MAGIC;
+    trace_buffer.frequency = dwt_get_cycle_frequency();
+    trace_buffer.length = TRACE_RING_LENGTH;
+    trace_buffer.count = 0;
+    trace_buffer.paused = 0;
+}
+
+void trace_record(uint16_t id, uint32_t arg)
+{
+    uint32_t cycles = dwt_get_cycle_count();
+    uint32_t number;
+    trace_record_t *record;
+
+    if (trace_buffer.paused)
+    {
+        return;
+    }
+
+    // Reserve the record, interrupts reserve the following ones
+    number = __sync_fetch_and_add(&trace_buffer.count, 1);
+    record = &trace_buffer.ring[number & (TRACE_RING_LENGTH - 1)];
+
+    record->cycles = cycles;
+    record->arg = arg;
+    record->id = id;
+
+    // The number marks the record complete, an interrupted one is dropped
+    asm volatile("" ::: "memory");
+    record->number = number;
+}
+
+void trace_dump()
+{
+    uint32_t count, number;
+
+    trace_buffer.paused = 1;
+
+    // The clock may have been changed since the init
+    trace_buffer.frequency = dwt_get_cycle_frequency();
+    count = trace_buffer.count;
+
+    printf("trace,%u,%u,%u\n", trace_buffer.frequency, TRACE_RING_LENGTH,
+           count);
+
+    number = count > TRACE_RING_LENGTH ? count - TRACE_RING_LENGTH : 0;
+
+    for (; number != count; number++)
+    {
+        const trace_record_t *record =
+            &trace_buffer.ring[number & (TRACE_RING_LENGTH - 1)];
+
+        if (record->number != (uint16_t) number)
+        {
+            continue;
+        }
+
+        printf("trace,%u,%u,%04x,%08x\n", number, record->cycles,
+               record->id, record->arg);
+    }
+
+    trace_buffer.paused = 0;
+}
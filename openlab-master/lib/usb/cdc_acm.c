@@ -72,11 +72,16 @@
 #define ENDPOINT_0_SIZE            64
 
 #define CDC_ACM_EP_COMM_SIZE       16
-#define CDC_ACM_EP_DATAOUT_SIZE    16
-#define CDC_ACM_EP_DATAIN_SIZE     16
+#define CDC_ACM_EP_DATAOUT_SIZE    64   // full speed bulk max, double buffered
+#define CDC_ACM_EP_DATAIN_SIZE     64   // full speed bulk max, double buffered
 
-#define CDC_ACM_TXBUF_SIZE         128
-#define CDC_ACM_RXBUF_SIZE         CDC_ACM_EP_DATAOUT_SIZE    
+/* TX and RX rings, sizes can be set at build time */
+#ifndef CDC_ACM_TXBUF_SIZE
+#define CDC_ACM_TXBUF_SIZE         512
+#endif
+#ifndef CDC_ACM_RXBUF_SIZE
+#define CDC_ACM_RXBUF_SIZE         256
+#endif
 
 /* ************************************************************ */
 /* ************************************************************ */
@@ -166,7 +171,8 @@ static const usb_endp_desc_t cdc_acm_data_endp_desc[] =
         .bInterval          = 0,
         .class_specific     = 0,
         .class_specific_len = 0,
-        .endpoint_callback  = cdc_acm_data_out
+        .endpoint_callback  = cdc_acm_data_out,
+        .double_buffered    = true
     },
     {
         .bLength            = USB_ENDP_DESC_SIZE,
@@ -177,7 +183,8 @@ static const usb_endp_desc_t cdc_acm_data_endp_desc[] =
         .bInterval          = 0,
         .class_specific     = 0,
         .class_specific_len = 0,
-        .endpoint_callback  = cdc_acm_data_in
+        .endpoint_callback  = cdc_acm_data_in,
+        .double_buffered    = true
     }
 };
 
@@ -359,14 +366,36 @@ static cdc_acm_line_coding_t line_coding = {
     .bDataBits    = 8
 };
 
+/*
+ * TX ring, filled by cdc_acm_send() and emptied by the IN endpoint.
+ * One packet is copied to the endpoint packet memory while the previous
+ * one is sent. A zero length packet ends a transfer that stops on a
+ * full packet, so that the host does not wait for more data.
+ */
 static uint8_t  tx_buf[ CDC_ACM_TXBUF_SIZE ] __attribute__((aligned(4)));
-static uint16_t tx_len   = 0;
+static volatile uint16_t tx_len   = 0;
 static uint16_t tx_write = 0;    // write ptr
 static uint16_t tx_read  = 0;    // read ptr
+static uint8_t  tx_pkt[ CDC_ACM_EP_DATAIN_SIZE ] __attribute__((aligned(4)));
+static bool     tx_prepared = false;   // packet written to the endpoint, not released
+static uint16_t tx_last_len = 0;       // length of the last packet written
 
+/*
+ * RX ring, filled by the OUT endpoint when no data callback is
+ * registered. The host is NAKed while the ring has no room for a packet.
+ */
 static uint8_t  rx_buf[ CDC_ACM_RXBUF_SIZE ] __attribute__((aligned(4)));
+static volatile uint16_t rx_len   = 0;
+static uint16_t rx_write = 0;    // write ptr
+static uint16_t rx_read  = 0;    // read ptr
+static uint8_t  rx_pkt[ CDC_ACM_EP_DATAOUT_SIZE ] __attribute__((aligned(4)));
 static cdc_acm_data_callback_t rx_cb = NULL;
 
+static handler_t     tx_handler = NULL;
+static handler_arg_t tx_handler_arg;
+static handler_t     rx_handler = NULL;
+static handler_arg_t rx_handler_arg;
+
 /* ************************************************************ */
 /* **** Public Functions ************************************** */
 /* ************************************************************ */
@@ -376,114 +405,208 @@ void cdc_acm_register_rx_callback(cdc_acm_data_callback_t cb_rx)
     rx_cb = cb_rx;
 }
 
+void cdc_acm_set_rx_handler(handler_t handler, handler_arg_t arg)
+{
+    rx_handler_arg = arg;
+    rx_handler     = handler;
+}
+
+void cdc_acm_set_tx_handler(handler_t handler, handler_arg_t arg)
+{
+    tx_handler_arg = arg;
+    tx_handler     = handler;
+}
+
 /* 
- * this function is called both from user context via cdc_acm_send()
- * and from  cdc_acm_data_in() in interrupt context.
- * Data are protected using eint/dint..
+ * Endpoints functions are called both from user context with
+ * interrupts disabled and from the endpoints handlers in interrupt
+ * context. Data are protected using eint/dint..
  */
 
 #define dint()   platform_enter_critical() // asm volatile("cpsid i\n")
 #define eint()   platform_exit_critical()  // asm volatile("cpsie i\n")
 
-void cdc_acm_send_to_endpoint()
+/*
+ * Copy the next packet of the TX ring to the application buffer of
+ * the IN endpoint.
+ */
+static void cdc_acm_prepare_packet()
 {
-    uint16_t txr,txw,txl,len;
+    uint16_t i,len,max;
 
-    dint();
-    txr = tx_read;
-    txw = tx_write;
-    txl = tx_len;
-    eint();
-    len = 0;
+    if (tx_prepared)
+    {
+        return;
+    }
 
-    if (txl == 0)
+    max = usb_get_max_packet_size( CDC_ACM_EP_DATAIN );
+    len = (tx_len < max) ? tx_len : max;
+
+    if ((len == 0) && (tx_last_len != max))
     {
-        //DBG("=");
+        // nothing to send, previous transfer ended with a short packet
         return;
     }
 
-    if (txl > 0)
+    for (i = 0; i < len; i++)
     {
-        if (txw > txr)
-        {
-            len = txw - txr;
-        }
-        else
+        tx_pkt[i] = tx_buf[tx_read];
+        tx_read++;
+        if (tx_read >= sizeof(tx_buf))
         {
-            len = sizeof(tx_buf) - txr;
+            tx_read = 0;
         }
     }
+    tx_len = tx_len - len;
 
-    if (len > usb_get_max_packet_size( CDC_ACM_EP_DATAIN ))
+    log_debug("cdc_acm tx %d bytes to host",len);
+    usb_dbl_send( CDC_ACM_EP_DATAIN, tx_pkt, len);
+    tx_last_len = len;
+    tx_prepared = true;
+}
+
+void cdc_acm_send_to_endpoint()
+{
+    cdc_acm_prepare_packet();
+
+    if (tx_prepared && !usb_dbl_send_pending( CDC_ACM_EP_DATAIN ))
     {
-        len = usb_get_max_packet_size( CDC_ACM_EP_DATAIN );
+        usb_dbl_send_release( CDC_ACM_EP_DATAIN );
+        tx_prepared = false;
+
+        // copy the next packet while this one is sent
+        cdc_acm_prepare_packet();
     }
+}
 
-    if (len > 0)
+uint16_t cdc_acm_tx_space()
+{
+    return sizeof(tx_buf) - tx_len;
+}
+
+static uint16_t cdc_acm_write(const uint8_t *buf, uint16_t len)
+{
+    uint16_t i;
+    uint16_t txw;
+
+    // tx_write is only used here, the IN endpoint only frees space
+    txw = tx_write;
+    for (i = 0; i < len; i++)
     {
-        log_debug("cdc_acm tx %d bytes to host",len);
-        usb_send( CDC_ACM_EP_DATAIN, true, NO_CHANGE, &(tx_buf[txr]), len);
+        tx_buf[txw] = buf[i];
+        txw++;
+
+        if (txw >= sizeof(tx_buf))
+        {
+            txw = 0;
+        }
     }
 
+    // update pointers and send to endpoint if idle
     dint();
-    tx_len  = tx_len  - len;
-    tx_read = tx_read + len;
-    if (tx_read >= sizeof(tx_buf))
-    {
-        tx_read = 0;
-    }
+    tx_write = txw;
+    tx_len   = tx_len + len;
+    cdc_acm_send_to_endpoint();
     eint();
-}
 
+    return len;
+}
 
 uint16_t cdc_acm_send(uint8_t *buf, uint16_t len)
 {
-    uint16_t i = 0;
-    uint16_t txr,txw,txl;
+    uint16_t space = cdc_acm_tx_space();
+    uint16_t n     = (len < space) ? len : space;
 
-    // buffer pointers snapshot
-    dint();
-    txr = tx_read;
-    txw = tx_write;
-    txl = tx_len;
-    eint();
+    cdc_acm_write(buf, n);
 
-    // write to buffer
-    if ((txl == 0) || (txw != txr))
+    if (n < len)
     {
-        for (i = 0; i < len; i++)
-        {
-            tx_buf[txw] = buf[i];
-            txw++;
+        log_warning("cdc_acm tx to host buffer overflow of %d bytes on %d bytes msg", len - n, len);
+    }
 
-            if (txw >= sizeof(tx_buf))
-            {
-                txw = 0;
-            }
+    return n;
+}
 
-            if (txw == txr)
-            {
-                i++;
-                break;
-            }
+int cdc_acm_send_frame(const uint8_t *buf, uint16_t len)
+{
+    if (cdc_acm_tx_space() < len)
+    {
+        return 1;
+    }
+
+    cdc_acm_write(buf, len);
+    return 0;
+}
+
+/*
+ * Move the packet received on the OUT endpoint to the RX ring
+ */
+static void cdc_acm_receive_packet()
+{
+    uint16_t i,len;
+
+    if (!usb_dbl_recv_pending( CDC_ACM_EP_DATAOUT ))
+    {
+        return;
+    }
+    if ((sizeof(rx_buf) - rx_len) < usb_get_max_packet_size( CDC_ACM_EP_DATAOUT ))
+    {
+        // no room, keep the host NAKed until data is read
+        return;
+    }
+
+    usb_dbl_recv_release( CDC_ACM_EP_DATAOUT );
+    len = usb_dbl_recv_get_len( CDC_ACM_EP_DATAOUT );
+    usb_dbl_recv( CDC_ACM_EP_DATAOUT, rx_pkt, len);
+    log_debug("cdc_acm rx %d bytes from host",len);
+
+    for (i = 0; i < len; i++)
+    {
+        rx_buf[rx_write] = rx_pkt[i];
+        rx_write++;
+        if (rx_write >= sizeof(rx_buf))
+        {
+            rx_write = 0;
         }
     }
+    rx_len = rx_len + len;
+}
 
-    // update pointers
-    dint();
-    tx_write = txw;
-    tx_len   = tx_len + i;
-    eint();
+uint16_t cdc_acm_rx_count()
+{
+    return rx_len;
+}
 
-    // send to endpoint if empty
-    cdc_acm_send_to_endpoint();
+uint16_t cdc_acm_recv(uint8_t *buf, uint16_t len)
+{
+    uint16_t i;
+    uint16_t rxr;
+
+    if (len > rx_len)
+    {
+        len = rx_len;
+    }
 
-    if (i < len)
+    // rx_read is only used here, the OUT endpoint only adds data
+    rxr = rx_read;
+    for (i = 0; i < len; i++)
     {
-        log_warning("cdc_acm tx to host buffer overflow of %d bytes on %d bytes msg", len - i, len);
+        buf[i] = rx_buf[rxr];
+        rxr++;
+        if (rxr >= sizeof(rx_buf))
+        {
+            rxr = 0;
+        }
     }
 
-    return i;
+    // update pointers and receive the packet waiting for room
+    dint();
+    rx_read = rxr;
+    rx_len  = rx_len - len;
+    cdc_acm_receive_packet();
+    eint();
+
+    return len;
 }
 
 /* ************************************************************ */
@@ -509,6 +632,11 @@ static void cdc_acm_data_in(uint8_t endp, bool rx, bool tx)
 
     //DBG("i");
     cdc_acm_send_to_endpoint();
+
+    if (tx_handler)
+    {
+        tx_handler(tx_handler_arg);
+    }
 }
 
 // from host to device
@@ -524,16 +652,20 @@ static void cdc_acm_data_out(uint8_t endp, bool rx, bool tx)
     //DBG("o");
     if (rx_cb)
     {
-        len = usb_recv_get_len(endp);
-        usb_recv(endp, rx_buf, len);  // len < sizeof(rx_buf) in #defines
+        usb_dbl_recv_release(endp);
+        len = usb_dbl_recv_get_len(endp);
+        usb_dbl_recv(endp, rx_pkt, len);  // len <= sizeof(rx_pkt) in #defines
         log_debug("cdc_acm rx %d bytes from host",len);
-        rx_cb(rx_buf, len);
+        rx_cb(rx_pkt, len);
     }
     else
     {
-        log_warning("No receive callback available");
+        cdc_acm_receive_packet();
+        if (rx_handler)
+        {
+            rx_handler(rx_handler_arg);
+        }
     }
-    usb_recv_set_status(endp, STAT_RX_VALID);
 }
 
 
@@ -29,16 +29,65 @@
 #ifndef __USB_CDC_ACM_H
 #define __USB_CDC_ACM_H
 
+#include "handler.h"
+
 extern const usb_profile_t usb_cdc_acm;
 
 /**
  * USB CDC ACM Application Interface 
+ *
+ * Data endpoints are 64 bytes double buffered bulk endpoints.
+ * Sent data are queued in a TX ring, received data are either given to
+ * the registered callback or queued in a RX ring.
+ * Functions are not reentrant, each direction should be used from a
+ * single context.
  */
 
 typedef void (*cdc_acm_data_callback_t)(uint8_t *buf, uint16_t len);
 
+/**
+ * Register a callback called in interrupt context for each received packet.
+ * When set, the RX ring is not used.
+ */
 void cdc_acm_register_rx_callback(cdc_acm_data_callback_t cb_rx);
 
+/**
+ * Queue data to be sent to the host.
+ *
+ * \return the number of bytes queued, data not fitting in the TX ring are lost
+ */
 uint16_t cdc_acm_send(uint8_t *buf, uint16_t len);
 
+/**
+ * Queue a complete frame to be sent to the host, or nothing.
+ *
+ * \return 0 if the frame was queued, 1 if there is not enough space
+ */
+int cdc_acm_send_frame(const uint8_t *buf, uint16_t len);
+
+/** Get the free space in the TX ring */
+uint16_t cdc_acm_tx_space();
+
+/**
+ * Set a handler called in interrupt context when space is freed in the
+ * TX ring, to resume a pending transfer.
+ */
+void cdc_acm_set_tx_handler(handler_t handler, handler_arg_t arg);
+
+/**
+ * Read data received from the host in the RX ring.
+ *
+ * \return the number of bytes read
+ */
+uint16_t cdc_acm_recv(uint8_t *buf, uint16_t len);
+
+/** Get the number of bytes waiting in the RX ring */
+uint16_t cdc_acm_rx_count();
+
+/**
+ * Set a handler called in interrupt context when data is added to the
+ * RX ring.
+ */
+void cdc_acm_set_rx_handler(handler_t handler, handler_arg_t arg);
+
 #endif
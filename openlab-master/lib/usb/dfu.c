@@ -30,6 +30,10 @@
 #include "dfu.h"
 #include "storage.h"
 
+#include "flash.h"
+#include "crc.h"
+#include "event.h"
+
 #define NO_DEBUG_HEADER
 #define LOG_LEVEL LOG_LEVEL_DEBUG
 #include "printf.h"
@@ -118,14 +122,34 @@ typedef enum
 
 #define DFU_DETACH_TIMEOUT         0xff00 // ms
 
+/*
+ * Size of the blocks sent by the host, one flash page at least.
+ * Two blocks are buffered in RAM: one is received while the other is
+ * programmed.
+ */
+#ifndef DFU_TRANSFER_SIZE
+#define DFU_TRANSFER_SIZE ((FLASH_SIZE_PAGE < 1024) ? 1024 : FLASH_SIZE_PAGE)
+#endif
+
+/*
+ * Flash area receiving the firmware, the upper half by default so that the
+ * running firmware is kept until the new one is verified and copied.
+ */
+#ifndef DFU_FLASH_START
+#define DFU_FLASH_START FLASH_MEMORY_UPPER
+#endif
+#ifndef DFU_FLASH_SIZE
+#define DFU_FLASH_SIZE  FLASH_MEMORY_HALF_SIZE
+#endif
+
 const usb_dfu_func_desc_t dfu_func_desc[] =
 {
     {
         .bLength            = 0x09,
         .bDescriptorType    = 0x21,  // DFU Functionnal
-        .bmAttributes       = DFU_CAN_UPLOAD | DFU_CAN_DOWNLOAD,
+        .bmAttributes       = DFU_CAN_UPLOAD | DFU_CAN_DOWNLOAD | DFU_MANIFEST_TOL,
         .wDetachTimeOut     = DFU_DETACH_TIMEOUT, // ms
-        .wMaxPacketSize     = 256,   // up to 2048 | flash page size ?
+        .wMaxPacketSize     = DFU_TRANSFER_SIZE, // wTransferSize
         .bcdDFUVersion      = 0x0100 // DFU 1.0
     }
 };
@@ -258,6 +282,52 @@ static uint8_t  usb_dfu_state             = DFU_STATE_appIDLE;
 static uint8_t  usb_dfu_state_next        = DFU_STATE_appIDLE;
 static uint32_t usb_dfu_getstatus_timeout = GET_STATUS_TIMEOUT;
 
+/**
+ * Poll timeouts in DFU mode, in ms. The host is told to poll again right
+ * away when a block buffer is free, so that the next block is received while
+ * the previous one is programmed.
+ */
+#define DFU_BUSY_TIMEOUT      10
+#define DFU_MANIFEST_TIMEOUT  10
+
+typedef enum
+{
+    DFU_BUF_FREE    = 0,
+    DFU_BUF_FILLING = 1, // data stage in progress
+    DFU_BUF_READY   = 2  // waiting to be programmed
+} dfu_buf_state_t;
+
+typedef struct
+{
+    uint8_t data[DFU_TRANSFER_SIZE] __attribute__((aligned(4)));
+    uint32_t address;
+    uint16_t len;
+    volatile uint8_t state;
+} dfu_buf_t;
+
+/*
+ * DFU mode download state. Blocks are received in the USB interrupt and
+ * programmed from the application event queue, buffers are used in turn.
+ */
+static struct
+{
+    dfu_buf_t buf[2];
+
+    uint8_t  filling;       // buffer receiving the next block
+    uint8_t  programmed;    // buffer to program next
+    uint16_t received;      // bytes of the block received so far
+    uint16_t block;         // expected block number
+    uint32_t offset;        // image length received, or upload offset
+    uint32_t erased;        // image length already erased
+
+    volatile uint8_t state;
+    volatile uint8_t status;
+    volatile uint8_t manifest; // image received, verification pending
+} dfu;
+
+static void dfu_mode_reset();
+static void dfu_program(handler_arg_t arg);
+
 /* ************************************************** */
 /* ************************************************** */
 /* ************************************************** */
@@ -268,6 +338,8 @@ void usb_dfu_init()
     usb_dfu_state_next        = DFU_STATE_appIDLE;
     usb_dfu_getstatus_timeout = GET_STATUS_TIMEOUT;
 
+    dfu_mode_reset();
+
     //! \todo Select the internal clock to have a 1kHz tick
     // timer_select_internal_clock(tim6, (timer_get_frequency(tim6) / 1000) - 1);
 }
@@ -391,10 +463,253 @@ static void dfu_mode_standard_interface(usb_device_request_t *req)
     }
 }
 
+static void dfu_mode_reset()
+{
+    dfu.filling    = dfu.programmed;
+    dfu.received   = 0;
+    dfu.offset     = 0;
+    dfu.erased     = 0;
+    dfu.manifest   = 0;
+    dfu.status     = DFU_STATUS_OK;
+    dfu.state      = DFU_STATE_dfuIDLE;
+}
+
+/* Report an error on the current request, the host reads it with GETSTATUS */
+static void dfu_mode_error(uint8_t status)
+{
+    dfu.status = status;
+    dfu.state  = DFU_STATE_dfuERROR;
+
+    usb_send_set_status(0, STAT_TX_STALL);
+    usb_recv_set_status(0, STAT_RX_STALL);
+}
+
+static bool dfu_mode_download_data(uint8_t endp)
+{
+    uint16_t len = usb_recv_get_len(endp);
+    dfu_buf_t *b = &dfu.buf[dfu.filling];
+
+    if (dfu.received + len > b->len)
+    {
+        len = b->len - dfu.received;
+    }
+
+    usb_recv(endp, b->data + dfu.received, len);
+    dfu.received += len;
+
+    if (dfu.received < b->len)
+    {
+        // The stage is NAKed after each packet, receive the next one
+        usb_recv_set_status(endp, STAT_RX_VALID);
+        return false;
+    }
+
+    // Pad the last block to a word with erased flash value
+    while (dfu.received % 4)
+    {
+        b->data[dfu.received++] = 0xFF;
+    }
+
+    b->state = DFU_BUF_READY;
+    dfu.filling ^= 1;
+    dfu.offset += b->len;
+    dfu.block++;
+    dfu.state = DFU_STATE_dfuDNLOAD_SYNC;
+
+    if (event_post_from_isr(EVENT_QUEUE_APPLI, dfu_program, NULL))
+    {
+        log_error("DFU: failed to post block programming");
+        dfu.status = DFU_STATUS_errUNKNOWN;
+    }
+
+    usb_send_status(endp, true);
+    return true;
+}
+
+static void dfu_mode_download(usb_device_request_t *req)
+{
+    dfu_buf_t *b;
+
+    if (req->wLength == 0)
+    {
+        // End of the image, verify it
+        if (dfu.state != DFU_STATE_dfuDNLOAD_IDLE)
+        {
+            dfu_mode_error(DFU_STATUS_errNOTDONE);
+            return;
+        }
+
+        dfu.manifest = 1;
+        dfu.state = DFU_STATE_dfuMANIFEST_SYNC;
+        if (event_post_from_isr(EVENT_QUEUE_APPLI, dfu_program, NULL))
+        {
+            dfu.status = DFU_STATUS_errUNKNOWN;
+        }
+
+        usb_send_status(0, true);
+        return;
+    }
+
+    if (dfu.state == DFU_STATE_dfuIDLE)
+    {
+        // New image, the CRC covers all its blocks
+        dfu_mode_reset();
+        dfu.block = req->wValue;
+        crc_enable();
+        crc_reset();
+    }
+    else if (dfu.state != DFU_STATE_dfuDNLOAD_IDLE)
+    {
+        dfu_mode_error(DFU_STATUS_errUNKNOWN);
+        return;
+    }
+
+    b = &dfu.buf[dfu.filling];
+
+    if ((req->wLength > DFU_TRANSFER_SIZE) || (b->state != DFU_BUF_FREE))
+    {
+        dfu_mode_error(DFU_STATUS_errUNKNOWN);
+        return;
+    }
+
+    // Only the last block may be short, blocks are written contiguously
+    if ((req->wValue != dfu.block) || (dfu.offset % DFU_TRANSFER_SIZE)
+            || (dfu.offset + req->wLength > DFU_FLASH_SIZE))
+    {
+        dfu_mode_error(DFU_STATUS_errADDRESS);
+        return;
+    }
+
+    b->state = DFU_BUF_FILLING;
+    b->address = DFU_FLASH_START + dfu.offset;
+    b->len = req->wLength;
+    dfu.received = 0;
+
+    // Prepare for the incoming data stage
+    usb_set_next_data_callback(0, dfu_mode_download_data);
+    usb_start_stage(0, false);
+}
+
+static void dfu_mode_upload(usb_device_request_t *req)
+{
+    uint32_t len = req->wLength;
+
+    if (dfu.state == DFU_STATE_dfuIDLE)
+    {
+        dfu.offset = 0;
+    }
+    else if (dfu.state != DFU_STATE_dfuUPLOAD_IDLE)
+    {
+        dfu_mode_error(DFU_STATUS_errUNKNOWN);
+        return;
+    }
+
+    if (dfu.offset + len > DFU_FLASH_SIZE)
+    {
+        len = DFU_FLASH_SIZE - dfu.offset;
+    }
+
+    // A short block ends the upload
+    dfu.state = (len < req->wLength) ? DFU_STATE_dfuIDLE : DFU_STATE_dfuUPLOAD_IDLE;
+
+    usb_send(0, true, DATA1, (const uint8_t *)(DFU_FLASH_START + dfu.offset), len);
+    dfu.offset += len;
+}
+
+static void dfu_mode_get_status()
+{
+    usb_dfu_status_t status;
+    uint32_t timeout = 0;
+    uint8_t state = dfu.state;
+
+    switch (state)
+    {
+        case DFU_STATE_dfuDNLOAD_SYNC:
+        case DFU_STATE_dfuDNBUSY:
+
+            // Ask for the next block as soon as its buffer is free
+            if (dfu.buf[dfu.filling].state == DFU_BUF_FREE)
+            {
+                state = DFU_STATE_dfuDNLOAD_IDLE;
+            }
+            else
+            {
+                state = DFU_STATE_dfuDNBUSY;
+                timeout = DFU_BUSY_TIMEOUT;
+            }
+
+            break;
+
+        case DFU_STATE_dfuMANIFEST_SYNC:
+        case DFU_STATE_dfuMANIFEST:
+
+            // Manifestation tolerant, back to idle once verified
+            if (dfu.manifest)
+            {
+                state = DFU_STATE_dfuMANIFEST;
+                timeout = DFU_MANIFEST_TIMEOUT;
+            }
+            else
+            {
+                state = DFU_STATE_dfuIDLE;
+            }
+
+            break;
+
+        default:
+            break;
+    }
+
+    if (dfu.status != DFU_STATUS_OK)
+    {
+        state = DFU_STATE_dfuERROR;
+    }
+
+    dfu.state = state;
+
+    status.bStatus = dfu.status;
+    status.bwPollTimeout[0] = (timeout >>  0) & 0xff;
+    status.bwPollTimeout[1] = (timeout >>  8) & 0xff;
+    status.bwPollTimeout[2] = (timeout >> 16) & 0xff;
+    status.bState  = state;
+    status.iString = 0;
+    usb_send(0, true, DATA1, (const uint8_t *)&status, sizeof(status));
+}
+
 static void dfu_mode_class_interface(usb_device_request_t *req)
 {
+    static uint8_t state;
+
     switch (req->bRequest)
     {
+        case DFU_REQ_DNLOAD:
+            dfu_mode_download(req);
+            break;
+        case DFU_REQ_UPLOAD:
+            dfu_mode_upload(req);
+            break;
+        case DFU_REQ_GETSTATUS:
+            dfu_mode_get_status();
+            break;
+        case DFU_REQ_CLRSTATUS:
+            if (dfu.state == DFU_STATE_dfuERROR)
+            {
+                dfu.status = DFU_STATUS_OK;
+                dfu.state = DFU_STATE_dfuIDLE;
+            }
+
+            usb_send_status(0, true);
+            break;
+        case DFU_REQ_GETSTATE:
+            state = dfu.state;
+            usb_send(0, true, DATA1, &state, 1);
+            break;
+        case DFU_REQ_ABORT:
+            // Blocks already received are still programmed
+            dfu.manifest = 0;
+            dfu.state = DFU_STATE_dfuIDLE;
+            usb_send_status(0, true);
+            break;
         default:
             log_error("DFU mode : interface request not handled: bRequest = 0x%02X bmRequestType = 0x%02X wValue = 0x%04X wIndex = 0x%04X wLength = 0x%04X",
                       req->bRequest, req->bmRequestType, req->wValue, req->wIndex, req->wLength);
@@ -402,6 +717,90 @@ static void dfu_mode_class_interface(usb_device_request_t *req)
     }
 }
 
+/* ************************************************** */
+/* DFU mode programming, in the event queue           */
+/* ************************************************** */
+
+static flash_status_t dfu_erase_to(uint32_t end)
+{
+    flash_status_t ret = FLASH_OK;
+
+    if (end > DFU_FLASH_SIZE)
+    {
+        end = DFU_FLASH_SIZE;
+    }
+
+    while ((ret == FLASH_OK) && (dfu.erased < end))
+    {
+        ret = flash_erase_page(DFU_FLASH_START + dfu.erased);
+        dfu.erased += FLASH_SIZE_PAGE;
+    }
+
+    return ret;
+}
+
+static void dfu_program(handler_arg_t arg)
+{
+    (void) arg;
+
+    while (dfu.buf[dfu.programmed].state == DFU_BUF_READY)
+    {
+        dfu_buf_t *b = &dfu.buf[dfu.programmed];
+        uint32_t words = (b->len + 3) / 4;
+
+        if (dfu.status == DFU_STATUS_OK)
+        {
+            if (dfu_erase_to(b->address - DFU_FLASH_START + b->len) != FLASH_OK)
+            {
+                dfu.status = DFU_STATUS_errERASE;
+            }
+            else if (flash_program(b->address, (const uint32_t *) b->data, words) != FLASH_OK)
+            {
+                dfu.status = DFU_STATUS_errPROG;
+            }
+            else
+            {
+                crc_compute((const uint32_t *) b->data, words);
+            }
+        }
+
+        b->state = DFU_BUF_FREE;
+        dfu.programmed ^= 1;
+    }
+
+    if (dfu.status != DFU_STATUS_OK)
+    {
+        dfu.manifest = 0;
+        return;
+    }
+
+    if (dfu.manifest)
+    {
+        // Check the whole image in flash against the received data
+        uint32_t expected = crc_terminate();
+
+        crc_reset();
+        crc_compute((const uint32_t *) DFU_FLASH_START, (dfu.offset + 3) / 4);
+
+        if (crc_terminate() != expected)
+        {
+            log_error("DFU: image CRC mismatch");
+            dfu.status = DFU_STATUS_errVERIFY;
+        }
+
+        crc_disable();
+        dfu.manifest = 0;
+        return;
+    }
+
+    // Erase the pages of the next block while it is received
+    if ((dfu.state != DFU_STATE_dfuIDLE)
+            && (dfu_erase_to(dfu.offset + DFU_TRANSFER_SIZE) != FLASH_OK))
+    {
+        dfu.status = DFU_STATUS_errERASE;
+    }
+}
+
 /* ************************************************** */
 /* ************************************************** */
 /* ************************************************** */
@@ -348,46 +348,69 @@ typedef enum {
 static scsi_params_t  params;
 
 /* MSC command, status and state   */
-static msc_cbw_t         cbw;                         // 31
-static msc_state_t       msc_state = MSC_STATE_NONE;  //  4
-static msc_csw_status_t  msc_csw_status;              //  4
+static msc_cbw_t            cbw;                         // 31
+static volatile msc_state_t msc_state = MSC_STATE_NONE;  //  4
+static msc_csw_status_t     msc_csw_status;              //  4
 
 /*
  * Data Buffers
  * 
- * when the buffer has been used (write + read) 
- * it must be released by setting len = 0 
+ * msc_buff is a ring of buffers shared between the SCSI backend, that
+ * runs in the event queue, and the endpoints interrupts. A buffer
+ * belongs to the producer while len == 0 and to the consumer once it
+ * has been closed with len != 0. The consumer releases it by setting
+ * len = 0 again.
+ *
+ *   DATA IN  : the backend fills msc_buff_write, the IN interrupt
+ *              sends msc_buff_read packet by packet
+ *   DATA OUT : the OUT interrupt fills msc_buff_write, the backend
+ *              writes msc_buff_read
+ *
+ * The endpoint transfer of buffer k thus runs while the backend
+ * reads or writes buffer k+1. The status (CSW) is queued in the
+ * ring after the data.
  */
 
-/* data buffers, 512 is a SD-Card block size */
-#define MSC_BUFFER_SIZE  512
+/* data buffers, a multiple of the SD-Card block size (512) */
+#ifndef MSC_BUFFER_SIZE
+#define MSC_BUFFER_SIZE  (4 * 512)
+#endif
 
 typedef struct {
-    uint8_t  data[MSC_BUFFER_SIZE];
-    uint16_t idx;
-    uint16_t len;
+    uint8_t           data[MSC_BUFFER_SIZE];
+    volatile uint16_t idx;
+    volatile uint16_t len;
 } msc_data_buff_t;
 
-/*
- * msc_buff is a circular array of buffers. 2 should do it.
- * At this point of dev&test we are strictly sequential and ordered.
- * Next release may have asyn double buffered I/O
- */
-#define MSC_BUFFER_COUNT   1
+#ifndef MSC_BUFFER_COUNT
+#define MSC_BUFFER_COUNT   2
+#endif
 
-static msc_data_buff_t msc_buff[MSC_BUFFER_COUNT] __attribute__((aligned(4)));;
-static int8_t          msc_buff_read;
-static int8_t          msc_buff_write;
+static msc_data_buff_t  msc_buff[MSC_BUFFER_COUNT] __attribute__((aligned(4)));
+static volatile uint8_t msc_buff_read;
+static volatile uint8_t msc_buff_write;
+
+/* a packet is being sent on the IN endpoint */
+static volatile bool     msc_in_busy;
+/* a packet waits in the OUT endpoint memory for a free buffer */
+static volatile bool     msc_out_pending;
+/* bytes still expected from the host during DATA OUT */
+static volatile uint32_t msc_out_remaining;
 
 /* ************************************************************ */
 /* **** Public Functions ************************************** */
 /* ************************************************************ */
 
 
-void usb_msc_reset()
+/*
+ * Drop the buffered data, a packet being sent on the IN endpoint
+ * is not affected
+ */
+static void usb_msc_flush_buffers()
 {
     uint8_t i;
 
+    platform_enter_critical();
     for(i=0; i<MSC_BUFFER_COUNT; i++)
     {
 	msc_buff[i].idx = 0;
@@ -395,6 +418,20 @@ void usb_msc_reset()
     }
     msc_buff_read       = 0;
     msc_buff_write      = 0;
+    msc_out_remaining   = 0;
+    if (msc_out_pending)
+    {
+	msc_out_pending = false;
+	usb_recv_set_status( MSC_EP_OUT, STAT_RX_VALID);
+    }
+    platform_exit_critical();
+}
+
+
+void usb_msc_reset()
+{
+    usb_msc_flush_buffers();
+    msc_in_busy         = false;
     msc_state           = MSC_STATE_NONE;
 }
 
@@ -429,12 +466,6 @@ static inline uint16_t min(uint16_t a, uint16_t b) { return a < b ? a : b; }
  */
 void usb_msc_close_read_buff()
 {
-    if (msc_buff[msc_buff_read].len != 0)
-    {
-	log_error("MSC Closing data on read buffer %d which has len = %d",msc_buff_read,msc_buff[msc_buff_read].len);
-	return;
-    }
-
     msc_buff[msc_buff_read].idx = 0;
     msc_buff[msc_buff_read].len = 0;
 
@@ -469,8 +500,10 @@ void usb_msc_close_write_buff(uint16_t length)
 }
 
 /*
- * USB IN: use the current read buffer as a data source for IN packets.
- * Returns true when the buffer is empty.
+ * USB IN: send the next packet of the current read buffer, the buffer
+ * is released as soon as its last packet is written to the endpoint.
+ * Called from the IN interrupt or with interrupts disabled.
+ * Returns true if a packet has been sent.
  */
 bool usb_msc_send_data_to_endpoint()
 {
@@ -478,9 +511,9 @@ bool usb_msc_send_data_to_endpoint()
     uint16_t  idx;
     uint8_t  *data;
 
-    if (msc_buff[msc_buff_read].len == 0)
+    if (msc_in_busy || (msc_buff[msc_buff_read].len == 0))
     {
-	return true;
+	return false;
     }
 
     len  = min( msc_buff[msc_buff_read].len, usb_get_max_packet_size( MSC_EP_IN ) );
@@ -489,21 +522,35 @@ bool usb_msc_send_data_to_endpoint()
 
     usb_send( MSC_EP_IN , true, NO_CHANGE, &data[idx], len);
     DBG("i");
+    msc_in_busy = true;
+    msc_buff[msc_buff_read].idx = idx + len;
     msc_buff[msc_buff_read].len = msc_buff[msc_buff_read].len - len;
-    msc_buff[msc_buff_read].idx = msc_buff[msc_buff_read].idx + len;
 
     if (msc_buff[msc_buff_read].len == 0)
     {
 	usb_msc_close_read_buff();
-	return true;
     }
-    return false;
+    return true;
+}
+
+/*
+ * USB IN: start sending from the event queue if the endpoint is idle.
+ */
+static void usb_msc_start_data_in()
+{
+    platform_enter_critical();
+    usb_msc_send_data_to_endpoint();
+    platform_exit_critical();
 }
 
 /*
- * USB OUT: write from out endpoint to buffer.
- * returns true if buffer is full or if #read < #max which
- * means EOP. On EOP the write buffer is closed.
+ * USB OUT: write from out endpoint to the current write buffer.
+ * The buffer is closed when it is full, on a short packet (EOP) or
+ * when all the expected data has been received. If the ring is full
+ * the packet is left in the endpoint, which NAKs the host until
+ * usb_msc_resume_data_out() is called.
+ * Called from the OUT interrupt or with interrupts disabled.
+ * Returns true if a buffer has been closed.
  */
 bool usb_msc_read_data_from_endpoint()
 {
@@ -511,36 +558,59 @@ bool usb_msc_read_data_from_endpoint()
     uint16_t  idx;
     uint8_t  *data;
 
-    if (msc_buff[msc_buff_write].idx == MSC_BUFFER_SIZE)
+    if (msc_buff[msc_buff_write].len != 0)
     {
-	return true;
+	msc_out_pending = true;
+	return false;
     }
+    msc_out_pending = false;
 
-    idx  = msc_buff[ msc_buff_read ].idx;
-    data = msc_buff[ msc_buff_read ].data;
+    idx  = msc_buff[ msc_buff_write ].idx;
+    data = msc_buff[ msc_buff_write ].data;
     plen = usb_get_max_packet_size( MSC_EP_OUT );
     rlen = usb_recv_get_len( MSC_EP_OUT );
-    blen = MSC_BUFFER_SIZE - msc_buff[msc_buff_write].idx;
+    blen = MSC_BUFFER_SIZE - idx;
 
     if (rlen > blen)
     {
 	log_error("MSC out called with too small buffer (%d/%d bytes)",rlen,blen);
 	rlen = blen;
     }
+    if (rlen > msc_out_remaining)
+    {
+	log_error("MSC out received more data than expected (%d/%d bytes)",rlen,msc_out_remaining);
+	rlen = msc_out_remaining;
+    }
 
     usb_recv( MSC_EP_OUT, &data[idx], rlen);
     DBG("o");
-    msc_buff[msc_buff_write].idx = msc_buff[msc_buff_write].idx + rlen;
+    idx = idx + rlen;
+    msc_buff[msc_buff_write].idx = idx;
+    msc_out_remaining = msc_out_remaining - rlen;
     usb_recv_set_status( MSC_EP_OUT , STAT_RX_VALID);
 
-    if ((msc_buff[msc_buff_write].idx ==  MSC_BUFFER_SIZE) || (rlen < plen))
+    if ((idx == MSC_BUFFER_SIZE) || (rlen < plen) || (msc_out_remaining == 0))
     {
-	usb_msc_close_write_buff( msc_buff[msc_buff_write].idx );
+	usb_msc_close_write_buff( idx );
 	return true;
     }
     return false;
 }
 
+/*
+ * USB OUT: receive the packet left in the endpoint while the ring
+ * was full, or while the data phase was not started yet.
+ */
+static void usb_msc_resume_data_out()
+{
+    platform_enter_critical();
+    if (msc_out_pending && (msc_state == MSC_STATE_DATA_OUT))
+    {
+	usb_msc_read_data_from_endpoint();
+    }
+    platform_exit_critical();
+}
+
 /* ********************************************************************** */
 /* ********************************************************************** */
 /* ********************************************************************** */
@@ -554,17 +624,39 @@ void usb_msc_build_csw(uint8_t *b, uint32_t t, msc_csw_status_t s)
     csw->dCSWStatus      = s;
 }
 
+/*
+ * Queue the status after the data already in the ring.
+ * Returns false if no buffer is free yet, the IN interrupt
+ * posts an event when one is released.
+ */
+static bool usb_msc_send_csw()
+{
+    bool queued = false;
+
+    platform_enter_critical();
+    if (msc_buff[msc_buff_write].len == 0)
+    {
+	msc_state = MSC_STATE_STATUS_sent;
+	usb_msc_build_csw( msc_buff[msc_buff_write].data, cbw.dCBWTag, msc_csw_status);
+	usb_msc_close_write_buff(sizeof(msc_csw_t));
+	usb_msc_send_data_to_endpoint();
+	queued = true;
+    }
+    platform_exit_critical();
+    return queued;
+}
+
 /* ********************************************************************** */
 /* ********************************************************************** */
 /* ********************************************************************** */
 
-scsi_params_t usb_msc_build_scsi_params(uint8_t count, int8_t msc_buff_direction, uint32_t datamax, uint32_t *datalen, scsi_status_t *status)
+scsi_params_t usb_msc_build_scsi_params(uint8_t count, uint8_t *data, uint32_t datamax, uint32_t *datalen, scsi_status_t *status)
 {
     scsi_params_t scsi_params = {
         .cont    =  count,
         .lun     =  cbw.dCBWLun,
         .cmd     =  (uint8_t*)cbw.CBWCB,
-        .data    =  msc_buff[msc_buff_direction].data,
+        .data    =  data,
         .datamax =  datamax,
         .datalen =  datalen,
         .status  =  status,
@@ -595,6 +687,17 @@ event_status_t msc_ev_post_from_isr(handler_arg_t arg)
     return event_post_from_isr(EVENT_QUEUE_APPLI, usb_msc_ev_handler, arg);
 }
 
+/*
+ * Command failed, drop the remaining data and send the status
+ */
+static void usb_msc_command_failed()
+{
+    usb_msc_flush_buffers();
+    msc_csw_status            = CSW_Command_Failed;
+    msc_state                 = MSC_STATE_STATUS;
+    msc_ev_post( MSC_EV );
+}
+
 int usb_msc_scsi_handler(bool firstcall)
 {
     int            handler_ret = 0;
@@ -605,16 +708,19 @@ int usb_msc_scsi_handler(bool firstcall)
 
     /*
      * Do the actual SCSI Command
+     * cnum saturates so that long transfers are never taken for a first call
      */
-    cnum = (firstcall) ? 0 : cnum + 1;
+    cnum = (firstcall) ? 0 : ((cnum < 0xff) ? cnum + 1 : cnum);
     switch (msc_state)
     {
     case MSC_STATE_DATA_OUT:
-	params = usb_msc_build_scsi_params(cnum, msc_buff_read, msc_buff[msc_buff_read].len, &datalen, &status);
+	params = usb_msc_build_scsi_params(cnum,
+		 msc_buff[msc_buff_read].data + msc_buff[msc_buff_read].idx,
+		 msc_buff[msc_buff_read].len, &datalen, &status);
 	ret = scsi_process_command(params);
 	break;
     default:
-	params = usb_msc_build_scsi_params(cnum, msc_buff_write, MSC_BUFFER_SIZE, &datalen, &status);
+	params = usb_msc_build_scsi_params(cnum, msc_buff[msc_buff_write].data, MSC_BUFFER_SIZE, &datalen, &status);
 	ret = scsi_process_command(params);
 	break;
     }
@@ -630,7 +736,7 @@ int usb_msc_scsi_handler(bool firstcall)
 	    if (cbw.dCBWFlags & 0x80)
 	    {
                 /*
-		 * Data are flowing from Host to Device
+		 * Data are flowing from Device to Host
 		 */
 		msc_csw_status    = CSW_Command_Passed;
 		msc_state         = MSC_STATE_DATA_IN;
@@ -642,7 +748,7 @@ int usb_msc_scsi_handler(bool firstcall)
 		}
 		else if (datalen < cbw.dCBWDataTransferLength)
 		{
-		    if (ret == SCSI_CMD_PARTIAL)
+		    if ((ret == SCSI_CMD_PARTIAL) && (datalen > 0))
 		    {
 			/* The return is only a part of the full request, 
 			 * we'll have to come back */
@@ -663,52 +769,60 @@ int usb_msc_scsi_handler(bool firstcall)
 		}
 
 		cbw.dCBWDataTransferLength = cbw.dCBWDataTransferLength - datalen;
+		if (datalen > 0)
+		{
+		    usb_msc_close_write_buff(datalen);
+		    usb_msc_start_data_in();
+		}
 		if (cbw.dCBWDataTransferLength == 0)
 		{
-		    //log_info("Last packet");
+		    // all requested information queued, going to Status
+		    msc_state = MSC_STATE_STATUS;
+		    usb_msc_send_csw();
 		}
-		usb_msc_close_write_buff(datalen);
 		handler_ret = datalen;
 	    }
 	    else
 	    {
 		/*
-		 * Data are flowing from Device to Host
+		 * Data are flowing from Host to Device
 		 * can we assert(msc_state == MSC_STATE_DATA_OUT) ?
 		 */
 		if (msc_state != MSC_STATE_DATA_OUT) // == MSC_STATE_READY ??
 		{
 		    msc_csw_status    = CSW_Command_Passed;
+		    msc_out_remaining = cbw.dCBWDataTransferLength;
 		    msc_state         = MSC_STATE_DATA_OUT;
 		}
+		else if ((datalen == 0) || (datalen > msc_buff[msc_buff_read].len))
+		{
+		    log_error("MSC SCSI write consumed %d bytes out of %d", datalen, msc_buff[msc_buff_read].len);
+		    usb_msc_command_failed();
+		}
 		else
 		{
-		    if (datalen != msc_buff[msc_buff_read].len)
+		    /* the backend may not consume the whole buffer at once */
+		    msc_buff[msc_buff_read].idx = msc_buff[msc_buff_read].idx + datalen;
+		    msc_buff[msc_buff_read].len = msc_buff[msc_buff_read].len - datalen;
+		    if (msc_buff[msc_buff_read].len == 0)
 		    {
-			log_error("datalen != msc_buff[msc_buff_read].len !!");
-			cbw.dCBWDataTransferLength = datalen;
+			usb_msc_close_read_buff();
+		    }
+
+		    if (datalen > cbw.dCBWDataTransferLength)
+		    {
+			datalen = cbw.dCBWDataTransferLength;
 		    }
-		    msc_buff[msc_buff_read].len = 0;
-		    usb_msc_close_read_buff();
 		    cbw.dCBWDataTransferLength = cbw.dCBWDataTransferLength - datalen;
 		    if (cbw.dCBWDataTransferLength == 0)
 		    {
 			msc_csw_status    = CSW_Command_Passed;
 			msc_state         = MSC_STATE_STATUS;
-
-			msc_state         = MSC_STATE_STATUS_sent;
-			usb_msc_build_csw( msc_buff[msc_buff_write].data, cbw.dCBWTag, msc_csw_status);
-			usb_msc_close_write_buff(sizeof(msc_csw_t));
-			if (! usb_msc_send_data_to_endpoint())
-			{
-			    // log_error("this should not happen");
-			}
+			usb_msc_send_csw();
 		    }
 		    else
 		    {
 			DBG("+");
-			msc_csw_status    = CSW_Command_Passed;
-			msc_state         = MSC_STATE_DATA_OUT;
 		    }
 		}
 	    }
@@ -716,101 +830,86 @@ int usb_msc_scsi_handler(bool firstcall)
 	else // Data are done, send Status
 	{
 	    msc_csw_status = CSW_Command_Passed;
-	    msc_state      = MSC_STATE_STATUS_sent;
-	    usb_msc_build_csw( msc_buff[msc_buff_write].data, cbw.dCBWTag, msc_csw_status);
-	    usb_msc_close_write_buff(sizeof(msc_csw_t));
-	    if (! usb_msc_send_data_to_endpoint())
-	    {
-		// log_error("this should not happen");
-	    }
+	    msc_state      = MSC_STATE_STATUS;
+	    usb_msc_send_csw();
 	}
 	break;
 	
     case SCSI_CHECK_CONDITION:
-	msc_csw_status            = CSW_Command_Failed;
-	msc_state                 = MSC_STATE_STATUS;
-	msc_ev_post( MSC_EV );
+	usb_msc_command_failed();
 	//log_info("MSC Check Condition");
 	break;
 	
     default:
-	msc_csw_status            = CSW_Command_Failed;
-	msc_state                 = MSC_STATE_STATUS;
-	msc_ev_post( MSC_EV );
+	usb_msc_command_failed();
 	//log_error("MSC Unhandled SCSI return status");
 	break;
     }
     return handler_ret;
 }
 
+/*
+ * DATA IN: run the backend on every free buffer of the ring
+ */
+static void usb_msc_fill_data_in()
+{
+    while ((msc_state == MSC_STATE_DATA_IN) && (msc_buff[msc_buff_write].len == 0))
+    {
+	usb_msc_scsi_handler(false);
+    }
+}
+
+/*
+ * DATA OUT: run the backend on every buffer received from the host
+ */
+static void usb_msc_drain_data_out()
+{
+    usb_msc_resume_data_out();
+    while ((msc_state == MSC_STATE_DATA_OUT) && (msc_buff[msc_buff_read].len != 0))
+    {
+	usb_msc_scsi_handler(false);
+	usb_msc_resume_data_out();
+    }
+}
+
 /* ********************************************************************** 
  * MSC Main Event Handler                                                 
  * ********************************************************************** */
 
 void usb_msc_ev_handler( handler_arg_t arg )
 {
-    int scsi_ret;
-
     switch (msc_state)
     {
     case MSC_STATE_NONE:
 	break;
 
     case MSC_STATE_READY:
-	// first SCSI Command call, fill data buffer with answer
-	scsi_ret = usb_msc_scsi_handler(true); 
-	if (scsi_ret)
+	if (arg != MSC_EV_OUT)
 	{
-	    if (usb_msc_send_data_to_endpoint()) 
-	    {
-		// buffer sent in 1 packet, skip to STATUS
-		msc_state     = MSC_STATE_STATUS;
-	    }
+	    // late IN event of the previous command
+	    break;
 	}
+	// first SCSI Command call, fill data buffers with answer
+	usb_msc_scsi_handler(true); 
+	usb_msc_fill_data_in();
+	usb_msc_drain_data_out();
 	break;
 
     case MSC_STATE_DATA_IN:
-	if (usb_msc_send_data_to_endpoint()) 
-	{
-	    if (cbw.dCBWDataTransferLength > 0) 
-	    {
-		/* SCSI command not complete, precharge next buffer but do not
-		 * write to endpoint */
-		usb_msc_scsi_handler(false); 
-	    }
-	    else
-	    {
-		// all requested information transferred, going to Status
-		msc_state = MSC_STATE_STATUS;
-	    }
-	}
+	usb_msc_fill_data_in();
 	break;
 
     case MSC_STATE_DATA_OUT:
-	if (usb_msc_read_data_from_endpoint())
-	{
-	    scsi_ret = usb_msc_scsi_handler(false);
-	}
+	usb_msc_drain_data_out();
 	break;
 
-    /* case MSC_STATE_STATUS_tosend: */
-    /* 	msc_state = MSC_STATE_STATUS; */
-    /* 	break; */
-
     case MSC_STATE_STATUS:
 	//DBG("S");
-	msc_state = MSC_STATE_STATUS_sent;
-	usb_msc_build_csw( msc_buff[msc_buff_write].data, cbw.dCBWTag, msc_csw_status);
-	usb_msc_close_write_buff(sizeof(msc_csw_t));
-	if (usb_msc_send_data_to_endpoint())
+	if (! usb_msc_send_csw())
 	{
-	    //DBG("s\n");
+	    // data still in the ring, wait for a buffer to be released
+	    DBG("s");
 	}
-	else
-	{
-	    log_error(" STATUS cannot be sent ??");
-	}
-	//DBG("\n");
 	break;
 
     case MSC_STATE_STATUS_sent:
@@ -828,13 +927,24 @@ void usb_msc_ev_handler( handler_arg_t arg )
 
 static void usb_msc_data_in(uint8_t endp, bool rx, bool tx)
 {
+    uint8_t read;
+
     if (!tx && rx)
     {
         log_error("MSC data in (to host) callback called with: rx = %d and tx = %d", rx, tx);
 	return;
     }
 
-    msc_ev_post_from_isr( MSC_EV_IN );
+    /* packets of the current buffer are sent without going through the event queue */
+    msc_in_busy = false;
+    read        = msc_buff_read;
+    usb_msc_send_data_to_endpoint();
+
+    /* wake the event queue up when a buffer is released or when the endpoint is idle */
+    if ((read != msc_buff_read) || !msc_in_busy)
+    {
+	msc_ev_post_from_isr( MSC_EV_IN );
+    }
 }
 
 
@@ -897,8 +1007,15 @@ static void usb_msc_data_out(uint8_t endp, bool rx, bool tx)
 	break;
 	
     case MSC_STATE_READY:
+	// data phase not started yet, keep the packet in the endpoint
+	msc_out_pending = true;
+	break;
+
     case MSC_STATE_DATA_OUT:
-	msc_ev_post_from_isr( MSC_EV_OUT );
+	if (usb_msc_read_data_from_endpoint())
+	{
+	    msc_ev_post_from_isr( MSC_EV_OUT );
+	}
 	break;
 
     case MSC_STATE_DATA_IN:
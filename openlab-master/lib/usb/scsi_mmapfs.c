@@ -555,64 +555,80 @@ void scsi_mmapfs_read_capacity(uint8_t lun, uint32_t *bcount, uint16_t *bsize)
 
 
 /* ********************************************************************** */
-/* READ10, MMC5 page 425                                                  */
+/* Sectors access                                                         */
 /* ********************************************************************** */
 
 
-scsi_cmdret_t scsi_mmapfs_read10(scsi_params_t scsi_params)
+static void mmapfs_read_sector(const mmapfs_t *mmapfs, uint32_t lba, uint8_t *data)
 {
-    const mmapfs_t *mmapfs;
-    mmapfs    = (const mmapfs_t*)scsi_lun[scsi_params.lun].info;
-
-    scsi_cdb10_t   *cdb10    = (scsi_cdb10_t *)scsi_params.cmd;
-    //uint8_t       DPO      = (cdb10->cdb_info >> 4) & 0x1;
-    //uint8_t       FUA      = (cdb10->cdb_info >> 3) & 0x1;
-    uint32_t        lba      = msbtohost32(cdb10->lba);
-    uint32_t        nblocks  = msbtohost16(cdb10->length);
-    
-    scsi_cmdret_t   ret;
+    DBG("R%d",lba);
 
-    if ((lba + nblocks - 1) >= LUN_SIZE)
+    // Boot and reserved sectors
+    if ((lba >= 0) && (lba < FAT_FAT1_FIRST))
     {
-	log_error("SCSI Read(10), mmapfs read beyond limit (limit 0x%08x, request 0x%08x / +%d)",LUN_SIZE,lba,nblocks);
-	*scsi_params.status = SCSI_CHECK_CONDITION;
-	return SCSI_CMD_DONE;
+	build_bootsector(mmapfs,lba,data);
+    } 
+    // FAT 1
+    else if ((lba >= FAT_FAT1_FIRST) && (lba <= FAT_FAT1_LAST))
+    {
+	build_fat(mmapfs,lba - FAT_FAT1_FIRST,data);
+    } 
+    // RootDirectory
+    else if ((lba >= DIRECTORY_FIRST) && (lba <= DIRECTORY_LAST))
+    {
+	build_rootdirectory(MMAPFS_BUILD, mmapfs,lba - DIRECTORY_FIRST,data);
     }
-
-    if (scsi_params.datamax < LUN_SECTORSIZE)
+    // Data
+    else
     {
-	log_error("SCSI Read(10), mmapfs read buffer is smaller than a single sector (%d/%d bytes)",scsi_params.datalen,LUN_SECTORSIZE);
-	*scsi_params.status = SCSI_CHECK_CONDITION;
-	return SCSI_CMD_ERROR;
+	build_data(MMAPFS_READ, mmapfs,lba,data);
     }
 
-    DBG("R%d",lba);
+    DBG(" ");
+}
+
+static void mmapfs_write_sector(const mmapfs_t *mmapfs, uint32_t lba, uint8_t *data)
+{
+    DBG("W%d-",lba);
 
     // Boot and reserved sectors
     if ((lba >= 0) && (lba < FAT_FAT1_FIRST))
     {
-	build_bootsector(mmapfs,lba,scsi_params.data);
+	log_error("mmapfs write to Boot sector %d",lba );
+	DUMP_WRITE(lba, data, SECTORSIZE);
     } 
     // FAT 1
     else if ((lba >= FAT_FAT1_FIRST) && (lba <= FAT_FAT1_LAST))
     {
-	build_fat(mmapfs,lba - FAT_FAT1_FIRST,scsi_params.data);
+	log_info("mmapfs write to FAT sector %d",lba - FAT_FAT1_FIRST);
+	DUMP_WRITE(lba, data, SECTORSIZE);
     } 
     // RootDirectory
     else if ((lba >= DIRECTORY_FIRST) && (lba <= DIRECTORY_LAST))
     {
-	build_rootdirectory(MMAPFS_BUILD, mmapfs,lba - DIRECTORY_FIRST,scsi_params.data);
+	build_rootdirectory(MMAPFS_CHECK, mmapfs,lba - DIRECTORY_FIRST,data);
     }
     // Data
     else
     {
-	build_data(MMAPFS_READ, mmapfs,lba,scsi_params.data);
+	build_data(MMAPFS_WRITE, mmapfs,lba,data);
     }
+}
 
-    DBG(" ");
-
+/*
+ * Number of sectors of the request that fit in the data buffer,
+ * they are all processed by the same call
+ */
+static uint32_t mmapfs_sectors_count(uint32_t datamax, uint32_t nblocks)
+{
+    uint32_t n = datamax / LUN_SECTORSIZE;
+    return (n > nblocks) ? nblocks : n;
+}
 
-    *scsi_params.datalen = scsi_params.datamax;
+static scsi_cmdret_t mmapfs_request_done(scsi_params_t scsi_params, uint32_t lba, uint32_t nblocks, uint32_t ndone)
+{
+    scsi_cdb10_t   *cdb10    = (scsi_cdb10_t *)scsi_params.cmd;
+    scsi_cmdret_t   ret;
 
     switch (nblocks)
     {
@@ -620,22 +636,65 @@ scsi_cmdret_t scsi_mmapfs_read10(scsi_params_t scsi_params)
 	*scsi_params.status     = SCSI_CHECK_CONDITION;
 	ret            = SCSI_CMD_ERROR;
 	break;
-    case 1:
-	*scsi_params.datalen    = LUN_SECTORSIZE;
-	*scsi_params.status     = SCSI_GOOD;
-	ret            = SCSI_CMD_DONE;
-	break;
     default:
-	cdb10->lba     = msbtohost32( lba     + 1 );
-	cdb10->length  = msbtohost16( nblocks - 1 );
-	*scsi_params.datalen    = LUN_SECTORSIZE;
+	*scsi_params.datalen    = ndone * LUN_SECTORSIZE;
 	*scsi_params.status     = SCSI_GOOD;
-	ret            = SCSI_CMD_PARTIAL;
+	if (nblocks == ndone)
+	{
+	    ret        = SCSI_CMD_DONE;
+	}
+	else
+	{
+	    cdb10->lba     = msbtohost32( lba     + ndone );
+	    cdb10->length  = msbtohost16( nblocks - ndone );
+	    ret        = SCSI_CMD_PARTIAL;
+	}
 	break;
     }
     return ret;
 }
 
+/* ********************************************************************** */
+/* READ10, MMC5 page 425                                                  */
+/* ********************************************************************** */
+
+
+scsi_cmdret_t scsi_mmapfs_read10(scsi_params_t scsi_params)
+{
+    const mmapfs_t *mmapfs;
+    mmapfs    = (const mmapfs_t*)scsi_lun[scsi_params.lun].info;
+
+    scsi_cdb10_t   *cdb10    = (scsi_cdb10_t *)scsi_params.cmd;
+    //uint8_t       DPO      = (cdb10->cdb_info >> 4) & 0x1;
+    //uint8_t       FUA      = (cdb10->cdb_info >> 3) & 0x1;
+    uint32_t        lba      = msbtohost32(cdb10->lba);
+    uint32_t        nblocks  = msbtohost16(cdb10->length);
+    uint32_t        ndone;
+    uint32_t        i;
+
+    if ((lba + nblocks - 1) >= LUN_SIZE)
+    {
+	log_error("SCSI Read(10), mmapfs read beyond limit (limit 0x%08x, request 0x%08x / +%d)",LUN_SIZE,lba,nblocks);
+	*scsi_params.status = SCSI_CHECK_CONDITION;
+	return SCSI_CMD_DONE;
+    }
+
+    if (scsi_params.datamax < LUN_SECTORSIZE)
+    {
+	log_error("SCSI Read(10), mmapfs read buffer is smaller than a single sector (%d/%d bytes)",scsi_params.datalen,LUN_SECTORSIZE);
+	*scsi_params.status = SCSI_CHECK_CONDITION;
+	return SCSI_CMD_ERROR;
+    }
+
+    ndone = mmapfs_sectors_count(scsi_params.datamax, nblocks);
+    for (i = 0; i < ndone; i++)
+    {
+	mmapfs_read_sector(mmapfs, lba + i, scsi_params.data + i * LUN_SECTORSIZE);
+    }
+
+    return mmapfs_request_done(scsi_params, lba, nblocks, ndone);
+}
+
 
 /* ********************************************************************** */
 /* WRITE10, MMC5 page 425                                                  */
@@ -652,7 +711,8 @@ scsi_cmdret_t scsi_mmapfs_write10( scsi_params_t scsi_params)
     //uint8_t       FUA      = (cdb10->cdb_info >> 3) & 0x1;
     uint32_t        lba      = msbtohost32(cdb10->lba);
     uint32_t        nblocks  = msbtohost16(cdb10->length);
-    scsi_cmdret_t   ret;
+    uint32_t        ndone;
+    uint32_t        i;
 
 
     if ((lba + nblocks - 1) >= LUN_SIZE)
@@ -669,62 +729,20 @@ scsi_cmdret_t scsi_mmapfs_write10( scsi_params_t scsi_params)
 	return SCSI_CMD_ERROR;
     }
 
-    DBG("W%d-",lba);
-
-    
     if (scsi_params.cont == 0)
     {
 	// log_info("SCSI Start Write(10) mmapfs, lba 0x%08x, length %d",lba,nblocks);
 	*scsi_params.status = SCSI_GOOD;
 	return SCSI_CMD_PARTIAL;
     }
-    else
-    {
-	// Boot and reserved sectors
-	if ((lba >= 0) && (lba < FAT_FAT1_FIRST))
-	{
-	    log_error("mmapfs write to Boot sector %d",lba );
-	    DUMP_WRITE(lba, scsi_params.data, SECTORSIZE);
-	} 
-	// FAT 1
-	else if ((lba >= FAT_FAT1_FIRST) && (lba <= FAT_FAT1_LAST))
-	{
-	    log_info("mmapfs write to FAT sector %d",lba - FAT_FAT1_FIRST);
-	    DUMP_WRITE(lba, scsi_params.data, SECTORSIZE);
-	} 
-	// RootDirectory
-	else if ((lba >= DIRECTORY_FIRST) && (lba <= DIRECTORY_LAST))
-	{
-	    build_rootdirectory(MMAPFS_CHECK, mmapfs,lba - DIRECTORY_FIRST,scsi_params.data);
-	}
-	// Data
-	else
-	{
-	    build_data(MMAPFS_WRITE, mmapfs,lba,scsi_params.data);
-	}
-    }
 
-
-    switch (nblocks)
+    ndone = mmapfs_sectors_count(scsi_params.datamax, nblocks);
+    for (i = 0; i < ndone; i++)
     {
-    case 0:
-	*scsi_params.status   = SCSI_CHECK_CONDITION;
-	ret            = SCSI_CMD_ERROR;
-	break;
-    case 1:
-	*scsi_params.datalen  = LUN_SECTORSIZE;
-	*scsi_params.status   = SCSI_GOOD;
-	ret            = SCSI_CMD_DONE;
-	break;
-    default:
-	cdb10->lba     = msbtohost32( lba     + 1 );
-	cdb10->length  = msbtohost16( nblocks - 1 );
-	*scsi_params.datalen  = LUN_SECTORSIZE;
-	*scsi_params.status   = SCSI_GOOD;
-	ret            = SCSI_CMD_PARTIAL;
-	break;
+	mmapfs_write_sector(mmapfs, lba + i, scsi_params.data + i * LUN_SECTORSIZE);
     }
-    return ret;
+
+    return mmapfs_request_done(scsi_params, lba, nblocks, ndone);
 }
 
 
@@ -48,8 +48,12 @@
 
 #define BLOCKSIZE                    512ul
 
+/* max blocks transferred with one SD command */
+#define SCSI_SD_MAX_BLOCKS           16
+
 /* used in sdio transfers */
 static volatile bool       sd_transfer_ended = false;
+static uint8_t            *sd_blocks[SCSI_SD_MAX_BLOCKS];
 
 /* ********************************************************************** */
 /* Init                                                                   */
@@ -74,6 +78,26 @@ void sd_transfer_handler(handler_arg_t arg)
     sd_transfer_ended = true;
 }
 
+/* ********************************************************************** */
+/* Blocks that fit in the data buffer, they are transferred at once       */
+/* ********************************************************************** */
+
+static uint32_t scsi_sd_set_blocks(uint8_t *data, uint32_t datamax, uint32_t nblocks)
+{
+    uint32_t i;
+    uint32_t n = datamax / BLOCKSIZE;
+
+    if (n > nblocks)
+        n = nblocks;
+    if (n > SCSI_SD_MAX_BLOCKS)
+        n = SCSI_SD_MAX_BLOCKS;
+
+    for (i = 0; i < n; i++)
+        sd_blocks[i] = data + i * BLOCKSIZE;
+
+    return n;
+}
+
 /* ********************************************************************** */
 /* READ CAPACITY(10), MMC5 page 435                                       */
 /* ********************************************************************** */
@@ -103,6 +127,7 @@ scsi_cmdret_t scsi_sd_read10( scsi_params_t scsi_params )
     sd_error_t      sdret;
     scsi_cmdret_t   ret;
     uint32_t        la       = (sdtype != SDHC) ? lba * BLOCKSIZE : lba;
+    uint32_t        ndone    = 0;
 
     sdret             = SD_NO_ERROR;
     sd_transfer_ended = false;
@@ -122,7 +147,11 @@ scsi_cmdret_t scsi_sd_read10( scsi_params_t scsi_params )
 	return SCSI_CMD_ERROR;
     }
 
-    sdret = sd_read_single_block(*sdio, la, scsi_params.data);
+    ndone = scsi_sd_set_blocks(scsi_params.data, scsi_params.datamax, nblocks);
+    if (ndone)
+    {
+	sdret = sd_read_multiple_blocks(*sdio, la, sd_blocks, ndone);
+    }
 
     if (scsi_params.cont == 0)
     {
@@ -140,7 +169,7 @@ scsi_cmdret_t scsi_sd_read10( scsi_params_t scsi_params )
 	return SCSI_CMD_DONE;
     }
 
-    while (!sd_transfer_ended) 
+    while (ndone && !sd_transfer_ended)
     {
 	;
     }
@@ -160,17 +189,19 @@ scsi_cmdret_t scsi_sd_read10( scsi_params_t scsi_params )
 	*scsi_params.status        = SCSI_CHECK_CONDITION;
     ret          		       = SCSI_CMD_ERROR;
 	break;
-    case 1:
-	*scsi_params.datalen       = BLOCKSIZE;
-	*scsi_params.status        = SCSI_GOOD;
-	ret          			   = SCSI_CMD_DONE;
-	break;
     default:
-	cdb10->lba    			   = msbtohost32( lba     + 1 );
-	cdb10->length			   = msbtohost16( nblocks - 1 );
-	*scsi_params.datalen       = BLOCKSIZE;
+	*scsi_params.datalen       = ndone * BLOCKSIZE;
 	*scsi_params.status        = SCSI_GOOD;
-	ret           			   = SCSI_CMD_PARTIAL;
+	if (nblocks == ndone)
+	{
+	    ret                    = SCSI_CMD_DONE;
+	}
+	else
+	{
+	    cdb10->lba             = msbtohost32( lba     + ndone );
+	    cdb10->length          = msbtohost16( nblocks - ndone );
+	    ret                    = SCSI_CMD_PARTIAL;
+	}
 	break;
     }
     return ret;
@@ -194,6 +225,7 @@ scsi_cmdret_t scsi_sd_write10( scsi_params_t scsi_params )
     sd_error_t      sdret;
     scsi_cmdret_t   ret;
     uint32_t        la       = (sdtype != SDHC) ? lba * BLOCKSIZE : lba;
+    uint32_t        ndone    = 0;
 
     sdret             = SD_NO_ERROR;
     sd_transfer_ended = false;
@@ -229,7 +261,11 @@ scsi_cmdret_t scsi_sd_write10( scsi_params_t scsi_params )
 	sdret             = SD_NO_ERROR;
 	sd_transfer_ended = true;
 #else
-        sdret = sd_write_single_block(*sdio, la, scsi_params.data);
+	ndone = scsi_sd_set_blocks(scsi_params.data, scsi_params.datamax, nblocks);
+	if (ndone)
+	{
+	    sdret = sd_write_multiple_blocks(*sdio, la, sd_blocks, ndone);
+	}
 #endif
     }
 
@@ -240,7 +276,7 @@ scsi_cmdret_t scsi_sd_write10( scsi_params_t scsi_params )
 	return SCSI_CMD_DONE;
     }
 
-    while (!sd_transfer_ended)
+    while (ndone && !sd_transfer_ended)
     {
 	;
     }
@@ -260,17 +296,19 @@ scsi_cmdret_t scsi_sd_write10( scsi_params_t scsi_params )
 	*scsi_params.status        = SCSI_CHECK_CONDITION;
 	ret            = SCSI_CMD_ERROR;
 	break;
-    case 1:
-	*scsi_params.datalen       = BLOCKSIZE;
-	*scsi_params.status        = SCSI_GOOD;
-	ret            = SCSI_CMD_DONE;
-	break;
     default:
-	cdb10->lba     = msbtohost32( lba     + 1 );
-	cdb10->length  = msbtohost16( nblocks - 1 );
-	*scsi_params.datalen       = BLOCKSIZE;
+	*scsi_params.datalen       = ndone * BLOCKSIZE;
 	*scsi_params.status        = SCSI_GOOD;
-	ret            = SCSI_CMD_PARTIAL;
+	if (nblocks == ndone)
+	{
+	    ret        = SCSI_CMD_DONE;
+	}
+	else
+	{
+	    cdb10->lba     = msbtohost32( lba     + ndone );
+	    cdb10->length  = msbtohost16( nblocks - ndone );
+	    ret        = SCSI_CMD_PARTIAL;
+	}
 	break;
     }
     return ret;
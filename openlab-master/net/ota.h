@@ -0,0 +1,122 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/*
+ * ota.h
+ *
+ * Over the air firmware dissemination, on top of the CSMA MAC layer.
+ *
+ * The image is split in pages of OTA_PAGE_SIZE bytes, each sent as
+ * OTA_PAGE_PACKETS broadcast data packets, so one transmission serves every
+ * neighbour missing the page. Pages are received in order and staged in the
+ * N25xxx external flash.
+ *
+ * Nodes periodically advertise their image version and number of complete
+ * pages, at a rate slowing down while the neighbourhood is consistent
+ * (trickle timer). A node missing pages requests the next one from an
+ * advertising neighbour, with the bitmap of its missing packets, and requests
+ * it again for the packets still missing (NACK based repair). Requests are
+ * delayed while data packets of the page are heard.
+ *
+ * Once verified, the staged image can be installed: it is copied to the
+ * internal flash staging area and the boot stage copies it over the running
+ * firmware at the next reset.
+ */
+
+#ifndef OTA_H_
+#define OTA_H_
+
+#include <stdint.h>
+#include "handler.h"
+
+/** Size of an image page */
+#define OTA_PAGE_SIZE    2048
+/** Payload of a data packet */
+#define OTA_PACKET_SIZE  64
+/** Number of data packets in a page */
+#define OTA_PAGE_PACKETS (OTA_PAGE_SIZE / OTA_PACKET_SIZE)
+
+/**
+ * Handler called when an image has been received and verified.
+ *
+ * \param arg the argument given to \ref ota_init
+ * \param version the version of the image
+ */
+typedef void (*ota_handler_t)(handler_arg_t arg, uint16_t version);
+
+/**
+ * Initialize the dissemination and start advertising.
+ *
+ * The last sub-sector of the staging area keeps the description of a complete
+ * image, so that it is still served after a reset.
+ * The MAC layer must be initialized.
+ *
+ * \param start the staging area address in the N25xxx flash, sub-sector
+ * aligned
+ * \param size the staging area size, a multiple of the sub-sector size
+ * \param handler the handler called when a new image is complete, may be NULL
+ * \param arg the handler argument
+ */
+void ota_init(uint32_t start, uint32_t size, ota_handler_t handler,
+        handler_arg_t arg);
+
+/**
+ * Disseminate an image already written at the start of the staging area.
+ *
+ * Bytes after the image up to the next word must be 0xFF.
+ * The image is verified in background, then advertised.
+ *
+ * \param version the image version, greater than the disseminated ones
+ * \param length the image length
+ * \return 0 on success, 1 if the image does not fit or a flash operation is
+ * in progress
+ */
+int ota_publish(uint16_t version, uint32_t length);
+
+/**
+ * Handle a frame received by the MAC layer.
+ *
+ * To be called from \ref mac_csma_data_received.
+ *
+ * \param src_addr the frame source address
+ * \param data the frame payload
+ * \param length the payload length
+ * \return 1 if the frame is a dissemination frame, 0 otherwise
+ */
+int ota_handle_frame(uint16_t src_addr, const uint8_t *data, uint8_t length);
+
+/**
+ * Get the version of the complete image.
+ *
+ * \return the version, 0 if no image is complete
+ */
+uint16_t ota_version();
+
+/**
+ * Install the complete image.
+ *
+ * The image is copied to the internal flash staging area, then the node is
+ * reset and the boot stage copies it over the running firmware.
+ *
+ * \return 0 if the installation is started, 1 if no image is complete or it
+ * does not fit
+ */
+int ota_install();
+
+#endif /* OTA_H_ */
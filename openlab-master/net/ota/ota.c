@@ -0,0 +1,823 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/*
+ * ota.c
+ *
+ * Frames, after the MAC header:
+ * - advertisement, broadcast: type, version, length, crc, complete pages
+ * - request, to an advertising node: type, version, page, missing bitmap
+ * - data, broadcast: type, version, page, packet index, payload
+ *
+ * All flash accesses are asynchronous N25xxx requests. A single page buffer
+ * receives the page following the complete ones, it is programmed once all
+ * its packets are received.
+ */
+
+#include <string.h>
+
+#include "platform.h"
+#include "soft_timer.h"
+#include "random.h"
+#include "packer.h"
+#include "n25xxx.h"
+#include "mac_csma.h"
+#include "crc.h"
+#include "flash.h"
+#include "boot.h"
+#include "nvic.h"
+
+#include "ota.h"
+
+#define LOG_LEVEL LOG_LEVEL_WARNING
+#include "debug.h"
+
+#define OTA_SUBSECTOR_SIZE  4096
+#define OTA_FLASH_PAGE_SIZE 256
+
+/* Trickle interval bounds and redundancy constant */
+#define OTA_TAU_LOW_MS      1000
+#define OTA_TAU_HIGH_MS     60000
+#define OTA_REDUNDANCY      2
+
+/* Random delay before a request, and wait for data after a request */
+#define OTA_REQ_DELAY_MS    100
+#define OTA_DATA_WAIT_MS    250
+#define OTA_REQ_RETRIES     8
+
+/* Period of the data packets of a served page */
+#define OTA_TX_PERIOD_MS    6
+
+#define OTA_META_MAGIC      0x4f544131
+
+enum
+{
+    OTA_FRAME_ADV  = 0xF1,
+    OTA_FRAME_REQ  = 0xF2,
+    OTA_FRAME_DATA = 0xF3,
+};
+
+#define OTA_ADV_LENGTH      13
+#define OTA_REQ_LENGTH      9
+#define OTA_DATA_HEADER     6
+
+static void trickle_interval();
+static void trickle_reset();
+static void adv_timeout(handler_arg_t arg);
+static void req_timeout(handler_arg_t arg);
+static void tx_timeout(handler_arg_t arg);
+static void tx_read_done(handler_arg_t arg);
+static void page_write_next(handler_arg_t arg);
+static void check_start(handler_arg_t arg);
+static void check_next(handler_arg_t arg);
+static void meta_read_done(handler_arg_t arg);
+static void meta_write_done(handler_arg_t arg);
+static void install_next(handler_arg_t arg);
+
+static struct
+{
+    uint32_t start;
+    uint32_t size;
+    ota_handler_t handler;
+    handler_arg_t handler_arg;
+
+    /* Image being disseminated */
+    uint16_t version;
+    uint32_t length;
+    uint32_t crc;
+    uint16_t num_pages;
+    uint16_t pages;         // complete pages
+    int complete;           // all pages received and verified
+
+    /* Advertisements, trickle timer */
+    soft_timer_t adv_timer;
+    uint32_t tau;
+    uint32_t adv_rest;      // ticks from the advertisement to the interval end
+    int adv_sent;
+    uint8_t adv_heard;      // consistent advertisements heard in the interval
+
+    /* Download of the next page */
+    soft_timer_t req_timer;
+    uint16_t source;        // neighbour with more pages
+    uint16_t source_pages;
+    uint8_t retries;
+    uint32_t received;      // bitmap of the received packets
+    uint8_t page_buf[OTA_PAGE_SIZE] __attribute__((aligned(4)));
+
+    /* Flash writes and checks, one at a time */
+    n25xxx_request_t wr_req;
+    int flash_busy;
+    int erase_meta;         // meta sub-sector to erase before the next write
+    int erased;             // sub-sector of the current page erased
+    uint32_t offset;
+    int publishing;
+    uint8_t chunk[OTA_FLASH_PAGE_SIZE] __attribute__((aligned(4)));
+
+    /* Page served to the neighbours */
+    soft_timer_t tx_timer;
+    n25xxx_request_t rd_req;
+    uint16_t tx_page;
+    uint32_t tx_missing;
+    uint8_t tx_index;
+    int tx_reading;
+    uint8_t tx_frame[OTA_DATA_HEADER + OTA_PACKET_SIZE];
+} ota;
+
+
+void ota_init(uint32_t start, uint32_t size, ota_handler_t handler,
+        handler_arg_t arg)
+{
+    ota.start = start;
+    ota.size = size;
+    ota.handler = handler;
+    ota.handler_arg = arg;
+
+    ota.version = 0;
+    ota.pages = 0;
+    ota.num_pages = 0;
+    ota.complete = 0;
+    ota.source_pages = 0;
+    memset(ota.page_buf, 0xFF, sizeof(ota.page_buf));
+
+    soft_timer_set_handler(&ota.adv_timer, adv_timeout, NULL);
+    soft_timer_set_handler(&ota.req_timer, req_timeout, NULL);
+    soft_timer_set_handler(&ota.tx_timer, tx_timeout, NULL);
+
+    // Get back a complete image
+    ota.flash_busy = 1;
+    ota.wr_req.op = N25XXX_OP_READ;
+    ota.wr_req.address = ota.start + ota.size - OTA_SUBSECTOR_SIZE;
+    ota.wr_req.buf = ota.chunk;
+    ota.wr_req.len = 16;
+    ota.wr_req.handler = meta_read_done;
+    n25xxx_submit(&ota.wr_req);
+
+    ota.tau = soft_timer_ms_to_ticks(OTA_TAU_LOW_MS);
+    trickle_interval();
+}
+
+int ota_publish(uint16_t version, uint32_t length)
+{
+    if (ota.flash_busy || (length == 0)
+            || (length > ota.size - OTA_SUBSECTOR_SIZE))
+    {
+        return 1;
+    }
+
+    soft_timer_stop(&ota.req_timer);
+    ota.version = version;
+    ota.length = length;
+    ota.num_pages = (length + OTA_PAGE_SIZE - 1) / OTA_PAGE_SIZE;
+    ota.pages = ota.num_pages;
+    ota.complete = 0;
+    ota.tx_missing = 0;
+
+    // The previous image description is erased, the CRC is computed
+    ota.publishing = 1;
+    ota.flash_busy = 1;
+    ota.wr_req.op = N25XXX_OP_ERASE_SUBSECTOR;
+    ota.wr_req.address = ota.start + ota.size - OTA_SUBSECTOR_SIZE;
+    ota.wr_req.handler = check_start;
+    n25xxx_submit(&ota.wr_req);
+    return 0;
+}
+
+uint16_t ota_version()
+{
+    return ota.complete ? ota.version : 0;
+}
+
+/*
+ * Image description, in the last sub-sector of the staging area
+ */
+static void meta_read_done(handler_arg_t arg)
+{
+    (void) arg;
+    uint32_t magic, length, crc;
+    uint16_t version;
+    const uint8_t *p = ota.chunk;
+
+    ota.flash_busy = 0;
+
+    p = packer_uint32_unpack(p, &magic);
+    p = packer_uint16_unpack(p, &version);
+    p = packer_uint32_unpack(p, &length);
+    p = packer_uint32_unpack(p, &crc);
+
+    if ((magic != OTA_META_MAGIC) || (length == 0)
+            || (length > ota.size - OTA_SUBSECTOR_SIZE)
+            || (ota.version != 0))
+    {
+        return;
+    }
+
+    ota.version = version;
+    ota.length = length;
+    ota.crc = crc;
+    ota.num_pages = (length + OTA_PAGE_SIZE - 1) / OTA_PAGE_SIZE;
+    ota.pages = ota.num_pages;
+    ota.complete = 1;
+    log_info("OTA: image %u, %u bytes", version, length);
+}
+
+static void meta_write()
+{
+    uint8_t *p = ota.chunk;
+
+    memset(ota.chunk, 0xFF, sizeof(ota.chunk));
+    p = packer_uint32_pack(p, OTA_META_MAGIC);
+    p = packer_uint16_pack(p, ota.version);
+    p = packer_uint32_pack(p, ota.length);
+    p = packer_uint32_pack(p, ota.crc);
+
+    ota.wr_req.op = N25XXX_OP_PROGRAM;
+    ota.wr_req.address = ota.start + ota.size - OTA_SUBSECTOR_SIZE;
+    ota.wr_req.buf = ota.chunk;
+    ota.wr_req.len = sizeof(ota.chunk);
+    ota.wr_req.handler = meta_write_done;
+    n25xxx_submit(&ota.wr_req);
+}
+
+static void meta_write_done(handler_arg_t arg)
+{
+    (void) arg;
+
+    ota.flash_busy = 0;
+    ota.complete = 1;
+    trickle_reset();
+
+    if (ota.handler)
+    {
+        ota.handler(ota.handler_arg, ota.version);
+    }
+}
+
+/*
+ * Image check, the CRC of the staged image is computed by chunks
+ */
+static void check_start(handler_arg_t arg)
+{
+    (void) arg;
+
+    crc_enable();
+    crc_reset();
+
+    ota.offset = 0;
+    check_next(NULL);
+}
+
+static void check_next(handler_arg_t arg)
+{
+    uint32_t padded = (ota.length + 3) & ~3;
+
+    if (arg)
+    {
+        // A chunk was read
+        uint32_t len = padded - ota.offset;
+
+        if (len > sizeof(ota.chunk))
+        {
+            len = sizeof(ota.chunk);
+        }
+
+        crc_compute((const uint32_t *) ota.chunk, len / 4);
+        ota.offset += len;
+    }
+
+    if (ota.offset < padded)
+    {
+        ota.wr_req.op = N25XXX_OP_READ;
+        ota.wr_req.address = ota.start + ota.offset;
+        ota.wr_req.buf = ota.chunk;
+        ota.wr_req.len = sizeof(ota.chunk);
+        ota.wr_req.handler = check_next;
+        ota.wr_req.handler_arg = &ota;
+        n25xxx_submit(&ota.wr_req);
+        return;
+    }
+
+    ota.wr_req.handler_arg = NULL;
+    uint32_t crc = crc_terminate();
+    crc_disable();
+
+    if (ota.publishing)
+    {
+        ota.publishing = 0;
+        ota.crc = crc;
+    }
+    else if (crc != ota.crc)
+    {
+        // Download it again
+        log_error("OTA: image %u CRC mismatch", ota.version);
+        ota.pages = 0;
+        ota.erase_meta = 1;
+        ota.flash_busy = 0;
+        trickle_reset();
+        return;
+    }
+
+    meta_write();
+}
+
+/*
+ * Page download
+ */
+static uint32_t page_mask(uint16_t page)
+{
+    uint32_t len = ota.length - page * OTA_PAGE_SIZE;
+    uint32_t packets;
+
+    if (len >= OTA_PAGE_SIZE)
+    {
+        return 0xFFFFFFFF;
+    }
+
+    // A last page of 32 packets, not full, has them all
+    packets = (len + OTA_PACKET_SIZE - 1) / OTA_PACKET_SIZE;
+    if (packets >= 32)
+    {
+        return 0xFFFFFFFF;
+    }
+
+    return (1u << packets) - 1;
+}
+
+static void adopt(uint16_t version, uint32_t length, uint32_t crc)
+{
+    log_info("OTA: new image %u, %u bytes", version, length);
+
+    ota.version = version;
+    ota.length = length;
+    ota.crc = crc;
+    ota.num_pages = (length + OTA_PAGE_SIZE - 1) / OTA_PAGE_SIZE;
+    ota.pages = 0;
+    ota.complete = 0;
+    ota.received = 0;
+    ota.erase_meta = 1;
+    ota.tx_missing = 0;
+    memset(ota.page_buf, 0xFF, sizeof(ota.page_buf));
+}
+
+static void request_later(uint32_t ms)
+{
+    soft_timer_start(&ota.req_timer, soft_timer_ms_to_ticks(ms
+                     + random_rand16() % OTA_REQ_DELAY_MS), 0);
+}
+
+static void req_timeout(handler_arg_t arg)
+{
+    (void) arg;
+    uint8_t frame[OTA_REQ_LENGTH], *p = frame;
+
+    if (ota.complete || ota.flash_busy || (ota.pages >= ota.source_pages))
+    {
+        return;
+    }
+
+    if (++ota.retries > OTA_REQ_RETRIES)
+    {
+        // Wait for the next advertisement
+        ota.source_pages = 0;
+        return;
+    }
+
+    *p++ = OTA_FRAME_REQ;
+    p = packer_uint16_pack(p, ota.version);
+    p = packer_uint16_pack(p, ota.pages);
+    p = packer_uint32_pack(p, page_mask(ota.pages) & ~ota.received);
+
+    mac_csma_data_send(ota.source, frame, sizeof(frame));
+    request_later(OTA_DATA_WAIT_MS);
+}
+
+static void page_write_start()
+{
+    ota.flash_busy = 1;
+    ota.erased = 0;
+    ota.offset = 0;
+    soft_timer_stop(&ota.req_timer);
+    page_write_next(NULL);
+}
+
+static void page_write_next(handler_arg_t arg)
+{
+    (void) arg;
+    uint32_t address = ota.start + ota.pages * OTA_PAGE_SIZE;
+
+    ota.wr_req.handler = page_write_next;
+
+    if (ota.erase_meta)
+    {
+        ota.erase_meta = 0;
+        ota.wr_req.op = N25XXX_OP_ERASE_SUBSECTOR;
+        ota.wr_req.address = ota.start + ota.size - OTA_SUBSECTOR_SIZE;
+    }
+    else if (!ota.erased && (address % OTA_SUBSECTOR_SIZE) == 0)
+    {
+        ota.erased = 1;
+        ota.wr_req.op = N25XXX_OP_ERASE_SUBSECTOR;
+        ota.wr_req.address = address;
+    }
+    else if (ota.offset < OTA_PAGE_SIZE)
+    {
+        ota.wr_req.op = N25XXX_OP_PROGRAM;
+        ota.wr_req.address = address + ota.offset;
+        ota.wr_req.buf = ota.page_buf + ota.offset;
+        ota.wr_req.len = OTA_FLASH_PAGE_SIZE;
+        ota.offset += OTA_FLASH_PAGE_SIZE;
+    }
+    else
+    {
+        // Page complete
+        ota.pages++;
+        ota.received = 0;
+        ota.retries = 0;
+        memset(ota.page_buf, 0xFF, sizeof(ota.page_buf));
+
+        if (ota.pages == ota.num_pages)
+        {
+            check_start(NULL);
+            return;
+        }
+
+        ota.flash_busy = 0;
+        trickle_reset();
+
+        if (ota.source_pages > ota.pages)
+        {
+            request_later(0);
+        }
+
+        return;
+    }
+
+    n25xxx_submit(&ota.wr_req);
+}
+
+static void handle_data(uint16_t page, uint8_t index, const uint8_t *data,
+        uint8_t length)
+{
+    uint32_t mask;
+
+    if (ota.complete || ota.flash_busy || (page != ota.pages)
+            || (index >= OTA_PAGE_PACKETS) || (length > OTA_PACKET_SIZE))
+    {
+        return;
+    }
+
+    memcpy(ota.page_buf + index * OTA_PACKET_SIZE, data, length);
+    ota.received |= 1u << index;
+
+    mask = page_mask(page);
+
+    if ((ota.received & mask) == mask)
+    {
+        page_write_start();
+    }
+    else
+    {
+        // Data is flowing, repair once it stops
+        ota.retries = 0;
+        request_later(OTA_DATA_WAIT_MS);
+    }
+}
+
+/*
+ * Page service
+ */
+static void serve(uint16_t page, uint32_t missing)
+{
+    if (ota.tx_missing && (ota.tx_page != page))
+    {
+        // Busy with another page, the node requests again
+        return;
+    }
+
+    ota.tx_page = page;
+    ota.tx_missing |= missing & page_mask(page);
+
+    if (ota.tx_missing && !ota.tx_reading
+            && !soft_timer_is_active(&ota.tx_timer))
+    {
+        soft_timer_start(&ota.tx_timer,
+                         soft_timer_ms_to_ticks(OTA_TX_PERIOD_MS), 0);
+    }
+}
+
+static void tx_timeout(handler_arg_t arg)
+{
+    (void) arg;
+    uint32_t offset;
+
+    if (ota.tx_missing == 0)
+    {
+        return;
+    }
+
+    for (ota.tx_index = 0; !(ota.tx_missing & (1u << ota.tx_index));
+            ota.tx_index++)
+    {
+    }
+
+    offset = ota.tx_page * OTA_PAGE_SIZE + ota.tx_index * OTA_PACKET_SIZE;
+
+    ota.tx_reading = 1;
+    ota.rd_req.op = N25XXX_OP_READ;
+    ota.rd_req.address = ota.start + offset;
+    ota.rd_req.buf = ota.tx_frame + OTA_DATA_HEADER;
+    ota.rd_req.len = OTA_PACKET_SIZE;
+    ota.rd_req.handler = tx_read_done;
+    n25xxx_submit(&ota.rd_req);
+}
+
+static void tx_read_done(handler_arg_t arg)
+{
+    (void) arg;
+    uint8_t *p = ota.tx_frame;
+    uint32_t len = ota.length - ota.tx_page * OTA_PAGE_SIZE
+                   - ota.tx_index * OTA_PACKET_SIZE;
+
+    ota.tx_reading = 0;
+
+    if (len > OTA_PACKET_SIZE)
+    {
+        len = OTA_PACKET_SIZE;
+    }
+
+    *p++ = OTA_FRAME_DATA;
+    p = packer_uint16_pack(p, ota.version);
+    p = packer_uint16_pack(p, ota.tx_page);
+    *p++ = ota.tx_index;
+
+    // Sent to all, every neighbour missing the page takes it
+    if (mac_csma_data_send(0xFFFF, ota.tx_frame, OTA_DATA_HEADER + len))
+    {
+        ota.tx_missing &= ~(1u << ota.tx_index);
+    }
+
+    if (ota.tx_missing)
+    {
+        soft_timer_start(&ota.tx_timer,
+                         soft_timer_ms_to_ticks(OTA_TX_PERIOD_MS), 0);
+    }
+}
+
+/*
+ * Advertisements
+ */
+static void trickle_interval()
+{
+    uint32_t half = ota.tau / 2;
+    uint32_t t = half + random_rand32() % half;
+
+    ota.adv_rest = ota.tau - t;
+    ota.adv_sent = 0;
+    ota.adv_heard = 0;
+    soft_timer_start(&ota.adv_timer, t, 0);
+}
+
+static void trickle_reset()
+{
+    if (ota.tau > soft_timer_ms_to_ticks(OTA_TAU_LOW_MS))
+    {
+        ota.tau = soft_timer_ms_to_ticks(OTA_TAU_LOW_MS);
+        trickle_interval();
+    }
+}
+
+static void adv_timeout(handler_arg_t arg)
+{
+    (void) arg;
+    uint8_t frame[OTA_ADV_LENGTH], *p = frame;
+
+    if (ota.adv_sent)
+    {
+        // End of the interval
+        ota.tau *= 2;
+
+        if (ota.tau > soft_timer_ms_to_ticks(OTA_TAU_HIGH_MS))
+        {
+            ota.tau = soft_timer_ms_to_ticks(OTA_TAU_HIGH_MS);
+        }
+
+        trickle_interval();
+        return;
+    }
+
+    ota.adv_sent = 1;
+    soft_timer_start(&ota.adv_timer, ota.adv_rest, 0);
+
+    if (ota.adv_heard >= OTA_REDUNDANCY)
+    {
+        // Enough neighbours told the same
+        return;
+    }
+
+    *p++ = OTA_FRAME_ADV;
+    p = packer_uint16_pack(p, ota.version);
+    p = packer_uint32_pack(p, ota.length);
+    p = packer_uint32_pack(p, ota.crc);
+    p = packer_uint16_pack(p, ota.complete ? ota.num_pages : ota.pages);
+
+    mac_csma_data_send(0xFFFF, frame, sizeof(frame));
+}
+
+static void handle_adv(uint16_t src_addr, uint16_t version, uint32_t length,
+        uint32_t crc, uint16_t pages)
+{
+    if ((version > ota.version) && !ota.flash_busy
+            && (length > 0) && (length <= ota.size - OTA_SUBSECTOR_SIZE))
+    {
+        adopt(version, length, crc);
+    }
+    else if (version != ota.version)
+    {
+        // The neighbour is late, tell it soon
+        trickle_reset();
+        return;
+    }
+
+    if (pages > ota.pages)
+    {
+        ota.source = src_addr;
+        ota.source_pages = pages;
+
+        if (!ota.complete && !ota.flash_busy
+                && !soft_timer_is_active(&ota.req_timer))
+        {
+            ota.retries = 0;
+            request_later(0);
+        }
+    }
+    else if (pages < (ota.complete ? ota.num_pages : ota.pages))
+    {
+        trickle_reset();
+    }
+    else
+    {
+        ota.adv_heard++;
+    }
+}
+
+int ota_handle_frame(uint16_t src_addr, const uint8_t *data, uint8_t length)
+{
+    uint16_t version, page, pages;
+    uint32_t value, crc;
+    const uint8_t *p = data + 1;
+
+    if (length < 1)
+    {
+        return 0;
+    }
+
+    switch (data[0])
+    {
+        case OTA_FRAME_ADV:
+
+            if (length == OTA_ADV_LENGTH)
+            {
+                p = packer_uint16_unpack(p, &version);
+                p = packer_uint32_unpack(p, &value);
+                p = packer_uint32_unpack(p, &crc);
+                p = packer_uint16_unpack(p, &pages);
+                handle_adv(src_addr, version, value, crc, pages);
+            }
+
+            return 1;
+
+        case OTA_FRAME_REQ:
+
+            if (length == OTA_REQ_LENGTH)
+            {
+                p = packer_uint16_unpack(p, &version);
+                p = packer_uint16_unpack(p, &page);
+                p = packer_uint32_unpack(p, &value);
+
+                if ((version == ota.version) && (page < ota.pages))
+                {
+                    serve(page, value);
+                }
+            }
+
+            return 1;
+
+        case OTA_FRAME_DATA:
+
+            if (length > OTA_DATA_HEADER)
+            {
+                p = packer_uint16_unpack(p, &version);
+                p = packer_uint16_unpack(p, &page);
+
+                if (version == ota.version)
+                {
+                    handle_data(page, *p, data + OTA_DATA_HEADER,
+                                length - OTA_DATA_HEADER);
+                }
+            }
+
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Installation, the image is copied to the internal flash staging area
+ */
+int ota_install()
+{
+    boot_image_t *header = boot_staged_image();
+    uint32_t offset;
+
+    if (!ota.complete || ota.flash_busy || (header == NULL)
+            || (ota.length > boot_staging.size - sizeof(boot_image_t)))
+    {
+        return 1;
+    }
+
+    // Stop disseminating
+    ota.flash_busy = 1;
+    soft_timer_stop(&ota.adv_timer);
+    soft_timer_stop(&ota.req_timer);
+    soft_timer_stop(&ota.tx_timer);
+
+    for (offset = 0; offset < ota.length; offset += FLASH_SIZE_PAGE)
+    {
+        flash_erase_page(boot_staging.start + offset);
+    }
+
+    flash_erase_page((uint32_t) header & ~(FLASH_SIZE_PAGE - 1));
+
+    ota.offset = 0;
+    install_next(NULL);
+    return 0;
+}
+
+static void install_next(handler_arg_t arg)
+{
+    uint32_t padded = (ota.length + 3) & ~3;
+    boot_image_t image;
+
+    if (arg)
+    {
+        // Program the chunk read
+        uint32_t len = padded - ota.offset;
+
+        if (len > sizeof(ota.chunk))
+        {
+            len = sizeof(ota.chunk);
+        }
+
+        if (flash_program(boot_staging.start + ota.offset,
+                          (const uint32_t *) ota.chunk, len / 4) != FLASH_OK)
+        {
+            log_error("OTA: install failed at %u", ota.offset);
+            ota.flash_busy = 0;
+            trickle_interval();
+            return;
+        }
+
+        ota.offset += len;
+    }
+
+    if (ota.offset < padded)
+    {
+        ota.wr_req.op = N25XXX_OP_READ;
+        ota.wr_req.address = ota.start + ota.offset;
+        ota.wr_req.buf = ota.chunk;
+        ota.wr_req.len = sizeof(ota.chunk);
+        ota.wr_req.handler = install_next;
+        ota.wr_req.handler_arg = &ota;
+        n25xxx_submit(&ota.wr_req);
+        return;
+    }
+
+    // Same CRC as the staged image, computed by the same unit
+    image.magic = BOOT_IMAGE_MAGIC;
+    image.length = ota.length;
+    image.crc = ota.crc;
+    image.version = ota.version;
+
+    flash_program((uint32_t) boot_staged_image(), (const uint32_t *) &image,
+                  sizeof(image) / 4);
+
+    log_info("OTA: image %u staged, reset", ota.version);
+    nvic_reset();
+}
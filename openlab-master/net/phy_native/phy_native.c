@@ -0,0 +1,1011 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/*
+ * phy_native.c
+ *
+ * PHY layer of the native platform, on a simulated radio medium.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "platform.h"
+#include "native.h"
+#include "phy_native.h"
+#include "phy_native_medium.h"
+#include "unique_id.h"
+
+// Global lib
+#include "event.h"
+#include "soft_timer_delay.h"
+#include "trace.h"
+
+#include "printf.h"
+#include "debug.h"
+
+/* Private Variables */
+static timestamp_handler_cb_t phy_timestamp_handler;
+
+/* Private Functions */
+static uint64_t now_ns();
+static uint32_t ns_to_time(uint64_t ns);
+static uint64_t time_to_ns(uint32_t time);
+
+static void medium_send(phy_native_t *_phy, phy_native_msg_t *msg);
+static void medium_send_state(phy_native_t *_phy, phy_native_radio_t state);
+static void medium_handle_msg(phy_native_t *_phy, const phy_native_msg_t *msg);
+
+// Interrupt handlers
+static void medium_irq_handler(handler_arg_t arg);
+static void rx_start_handler(handler_arg_t arg, uint16_t timer_value);
+static void rx_timeout_handler(handler_arg_t arg, uint16_t timer_value);
+static void tx_end_handler(handler_arg_t arg, uint16_t timer_value);
+
+// API implementations (mutex must be taken)
+static void radio_sleep(phy_native_t *_phy);
+static void radio_idle(phy_native_t *_phy);
+static void radio_stop(phy_native_t *_phy, phy_native_state_t state);
+
+// Functions posted (must include protection)
+static void handle_rx_end(handler_arg_t arg);
+static void handle_rx_timeout(handler_arg_t arg);
+static void handle_tx_end(handler_arg_t arg);
+static void start_rx(handler_arg_t arg);
+
+/* Wait for the medium answers */
+#define MEDIUM_MAX_WAIT_MS 1000
+
+#if !defined(PLATFORM_OS) || (PLATFORM_OS == FREERTOS)
+#include "FreeRTOS.h"
+#include "semphr.h"
+static xSemaphoreHandle mutex = NULL;
+static inline void seminit()
+{
+    if (mutex == NULL)
+    {
+        mutex = xSemaphoreCreateMutex();
+    }
+}
+static inline void take()
+{
+    xSemaphoreTake(mutex, configTICK_RATE_HZ);
+}
+static inline void give()
+{
+    xSemaphoreGive(mutex);
+}
+#else
+static inline void seminit() {}
+static inline void take()    {}
+static inline void give()    {}
+#endif
+
+// ******************** API methods ************************** //
+
+void phy_native_init(phy_native_t *_phy, openlab_timer_t timer,
+        timer_channel_t channel)
+{
+    const char *path = getenv(PHY_NATIVE_MEDIUM_ENV);
+
+    // Create mutex if required
+    seminit();
+    take();
+
+    // Store the pointers
+    _phy->timer = timer;
+    _phy->channel = channel;
+
+    // Initialize the packet pointer, and radio parameters
+    _phy->pkt = NULL;
+    _phy->state = PHY_STATE_SLEEP;
+    TRACE_VALUE(TRACE_ID_PHY_STATE, PHY_STATE_SLEEP);
+    _phy->radio_channel = PHY_2400_MIN_CHANNEL;
+    _phy->power = 3;
+    _phy->medium = -1;
+
+    // Connect to the medium, if any
+    if (path)
+    {
+        struct sockaddr_un addr;
+        phy_native_msg_t msg;
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+        _phy->medium = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+
+        if (_phy->medium < 0
+                || connect(_phy->medium, (struct sockaddr *) &addr,
+                        sizeof(addr)) < 0)
+        {
+            log_error("Failed to connect to the medium %s", path);
+
+            if (_phy->medium >= 0)
+            {
+                close(_phy->medium);
+                _phy->medium = -1;
+            }
+        }
+        else
+        {
+            memset(&msg, 0, sizeof(msg));
+            msg.type = PHY_NATIVE_MSG_HELLO;
+            msg.node = platform_uid();
+            medium_send(_phy, &msg);
+
+            native_set_fd_handler(_phy->medium, medium_irq_handler, _phy);
+        }
+    }
+
+    if (_phy->medium < 0)
+    {
+        log_info("No radio medium, running standalone");
+    }
+
+    give();
+}
+
+void phy_reset(phy_t phy)
+{
+    take();
+
+    // Cast to native PHY
+    phy_native_t *_phy = phy;
+
+    // Back to the default parameters, asleep
+    _phy->radio_channel = PHY_2400_MIN_CHANNEL;
+    _phy->power = 3;
+    radio_sleep(_phy);
+
+    give();
+}
+
+void phy_sleep(phy_t phy)
+{
+    take();
+
+    // Cast to native PHY
+    phy_native_t *_phy = phy;
+
+    // Do the real sleep
+    radio_sleep(_phy);
+
+    give();
+}
+
+void phy_idle(phy_t phy)
+{
+    take();
+
+    // Cast to native PHY
+    phy_native_t *_phy = phy;
+
+    // Do the real idle
+    radio_idle(_phy);
+
+    give();
+}
+
+phy_status_t phy_set_channel(phy_t phy, uint8_t channel)
+{
+    take();
+
+    // Cast to native PHY
+    phy_native_t *_phy = phy;
+
+    // Check state
+    if ((_phy->state != PHY_STATE_SLEEP) && (_phy->state != PHY_STATE_IDLE))
+    {
+        log_error("Invalid state %u", _phy->state);
+
+        give();
+        // State is invalid for channel setting, return error
+        return PHY_ERR_INVALID_STATE;
+    }
+
+    // Check min and max value, the simulated radio is a 2.4GHz one
+    if (channel < PHY_2400_MIN_CHANNEL)
+    {
+        channel = PHY_2400_MIN_CHANNEL;
+    }
+    else if (channel > PHY_2400_MAX_CHANNEL)
+    {
+        channel = PHY_2400_MAX_CHANNEL;
+    }
+
+    // Given to the medium with the next state change
+    _phy->radio_channel = channel;
+
+    give();
+    return PHY_SUCCESS;
+}
+
+/* TX power in dBm of the phy_power_t values */
+static const float power_dbm[] =
+{
+    -30, -29, -28, -27, -26, -25, -24, -23, -22, -21, -20, -19, -18, -17,
+    -16, -15, -14, -13, -12, -11, -10, -9, -8, -7, -6, -5, -4, -3, -2, -1,
+    0, 0.7, 1, 1.3, 1.8, 2, 2.3, 2.8, 3, 4, 5
+};
+
+phy_status_t phy_set_power(phy_t phy, phy_power_t power)
+{
+    take();
+
+    // Cast to native PHY
+    phy_native_t *_phy = phy;
+
+    // Check state
+    if ((_phy->state != PHY_STATE_SLEEP) && (_phy->state != PHY_STATE_IDLE))
+    {
+        log_error("Invalid state %u", _phy->state);
+
+        give();
+
+        // State is invalid for power setting, return error
+        return PHY_ERR_INVALID_STATE;
+    }
+
+    if (power > PHY_POWER_5dBm)
+    {
+        power = PHY_POWER_5dBm;
+    }
+
+    // The medium works with whole dBm
+    _phy->power = (int8_t) (power_dbm[power] + (power_dbm[power] < 0 ? -0.5f
+                            : 0.5f));
+
+    give();
+    return PHY_SUCCESS;
+}
+
+phy_power_t phy_convert_power(float power)
+{
+    phy_power_t result = PHY_POWER_m30dBm;
+    int i;
+
+    // Closest value
+    for (i = PHY_POWER_m30dBm; i <= PHY_POWER_5dBm; i++)
+    {
+        float d = power - power_dbm[i];
+        float best = power - power_dbm[result];
+
+        if (d * d < best * best)
+        {
+            result = i;
+        }
+    }
+
+    return result;
+}
+
+static phy_status_t phy_ed_cca_measure(phy_t phy, int32_t *result, int32_t ed)
+{
+    phy_native_msg_t msg;
+    int32_t energy = PHY_NATIVE_ED_MIN;
+
+    take();
+
+    // Cast to native PHY
+    phy_native_t *_phy = phy;
+
+    // Check state
+    if ((_phy->state != PHY_STATE_SLEEP) && (_phy->state != PHY_STATE_IDLE))
+    {
+        // Invalid state!
+        log_error("Invalid state %u", _phy->state);
+
+        give();
+        return PHY_ERR_INVALID_STATE;
+    }
+
+    if (_phy->medium >= 0)
+    {
+        struct pollfd fds;
+        int received = 0;
+
+        // Block the medium interrupt while waiting for the answer
+        platform_enter_critical();
+
+        memset(&msg, 0, sizeof(msg));
+        msg.type = PHY_NATIVE_MSG_SENSE;
+        msg.channel = _phy->radio_channel;
+        msg.state = ed ? 1 : 0;
+        medium_send(_phy, &msg);
+
+        fds.fd = _phy->medium;
+        fds.events = POLLIN;
+
+        while (!received && poll(&fds, 1, MEDIUM_MAX_WAIT_MS) > 0)
+        {
+            while (recv(_phy->medium, &msg, sizeof(msg), 0) > 0)
+            {
+                if (msg.type == PHY_NATIVE_MSG_SENSE_RESULT)
+                {
+                    energy = msg.rssi;
+                    received = 1;
+                    break;
+                }
+
+                // Handle the other messages as the interrupt would have
+                medium_handle_msg(_phy, &msg);
+            }
+        }
+
+        platform_exit_critical();
+
+        if (!received)
+        {
+            log_error("No answer from the medium");
+
+            give();
+            return PHY_ERR_INTERNAL;
+        }
+    }
+
+    if (ed)
+    {
+        // Set ED value
+        *result = energy < PHY_NATIVE_ED_MIN ? PHY_NATIVE_ED_MIN : energy;
+    }
+    else
+    {
+        // Set CCA STATUS
+        *result = energy < PHY_NATIVE_CCA_THRESHOLD;
+    }
+
+    give();
+
+    // Return success
+    return PHY_SUCCESS;
+}
+
+phy_status_t phy_ed(phy_t phy, int32_t *ed)
+{
+    return phy_ed_cca_measure(phy, ed, 1);
+}
+
+phy_status_t phy_cca(phy_t phy, int32_t *cca)
+{
+    return phy_ed_cca_measure(phy, cca, 0);
+}
+
+phy_status_t phy_rx(phy_t phy, uint32_t rx_time, uint32_t timeout_time,
+        phy_packet_t *pkt, phy_handler_t handler)
+{
+    take();
+
+    // Cast to native PHY
+    phy_native_t *_phy = phy;
+
+    // Check the provided packet
+    if (pkt == NULL)
+    {
+        log_error("Invalid provided RX packet: NULL");
+        HALT();
+    }
+
+    // Check state
+    if ((_phy->state != PHY_STATE_SLEEP) && (_phy->state != PHY_STATE_IDLE))
+    {
+        // Invalid state!
+        log_error("Invalid state %u", _phy->state);
+
+        give();
+        return PHY_ERR_INVALID_STATE;
+    }
+
+    // Store timeout time
+    _phy->rx_timeout = timeout_time;
+
+    // Store packet pointer and handler
+    _phy->pkt = pkt;
+    _phy->handler = handler;
+
+    // Clear timestamp
+    _phy->pkt->timestamp = 0;
+    _phy->pkt->t_rx_start = 0;
+    _phy->pkt->t_rx_end = 0;
+
+    // Compute delta
+    uint32_t now = soft_timer_time();
+    int16_t delta_rx = rx_time - now;
+    int16_t delta_timeout = timeout_time - now;
+
+    // Check for invalid time
+    if ((rx_time && (delta_rx < 1)) || (timeout_time && (delta_timeout < 1))
+            || (rx_time && timeout_time && (timeout_time - rx_time < 1)))
+    {
+        // Invalid timing (too late), stay in the current state
+        log_warning("RX too late or timeout too late");
+        _phy->pkt = NULL;
+
+        give();
+        return PHY_ERR_TOO_LATE;
+    }
+
+    // Store State
+    _phy->state = PHY_STATE_RX_WAIT;
+    TRACE_VALUE(TRACE_ID_PHY_STATE, PHY_STATE_RX_WAIT);
+
+    // Block low power
+    platform_prevent_low_power();
+
+    // Check if an RX time is specified
+    if (rx_time)
+    {
+        // Set RX start time
+        timer_set_channel_compare(_phy->timer, _phy->channel, rx_time & 0xFFFF,
+                rx_start_handler, _phy);
+
+        give();
+    }
+    else
+    {
+        // Release mutex before
+        give();
+
+        // Set RX now
+        start_rx(_phy);
+    }
+
+    return PHY_SUCCESS;
+}
+
+phy_status_t phy_tx(phy_t phy, uint32_t tx_time, phy_packet_t *pkt,
+        phy_handler_t handler)
+{
+    phy_native_msg_t msg;
+    uint64_t start;
+
+    take();
+
+    // Cast to native PHY
+    phy_native_t *_phy = phy;
+
+    // Check the provided packet
+    if (pkt == NULL)
+    {
+        log_error("Invalid provided TX packet: NULL");
+
+        give();
+        return PHY_ERR_INTERNAL;
+    }
+
+    // Check length is valid
+    if (pkt->length > PHY_MAX_TX_LENGTH)
+    {
+        log_error("length too big: %u", pkt->length);
+
+        give();
+        return PHY_ERR_INVALID_LENGTH;
+    }
+
+    // Check state
+    if ((_phy->state != PHY_STATE_SLEEP) && (_phy->state != PHY_STATE_IDLE))
+    {
+        log_error("Invalid state %u", _phy->state);
+
+        give();
+        return PHY_ERR_INVALID_STATE;
+    }
+
+    // Check if TX time is delayed, it is the time of the SFD
+    if (tx_time)
+    {
+        int16_t spare_time = tx_time - soft_timer_time();
+
+        if (spare_time <= 1)
+        {
+            log_warning("TX too late: %d", -spare_time);
+
+            give();
+            return PHY_ERR_TOO_LATE;
+        }
+
+        start = time_to_ns(tx_time) - PHY_NATIVE_SFD_NS;
+    }
+    else
+    {
+        start = now_ns();
+    }
+
+    // Store packet and handler
+    _phy->pkt = pkt;
+    _phy->handler = handler;
+
+    // Store State, TX starts at the given time in the medium
+    _phy->state = tx_time ? PHY_STATE_TX_WAIT : PHY_STATE_TX;
+    TRACE_VALUE(TRACE_ID_PHY_STATE, tx_time ? PHY_STATE_TX_WAIT : PHY_STATE_TX);
+
+    // Block low power
+    platform_prevent_low_power();
+
+    if (_phy->medium >= 0)
+    {
+        // The medium sends TX_END at the end of the frame
+        memset(&msg, 0, PHY_NATIVE_MSG_HEADER_LENGTH);
+        msg.type = PHY_NATIVE_MSG_TX;
+        msg.channel = _phy->radio_channel;
+        msg.power = _phy->power;
+        msg.length = pkt->length;
+        msg.time = start;
+        memcpy(msg.data, pkt->data, pkt->length);
+        medium_send(_phy, &msg);
+    }
+    else
+    {
+        // Nobody listens, the frame ends after its airtime
+        _phy->pkt->timestamp = ns_to_time(start + PHY_NATIVE_SFD_NS);
+        _phy->pkt->eop_time = ns_to_time(start
+                + PHY_NATIVE_AIRTIME_NS(pkt->length));
+
+        timer_set_channel_compare(_phy->timer, _phy->channel,
+                _phy->pkt->eop_time & 0xFFFF, tx_end_handler, _phy);
+    }
+
+    give();
+
+    // Return Success
+    return PHY_SUCCESS;
+}
+
+phy_status_t phy_jam(phy_t phy, uint8_t channel, phy_power_t power)
+{
+    phy_native_msg_t msg;
+
+    if (phy_set_channel(phy, channel) != PHY_SUCCESS
+            || phy_set_power(phy, power) != PHY_SUCCESS)
+    {
+        return PHY_ERR_INVALID_STATE;
+    }
+
+    take();
+
+    // Cast to native PHY
+    phy_native_t *_phy = phy;
+
+    // Block low power
+    platform_prevent_low_power();
+
+    // Transmit until the next state change
+    _phy->state = PHY_STATE_JAMMING;
+    TRACE_VALUE(TRACE_ID_PHY_STATE, PHY_STATE_JAMMING);
+
+    if (_phy->medium >= 0)
+    {
+        memset(&msg, 0, PHY_NATIVE_MSG_HEADER_LENGTH);
+        msg.type = PHY_NATIVE_MSG_JAM;
+        msg.channel = _phy->radio_channel;
+        msg.power = _phy->power;
+        medium_send(_phy, &msg);
+    }
+
+    give();
+
+    // Return Success
+    return PHY_SUCCESS;
+}
+
+void register_timestamp_handler(timestamp_handler_cb_t timestamp_handler)
+{
+    phy_timestamp_handler = timestamp_handler;
+}
+
+// ***************** Internal methods (mutex taken before) ******************* //
+
+static void radio_sleep(phy_native_t *_phy)
+{
+    radio_stop(_phy, PHY_STATE_SLEEP);
+}
+
+static void radio_idle(phy_native_t *_phy)
+{
+    radio_stop(_phy, PHY_STATE_IDLE);
+}
+
+static void radio_stop(phy_native_t *_phy, phy_native_state_t state)
+{
+    switch (_phy->state)
+    {
+        case PHY_STATE_RX:
+        case PHY_STATE_RX_WAIT:
+        case PHY_STATE_TX:
+        case PHY_STATE_TX_WAIT:
+        case PHY_STATE_JAMMING:
+            platform_release_low_power();
+            break;
+
+        default:
+            // Nothing to do
+            break;
+    }
+
+    // Cancel any alarm
+    timer_set_channel_compare(_phy->timer, _phy->channel, 0, NULL, NULL);
+
+    // Change state before the interrupt may use the packet again
+    platform_enter_critical();
+    _phy->pkt = NULL;
+    _phy->state = state;
+    TRACE_VALUE(TRACE_ID_PHY_STATE, state);
+    platform_exit_critical();
+
+    // Any ongoing RX or TX is aborted by the medium
+    medium_send_state(_phy, state == PHY_STATE_SLEEP ? PHY_NATIVE_RADIO_SLEEP
+                      : PHY_NATIVE_RADIO_IDLE);
+}
+
+// *********************** Time conversions ************************ //
+
+static uint64_t now_ns()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static uint32_t ns_to_time(uint64_t ns)
+{
+    uint32_t now = soft_timer_time();
+    int64_t dt = (int64_t) (ns - now_ns());
+
+    return now + dt * SOFT_TIMER_FREQUENCY / 1000000000;
+}
+
+static uint64_t time_to_ns(uint32_t time)
+{
+    int32_t dt = time - soft_timer_time();
+
+    return now_ns() + (int64_t) dt * 1000000000 / SOFT_TIMER_FREQUENCY;
+}
+
+// *********************** Medium messages ************************ //
+
+static void medium_send(phy_native_t *_phy, phy_native_msg_t *msg)
+{
+    size_t length = PHY_NATIVE_MSG_HEADER_LENGTH;
+
+    if (_phy->medium < 0)
+    {
+        return;
+    }
+
+    if (msg->type == PHY_NATIVE_MSG_TX)
+    {
+        length += msg->length;
+    }
+
+    if (send(_phy->medium, msg, length, MSG_NOSIGNAL) != (ssize_t) length)
+    {
+        log_error("Failed to send message %x to the medium", msg->type);
+    }
+}
+
+static void medium_send_state(phy_native_t *_phy, phy_native_radio_t state)
+{
+    phy_native_msg_t msg;
+
+    memset(&msg, 0, PHY_NATIVE_MSG_HEADER_LENGTH);
+    msg.type = PHY_NATIVE_MSG_STATE;
+    msg.channel = _phy->radio_channel;
+    msg.state = state;
+    msg.seq = _phy->rx_seq;
+    medium_send(_phy, &msg);
+}
+
+/* Called from interrupt, or with the interrupts disabled */
+static void medium_handle_msg(phy_native_t *_phy, const phy_native_msg_t *msg)
+{
+    switch (msg->type)
+    {
+        case PHY_NATIVE_MSG_RX_START:
+            // Check state and sequence, the RX may have been aborted since
+            if (_phy->state != PHY_STATE_RX || msg->seq != _phy->rx_seq
+                    || _phy->rx_started)
+            {
+                break;
+            }
+
+            _phy->rx_started = 1;
+
+            // Stop RX timeout alarm
+            timer_set_channel_compare(_phy->timer, _phy->channel, 0, NULL,
+                    NULL);
+
+            // Store SFD time
+            _phy->pkt->timestamp = ns_to_time(msg->time);
+
+            if (phy_timestamp_handler)
+            {
+                phy_timestamp_handler(&(_phy->pkt->timestamp_alt.msb),
+                        &(_phy->pkt->timestamp_alt.lsb));
+            }
+
+            break;
+
+        case PHY_NATIVE_MSG_RX_END:
+            if (_phy->state != PHY_STATE_RX || msg->seq != _phy->rx_seq
+                    || !_phy->rx_started)
+            {
+                break;
+            }
+
+            _phy->rx_started = 0;
+            _phy->pkt->eop_time = ns_to_time(msg->eop);
+            _phy->pkt->t_rx_start = _phy->pkt->timestamp;
+            _phy->pkt->t_rx_end = soft_timer_time();
+
+            if (phy_timestamp_handler)
+            {
+                phy_timestamp_handler(&(_phy->pkt->eop_time_alt.msb),
+                        &(_phy->pkt->eop_time_alt.lsb));
+            }
+
+            if (!msg->state)
+            {
+                _phy->rx_status = PHY_RX_CRC_ERROR;
+            }
+            else if ((msg->length == 0)
+                    || (_phy->pkt->data + msg->length
+                            > _phy->pkt->raw_data + PHY_MAX_RX_LENGTH))
+            {
+                _phy->rx_status = PHY_RX_LENGTH_ERROR;
+            }
+            else
+            {
+                memcpy(_phy->pkt->data, msg->data, msg->length);
+                _phy->pkt->length = msg->length;
+                _phy->pkt->rssi = msg->rssi;
+                _phy->pkt->lqi = msg->lqi;
+                _phy->rx_status = PHY_SUCCESS;
+            }
+
+            // Call RX end handler from event task
+            event_post_from_isr(EVENT_QUEUE_NETWORK, handle_rx_end, _phy);
+            break;
+
+        case PHY_NATIVE_MSG_TX_END:
+            if (_phy->state != PHY_STATE_TX && _phy->state != PHY_STATE_TX_WAIT)
+            {
+                break;
+            }
+
+            // Store the SFD and end of packet times
+            _phy->pkt->timestamp = ns_to_time(msg->time);
+            _phy->pkt->eop_time = ns_to_time(msg->eop);
+
+            if (phy_timestamp_handler)
+            {
+                phy_timestamp_handler(&(_phy->pkt->eop_time_alt.msb),
+                        &(_phy->pkt->eop_time_alt.lsb));
+            }
+
+            // Call TX end handler from event task
+            event_post_from_isr(EVENT_QUEUE_NETWORK, handle_tx_end, _phy);
+            break;
+
+        default:
+            // Late sense result, or unknown
+            break;
+    }
+}
+
+// *********************** INPUT handlers (posted from ISR) ************************ //
+
+static void start_rx(handler_arg_t arg)
+{
+    take();
+
+    // Cast to native PHY
+    phy_native_t *_phy = arg;
+
+    // Check state and pkt
+    if (_phy->state != PHY_STATE_RX_WAIT)
+    {
+        log_error("start_rx but state not RX wait: %x", _phy->state);
+
+        give();
+        return;
+    }
+
+    if (_phy->pkt == NULL)
+    {
+        log_error("start_rx but pkt NULL");
+        HALT();
+    }
+
+    // Set State, with a new sequence for the medium messages
+    platform_enter_critical();
+    _phy->state = PHY_STATE_RX;
+    TRACE_VALUE(TRACE_ID_PHY_STATE, PHY_STATE_RX);
+    _phy->rx_started = 0;
+    _phy->rx_seq++;
+    platform_exit_critical();
+
+    medium_send_state(_phy, PHY_NATIVE_RADIO_RX);
+
+    // Set timer for timeout, if any
+    if (_phy->rx_timeout)
+    {
+        timer_set_channel_compare(_phy->timer, _phy->channel,
+                _phy->rx_timeout & 0xFFFF, rx_timeout_handler, _phy);
+    }
+    else
+    {
+        // Disable timer
+        timer_set_channel_compare(_phy->timer, _phy->channel, 0, NULL, NULL);
+    }
+
+    give();
+}
+
+static void handle_rx_end(handler_arg_t arg)
+{
+    take();
+
+    // Cast to native PHY
+    phy_native_t *_phy = arg;
+
+    // Check state
+    if (_phy->state != PHY_STATE_RX)
+    {
+        log_error("handle_rx_end but state not RX: %x", _phy->state);
+
+        give();
+        return;
+    }
+
+    // Go to idle
+    radio_idle(_phy);
+
+    give();
+
+    // Call RX handler if any
+    if (_phy->handler)
+    {
+        _phy->handler(_phy->rx_status);
+    }
+}
+
+static void handle_rx_timeout(handler_arg_t arg)
+{
+    take();
+
+    // Cast to native PHY
+    phy_native_t *_phy = arg;
+
+    // Handle Timeout should only occur in RX state
+    if ((_phy->state != PHY_STATE_RX_WAIT) && (_phy->state != PHY_STATE_RX))
+    {
+        // Interrupt may have slipped, discard
+        log_warning("invalid state for phy handle_rx_timeout: %x", _phy->state);
+
+        give();
+        return;
+    }
+
+    // Set Idle
+    radio_idle(_phy);
+
+    give();
+
+    // Notify receiving failed
+    if (_phy->handler)
+    {
+        _phy->handler(PHY_RX_TIMEOUT_ERROR);
+    }
+}
+
+static void handle_tx_end(handler_arg_t arg)
+{
+    take();
+
+    // Cast to native PHY
+    phy_native_t *_phy = arg;
+
+    if ((_phy->state != PHY_STATE_TX) && (_phy->state != PHY_STATE_TX_WAIT))
+    {
+        log_warning("invalid state for phy handle_tx_end: %x", _phy->state);
+
+        give();
+        return;
+    }
+
+    // Go to Idle
+    radio_idle(_phy);
+
+    give();
+
+    // Notify sending is done if handler is not null
+    if (_phy->handler)
+    {
+        _phy->handler(PHY_SUCCESS);
+    }
+}
+
+// ************************** Interrupt Routines ************************** //
+
+/* Those are called from interrupt service routines */
+static void medium_irq_handler(handler_arg_t arg)
+{
+    phy_native_t *_phy = arg;
+    phy_native_msg_t msg;
+    ssize_t length;
+
+    // Handle all the pending messages
+    while ((length = recv(_phy->medium, &msg, sizeof(msg), 0)) > 0)
+    {
+        TRACE_POINT(TRACE_ID_PHY_IRQ, msg.type);
+        medium_handle_msg(_phy, &msg);
+    }
+
+    if (length == 0)
+    {
+        // The medium is gone, the simulation is over
+        _exit(0);
+    }
+}
+
+static void rx_start_handler(handler_arg_t arg, uint16_t timer_value)
+{
+    // is not used
+    (void) timer_value;
+
+    // Request a post of start_rx
+    event_post_from_isr(EVENT_QUEUE_NETWORK, start_rx, arg);
+}
+
+static void rx_timeout_handler(handler_arg_t arg, uint16_t timer_value)
+{
+    // is not used
+    (void) timer_value;
+
+    // Cast to PHY
+    phy_native_t *_phy = arg;
+
+    // Disable timer
+    timer_set_channel_compare(_phy->timer, _phy->channel, 0, NULL, NULL);
+
+    // Call handle_rx_timeout handler from event task
+    event_post_from_isr(EVENT_QUEUE_NETWORK, handle_rx_timeout, arg);
+}
+
+static void tx_end_handler(handler_arg_t arg, uint16_t timer_value)
+{
+    // is not used
+    (void) timer_value;
+
+    // Cast to PHY
+    phy_native_t *_phy = arg;
+
+    // Disable timer
+    timer_set_channel_compare(_phy->timer, _phy->channel, 0, NULL, NULL);
+
+    // Call handle_tx_end handler from event task
+    event_post_from_isr(EVENT_QUEUE_NETWORK, handle_tx_end, arg);
+}
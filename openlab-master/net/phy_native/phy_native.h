@@ -0,0 +1,98 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/*
+ * phy_native.h
+ *
+ * PHY layer of the native platform, on a simulated radio medium.
+ *
+ * The node connects to the medium process whose socket path is given by the
+ * OPENLAB_MEDIUM environment variable, see native_medium. The medium models
+ * the 250kbps airtime, the path loss between the nodes, the collisions, and
+ * gives the RSSI, LQI and SFD time of the received frames.
+ *
+ * Without a medium, frames are sent to nobody after their airtime, nothing is
+ * ever received and the channel is always clear.
+ */
+
+#ifndef PHY_NATIVE_H_
+#define PHY_NATIVE_H_
+
+#include "phy.h"
+#include "timer.h"
+#include "soft_timer.h"
+
+typedef enum
+{
+    PHY_STATE_SLEEP = 0,
+    PHY_STATE_IDLE = 1,
+    PHY_STATE_RX_WAIT = 2,
+    PHY_STATE_RX = 3,
+    PHY_STATE_TX_WAIT = 4,
+    PHY_STATE_TX = 5,
+    PHY_STATE_JAMMING = 6,
+} phy_native_state_t;
+
+typedef struct
+{
+    // Socket to the medium, -1 when standalone
+    int medium;
+
+    // Timer for timed alarm
+    openlab_timer_t timer;
+    // Timer Channel for alarm
+    timer_channel_t channel;
+
+    // Pointers to the packet used in TX or RX
+    phy_packet_t *pkt;
+
+    // Running State
+    volatile phy_native_state_t state;
+
+    // Handler
+    phy_handler_t handler;
+
+    // RX timeout
+    uint32_t rx_timeout;
+
+    // Radio channel and TX power in dBm
+    uint8_t radio_channel;
+    int8_t power;
+
+    // RX sequence, to discard the medium messages of a previous RX
+    uint16_t rx_seq;
+    // Set once the SFD of the frame being received is detected
+    volatile uint8_t rx_started;
+    // Status of the RX, given to the handler
+    volatile phy_status_t rx_status;
+} phy_native_t;
+
+/**
+ * Initialize the PHY layer
+ *
+ * Connects to the medium, if any.
+ *
+ * \param phy the PHY to init.
+ * \param timer a timer to provide timeouts and so;
+ * \param channel a timer channel for timeouts and so;
+ */
+void phy_native_init(phy_native_t *phy, openlab_timer_t timer,
+                     timer_channel_t channel);
+
+#endif /* PHY_NATIVE_H_ */
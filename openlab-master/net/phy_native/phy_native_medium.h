@@ -0,0 +1,119 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/*
+ * phy_native_medium.h
+ *
+ * Messages exchanged between the native PHY of the simulated nodes and the
+ * radio medium, one message per packet of a SOCK_SEQPACKET Unix socket.
+ *
+ * All times are CLOCK_MONOTONIC times in nanoseconds, shared by all the
+ * processes of the host. Messages are in host byte order.
+ */
+
+#ifndef PHY_NATIVE_MEDIUM_H_
+#define PHY_NATIVE_MEDIUM_H_
+
+#include <stdint.h>
+
+/** Environment variable holding the medium socket path */
+#define PHY_NATIVE_MEDIUM_ENV   "OPENLAB_MEDIUM"
+/** Environment variable holding the node id */
+#define PHY_NATIVE_NODE_ID_ENV  "OPENLAB_NODE_ID"
+
+/** Duration of a byte at 250kbps, in ns */
+#define PHY_NATIVE_BYTE_NS      32000
+/** Synchronization header length, preamble and SFD, in bytes */
+#define PHY_NATIVE_SHR_LENGTH   5
+/** Length of the PHY header and of the FCS, in bytes */
+#define PHY_NATIVE_PHR_LENGTH   1
+#define PHY_NATIVE_FCS_LENGTH   2
+
+/** Time from the start of a frame to its SFD, in ns */
+#define PHY_NATIVE_SFD_NS       (PHY_NATIVE_SHR_LENGTH * PHY_NATIVE_BYTE_NS)
+
+/** Airtime of a frame with a payload of the given length, in ns */
+#define PHY_NATIVE_AIRTIME_NS(length) \
+    (((length) + PHY_NATIVE_SHR_LENGTH + PHY_NATIVE_PHR_LENGTH \
+      + PHY_NATIVE_FCS_LENGTH) * (uint64_t) PHY_NATIVE_BYTE_NS)
+
+/** Sensitivity, CCA threshold and ED floor, in dBm, as the RF231 */
+#define PHY_NATIVE_SENSITIVITY  (-101)
+#define PHY_NATIVE_CCA_THRESHOLD (-77)
+#define PHY_NATIVE_ED_MIN       (-91)
+
+typedef enum
+{
+    // Node to medium
+    PHY_NATIVE_MSG_HELLO = 1,
+    PHY_NATIVE_MSG_STATE = 2,
+    PHY_NATIVE_MSG_TX = 3,
+    PHY_NATIVE_MSG_JAM = 4,
+    PHY_NATIVE_MSG_SENSE = 5,
+
+    // Medium to node
+    PHY_NATIVE_MSG_RX_START = 0x81,
+    PHY_NATIVE_MSG_RX_END = 0x82,
+    PHY_NATIVE_MSG_TX_END = 0x83,
+    PHY_NATIVE_MSG_SENSE_RESULT = 0x84,
+} phy_native_msg_type_t;
+
+/** Radio states, as seen by the medium */
+typedef enum
+{
+    PHY_NATIVE_RADIO_SLEEP = 0,
+    PHY_NATIVE_RADIO_IDLE = 1,
+    PHY_NATIVE_RADIO_RX = 2,
+    PHY_NATIVE_RADIO_TX = 3,
+} phy_native_radio_t;
+
+typedef struct
+{
+    /** One of \ref phy_native_msg_type_t */
+    uint8_t type;
+    /** Radio channel, 11 to 26 */
+    uint8_t channel;
+    /** TX power in dBm, for TX and JAM */
+    int8_t power;
+    /** Radio state for STATE, CRC validity for RX_END, 1 for an ED SENSE */
+    uint8_t state;
+    /** Node id for HELLO */
+    uint16_t node;
+    /** RX sequence of STATE, echoed by RX_START and RX_END */
+    uint16_t seq;
+    /** Payload length, FCS excluded */
+    uint8_t length;
+    /** RSSI in dBm and LQI of a received frame, energy of SENSE_RESULT */
+    int8_t rssi;
+    uint8_t lqi;
+    uint8_t reserved[5];
+
+    /** Start of a TX, SFD of RX_START, RX_END and TX_END, in ns */
+    uint64_t time;
+    /** End of packet of RX_END and TX_END, in ns */
+    uint64_t eop;
+
+    /** The frame payload, for TX and RX_END */
+    uint8_t data[128];
+} phy_native_msg_t;
+
+/** Length of a message with no payload */
+#define PHY_NATIVE_MSG_HEADER_LENGTH  (sizeof(phy_native_msg_t) - 128)
+
+#endif /* PHY_NATIVE_MEDIUM_H_ */
@@ -33,6 +33,7 @@
 // Global lib
 #include "event.h"
 #include "soft_timer_delay.h"
+#include "trace.h"
 
 #include "printf.h"
 #include "debug.h"
@@ -472,6 +473,7 @@ phy_status_t phy_rx(phy_t phy, uint32_t rx_time, uint32_t timeout_time,
 
     // Store State
     _phy->state = PHY_STATE_RX_WAIT;
+    TRACE_VALUE(TRACE_ID_PHY_STATE, PHY_STATE_RX_WAIT);
 
     // Block low power
     platform_prevent_low_power();
@@ -580,6 +582,7 @@ phy_status_t phy_tx(phy_t phy, uint32_t tx_time, phy_packet_t *pkt,
     // Backup state and store new State
     uint32_t last_state = _phy->state;
     _phy->state = PHY_STATE_TX_WAIT;
+    TRACE_VALUE(TRACE_ID_PHY_STATE, PHY_STATE_TX_WAIT);
 
     // Check if TX time is delayed
     if (tx_time)
@@ -610,6 +613,7 @@ phy_status_t phy_tx(phy_t phy, uint32_t tx_time, phy_packet_t *pkt,
 
             // Go back to previous state
             _phy->state = last_state;
+            TRACE_VALUE(TRACE_ID_PHY_STATE, last_state);
             if (_phy->state == PHY_STATE_SLEEP)
             {
                 // Back to sleep
@@ -646,6 +650,7 @@ phy_status_t phy_tx(phy_t phy, uint32_t tx_time, phy_packet_t *pkt,
 
             // Go back to previous state
             _phy->state = last_state;
+            TRACE_VALUE(TRACE_ID_PHY_STATE, last_state);
             if (_phy->state == PHY_STATE_SLEEP)
             {
                 // Back to sleep
@@ -879,6 +884,7 @@ phy_status_t phy_jam(phy_t phy, uint8_t channel, phy_power_t power)
 
     // Store State
     _phy->state = PHY_STATE_JAMMING;
+    TRACE_VALUE(TRACE_ID_PHY_STATE, PHY_STATE_JAMMING);
 
     // Disable interrupt
     rf2xx_irq_disable(_phy->radio);
@@ -1166,6 +1172,7 @@ static void sleep(phy_rf2xx_t *_phy)
 
     // Save state
     _phy->state = PHY_STATE_SLEEP;
+    TRACE_VALUE(TRACE_ID_PHY_STATE, PHY_STATE_SLEEP);
 }
 
 static void idle(phy_rf2xx_t *_phy)
@@ -1219,6 +1226,7 @@ static void idle(phy_rf2xx_t *_phy)
 
     // Save state
     _phy->state = PHY_STATE_IDLE;
+    TRACE_VALUE(TRACE_ID_PHY_STATE, PHY_STATE_IDLE);
 }
 
 // *********************** INPUT handlers (posted from ISR) ************************ //
@@ -1247,6 +1255,7 @@ static void start_rx(handler_arg_t arg)
 
     // Set State
     _phy->state = PHY_STATE_RX;
+    TRACE_VALUE(TRACE_ID_PHY_STATE, PHY_STATE_RX);
 
     // Disable interrupt
     rf2xx_irq_disable(_phy->radio);
@@ -1375,6 +1384,7 @@ static phy_status_t handle_rx_start(phy_rf2xx_t *_phy)
     // Retrieve remaining of the data asynchronously (+1) to have the LQI
     uint8_t length = _phy->pkt->length + 1;
 
+    TRACE_BEGIN(TRACE_ID_PHY_RX_READ, length);
     rf2xx_fifo_read_remaining_async(_phy->radio, _phy->pkt->data, length,
             fifo_read_done_handler, _phy);
 
@@ -1419,6 +1429,7 @@ static void handle_rx_end(handler_arg_t arg)
     _phy->pkt->length -= 2;
 
     int16_t dt = _phy->pkt->t_rx_end - _phy->pkt->t_rx_start;
+    TRACE_POINT(TRACE_ID_PHY_RX_END, dt);
     if (dt > 500)
     {
         log_error("Too much time to read a packet, length = %u",
@@ -1612,6 +1623,7 @@ static void tx_start_handler(handler_arg_t arg, uint16_t timer_value)
 
         // Store State
         _phy->state = PHY_STATE_TX;
+        TRACE_VALUE(TRACE_ID_PHY_STATE, PHY_STATE_TX);
 
         // Disable timer
         timer_set_channel_compare(_phy->timer, _phy->channel, 0, NULL, NULL);
@@ -1641,6 +1653,8 @@ static void irq_handler(handler_arg_t arg)
     // Cast to PHY
     phy_rf2xx_t *_phy = arg;
 
+    TRACE_POINT(TRACE_ID_PHY_IRQ, _phy->state);
+
     // Store IRQ time in EOP
     _phy->pkt->eop_time = soft_timer_time();
     if (phy_timestamp_handler)
@@ -1653,6 +1667,8 @@ static void irq_handler(handler_arg_t arg)
 
 static void fifo_read_done_handler(handler_arg_t arg)
 {
+    TRACE_END(TRACE_ID_PHY_RX_READ, 0);
+
     // Call RX end handler from event task
     event_post_from_isr(EVENT_QUEUE_NETWORK, handle_rx_end, arg);
 }
@@ -8,91 +8,192 @@
  */
 
 /*-----------------------------------------------------------
- * Implementation of functions defined in portable.h for the ARM CM3 port.
+ * Implementation of functions defined in portable.h for the native (POSIX)
+ * port.
+ *
+ * Each task runs in its own thread, and only the thread of the current task
+ * is allowed to run, the others wait on their condition variable.  A context
+ * switch wakes the thread of the new current task up and puts the thread of
+ * the previous one to sleep.
+ *
+ * Interrupts are emulated by the SIGALRM and SIGIO signals, delivered to the
+ * running thread only as they are blocked in all the others.  Disabling
+ * interrupts blocks the signals.  The tick and the platform interrupts are handled by the
+ * signal handler of the platform, which must enclose them between
+ * vPortEnterInterrupt() and vPortExitInterrupt(), the context switches
+ * requested meanwhile being done on exit.
  *----------------------------------------------------------*/
 
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+
 /* Scheduler includes. */
 #include "FreeRTOS.h"
 #include "task.h"
 #include "platform.h"
 
-/* For backward compatibility, ensure configKERNEL_INTERRUPT_PRIORITY is
-defined.  The value should also ensure backward compatibility.
-FreeRTOS.org versions prior to V4.4.0 did not include this definition. */
-#ifndef configKERNEL_INTERRUPT_PRIORITY
-	#define configKERNEL_INTERRUPT_PRIORITY 255
-#endif
-
-/* Constants required to manipulate the NVIC. */
-#define portNVIC_SYSTICK_CTRL		( ( volatile unsigned long *) 0xe000e010 )
-#define portNVIC_SYSTICK_LOAD		( ( volatile unsigned long *) 0xe000e014 )
-#define portNVIC_INT_CTRL			( ( volatile unsigned long *) 0xe000ed04 )
-#define portNVIC_SYSPRI2			( ( volatile unsigned long *) 0xe000ed20 )
-#define portNVIC_SYSTICK_CLK		0x00000004
-#define portNVIC_SYSTICK_INT		0x00000002
-#define portNVIC_SYSTICK_ENABLE		0x00000001
-#define portNVIC_PENDSVSET			0x10000000
-#define portNVIC_PENDSV_PRI			( ( ( unsigned long ) configKERNEL_INTERRUPT_PRIORITY ) << 16 )
-#define portNVIC_SYSTICK_PRI		( ( ( unsigned long ) configKERNEL_INTERRUPT_PRIORITY ) << 24 )
-
-/* Constants required to set up the initial stack. */
-#define portINITIAL_XPSR			( 0x01000000 )
-
-/* The priority used by the kernel is assigned to a variable to make access
-from inline assembler easier. */
-const unsigned long ulKernelPriority = configKERNEL_INTERRUPT_PRIORITY;
+/* Size of the task threads stacks, the FreeRTOS stacks are not used. */
+#define portTHREAD_STACK_SIZE		( 256 * 1024 )
+
+/* The thread running a task. */
+typedef struct
+{
+	pthread_t xThread;
+	pthread_cond_t xCond;
+	pdTASK_CODE pxCode;
+	void *pvParameters;
+	volatile portBASE_TYPE xRunning;
+} xThreadState;
+
+/* The current TCB, whose first member is the task top of stack. */
+extern void * volatile pxCurrentTCB;
 
 /* Each task maintains its own interrupt status in the critical nesting
 variable. */
 static unsigned portBASE_TYPE uxCriticalNesting = 0xaaaaaaaa;
 
+/* Signal mask saved when entering the outermost critical section. */
+static sigset_t xCriticalMask;
+
+/* Interrupt nesting, and context switch requested while in interrupt or in
+critical section. */
+static volatile unsigned portBASE_TYPE uxInterruptNesting = 0;
+static volatile portBASE_TYPE xSwitchPending = pdFALSE;
+
+/* Mutex protecting the xRunning flags of the threads. */
+static pthread_mutex_t xRunMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Condition on which the main thread waits for the end of the scheduler. */
+static pthread_cond_t xEndCond = PTHREAD_COND_INITIALIZER;
+static volatile portBASE_TYPE xSchedulerEnded = pdFALSE;
+
+/* Set once the first task runs, no context switch is possible before. */
+static volatile portBASE_TYPE xSchedulerStarted = pdFALSE;
+
+/*
+ * The signals emulating the interrupts.
+ */
+static void prvInterruptSignals( sigset_t *pxSet );
+
 /*
  * Setup the timer to generate the tick interrupts.
  */
 static void prvSetupTimerInterrupt( void );
 
 /*
- * Exception handlers.
+ * Switch to the new current task, if it changed.  Interrupts must be
+ * disabled.
  */
-void pendsv_handler( void ) __attribute__ (( naked ));
-void xPortTickHandler( void* );
-void svc_handler( void ) __attribute__ (( naked ));
+static void prvSwitchContext( void );
 
 /*
- * Start first task is a separate function so it can be tested in isolation.
+ * Entry point of the task threads.
  */
-void vPortStartFirstTask( void ) __attribute__ (( naked ));
+static void *prvThreadStart( void *pvArg );
+
+void xPortTickHandler( void* );
 
 /*-----------------------------------------------------------*/
 
+#define prvGetThreadState( pxTCB ) ( *( xThreadState ** ) *( portSTACK_TYPE ** ) ( pxTCB ) )
+
 /*
  * See header file for description.
  */
 portSTACK_TYPE *pxPortInitialiseStack( portSTACK_TYPE *pxTopOfStack, pdTASK_CODE pxCode, void *pvParameters )
 {
-	/* Simulate the stack frame as it would be created by a context switch
-	interrupt. */
-	pxTopOfStack--; /* Offset added to account for the way the MCU uses the stack on entry/exit of interrupts. */
-	*pxTopOfStack = portINITIAL_XPSR;	/* xPSR */
-	pxTopOfStack--;
-	*pxTopOfStack = ( portSTACK_TYPE ) pxCode;	/* PC */
+xThreadState *pxThread;
+pthread_attr_t xAttr;
+sigset_t xSet, xOldMask;
+
+	pxThread = malloc( sizeof( xThreadState ) );
+	configASSERT( pxThread );
+
+	pxThread->pxCode = pxCode;
+	pxThread->pvParameters = pvParameters;
+	pxThread->xRunning = pdFALSE;
+	pthread_cond_init( &pxThread->xCond, NULL );
+
+	/* The thread inherits the blocked interrupts, until it first runs. */
+	prvInterruptSignals( &xSet );
+	pthread_sigmask( SIG_BLOCK, &xSet, &xOldMask );
+
+	pthread_attr_init( &xAttr );
+	pthread_attr_setdetachstate( &xAttr, PTHREAD_CREATE_DETACHED );
+	pthread_attr_setstacksize( &xAttr, portTHREAD_STACK_SIZE );
+
+	if( pthread_create( &pxThread->xThread, &xAttr, prvThreadStart, pxThread ) != 0 )
+	{
+		configASSERT( 0 );
+	}
+
+	pthread_attr_destroy( &xAttr );
+	pthread_sigmask( SIG_SETMASK, &xOldMask, NULL );
+
+	/* The stack only holds the thread state. */
 	pxTopOfStack--;
-	*pxTopOfStack = 0;	/* LR */
-	pxTopOfStack -= 5;	/* R12, R3, R2 and R1. */
-	*pxTopOfStack = ( portSTACK_TYPE ) pvParameters;	/* R0 */
-	pxTopOfStack -= 8;	/* R11, R10, R9, R8, R7, R6, R5 and R4. */
+	*( xThreadState ** ) pxTopOfStack = pxThread;
 
 	return pxTopOfStack;
 }
 /*-----------------------------------------------------------*/
 
-void svc_handler( void )
+static void *prvThreadStart( void *pvArg )
 {
+xThreadState *pxThread = pvArg;
+sigset_t xSet;
+
+	pthread_mutex_lock( &xRunMutex );
+	while( !pxThread->xRunning )
+	{
+		pthread_cond_wait( &pxThread->xCond, &xRunMutex );
+	}
+	pthread_mutex_unlock( &xRunMutex );
+
+	/* Tasks start with interrupts enabled, outside of any critical section. */
+	prvInterruptSignals( &xSet );
+	pthread_sigmask( SIG_UNBLOCK, &xSet, NULL );
+
+	pxThread->pxCode( pxThread->pvParameters );
+
+	/* Tasks must not return. */
+	for( ;; )
+	{
+		vTaskSuspend( NULL );
+	}
+
+	return NULL;
 }
 /*-----------------------------------------------------------*/
 
-void vPortStartFirstTask( void )
+static void prvSwitchContext( void )
 {
+xThreadState *pxPrevious, *pxNext;
+
+	xSwitchPending = pdFALSE;
+
+	pxPrevious = prvGetThreadState( pxCurrentTCB );
+	vTaskSwitchContext();
+	pxNext = prvGetThreadState( pxCurrentTCB );
+
+	if( pxPrevious == pxNext )
+	{
+		return;
+	}
+
+	pthread_mutex_lock( &xRunMutex );
+
+	pxPrevious->xRunning = pdFALSE;
+	pxNext->xRunning = pdTRUE;
+	pthread_cond_signal( &pxNext->xCond );
+
+	while( !pxPrevious->xRunning )
+	{
+		pthread_cond_wait( &pxPrevious->xCond, &xRunMutex );
+	}
+
+	pthread_mutex_unlock( &xRunMutex );
 }
 /*-----------------------------------------------------------*/
 
@@ -101,91 +202,170 @@ void vPortStartFirstTask( void )
  */
 portBASE_TYPE xPortStartScheduler( void )
 {
-	/* Make PendSV, CallSV and SysTick the same priroity as the kernel. */
-	*(portNVIC_SYSPRI2) |= portNVIC_PENDSV_PRI;
-	*(portNVIC_SYSPRI2) |= portNVIC_SYSTICK_PRI;
+xThreadState *pxFirst;
 
-	/* Start the timer that generates the tick ISR.  Interrupts are disabled
-	here already. */
-	prvSetupTimerInterrupt();
+	/* Interrupts are disabled here already, and remain so in the main
+	thread. */
 
 	/* Initialise the critical nesting count ready for the first task. */
 	uxCriticalNesting = 0;
 
+	/* Start the timer that generates the tick ISR. */
+	prvSetupTimerInterrupt();
+
 	/* Start the first task. */
-	vPortStartFirstTask();
+	pxFirst = prvGetThreadState( pxCurrentTCB );
+	xSchedulerStarted = pdTRUE;
+
+	pthread_mutex_lock( &xRunMutex );
+
+	pxFirst->xRunning = pdTRUE;
+	pthread_cond_signal( &pxFirst->xCond );
+
+	while( !xSchedulerEnded )
+	{
+		pthread_cond_wait( &xEndCond, &xRunMutex );
+	}
+
+	pthread_mutex_unlock( &xRunMutex );
 
-	/* Should not get here! */
 	return 0;
 }
 /*-----------------------------------------------------------*/
 
 void vPortEndScheduler( void )
 {
-	/* It is unlikely that the CM3 port will require this function as there
-	is nothing to return to.  */
+	/* Return from xPortStartScheduler() in the main thread, the calling task
+	thread goes on until the process exits. */
+	pthread_mutex_lock( &xRunMutex );
+	xSchedulerEnded = pdTRUE;
+	pthread_cond_signal( &xEndCond );
+	pthread_mutex_unlock( &xRunMutex );
+}
+/*-----------------------------------------------------------*/
+
+void vPortYield( void )
+{
+sigset_t xSet, xOldMask;
+
+	if( ( uxInterruptNesting != 0 ) || ( uxCriticalNesting != 0 ) )
+	{
+		/* Done when leaving the interrupt or the critical section. */
+		xSwitchPending = pdTRUE;
+		return;
+	}
+
+	prvInterruptSignals( &xSet );
+	pthread_sigmask( SIG_BLOCK, &xSet, &xOldMask );
+	prvSwitchContext();
+	pthread_sigmask( SIG_SETMASK, &xOldMask, NULL );
 }
 /*-----------------------------------------------------------*/
 
 void vPortYieldFromISR( void )
 {
-	/* Set a PendSV to request a context switch. */
-	*(portNVIC_INT_CTRL) = portNVIC_PENDSVSET;
+	/* Done when leaving the interrupt. */
+	xSwitchPending = pdTRUE;
+}
+/*-----------------------------------------------------------*/
+
+void vPortDisableInterrupts( void )
+{
+sigset_t xSet;
+
+	prvInterruptSignals( &xSet );
+	pthread_sigmask( SIG_BLOCK, &xSet, NULL );
+}
+/*-----------------------------------------------------------*/
+
+void vPortEnableInterrupts( void )
+{
+sigset_t xSet;
+
+	prvInterruptSignals( &xSet );
+	pthread_sigmask( SIG_UNBLOCK, &xSet, NULL );
 }
 /*-----------------------------------------------------------*/
 
 void vPortEnterCritical( void )
 {
-	portDISABLE_INTERRUPTS();
+sigset_t xSet, xOldMask;
+
+	prvInterruptSignals( &xSet );
+	pthread_sigmask( SIG_BLOCK, &xSet, &xOldMask );
+
+	if( uxCriticalNesting == 0 )
+	{
+		xCriticalMask = xOldMask;
+	}
+
 	uxCriticalNesting++;
 }
 /*-----------------------------------------------------------*/
 
 void vPortExitCritical( void )
 {
+sigset_t xMask;
+
 	uxCriticalNesting--;
 	if( uxCriticalNesting == 0 )
 	{
-		portENABLE_INTERRUPTS();
+		/* The saved mask is overwritten by the other tasks while switched
+		out. */
+		xMask = xCriticalMask;
+
+		if( xSwitchPending && ( uxInterruptNesting == 0 ) )
+		{
+			prvSwitchContext();
+		}
+
+		pthread_sigmask( SIG_SETMASK, &xMask, NULL );
 	}
 }
 /*-----------------------------------------------------------*/
 
-void pendsv_handler( void )
+void vPortEnterInterrupt( void )
 {
-	/* This is a naked function. */
+	uxInterruptNesting++;
 }
 /*-----------------------------------------------------------*/
 
-void xPortTickHandler( void* arg )
+void vPortExitInterrupt( void )
 {
-unsigned long ulDummy;
+	uxInterruptNesting--;
+	if( ( uxInterruptNesting == 0 ) && xSwitchPending && xSchedulerStarted )
+	{
+		/* Interrupts are blocked while the signal is handled. */
+		prvSwitchContext();
+	}
+}
+/*-----------------------------------------------------------*/
 
+void xPortTickHandler( void* arg )
+{
 	(void) arg;
 
+	vTaskIncrementTick();
+
 	/* If using preemption, also force a context switch. */
 	#if configUSE_PREEMPTION == 1
-		*(portNVIC_INT_CTRL) = portNVIC_PENDSVSET;
+		vPortYieldFromISR();
 	#endif
-
-	ulDummy = portSET_INTERRUPT_MASK_FROM_ISR();
-	{
-		vTaskIncrementTick();
-	}
-	portCLEAR_INTERRUPT_MASK_FROM_ISR( ulDummy );
 }
 /*-----------------------------------------------------------*/
 
-#include "nvic.h"
+static void prvInterruptSignals( sigset_t *pxSet )
+{
+	sigemptyset( pxSet );
+	sigaddset( pxSet, SIGALRM );
+	sigaddset( pxSet, SIGIO );
+}
+/*-----------------------------------------------------------*/
 
-/*
- * Setup the systick timer to generate the tick interrupts at the required
- * frequency.
- */
 void prvSetupTimerInterrupt( void )
 {
 	// Call the platform specific method to generate the FreeRTOS tick
-	// platform_start_freertos_tick(configTICK_RATE_HZ, xPortTickHandler, 0);
+	platform_start_freertos_tick(configTICK_RATE_HZ, xPortTickHandler, 0);
 }
 /*-----------------------------------------------------------*/
 
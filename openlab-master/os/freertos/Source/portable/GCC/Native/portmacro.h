@@ -51,9 +51,10 @@ extern "C" {
 
 
 /* Scheduler utilities. */
+extern void vPortYield( void );
 extern void vPortYieldFromISR( void );
 
-#define portYIELD()					vPortYieldFromISR()
+#define portYIELD()					vPortYield()
 
 #define portEND_SWITCHING_ISR( xSwitchRequired ) if( xSwitchRequired ) vPortYieldFromISR()
 /*-----------------------------------------------------------*/
@@ -61,29 +62,31 @@ extern void vPortYieldFromISR( void );
 
 /* Critical section management. */
 
-/* 
- * Set basepri to portMAX_SYSCALL_INTERRUPT_PRIORITY without effecting other
- * registers.  
- */ 
-#define portSET_INTERRUPT_MASK()					
-	
 /*
- * Set basepri back to 0 without effective other registers.
- * r0
+ * Interrupts are emulated by signals, blocked while disabled.  Interrupt
+ * handlers run with the signals blocked, so there is nothing to mask from
+ * them.
  */
-#define portCLEAR_INTERRUPT_MASK()					
-
-#define portSET_INTERRUPT_MASK_FROM_ISR()		0;portSET_INTERRUPT_MASK()
-#define portCLEAR_INTERRUPT_MASK_FROM_ISR(x)	portCLEAR_INTERRUPT_MASK();(void)x
+extern void vPortDisableInterrupts( void );
+extern void vPortEnableInterrupts( void );
 
+#define portSET_INTERRUPT_MASK_FROM_ISR()		0
+#define portCLEAR_INTERRUPT_MASK_FROM_ISR(x)	(void)x
 
 extern void vPortEnterCritical( void );
 extern void vPortExitCritical( void );
 
-#define portDISABLE_INTERRUPTS()	portSET_INTERRUPT_MASK()
-#define portENABLE_INTERRUPTS()		portCLEAR_INTERRUPT_MASK()
+#define portDISABLE_INTERRUPTS()	vPortDisableInterrupts()
+#define portENABLE_INTERRUPTS()		vPortEnableInterrupts()
 #define portENTER_CRITICAL()		vPortEnterCritical()
 #define portEXIT_CRITICAL()			vPortExitCritical()
+
+/*
+ * Enclose the handling of an interrupt signal, the context switches requested
+ * by the handlers are done when leaving the outermost interrupt.
+ */
+extern void vPortEnterInterrupt( void );
+extern void vPortExitInterrupt( void );
 /*-----------------------------------------------------------*/
 
 /* Task function macros as described on the FreeRTOS.org WEB site. */
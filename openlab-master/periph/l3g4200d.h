@@ -63,6 +63,29 @@ typedef enum
     L3G4200D_2000DPS = 0x30
 } l3g4200d_scale_t;
 
+/** Number of samples the FIFO holds */
+#define L3G4200D_FIFO_SIZE 32
+
+/** Block of samples read from the FIFO */
+typedef struct
+{
+    /** Number of samples in the block */
+    uint8_t num;
+    /** Non zero if the FIFO overflowed, older samples have been lost */
+    uint8_t overrun;
+    /** Raw rotation speeds of the X, Y and Z axes, oldest sample first */
+    int16_t rot_speed[L3G4200D_FIFO_SIZE][3];
+    /** Time of each sample, in soft timer ticks */
+    uint32_t timestamp[L3G4200D_FIFO_SIZE];
+} l3g4200d_fifo_block_t;
+
+/** Handler called with each block of samples read from the FIFO
+ * \param arg The argument given to \ref l3g4200d_fifo_start
+ * \param block The samples, only valid during the call
+ */
+typedef void (*l3g4200d_fifo_handler_t)(handler_arg_t arg,
+        const l3g4200d_fifo_block_t *block);
+
 /** Read WHOAMI register
  * This functions returns the content of the WHOAMI register. It allows chip type identification.
  * \return The content of the WHOAMI register
@@ -142,6 +165,32 @@ bool l3g4200d_read_drdy();
  */
 void l3g4200d_set_drdy_int(handler_t data_ready_handler, handler_arg_t data_ready_arg);
 
+/** Start the FIFO stream mode
+ * The samples are stored in the sensor FIFO, and read by blocks in a single
+ * I2C transfer when their number reaches the watermark, signaled on the DRDY
+ * pin instead of the data ready interrupt.
+ *
+ * The time of each sample is reconstructed from the time of the watermark
+ * interrupt and the sample period, measured between interrupts.
+ *
+ * The sensor must be configured with \ref l3g4200d_gyr_config before, the data
+ * ready interrupt must not be used at the same time.
+ *
+ * \note The handler is called from interrupt context.
+ * \param watermark The number of samples triggering a read, from 1 to 31
+ * \param handler The handler called with each block of samples
+ * \param arg The handler argument
+ * \return 0 if there was no error, non zero value if something went wrong
+ */
+uint8_t l3g4200d_fifo_start(uint8_t watermark,
+        l3g4200d_fifo_handler_t handler, handler_arg_t arg);
+
+/** Stop the FIFO stream mode
+ * A block being read may still be given to the handler.
+ * \return 0 if there was no error, non zero value if something went wrong
+ */
+uint8_t l3g4200d_fifo_stop();
+
 /** TODO */
 void l3g4200d_set_bw(uint8_t bw);
 
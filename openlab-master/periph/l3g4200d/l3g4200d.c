@@ -28,6 +28,7 @@
 #include "i2c.h"
 #include "l3g4200d.h"
 #include "l3g4200d_.h"
+#include "st_mems_fifo/st_mems_fifo.h"
 
 #define L3G4200D_ADDRESS   0xD0
 
@@ -60,6 +61,15 @@
 
 #define READ_MULTIPLE_BYTE 0x80
 
+#define CTRL_REG3_I2_WTM   0x04
+#define CTRL_REG5_FIFO_EN  0x40
+
+#define FIFO_MODE_BYPASS   0x00
+#define FIFO_MODE_STREAM   0x40
+
+static void fifo_block_done(uint8_t num, uint8_t overrun);
+static int fifo_read_pin();
+
 static struct
 {
     // We need an I2C link
@@ -67,8 +77,25 @@ static struct
     exti_line_t data_ready_line;
     gpio_t drdy_gpio;
     gpio_pin_t drdy_gpio_pin;
+    l3g4200d_datarate_t datarate;
+
+    st_mems_fifo_t fifo;
+    l3g4200d_fifo_handler_t fifo_handler;
+    handler_arg_t fifo_arg;
+    l3g4200d_fifo_block_t fifo_block;
 } l3g4200d;
 
+static const st_mems_fifo_config_t fifo_config =
+{
+    .addr = L3G4200D_ADDRESS,
+    .src_reg = FIFO_SRC_REG,
+    .out_reg = READ_MULTIPLE_BYTE | OUT_X_L,
+    .samples = l3g4200d.fifo_block.rot_speed,
+    .timestamps = l3g4200d.fifo_block.timestamp,
+    .block_handler = fifo_block_done,
+    .read_pin = fifo_read_pin,
+};
+
 uint8_t l3g4200d_config(i2c_t i2c, exti_line_t data_ready_line,
                        gpio_t drdy_gpio,
                        gpio_pin_t drdy_gpio_pin)
@@ -148,6 +175,7 @@ uint8_t l3g4200d_gyr_config(l3g4200d_datarate_t datarate, l3g4200d_scale_t scale
 {
     uint8_t buf[] = {CTRL_REG1, datarate | 0x3F};
 
+    l3g4200d.datarate = datarate;
     i2c_tx(l3g4200d.i2c, L3G4200D_ADDRESS, buf, 2);
 
     buf[0] = CTRL_REG4;
@@ -190,3 +218,76 @@ void l3g4200d_set_out(uint8_t out)
     buf[1] = (buf[1] & 0xFC) | (out & 0x03);
     i2c_tx(l3g4200d.i2c, L3G4200D_ADDRESS, buf, 2);
 }
+
+uint8_t l3g4200d_fifo_start(uint8_t watermark,
+        l3g4200d_fifo_handler_t handler, handler_arg_t arg)
+{
+    uint8_t buf[2], r;
+
+    if (st_mems_fifo_start(&l3g4200d.fifo, &fifo_config, l3g4200d.i2c,
+            watermark, 100 << (l3g4200d.datarate >> 6)))
+    {
+        return 1;
+    }
+
+    l3g4200d.fifo_handler = handler;
+    l3g4200d.fifo_arg = arg;
+
+    // Bypass mode empties the FIFO
+    buf[0] = FIFO_CTRL_REG;
+    buf[1] = FIFO_MODE_BYPASS;
+    r = i2c_tx(l3g4200d.i2c, L3G4200D_ADDRESS, buf, 2);
+
+    buf[0] = CTRL_REG5;
+    buf[1] = l3g4200d_read_crtl_reg(5) | CTRL_REG5_FIFO_EN;
+    r = r || i2c_tx(l3g4200d.i2c, L3G4200D_ADDRESS, buf, 2);
+
+    // Signal the watermark on the DRDY pin
+    buf[0] = CTRL_REG3;
+    buf[1] = CTRL_REG3_I2_WTM;
+    r = r || i2c_tx(l3g4200d.i2c, L3G4200D_ADDRESS, buf, 2);
+
+    exti_set_handler(l3g4200d.data_ready_line, st_mems_fifo_watermark,
+            &l3g4200d.fifo);
+    exti_enable_interrupt_line(l3g4200d.data_ready_line, EXTI_TRIGGER_RISING);
+
+    buf[0] = FIFO_CTRL_REG;
+    buf[1] = FIFO_MODE_STREAM | watermark;
+    return r || i2c_tx(l3g4200d.i2c, L3G4200D_ADDRESS, buf, 2);
+}
+
+uint8_t l3g4200d_fifo_stop()
+{
+    uint8_t buf[2], r;
+
+    exti_disable_interrupt_line(l3g4200d.data_ready_line);
+    st_mems_fifo_stop(&l3g4200d.fifo);
+
+    buf[0] = FIFO_CTRL_REG;
+    buf[1] = FIFO_MODE_BYPASS;
+    r = i2c_tx(l3g4200d.i2c, L3G4200D_ADDRESS, buf, 2);
+
+    buf[0] = CTRL_REG3;
+    buf[1] = 0x00;
+    r = r || i2c_tx(l3g4200d.i2c, L3G4200D_ADDRESS, buf, 2);
+
+    buf[0] = CTRL_REG5;
+    buf[1] = l3g4200d_read_crtl_reg(5) & ~CTRL_REG5_FIFO_EN;
+    return r || i2c_tx(l3g4200d.i2c, L3G4200D_ADDRESS, buf, 2);
+}
+
+static void fifo_block_done(uint8_t num, uint8_t overrun)
+{
+    l3g4200d.fifo_block.num = num;
+    l3g4200d.fifo_block.overrun = overrun;
+
+    if (l3g4200d.fifo_handler)
+    {
+        l3g4200d.fifo_handler(l3g4200d.fifo_arg, &l3g4200d.fifo_block);
+    }
+}
+
+static int fifo_read_pin()
+{
+    return l3g4200d_read_drdy();
+}
@@ -123,6 +123,29 @@ typedef enum
     LSM303DLHC_TEMP_MODE_OFF = 0x00,
 } lsm303dlhc_temp_mode_t;
 
+/** Number of samples the accelerometer FIFO holds */
+#define LSM303DLHC_ACC_FIFO_SIZE 32
+
+/** Block of accelerometer samples read from the FIFO */
+typedef struct
+{
+    /** Number of samples in the block */
+    uint8_t num;
+    /** Non zero if the FIFO overflowed, older samples have been lost */
+    uint8_t overrun;
+    /** Accelerations of the X, Y and Z axes, oldest sample first, finalized */
+    int16_t acc[LSM303DLHC_ACC_FIFO_SIZE][3];
+    /** Time of each sample, in soft timer ticks */
+    uint32_t timestamp[LSM303DLHC_ACC_FIFO_SIZE];
+} lsm303dlhc_acc_fifo_block_t;
+
+/** Handler called with each block of samples read from the FIFO
+ * \param arg The argument given to \ref lsm303dlhc_acc_fifo_start
+ * \param block The samples, only valid during the call
+ */
+typedef void (*lsm303dlhc_acc_fifo_handler_t)(handler_arg_t arg,
+        const lsm303dlhc_acc_fifo_block_t *block);
+
 /** Switch off the sensor
  * This function stops the accelerometer, the magnetometer and the temperature sensor
  * \return 0 if there was no error, non zero value if something went wrong during reading, false otherwise
@@ -316,6 +339,33 @@ static inline unsigned lsm303dlhc_read_acc(int16_t *acc)
  */
 void lsm303dlhc_read_acc_async_finalize(int16_t *acc);
 
+/** Start the accelerometer FIFO stream mode
+ * The samples are stored in the sensor FIFO, and read by blocks in a single
+ * I2C transfer when their number reaches the watermark, signaled on INT1
+ * instead of the data ready interrupt.
+ *
+ * The time of each sample is reconstructed from the time of the watermark
+ * interrupt and the sample period, measured between interrupts.
+ *
+ * The accelerometer must be configured with \ref lsm303dlhc_acc_config before,
+ * INT1 must not be used at the same time.
+ *
+ * \note handler is called from interrupt context.
+ *
+ * \param watermark The number of samples triggering a read, from 1 to 31
+ * \param handler The handler called with each block of samples
+ * \param handler_arg An argument given to the handler.
+ * \return 0 if there was no error, non zero value if something went wrong
+ */
+uint8_t lsm303dlhc_acc_fifo_start(uint8_t watermark,
+        lsm303dlhc_acc_fifo_handler_t handler, handler_arg_t handler_arg);
+
+/** Stop the accelerometer FIFO stream mode
+ * A block being read may still be given to the handler.
+ * \return 0 if there was no error, non zero value if something went wrong
+ */
+uint8_t lsm303dlhc_acc_fifo_stop();
+
 
 /** @} */
 
@@ -28,6 +28,7 @@
 #include "lsm303dlhc.h"
 #include "lsm303dlhc_.h"
 #include "platform.h"
+#include "st_mems_fifo/st_mems_fifo.h"
 #include "debug.h"
 
 enum
@@ -37,6 +38,18 @@ enum
     LSM303DLHC_ACC_MULTIBYTES = 0x80
 };
 
+enum
+{
+    LSM303DLHC_CTRL_REG3_A_I1_WTM = 0x04,
+    LSM303DLHC_CTRL_REG5_A_FIFO_EN = 0x40,
+
+    LSM303DLHC_FIFO_MODE_BYPASS = 0x00,
+    LSM303DLHC_FIFO_MODE_STREAM = 0x80
+};
+
+static void fifo_watermark_capture(handler_arg_t arg, uint16_t timer_value);
+static void fifo_block_done(uint8_t num, uint8_t overrun);
+
 static struct
 {
     i2c_t i2c;
@@ -54,8 +67,25 @@ static struct
     gpio_pin_t acc_int1_pin;
     gpio_pin_t acc_int2_pin;
     lsm303dlhc_mag_scale_t scale;
+    lsm303dlhc_acc_datarate_t acc_datarate;
+
+    st_mems_fifo_t fifo;
+    lsm303dlhc_acc_fifo_handler_t fifo_handler;
+    handler_arg_t fifo_arg;
+    lsm303dlhc_acc_fifo_block_t fifo_block;
 } lsm303;
 
+static const st_mems_fifo_config_t fifo_config =
+{
+    .addr = LSM303DLHC_ACC_ADDRESS,
+    .src_reg = LSM303DLHC_REG_FIFO_SRC_REG_A,
+    .out_reg = LSM303DLHC_ACC_MULTIBYTES | LSM303DLHC_REG_OUT_X_L_A,
+    .samples = lsm303.fifo_block.acc,
+    .timestamps = lsm303.fifo_block.timestamp,
+    .block_handler = fifo_block_done,
+    .read_pin = lsm303dlhc_acc_get_drdy_int1_pin_value,
+};
+
 uint8_t lsm303dlhc_config(i2c_t i2c,
                        exti_line_t mag_data_ready_line,
                        gpio_t mag_drdy_gpio, gpio_pin_t mag_drdy_pin,
@@ -202,6 +232,7 @@ uint8_t lsm303dlhc_acc_config(lsm303dlhc_acc_datarate_t datarate,
     // Set the data rate
     buf[0] = LSM303DLHC_REG_CTRL_REG1_A;
     buf[1] = datarate | 0x7;
+    lsm303.acc_datarate = datarate;
     r = i2c_tx(lsm303.i2c, LSM303DLHC_ACC_ADDRESS, buf, 2);
 
     // Set the scale
@@ -413,3 +444,131 @@ lsm303dlhc_mag_datarate_t lsm303dlhc_mag_compute_datarate(uint32_t freq)
     // All other cases, return max
     return LSM303DLHC_MAG_RATE_220HZ;
 }
+
+static uint32_t acc_frequency(lsm303dlhc_acc_datarate_t datarate)
+{
+    switch (datarate)
+    {
+        case LSM303DLHC_ACC_RATE_1HZ:
+            return 1;
+        case LSM303DLHC_ACC_RATE_10HZ:
+            return 10;
+        case LSM303DLHC_ACC_RATE_25HZ:
+            return 25;
+        case LSM303DLHC_ACC_RATE_50HZ:
+            return 50;
+        case LSM303DLHC_ACC_RATE_100HZ:
+            return 100;
+        case LSM303DLHC_ACC_RATE_200HZ:
+            return 200;
+        case LSM303DLHC_ACC_RATE_400HZ:
+            return 400;
+        case LSM303DLHC_ACC_RATE_1620HZ_LP:
+            return 1620;
+        case LSM303DLHC_ACC_RATE_1344HZ_N_5376HZ_LP:
+        default:
+            // Normal mode is used
+            return 1344;
+    }
+}
+
+uint8_t lsm303dlhc_acc_fifo_start(uint8_t watermark,
+        lsm303dlhc_acc_fifo_handler_t handler, handler_arg_t handler_arg)
+{
+    uint8_t buf[2], r;
+
+    if (st_mems_fifo_start(&lsm303.fifo, &fifo_config, lsm303.i2c, watermark,
+            acc_frequency(lsm303.acc_datarate)))
+    {
+        return 1;
+    }
+
+    lsm303.fifo_handler = handler;
+    lsm303.fifo_arg = handler_arg;
+
+    // Bypass mode empties the FIFO
+    buf[0] = LSM303DLHC_REG_FIFO_CTRL_REG_A;
+    buf[1] = LSM303DLHC_FIFO_MODE_BYPASS;
+    r = i2c_tx(lsm303.i2c, LSM303DLHC_ACC_ADDRESS, buf, 2);
+
+    r = r || lsm303dlhc_acc_reg_read(LSM303DLHC_REG_CTRL_REG5_A, &buf[1]);
+    buf[0] = LSM303DLHC_REG_CTRL_REG5_A;
+    buf[1] |= LSM303DLHC_CTRL_REG5_A_FIFO_EN;
+    r = r || i2c_tx(lsm303.i2c, LSM303DLHC_ACC_ADDRESS, buf, 2);
+
+    // Signal the watermark on INT1
+    if (lsm303.acc_int1_timer)
+    {
+        timer_set_channel_capture(lsm303.acc_int1_timer, lsm303.acc_int1.channel,
+                TIMER_CAPTURE_EDGE_RISING, fifo_watermark_capture, &lsm303.fifo);
+    }
+    else
+    {
+        exti_set_handler(lsm303.acc_int1.line, st_mems_fifo_watermark,
+                &lsm303.fifo);
+        exti_enable_interrupt_line(lsm303.acc_int1.line, EXTI_TRIGGER_RISING);
+    }
+
+    buf[0] = LSM303DLHC_REG_CTRL_REG3_A;
+    buf[1] = LSM303DLHC_CTRL_REG3_A_I1_WTM;
+    r = r || i2c_tx(lsm303.i2c, LSM303DLHC_ACC_ADDRESS, buf, 2);
+
+    buf[0] = LSM303DLHC_REG_FIFO_CTRL_REG_A;
+    buf[1] = LSM303DLHC_FIFO_MODE_STREAM | watermark;
+    return r || i2c_tx(lsm303.i2c, LSM303DLHC_ACC_ADDRESS, buf, 2);
+}
+
+uint8_t lsm303dlhc_acc_fifo_stop()
+{
+    uint8_t buf[2], r;
+
+    if (lsm303.acc_int1_timer)
+    {
+        timer_set_channel_capture(lsm303.acc_int1_timer, lsm303.acc_int1.channel,
+                TIMER_CAPTURE_EDGE_RISING, NULL, NULL);
+    }
+    else
+    {
+        exti_disable_interrupt_line(lsm303.acc_int1.line);
+    }
+
+    st_mems_fifo_stop(&lsm303.fifo);
+
+    buf[0] = LSM303DLHC_REG_CTRL_REG3_A;
+    buf[1] = 0x00;
+    r = i2c_tx(lsm303.i2c, LSM303DLHC_ACC_ADDRESS, buf, 2);
+
+    buf[0] = LSM303DLHC_REG_FIFO_CTRL_REG_A;
+    buf[1] = LSM303DLHC_FIFO_MODE_BYPASS;
+    r = r || i2c_tx(lsm303.i2c, LSM303DLHC_ACC_ADDRESS, buf, 2);
+
+    r = r || lsm303dlhc_acc_reg_read(LSM303DLHC_REG_CTRL_REG5_A, &buf[1]);
+    buf[0] = LSM303DLHC_REG_CTRL_REG5_A;
+    buf[1] &= ~LSM303DLHC_CTRL_REG5_A_FIFO_EN;
+    return r || i2c_tx(lsm303.i2c, LSM303DLHC_ACC_ADDRESS, buf, 2);
+}
+
+static void fifo_watermark_capture(handler_arg_t arg, uint16_t timer_value)
+{
+    (void) timer_value;
+
+    st_mems_fifo_watermark(arg);
+}
+
+static void fifo_block_done(uint8_t num, uint8_t overrun)
+{
+    uint32_t i;
+
+    lsm303.fifo_block.num = num;
+    lsm303.fifo_block.overrun = overrun;
+
+    for (i = 0; i < num; i++)
+    {
+        acc_finalize(lsm303.fifo_block.acc[i]);
+    }
+
+    if (lsm303.fifo_handler)
+    {
+        lsm303.fifo_handler(lsm303.fifo_arg, &lsm303.fifo_block);
+    }
+}
@@ -36,6 +36,7 @@
 #define N25XXX_H_
 
 #include <stdint.h>
+#include "handler.h"
 
 /** Read the flash chip ID
  * Reads the flash chip ID which contains the manufacturer ID, the device ID and an unique ID
@@ -109,6 +110,55 @@ void n25xxx_bulk_erase();
 /** Read the flash status register */
 uint8_t n25xxx_read_status(void);
 
+/** Operation of an asynchronous request */
+typedef enum
+{
+    N25XXX_OP_READ = 0,
+    N25XXX_OP_PROGRAM = 1,
+    N25XXX_OP_ERASE_SUBSECTOR = 2,
+    N25XXX_OP_ERASE_SECTOR = 3,
+} n25xxx_op_t;
+
+/** Asynchronous request, owned by the driver from submission to completion */
+typedef struct n25xxx_request
+{
+    /** Internally used pointer, DO NOT MODIFY */
+    struct n25xxx_request *next;
+
+    /** The operation to do */
+    n25xxx_op_t op;
+    /** The flash address, aligned by the chip for erase operations */
+    uint32_t address;
+    /** The buffer to read to or to program from, unused for erase operations */
+    uint8_t *buf;
+    /** The length to read or to program; a program must not cross a page */
+    uint16_t len;
+
+    /** Handler called when the operation is completed, may be NULL */
+    handler_t handler;
+    handler_arg_t handler_arg;
+} n25xxx_request_t;
+
+/** Queue an asynchronous request
+ * The request is done in background with low priority SPI requests, so the
+ * bus may be shared with other devices using the SPI queue. Write enable is
+ * sent before program and erase operations, whose end is detected by polling
+ * the status register from a soft timer instead of busy waiting.
+ *
+ * The handler is called from the application event queue, it may submit new
+ * requests.
+ *
+ * \warning The blocking functions must not be used while asynchronous
+ * requests are pending.
+ * \param req the request, must stay valid until the handler is called
+ */
+void n25xxx_submit(n25xxx_request_t *req);
+
+/** Check if asynchronous requests are pending
+ * \return 1 if a request is in progress or queued, 0 otherwise
+ */
+int n25xxx_async_busy();
+
 /*
  * Writes and/or reads a single byte.
  * Use within a _n25xxx_cs_clear/_n25xxx_cs_set surrounded section
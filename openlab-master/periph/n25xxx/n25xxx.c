@@ -23,12 +23,22 @@
  * \author Christophe Braillon <christophe.braillon.at.hikob.com>
  */
 
+#include "platform.h"
 #include "gpio.h"
 #include "spi.h"
+#include "soft_timer.h"
 #include "n25xxx.h"
 #include "n25xxx_.h"
 #include "n25xxx_regs.h"
 
+/* Status polling periods of asynchronous requests */
+#ifndef N25XXX_POLL_PROGRAM_US
+#define N25XXX_POLL_PROGRAM_US (250)
+#endif
+#ifndef N25XXX_POLL_ERASE_US
+#define N25XXX_POLL_ERASE_US (10000)
+#endif
+
 /** This type defines a flash chip
  */
 static struct
@@ -47,8 +57,34 @@ static struct
     // HOLDn pin
     gpio_t holdn_gpio;
     gpio_pin_t holdn_pin;
+
+    // Asynchronous requests
+    struct
+    {
+        // Request in progress, followed by the queued ones
+        n25xxx_request_t *first;
+        n25xxx_request_t *last;
+
+        // Device on the SPI queue, bulk accesses have a low priority
+        spi_device_t device;
+        spi_request_t wren, header, data, status;
+
+        // Instruction and address of the request in progress
+        uint8_t header_buf[4];
+        uint8_t status_buf[2];
+
+        // Timer for status polling while programming or erasing
+        soft_timer_t poll_timer;
+    } async;
 } flash;
 
+static void async_start();
+static void async_end(handler_arg_t arg);
+static void async_poll(handler_arg_t arg);
+static void async_status(handler_arg_t arg);
+static void async_check(handler_arg_t arg);
+static void async_done(handler_arg_t arg);
+
 /* Handy functions */
 inline static void csn_set()
 {
@@ -114,6 +150,17 @@ void n25xxx_init()
     csn_set();
     wn_set();
     holdn_set();
+
+    flash.async.first = NULL;
+    flash.async.last = NULL;
+    soft_timer_set_handler(&flash.async.poll_timer, async_poll, NULL);
+
+    // Keep the bus configuration
+    flash.async.device.spi = flash.spi;
+    flash.async.device.cs_gpio = flash.csn_gpio;
+    flash.async.device.cs_pin = flash.csn_pin;
+    flash.async.device.baudrate = 0;
+    spi_device_init(&flash.async.device);
 }
 
 void n25xxx_read_id(uint8_t *id, uint16_t len)
@@ -313,3 +360,194 @@ uint8_t _n25xxx_rw_byte(uint8_t byte)
 	// Send instruction
 	return spi_transfer_single(flash.spi, byte);
 }
+
+/* Asynchronous requests */
+void n25xxx_submit(n25xxx_request_t *req)
+{
+    int idle;
+
+    req->next = NULL;
+
+    platform_enter_critical();
+    idle = (flash.async.first == NULL);
+    if (idle)
+    {
+        flash.async.first = req;
+    }
+    else
+    {
+        flash.async.last->next = req;
+    }
+    flash.async.last = req;
+    platform_exit_critical();
+
+    if (idle)
+    {
+        async_start();
+    }
+}
+
+int n25xxx_async_busy()
+{
+    return flash.async.first != NULL;
+}
+
+static void async_start()
+{
+    static const uint8_t ins[] =
+    {
+        [N25XXX_OP_READ] = N25XXX_INS__READ,
+        [N25XXX_OP_PROGRAM] = N25XXX_INS__PP,
+        [N25XXX_OP_ERASE_SUBSECTOR] = N25XXX_INS__SSE,
+        [N25XXX_OP_ERASE_SECTOR] = N25XXX_INS__SE,
+    };
+    static const uint8_t wren = N25XXX_INS__WREN;
+    n25xxx_request_t *req = flash.async.first;
+    uint32_t address = req->address;
+    int has_data = (req->op == N25XXX_OP_READ || req->op == N25XXX_OP_PROGRAM)
+                   && req->len;
+
+    // Align erase addresses, program stays in the page
+    if (req->op == N25XXX_OP_ERASE_SUBSECTOR)
+    {
+        address &= ~0xFFF;
+    }
+    else if (req->op == N25XXX_OP_ERASE_SECTOR)
+    {
+        address &= ~0xFFFF;
+    }
+
+    // Write enable is a single byte, WEL is set when CSn rises
+    if (req->op != N25XXX_OP_READ)
+    {
+        flash.async.wren = (spi_request_t)
+        {
+            .device = &flash.async.device,
+            .priority = SPI_PRIORITY_LOW,
+            .tx_buffer = &wren,
+            .length = 1,
+        };
+        spi_submit(&flash.async.wren);
+    }
+
+    flash.async.header_buf[0] = ins[req->op];
+    flash.async.header_buf[1] = address >> 16;
+    flash.async.header_buf[2] = address >> 8;
+    flash.async.header_buf[3] = address;
+
+    // The data follows the header, with CSn kept low
+    flash.async.header = (spi_request_t)
+    {
+        .device = &flash.async.device,
+        .priority = SPI_PRIORITY_LOW,
+        .tx_buffer = flash.async.header_buf,
+        .length = 4,
+        .keep_cs = has_data,
+        .handler = has_data ? NULL : async_end,
+    };
+    spi_submit(&flash.async.header);
+
+    if (has_data)
+    {
+        flash.async.data = (spi_request_t)
+        {
+            .device = &flash.async.device,
+            .priority = SPI_PRIORITY_LOW,
+            .length = req->len,
+            .handler = async_end,
+        };
+
+        if (req->op == N25XXX_OP_READ)
+        {
+            flash.async.data.rx_buffer = req->buf;
+        }
+        else
+        {
+            flash.async.data.tx_buffer = req->buf;
+        }
+
+        spi_submit(&flash.async.data);
+    }
+}
+
+static void async_end(handler_arg_t arg)
+{
+    // Leave the interrupt, handlers and polling run in the event queue
+    if (flash.async.first->op == N25XXX_OP_READ)
+    {
+        event_post_from_isr(EVENT_QUEUE_APPLI, async_done, NULL);
+    }
+    else
+    {
+        // Program or erase started, poll the WIP bit
+        event_post_from_isr(EVENT_QUEUE_APPLI, async_poll, NULL);
+    }
+}
+
+static void async_poll(handler_arg_t arg)
+{
+    // Read the status through the queue, the bus may be shared
+    flash.async.status_buf[0] = N25XXX_INS__RDSR;
+    flash.async.status_buf[1] = 0;
+    flash.async.status = (spi_request_t)
+    {
+        .device = &flash.async.device,
+        .priority = SPI_PRIORITY_LOW,
+        .tx_buffer = flash.async.status_buf,
+        .rx_buffer = flash.async.status_buf,
+        .length = 2,
+        .handler = async_status,
+    };
+    spi_submit(&flash.async.status);
+}
+
+static void async_status(handler_arg_t arg)
+{
+    event_post_from_isr(EVENT_QUEUE_APPLI, async_check, NULL);
+}
+
+static void async_check(handler_arg_t arg)
+{
+    uint32_t period_us;
+
+    if (!(flash.async.status_buf[1] & 0x1))
+    {
+        async_done(NULL);
+        return;
+    }
+
+    // Page program takes ~1ms, erases hundreds of ms
+    if (flash.async.first->op == N25XXX_OP_PROGRAM)
+    {
+        period_us = N25XXX_POLL_PROGRAM_US;
+    }
+    else
+    {
+        period_us = N25XXX_POLL_ERASE_US;
+    }
+    soft_timer_start(&flash.async.poll_timer,
+            soft_timer_us_to_ticks(period_us), 0);
+}
+
+static void async_done(handler_arg_t arg)
+{
+    n25xxx_request_t *req;
+    int more;
+
+    platform_enter_critical();
+    req = flash.async.first;
+    flash.async.first = req->next;
+    more = (flash.async.first != NULL);
+    platform_exit_critical();
+
+    // Start the next request before calling the handler, which may submit
+    if (more)
+    {
+        async_start();
+    }
+
+    if (req->handler)
+    {
+        req->handler(req->handler_arg);
+    }
+}
@@ -0,0 +1,678 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2012 HiKoB.
+ */
+
+/**
+ * \file n25xxx_log.c
+ *
+ * Sub-sector layout:
+ * - header: magic, sequence number, erase count, header CRC, retired mark
+ * - records packed one after the other, up to an erased length (0xFFFF):
+ *   - uint16_t: payload length
+ *   - uint8_t:  type
+ *   - uint8_t:  flags, reserved (0xFF)
+ *   - uint16_t: CRC of the length, type, flags and payload
+ *   - payload
+ *
+ * Sub-sectors are used in address order. The one after the write sub-sector
+ * is erased and gets its header in background, as soon as it is not holding
+ * unread records anymore.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "platform.h"
+#include "n25xxx.h"
+#include "n25xxx_log.h"
+#include "debug.h"
+
+enum
+{
+    PAGE_SIZE = 256,
+    SECTOR_SIZE = 4096,
+    RECORD_HEADER_SIZE = 6,
+    LOG_MAGIC = 0x474f4c4e, // "NLOG"
+    RETIRED_OFFSET = 14,
+};
+
+/* Sub-sector header, on flash */
+struct sector_header
+{
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t erase_count;
+    uint16_t crc;
+    uint16_t retired;   // 0xFFFF when live, programmed to 0 when retired
+};
+
+/* Page buffer, programmed when full or on flush */
+struct page_buffer
+{
+    uint8_t data[PAGE_SIZE];
+    uint32_t address;
+    uint16_t len;
+    volatile int busy;
+    n25xxx_request_t req;
+};
+
+static void read_next();
+static void read_header_done(handler_arg_t arg);
+static void read_payload_done(handler_arg_t arg);
+static void read_end(int32_t len, uint8_t type);
+static void read_skip_sector();
+static void retire_done(handler_arg_t arg);
+
+static void prepare_next();
+static void prepare_read_done(handler_arg_t arg);
+static void prepare_erase_done(handler_arg_t arg);
+static void prepare_program_done(handler_arg_t arg);
+
+static void buffer_write(const uint8_t *data, uint16_t len);
+static void buffer_submit();
+static void buffer_done(handler_arg_t arg);
+
+static struct
+{
+    uint32_t start;
+    uint16_t num_sectors;
+
+    /* Write sub-sector, offset includes bytes buffered in RAM */
+    volatile uint16_t head;
+    uint16_t head_offset;
+    /* Offset up to which programs are queued, records before it can be read */
+    volatile uint16_t submitted;
+    /* End of the last record entirely written to the buffers */
+    uint16_t record_end;
+    uint32_t head_seq;
+    uint32_t head_erase_count;
+
+    /* Read sub-sector */
+    volatile uint16_t tail;
+    volatile uint16_t tail_offset;
+
+    /* Page buffers, records are written to 'cur' */
+    struct page_buffer buffers[2];
+    struct page_buffer *cur;
+
+    /* Preparation of the sub-sector after 'head' */
+    volatile int next_ready;
+    volatile int preparing;
+    struct sector_header prep_header;
+    n25xxx_request_t prep_req;
+
+    /* Read in progress */
+    volatile int reading;
+    uint8_t *read_buf;
+    uint16_t read_size;
+    uint8_t read_header[RECORD_HEADER_SIZE];
+    n25xxx_log_handler_t read_handler;
+    handler_arg_t read_arg;
+    n25xxx_request_t read_req;
+    n25xxx_request_t retire_req;
+} store;
+
+/* Programmed on the retired mark */
+static uint8_t retired_mark[2] = {0, 0};
+
+
+/* CRC-16 CCITT */
+static uint16_t crc16(uint16_t crc, const uint8_t *data, uint16_t len)
+{
+    uint16_t i;
+    int bit;
+
+    for (i = 0; i < len; i++)
+    {
+        crc ^= (uint16_t)data[i] << 8;
+        for (bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+static uint16_t header_crc(const struct sector_header *hdr)
+{
+    return crc16(0xFFFF, (const uint8_t *)hdr,
+            offsetof(struct sector_header, crc));
+}
+
+static inline uint32_t sector_address(uint16_t sector)
+{
+    return store.start + (uint32_t)sector * SECTOR_SIZE;
+}
+
+static inline uint16_t sector_next(uint16_t sector)
+{
+    return (sector + 1 == store.num_sectors) ? 0 : sector + 1;
+}
+
+
+/* Mount */
+static int mount_read_header(uint16_t sector, struct sector_header *hdr)
+{
+    n25xxx_read(sector_address(sector), (uint8_t *)hdr, sizeof(*hdr));
+    return (hdr->magic == LOG_MAGIC) && (hdr->crc == header_crc(hdr));
+}
+
+/* Find the end of the records of the head sub-sector */
+static uint16_t mount_scan_head()
+{
+    uint8_t payload[N25XXX_LOG_MAX_RECORD];
+    uint8_t header[RECORD_HEADER_SIZE];
+    uint16_t offset = sizeof(struct sector_header);
+    uint16_t len, crc;
+
+    while (offset + RECORD_HEADER_SIZE <= SECTOR_SIZE)
+    {
+        n25xxx_read(sector_address(store.head) + offset, header,
+                RECORD_HEADER_SIZE);
+        len = header[0] | (header[1] << 8);
+        if (len == 0xFFFF)
+        {
+            return offset;
+        }
+        if ((len > N25XXX_LOG_MAX_RECORD) ||
+                (offset + RECORD_HEADER_SIZE + len > SECTOR_SIZE))
+        {
+            break;
+        }
+
+        n25xxx_read(sector_address(store.head) + offset + RECORD_HEADER_SIZE,
+                payload, len);
+        crc = crc16(crc16(0xFFFF, header, 4), payload, len);
+        if (crc != (header[4] | (header[5] << 8)))
+        {
+            break;
+        }
+        offset += RECORD_HEADER_SIZE + len;
+    }
+
+    if (offset + RECORD_HEADER_SIZE <= SECTOR_SIZE)
+    {
+        // Interrupted write, don't append after it
+        log_warning("Log sub-sector %u ends with a corrupted record",
+                store.head);
+    }
+    return SECTOR_SIZE;
+}
+
+static void mount_format()
+{
+    struct sector_header hdr;
+    uint8_t page[PAGE_SIZE];
+
+    log_info("Formatting log");
+
+    store.head = 0;
+    hdr.magic = LOG_MAGIC;
+    hdr.seq = 1;
+    hdr.erase_count = 0;
+    hdr.crc = header_crc(&hdr);
+    hdr.retired = 0xFFFF;
+
+    memset(page, 0xFF, sizeof(page));
+    memcpy(page, &hdr, sizeof(hdr));
+
+    n25xxx_write_enable();
+    n25xxx_erase_subsector(sector_address(store.head));
+    n25xxx_write_enable();
+    n25xxx_write_page(sector_address(store.head), page);
+
+    store.head_seq = hdr.seq;
+    store.head_erase_count = hdr.erase_count;
+}
+
+/* Retire the sub-sectors from tail to head, and don't write in the head */
+static void mount_discard()
+{
+    uint8_t page[PAGE_SIZE];
+    uint16_t sector = store.tail;
+
+    memset(page, 0xFF, sizeof(page));
+    memcpy(&page[RETIRED_OFFSET], retired_mark, sizeof(retired_mark));
+
+    for (;;)
+    {
+        n25xxx_write_enable();
+        n25xxx_write_page(sector_address(sector), page);
+        if (sector == store.head)
+        {
+            break;
+        }
+        sector = sector_next(sector);
+    }
+
+    store.head_offset = SECTOR_SIZE;
+    store.tail = store.head;
+}
+
+void n25xxx_log_mount(uint32_t start, uint32_t size, int discard)
+{
+    struct sector_header hdr;
+    uint16_t sector, prev;
+    uint32_t seq;
+    int found = 0;
+    int head_retired = 0;
+
+    store.start = start;
+    store.num_sectors = size / SECTOR_SIZE;
+
+    memset(store.buffers, 0, sizeof(store.buffers));
+    store.cur = &store.buffers[0];
+    store.next_ready = 0;
+    store.preparing = 0;
+    store.reading = 0;
+
+    // The write sub-sector has the greatest sequence number
+    for (sector = 0; sector < store.num_sectors; sector++)
+    {
+        if (mount_read_header(sector, &hdr) &&
+                (!found || (hdr.seq > store.head_seq)))
+        {
+            found = 1;
+            store.head = sector;
+            store.head_seq = hdr.seq;
+            store.head_erase_count = hdr.erase_count;
+            head_retired = (hdr.retired != 0xFFFF);
+        }
+    }
+
+    if (!found)
+    {
+        mount_format();
+        store.head_offset = sizeof(struct sector_header);
+    }
+    else if (head_retired)
+    {
+        store.head_offset = SECTOR_SIZE;
+    }
+    else
+    {
+        store.head_offset = mount_scan_head();
+    }
+
+    // Unread records are in the live sub-sectors preceding the head
+    store.tail = store.head;
+    seq = store.head_seq;
+    for (;;)
+    {
+        prev = (store.tail == 0) ? store.num_sectors - 1 : store.tail - 1;
+        if ((prev == store.head) || !mount_read_header(prev, &hdr) ||
+                (hdr.seq != seq - 1) || (hdr.retired != 0xFFFF))
+        {
+            break;
+        }
+        store.tail = prev;
+        seq = hdr.seq;
+    }
+
+    if (discard)
+    {
+        mount_discard();
+    }
+
+    // Records of a retired head sub-sector have been read
+    store.submitted = store.head_offset;
+    store.record_end = store.head_offset;
+    store.tail_offset = (discard || head_retired) ? SECTOR_SIZE :
+            sizeof(struct sector_header);
+
+    log_info("Log mounted, sub-sectors %u to %u, write offset %u",
+            store.tail, store.head, store.head_offset);
+
+    prepare_next();
+}
+
+
+/* Append */
+int n25xxx_log_append(uint8_t type, const uint8_t *data, uint16_t len)
+{
+    uint8_t header[RECORD_HEADER_SIZE];
+    uint16_t size = RECORD_HEADER_SIZE + len;
+    uint16_t crc;
+    uint32_t address;
+
+    if (len > N25XXX_LOG_MAX_RECORD)
+    {
+        return 1;
+    }
+
+    // Move to the prepared sub-sector
+    if (store.head_offset + size > SECTOR_SIZE)
+    {
+        if (!store.next_ready || store.buffers[0].busy || store.buffers[1].busy)
+        {
+            return 1;
+        }
+
+        buffer_submit();
+
+        // Reader may see the new sub-sector empty, never the old one longer
+        store.submitted = sizeof(struct sector_header);
+        store.record_end = sizeof(struct sector_header);
+        store.head = sector_next(store.head);
+        store.head_offset = sizeof(struct sector_header);
+        store.head_seq++;
+        store.head_erase_count = store.prep_header.erase_count;
+        store.next_ready = 0;
+        prepare_next();
+    }
+
+    // A record crossing a page needs both buffers
+    address = sector_address(store.head) + store.head_offset;
+    if (store.cur->busy ||
+            (((address % PAGE_SIZE) + size > PAGE_SIZE) &&
+             store.buffers[store.cur == &store.buffers[0]].busy))
+    {
+        return 1;
+    }
+
+    header[0] = len;
+    header[1] = len >> 8;
+    header[2] = type;
+    header[3] = 0xFF;
+    crc = crc16(crc16(0xFFFF, header, 4), data, len);
+    header[4] = crc;
+    header[5] = crc >> 8;
+
+    buffer_write(header, RECORD_HEADER_SIZE);
+    buffer_write(data, len);
+    store.record_end = store.head_offset;
+
+    // Ending on a page end, the record was submitted before it was complete
+    if (store.cur->len == 0)
+    {
+        store.submitted = store.record_end;
+    }
+
+    return 0;
+}
+
+void n25xxx_log_flush()
+{
+    if (!store.cur->busy)
+    {
+        buffer_submit();
+    }
+}
+
+static void buffer_write(const uint8_t *data, uint16_t len)
+{
+    uint32_t address;
+    uint16_t chunk;
+
+    while (len)
+    {
+        address = sector_address(store.head) + store.head_offset;
+        if (store.cur->len == 0)
+        {
+            store.cur->address = address;
+        }
+
+        chunk = PAGE_SIZE - (address % PAGE_SIZE);
+        if (chunk > len)
+        {
+            chunk = len;
+        }
+
+        memcpy(&store.cur->data[store.cur->len], data, chunk);
+        store.cur->len += chunk;
+        store.head_offset += chunk;
+        data += chunk;
+        len -= chunk;
+
+        if (((address + chunk) % PAGE_SIZE) == 0)
+        {
+            buffer_submit();
+        }
+    }
+}
+
+/* Program the current buffer and switch to the other one */
+static void buffer_submit()
+{
+    struct page_buffer *buf = store.cur;
+
+    if (buf->len == 0)
+    {
+        return;
+    }
+
+    buf->busy = 1;
+    buf->req.op = N25XXX_OP_PROGRAM;
+    buf->req.address = buf->address;
+    buf->req.buf = buf->data;
+    buf->req.len = buf->len;
+    buf->req.handler = buffer_done;
+    buf->req.handler_arg = buf;
+
+    store.cur = &store.buffers[buf == &store.buffers[0]];
+    n25xxx_submit(&buf->req);
+
+    // Reads queued from now on come after this program, a page end may
+    // split a record whose end is not queued yet
+    store.submitted = store.record_end;
+}
+
+static void buffer_done(handler_arg_t arg)
+{
+    struct page_buffer *buf = arg;
+
+    buf->len = 0;
+    buf->busy = 0;
+}
+
+
+/* Preparation of the next sub-sector: read its erase count, erase, header */
+static void prepare_next()
+{
+    uint16_t next = sector_next(store.head);
+
+    platform_enter_critical();
+    if (store.next_ready || store.preparing || (next == store.tail))
+    {
+        // Done, in progress, or holding unread records
+        platform_exit_critical();
+        return;
+    }
+    store.preparing = 1;
+    platform_exit_critical();
+
+    store.prep_req.op = N25XXX_OP_READ;
+    store.prep_req.address = sector_address(next);
+    store.prep_req.buf = (uint8_t *)&store.prep_header;
+    store.prep_req.len = sizeof(store.prep_header);
+    store.prep_req.handler = prepare_read_done;
+    store.prep_req.handler_arg = NULL;
+    n25xxx_submit(&store.prep_req);
+}
+
+static void prepare_read_done(handler_arg_t arg)
+{
+    uint32_t erase_count = 0;
+
+    if ((store.prep_header.magic == LOG_MAGIC) &&
+            (store.prep_header.crc == header_crc(&store.prep_header)))
+    {
+        erase_count = store.prep_header.erase_count + 1;
+    }
+
+    // The header is written after the erase
+    store.prep_header.magic = LOG_MAGIC;
+    store.prep_header.seq = store.head_seq + 1;
+    store.prep_header.erase_count = erase_count;
+    store.prep_header.crc = header_crc(&store.prep_header);
+    store.prep_header.retired = 0xFFFF;
+
+    store.prep_req.op = N25XXX_OP_ERASE_SUBSECTOR;
+    store.prep_req.handler = prepare_erase_done;
+    n25xxx_submit(&store.prep_req);
+}
+
+static void prepare_erase_done(handler_arg_t arg)
+{
+    store.prep_req.op = N25XXX_OP_PROGRAM;
+    store.prep_req.handler = prepare_program_done;
+    n25xxx_submit(&store.prep_req);
+}
+
+static void prepare_program_done(handler_arg_t arg)
+{
+    store.preparing = 0;
+    store.next_ready = 1;
+}
+
+
+/* Read */
+int n25xxx_log_read(uint8_t *buf, uint16_t size,
+        n25xxx_log_handler_t handler, handler_arg_t arg)
+{
+    platform_enter_critical();
+    if (store.reading)
+    {
+        platform_exit_critical();
+        return 1;
+    }
+    store.reading = 1;
+    platform_exit_critical();
+
+    store.read_buf = buf;
+    store.read_size = size;
+    store.read_handler = handler;
+    store.read_arg = arg;
+
+    read_next();
+    return 0;
+}
+
+int n25xxx_log_empty()
+{
+    return (store.tail == store.head) && (store.tail_offset >= store.head_offset);
+}
+
+uint32_t n25xxx_log_erase_count()
+{
+    return store.head_erase_count;
+}
+
+static void read_next()
+{
+    if (store.tail == store.head)
+    {
+        // Only read records whose program is queued
+        if (store.tail_offset >= store.submitted)
+        {
+            read_end(-1, 0);
+            return;
+        }
+    }
+    else if (store.tail_offset + RECORD_HEADER_SIZE > SECTOR_SIZE)
+    {
+        read_skip_sector();
+        return;
+    }
+
+    store.read_req.op = N25XXX_OP_READ;
+    store.read_req.address = sector_address(store.tail) + store.tail_offset;
+    store.read_req.buf = store.read_header;
+    store.read_req.len = RECORD_HEADER_SIZE;
+    store.read_req.handler = read_header_done;
+    store.read_req.handler_arg = NULL;
+    n25xxx_submit(&store.read_req);
+}
+
+static void read_header_done(handler_arg_t arg)
+{
+    uint16_t len = store.read_header[0] | (store.read_header[1] << 8);
+
+    if ((len > N25XXX_LOG_MAX_RECORD) ||
+            (store.tail_offset + RECORD_HEADER_SIZE + len > SECTOR_SIZE))
+    {
+        // End of the sub-sector records, or corrupted length
+        read_skip_sector();
+        return;
+    }
+    if (len > store.read_size)
+    {
+        log_warning("Log record of %u bytes skipped", len);
+        store.tail_offset += RECORD_HEADER_SIZE + len;
+        read_next();
+        return;
+    }
+
+    store.read_req.address += RECORD_HEADER_SIZE;
+    store.read_req.buf = store.read_buf;
+    store.read_req.len = len;
+    store.read_req.handler = read_payload_done;
+    n25xxx_submit(&store.read_req);
+}
+
+static void read_payload_done(handler_arg_t arg)
+{
+    uint16_t len = store.read_req.len;
+    uint16_t crc = crc16(crc16(0xFFFF, store.read_header, 4), store.read_buf,
+            len);
+
+    if (crc != (store.read_header[4] | (store.read_header[5] << 8)))
+    {
+        log_warning("Corrupted record in log sub-sector %u", store.tail);
+        read_skip_sector();
+        return;
+    }
+
+    store.tail_offset += RECORD_HEADER_SIZE + len;
+    read_end(len, store.read_header[2]);
+}
+
+static void read_end(int32_t len, uint8_t type)
+{
+    store.reading = 0;
+    store.read_handler(store.read_arg, len, type);
+}
+
+/* Retire the read sub-sector and continue on the next one */
+static void read_skip_sector()
+{
+    if (store.tail == store.head)
+    {
+        // Corrupted record in the write sub-sector, drop what is queued
+        store.tail_offset = store.submitted;
+        read_end(-1, 0);
+        return;
+    }
+
+    store.retire_req.op = N25XXX_OP_PROGRAM;
+    store.retire_req.address = sector_address(store.tail) + RETIRED_OFFSET;
+    store.retire_req.buf = retired_mark;
+    store.retire_req.len = sizeof(retired_mark);
+    store.retire_req.handler = retire_done;
+    store.retire_req.handler_arg = NULL;
+    n25xxx_submit(&store.retire_req);
+}
+
+static void retire_done(handler_arg_t arg)
+{
+    store.tail = sector_next(store.tail);
+    store.tail_offset = sizeof(struct sector_header);
+
+    // The retired sub-sector may be the one to prepare
+    prepare_next();
+    read_next();
+}
@@ -0,0 +1,114 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2012 HiKoB.
+ */
+
+/** Append-only record log on the N25xxx flash
+ * \file n25xxx_log.h
+ */
+
+/** \addtogroup periph
+ * @{
+ */
+
+/** \defgroup n25xxx_log N25xxx record log
+ *
+ * Records are appended to a ring of 4kB sub-sectors, which are erased in
+ * turn, so all of them wear evenly. Each sub-sector starts with a header
+ * holding its sequence number and erase count, each record is protected by a
+ * CRC. Records are read back in order, a sub-sector is marked as retired
+ * once all its records have been read.
+ *
+ * Flash accesses use the asynchronous n25xxx requests, functions never wait
+ * for the flash except \ref n25xxx_log_mount.
+ * Appends are buffered in RAM by pages, \ref n25xxx_log_flush programs the
+ * current partial page.
+ *
+ * The read position is only saved when a sub-sector is retired: after a
+ * reset, records of the oldest sub-sector may be read again.
+ *
+ * Functions are not reentrant, appends and reads should each be done from a
+ * single context.
+ *
+ * @{
+ */
+
+#ifndef N25XXX_LOG_H_
+#define N25XXX_LOG_H_
+
+#include <stdint.h>
+#include "handler.h"
+
+/** Max payload length of a record, a record never spans more than 2 pages */
+#define N25XXX_LOG_MAX_RECORD (248)
+
+/**
+ * Handler called when a read ends.
+ *
+ * \param arg the argument given to \ref n25xxx_log_read
+ * \param len the length of the record read, -1 if the log is empty
+ * \param type the type of the record read
+ */
+typedef void (*n25xxx_log_handler_t)(handler_arg_t arg, int32_t len,
+        uint8_t type);
+
+/** Mount the log, formatting it if no valid sub-sector is found
+ * Only sub-sector headers and the records of the last sub-sector are read.
+ * Uses the blocking flash functions, no asynchronous request must be pending.
+ * \param start flash address of the log, aligned on a sub-sector
+ * \param size the log size, a multiple of the sub-sector size, at least
+ * two sub-sectors
+ * \param discard 1 to retire all the records already in the log
+ */
+void n25xxx_log_mount(uint32_t start, uint32_t size, int discard);
+
+/** Append a record
+ * \param type the record type
+ * \param data the record payload, copied
+ * \param len the payload length, at most \ref N25XXX_LOG_MAX_RECORD
+ * \return 0 on success, 1 if the log is full or the page buffers are busy
+ */
+int n25xxx_log_append(uint8_t type, const uint8_t *data, uint16_t len);
+
+/** Start programming the records buffered in RAM */
+void n25xxx_log_flush();
+
+/** Read the oldest record
+ * The handler is called from the application event queue, or directly if
+ * no record is available.
+ * \param buf the buffer receiving the payload
+ * \param size the buffer size, longer records are skipped
+ * \param handler the handler called when the read ends
+ * \param arg the handler argument
+ * \return 0 if the read is started, 1 if a read is already in progress
+ */
+int n25xxx_log_read(uint8_t *buf, uint16_t size,
+        n25xxx_log_handler_t handler, handler_arg_t arg);
+
+/** Check if all appended records have been read
+ * \return 1 if the log is empty, 0 otherwise
+ */
+int n25xxx_log_empty();
+
+/** Get the erase count of the current sub-sector, for wear monitoring */
+uint32_t n25xxx_log_erase_count();
+
+/** @} */
+
+/** @} */
+
+#endif /* N25XXX_LOG_H_ */
@@ -0,0 +1,225 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/*
+ * st_mems_fifo.c
+ *
+ *  Created on: Oct 2013
+ */
+
+#include "platform.h"
+#include "soft_timer_delay.h"
+#include "st_mems_fifo.h"
+
+#define FIFO_SRC_OVRN      0x40
+#define FIFO_SRC_EMPTY     0x20
+#define FIFO_SRC_FSS_MASK  0x1F
+
+static void fifo_read(st_mems_fifo_t *fifo, int anchored);
+static void fifo_src_done(handler_arg_t arg, unsigned result);
+static void fifo_data_done(handler_arg_t arg, unsigned result);
+static void fifo_timestamp(st_mems_fifo_t *fifo);
+static void fifo_end(st_mems_fifo_t *fifo);
+
+uint8_t st_mems_fifo_start(st_mems_fifo_t *fifo,
+        const st_mems_fifo_config_t *config, i2c_t i2c, uint8_t watermark,
+        uint32_t frequency)
+{
+    if (fifo->reading || watermark == 0 || watermark >= ST_MEMS_FIFO_SIZE)
+    {
+        return 1;
+    }
+
+    fifo->config = config;
+    fifo->i2c = i2c;
+    fifo->watermark = watermark;
+    fifo->pending = 0;
+    fifo->anchor_count = 0;
+    fifo->nominal = (SOFT_TIMER_FREQUENCY << 8) / frequency;
+    fifo->period = fifo->nominal;
+    fifo->running = 1;
+
+    return 0;
+}
+
+void st_mems_fifo_stop(st_mems_fifo_t *fifo)
+{
+    fifo->running = 0;
+}
+
+void st_mems_fifo_watermark(handler_arg_t arg)
+{
+    st_mems_fifo_t *fifo = arg;
+
+    if (fifo->reading)
+    {
+        // The samples are read with the current block
+        fifo->pending = 1;
+        return;
+    }
+
+    fifo->time = soft_timer_time();
+    fifo_read(fifo, 1);
+}
+
+static void fifo_read(st_mems_fifo_t *fifo, int anchored)
+{
+    i2c_transfer_t *transfer = &fifo->transfer;
+
+    fifo->reading = 1;
+    fifo->pending = 0;
+    fifo->anchored = anchored;
+
+    // Get the number of samples first
+    transfer->addr = fifo->config->addr;
+    transfer->tx_buffer = &fifo->config->src_reg;
+    transfer->tx_length = 1;
+    transfer->rx_buffer = &fifo->src;
+    transfer->rx_length = 1;
+    transfer->handler = fifo_src_done;
+    transfer->arg = fifo;
+    i2c_submit(fifo->i2c, transfer);
+}
+
+static void fifo_src_done(handler_arg_t arg, unsigned result)
+{
+    st_mems_fifo_t *fifo = arg;
+    i2c_transfer_t *transfer = &fifo->transfer;
+    uint8_t num = fifo->src & FIFO_SRC_FSS_MASK;
+
+    if (fifo->src & FIFO_SRC_OVRN)
+    {
+        num = ST_MEMS_FIFO_SIZE;
+    }
+    else if (fifo->src & FIFO_SRC_EMPTY)
+    {
+        num = 0;
+    }
+
+    if (result)
+    {
+        fifo->anchor_count = 0;
+    }
+
+    if (result || num == 0)
+    {
+        fifo_end(fifo);
+        return;
+    }
+
+    fifo->num = num;
+
+    // The address rolls back to OUT_X_L after OUT_Z_H in FIFO mode
+    transfer->tx_buffer = &fifo->config->out_reg;
+    transfer->rx_buffer = (uint8_t *) fifo->config->samples;
+    transfer->rx_length = num * 6;
+    transfer->handler = fifo_data_done;
+    i2c_submit(fifo->i2c, transfer);
+}
+
+static void fifo_data_done(handler_arg_t arg, unsigned result)
+{
+    st_mems_fifo_t *fifo = arg;
+
+    if (result)
+    {
+        // The samples read are unknown, restart the period measurement
+        fifo->anchor_count = 0;
+    }
+    else
+    {
+        fifo_timestamp(fifo);
+
+        if (fifo->running)
+        {
+            fifo->config->block_handler(fifo->num,
+                    (fifo->src & FIFO_SRC_OVRN) != 0);
+        }
+    }
+
+    fifo_end(fifo);
+}
+
+static void fifo_end(st_mems_fifo_t *fifo)
+{
+    int again;
+
+    if (!fifo->running)
+    {
+        fifo->reading = 0;
+        return;
+    }
+
+    platform_enter_critical();
+
+    // The watermark pin stays high while the watermark is reached
+    again = fifo->pending || fifo->config->read_pin();
+
+    if (!again)
+    {
+        fifo->reading = 0;
+    }
+
+    platform_exit_critical();
+
+    if (again)
+    {
+        fifo_read(fifo, 0);
+    }
+}
+
+static void fifo_timestamp(st_mems_fifo_t *fifo)
+{
+    uint32_t nominal = fifo->nominal;
+    uint32_t i;
+
+    if (fifo->anchored)
+    {
+        // Measure the period between watermark interrupts
+        if (fifo->anchor_count)
+        {
+            uint32_t period = ((fifo->time - fifo->anchor_time) << 8)
+                              / fifo->anchor_count;
+
+            if (period > nominal - nominal / 8 && period < nominal + nominal / 8)
+            {
+                fifo->period = (3 * fifo->period + period) / 4;
+            }
+        }
+
+        fifo->anchor_time = fifo->time;
+        fifo->anchor_count = 0;
+
+        // The watermark sample is the one completing the interrupt
+        fifo->origin = fifo->time;
+        fifo->index = 1 - fifo->watermark;
+    }
+
+    for (i = 0; i < fifo->num; i++)
+    {
+        fifo->config->timestamps[i] = fifo->origin
+                + (int32_t)(((int64_t) fifo->index * fifo->period) >> 8);
+        fifo->index++;
+    }
+
+    if (fifo->anchor_count || fifo->anchored)
+    {
+        fifo->anchor_count += fifo->num;
+    }
+}
@@ -0,0 +1,122 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/*
+ * st_mems_fifo.h
+ *
+ * Stream mode FIFO of the ST MEMS sensors, shared by the l3g4200d gyroscope
+ * and the lsm303dlhc accelerometer drivers.
+ *
+ * On each watermark interrupt the FIFO level is read from the FIFO_SRC
+ * register, then all the stored samples in a single auto-increment I2C
+ * transfer. The time of each sample is reconstructed from the time of the
+ * watermark interrupt and the sample period, measured between interrupts and
+ * bounded around the nominal data rate. A read is chained without anchor
+ * while the watermark pin stays high.
+ *
+ * The drivers program the FIFO registers and route the watermark interrupt
+ * to st_mems_fifo_watermark.
+ *
+ *  Created on: Oct 2013
+ */
+
+#ifndef ST_MEMS_FIFO_H_
+#define ST_MEMS_FIFO_H_
+
+#include <stdint.h>
+#include "handler.h"
+#include "i2c.h"
+
+/** Number of samples the FIFOs hold */
+#define ST_MEMS_FIFO_SIZE 32
+
+typedef struct
+{
+    /** I2C address of the sensor */
+    uint8_t addr;
+    /** FIFO_SRC register, and first output register with auto-increment */
+    uint8_t src_reg;
+    uint8_t out_reg;
+
+    /** Buffers receiving the X, Y and Z samples and their times */
+    int16_t (*samples)[3];
+    uint32_t *timestamps;
+
+    /** Called from interrupt context with each block of samples read */
+    void (*block_handler)(uint8_t num, uint8_t overrun);
+    /** Level of the watermark pin */
+    int (*read_pin)();
+} st_mems_fifo_config_t;
+
+typedef struct
+{
+    const st_mems_fifo_config_t *config;
+    i2c_t i2c;
+    uint8_t watermark;
+    volatile uint8_t running;
+
+    // Read state, the read is anchored if started by the watermark edge
+    volatile uint8_t reading;
+    volatile uint8_t pending;
+    uint8_t anchored;
+    uint8_t src;
+    uint8_t num;
+    uint32_t time;
+
+    // Sample period in 1/256 soft timer ticks, nominal and measured
+    uint32_t nominal;
+    uint32_t period;
+    // Last watermark time and number of samples read since
+    uint32_t anchor_time;
+    uint32_t anchor_count;
+    // Time origin and index of the next sample relative to it
+    uint32_t origin;
+    int32_t index;
+
+    i2c_transfer_t transfer;
+} st_mems_fifo_t;
+
+/**
+ * Prepare the reads of a FIFO, before the driver enables it.
+ *
+ * \param fifo the FIFO state
+ * \param config the sensor registers and buffers
+ * \param i2c the I2C bus of the sensor
+ * \param watermark the number of samples triggering a read, from 1 to 31
+ * \param frequency the sensor data rate, in Hz
+ * \return 0 if the reads are prepared, 1 if a block is still being read or
+ *      the watermark is invalid
+ */
+uint8_t st_mems_fifo_start(st_mems_fifo_t *fifo,
+        const st_mems_fifo_config_t *config, i2c_t i2c, uint8_t watermark,
+        uint32_t frequency);
+
+/**
+ * Stop the reads, a block being read may still be given to the driver.
+ */
+void st_mems_fifo_stop(st_mems_fifo_t *fifo);
+
+/**
+ * Handler of the watermark interrupt.
+ *
+ * \param arg the FIFO state
+ */
+void st_mems_fifo_watermark(handler_arg_t arg);
+
+#endif /* ST_MEMS_FIFO_H_ */
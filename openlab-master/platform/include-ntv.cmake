@@ -8,6 +8,9 @@ set(FREERTOS_MEMMANG heap_3)
 # GCC target specific flags
 set(MY_C_FLAGS   "${MY_C_FLAGS} -DGCC_NATIVE")
 
+# Keep printf calls on the printf library, not turned into libc puts
+set(MY_C_FLAGS   "${MY_C_FLAGS} -fno-builtin-printf -fno-builtin-putchar -fno-builtin-puts")
+
 # LD target specific flags
 set(MY_LD_FLAGS  "${MY_LD_FLAGS} ")
 
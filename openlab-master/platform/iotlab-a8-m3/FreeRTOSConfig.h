@@ -94,4 +94,9 @@
 /* Priority 5, or 95 as only the top four bits are implemented. */
 #define configMAX_SYSCALL_INTERRUPT_PRIORITY    ( configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY << (8 - configPRIO_BITS) )
 
+/* Tasks run time and stack monitoring, see monitor.h */
+#if MONITOR_TASKS
+#include "monitor/monitor_hooks.h"
+#endif
+
 #endif /* FREERTOS_CONFIG_H */
@@ -57,6 +57,11 @@ void platform_drivers_setup()
                                            RCC_SYSCLK_CLOCK_PCLK1_TIM) / 32768) - 1);
     timer_start(TIM_3, 0xFFFF, NULL, NULL);
 
+    // Clock the TIM2 as TIM3, for GPIO input capture in the same timebase
+    timer_enable(TIM_2);
+    timer_select_internal_clock(TIM_2, (rcc_sysclk_get_clock_frequency(
+                                           RCC_SYSCLK_CLOCK_PCLK1_TIM) / 32768) - 1);
+
     // Enable the print uart
     gpio_set_uart_tx(GPIO_A, GPIO_PIN_9);
     gpio_set_uart_rx(GPIO_A, GPIO_PIN_10);
@@ -33,8 +33,11 @@
 void platform_lib_setup()
 {
     // Setup the software timer
-    soft_timer_config(TIM_3, TIMER_CHANNEL_1);
+    // TIM3 channel 1 is left for PPS input capture
+    soft_timer_config(TIM_3, TIMER_CHANNEL_2);
     timer_start(TIM_3, 0xFFFF, soft_timer_update, NULL);
+    // Restart TIM2 with TIM3 to keep their counters aligned
+    timer_start(TIM_2, 0xFFFF, NULL, NULL);
 
     // Setup the event system
     event_init();
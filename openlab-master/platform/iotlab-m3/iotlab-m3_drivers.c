@@ -82,9 +82,15 @@ void platform_drivers_setup()
     spi_set_dma(SPI_2, DMA_1_CH4, DMA_1_CH5);
     spi_enable(SPI_2, 4000000, SPI_CLOCK_MODE_IDLE_LOW_RISING);
 
-    // Configure the I2C 1
+    // Configure the DMA for the ADC scans
+    dma_enable(DMA_1_CH1);
+    adc_set_dma(ADC_1, DMA_1_CH1);
+
+    // Configure the I2C 1, receptions by DMA
+    dma_enable(DMA_1_CH7);
     gpio_set_i2c_scl(GPIO_B, GPIO_PIN_6);
     gpio_set_i2c_sda(GPIO_B, GPIO_PIN_7);
+    i2c_set_dma(I2C_1, DMA_1_CH7);
     i2c_enable(I2C_1, I2C_CLOCK_MODE_FAST);
 
     // Force inclusion of EXTI
@@ -157,6 +163,11 @@ void i2c1_er_isr()
     i2c_handle_er_interrupt(I2C_1);
 }
 
+void dma1_channel1_isr()
+{
+    dma_handle_interrupt(DMA_1_CH1);
+}
+
 void dma1_channel2_isr()
 {
     dma_handle_interrupt(DMA_1_CH2);
@@ -175,3 +186,8 @@ void dma1_channel5_isr()
 {
     dma_handle_interrupt(DMA_1_CH5);
 }
+
+void dma1_channel7_isr()
+{
+    dma_handle_interrupt(DMA_1_CH7);
+}
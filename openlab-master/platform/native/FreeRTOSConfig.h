@@ -39,7 +39,7 @@
  *----------------------------------------------------------*/
 
 #define configUSE_PREEMPTION            1
-#define configUSE_IDLE_HOOK             0
+#define configUSE_IDLE_HOOK             1
 #define configUSE_TICK_HOOK             0
 #define configCPU_CLOCK_HZ              ((unsigned portLONG)72000000) // Clock setup from main.c in the demo application.
 #define configTICK_RATE_HZ              ((portTickType)1000)
@@ -94,5 +94,9 @@ to exclude the API function. */
 #define configKERNEL_INTERRUPT_PRIORITY       255
 #define configMAX_SYSCALL_INTERRUPT_PRIORITY  0 /* 191 */
 
+/* Tasks run time and stack monitoring, see monitor.h */
+#if MONITOR_TASKS
+#include "monitor/monitor_hooks.h"
+#endif
 
 #endif /* FREERTOS_CONFIG_H */
@@ -6,6 +6,12 @@ set(PLATFORM_VERSION 0x01)
 
 set(PLATFORM_RAM_KB 1000000)
 
+# FAT32 file system on a disk image file
+set(PLATFORM_HAS_FS_IMAGE 1)
+
 # Set the flags to select the application that may be compiled
+set(PLATFORM_HAS_PHY 1)
+set(PLATFORM_HAS_CSMA 1)
+set(PLATFORM_HAS_TDMA 1)
 
 include(${PROJECT_SOURCE_DIR}/platform/include-ntv.cmake)
@@ -0,0 +1,1039 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/*
+ * medium.c
+ *
+ * Radio medium of the simulated native nodes, and their launcher.
+ *
+ * The nodes of a topology file are started as processes, each connecting to
+ * the medium Unix socket with the native PHY. The medium models the frames
+ * airtime at 250kbps, the reception power given by the path loss between the
+ * nodes, and the collisions: a receiver synchronizes on a frame at its SFD if
+ * its signal over interference and noise ratio is above the capture threshold
+ * and the frame is received with a CRC error if the ratio falls under it
+ * before its end. CCA and ED measure the energy on the channel.
+ *
+ * At exit, the statistics of each node are printed: frames sent, received and
+ * corrupted, time spent in each radio state and radio energy.
+ *
+ * Topology file, one statement per line, # for comments:
+ *   firmware <path>               default firmware of the nodes
+ *   pathloss <loss at 1m> <exp>   log distance path loss, in dB
+ *   noise <dBm>                   noise floor
+ *   capture <dB>                  capture threshold
+ *   node <id> <x> <y> [firmware]  a node, position in meters
+ *   link <a> <b> <loss> [asym]    loss between two nodes, in dB
+ *
+ * A node with no firmware is not started, but waited for: run it by hand with
+ * the OPENLAB_MEDIUM and OPENLAB_NODE_ID environment variables set.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+
+#include "phy_native/phy_native_medium.h"
+
+#define MAX_NODES 1024
+#define NO_TIME UINT64_MAX
+
+/* RF231 radio currents in mA, at 3V */
+#define VOLTAGE 3.0
+static const double current_ma[] =
+{
+    [PHY_NATIVE_RADIO_SLEEP] = 0.00002,
+    [PHY_NATIVE_RADIO_IDLE] = 0.4,
+    [PHY_NATIVE_RADIO_RX] = 12.3,
+    [PHY_NATIVE_RADIO_TX] = 14.0,
+};
+
+typedef enum
+{
+    TX_NONE,
+    TX_PENDING,
+    TX_ON_AIR,
+} tx_state_t;
+
+typedef struct
+{
+    uint16_t id;
+    double x, y;
+    const char *firmware;
+    pid_t pid;
+    int fd;
+
+    // Radio state, as given by the node
+    phy_native_radio_t state;
+    uint8_t channel;
+    uint16_t rx_seq;
+
+    // Frame being sent
+    struct
+    {
+        tx_state_t state;
+        int jam;
+        uint8_t channel;
+        int8_t power;
+        uint64_t start, sfd, end;
+        uint8_t length;
+        uint8_t data[128];
+    } tx;
+
+    // Frame being received, index of its sender or -1
+    int locked;
+    double min_sinr;
+
+    // Statistics
+    uint64_t state_since;
+    uint64_t state_time[4];
+    uint32_t frames_tx, frames_rx, frames_crc, dropped;
+} node_t;
+
+static struct
+{
+    node_t node[MAX_NODES];
+    int num;
+    int by_id[65536];
+
+    // Loss between nodes, in dB, [tx][rx]
+    float *loss;
+    double pathloss_d0, pathloss_exp;
+    double noise_dbm;
+    double capture_db;
+    const char *firmware;
+
+    // Connections not identified yet
+    int pending[MAX_NODES];
+    int pending_num;
+
+    int listener;
+    int started;
+    char path[108];
+    FILE *trace;
+    uint64_t start;
+    volatile sig_atomic_t stop;
+} medium;
+
+static uint64_t now_ns()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static double dbm_to_mw(double dbm)
+{
+    return pow(10, dbm / 10);
+}
+
+static double mw_to_dbm(double mw)
+{
+    return 10 * log10(mw);
+}
+
+static float *loss(int tx, int rx)
+{
+    return &medium.loss[tx * MAX_NODES + rx];
+}
+
+static void trace(uint64_t time, const node_t *n, const char *event,
+        const node_t *peer, int length, double rssi)
+{
+    if (medium.trace)
+    {
+        fprintf(medium.trace, "%llu,%u,%s,%u,%d,%d,%.1f\n",
+                (unsigned long long) (time - medium.start), n->id, event,
+                n->channel, peer ? peer->id : -1, length, rssi);
+    }
+}
+
+/* ------------------------------------------------------------ */
+/* Topology                                                     */
+/* ------------------------------------------------------------ */
+
+static int topology_load(const char *file)
+{
+    FILE *f = fopen(file, "r");
+    char line[512];
+    int line_num = 0;
+    int i, j;
+
+    struct
+    {
+        int a, b;
+        float loss;
+        int asym;
+    } *links = NULL;
+    int links_num = 0;
+
+    if (f == NULL)
+    {
+        perror(file);
+        return -1;
+    }
+
+    medium.pathloss_d0 = 40;
+    medium.pathloss_exp = 3;
+    medium.noise_dbm = -100;
+    medium.capture_db = 3;
+
+    for (i = 0; i < 65536; i++)
+    {
+        medium.by_id[i] = -1;
+    }
+
+    while (fgets(line, sizeof(line), f))
+    {
+        char word[16], arg[256];
+        char *comment = strchr(line, '#');
+        node_t *n;
+        unsigned id, id_b;
+        float value;
+        int count;
+
+        line_num++;
+
+        if (comment)
+        {
+            *comment = 0;
+        }
+
+        if (sscanf(line, "%15s", word) != 1)
+        {
+            continue;
+        }
+
+        if (strcmp(word, "firmware") == 0 && sscanf(line, "%*s %255s", arg) == 1)
+        {
+            medium.firmware = strdup(arg);
+        }
+        else if (strcmp(word, "pathloss") == 0)
+        {
+            sscanf(line, "%*s %lf %lf", &medium.pathloss_d0,
+                    &medium.pathloss_exp);
+        }
+        else if (strcmp(word, "noise") == 0)
+        {
+            sscanf(line, "%*s %lf", &medium.noise_dbm);
+        }
+        else if (strcmp(word, "capture") == 0)
+        {
+            sscanf(line, "%*s %lf", &medium.capture_db);
+        }
+        else if (strcmp(word, "node") == 0)
+        {
+            if (medium.num == MAX_NODES)
+            {
+                fprintf(stderr, "%s:%d: too many nodes\n", file, line_num);
+                goto error;
+            }
+
+            n = &medium.node[medium.num];
+            count = sscanf(line, "%*s %u %lf %lf %255s", &id, &n->x, &n->y,
+                           arg);
+
+            if (count < 3 || id > 0xFFFF || medium.by_id[id] >= 0)
+            {
+                fprintf(stderr, "%s:%d: invalid node\n", file, line_num);
+                goto error;
+            }
+
+            n->id = id;
+            n->firmware = count == 4 ? strdup(arg) : NULL;
+            medium.by_id[id] = medium.num++;
+        }
+        else if (strcmp(word, "link") == 0)
+        {
+            links = realloc(links, (links_num + 1) * sizeof(*links));
+
+            if (sscanf(line, "%*s %u %u %f %255s", &id, &id_b, &value, arg) < 3
+                    || id > 0xFFFF || id_b > 0xFFFF)
+            {
+                fprintf(stderr, "%s:%d: invalid link\n", file, line_num);
+                goto error;
+            }
+
+            links[links_num].a = id;
+            links[links_num].b = id_b;
+            links[links_num].loss = value;
+            links[links_num].asym = strstr(line, "asym") != NULL;
+            links_num++;
+        }
+        else
+        {
+            fprintf(stderr, "%s:%d: unknown statement %s\n", file, line_num,
+                    word);
+            goto error;
+        }
+    }
+
+    fclose(f);
+
+    // Path loss from the distance, then the given links
+    medium.loss = malloc(sizeof(float) * MAX_NODES * MAX_NODES);
+
+    for (i = 0; i < medium.num; i++)
+    {
+        node_t *n = &medium.node[i];
+
+        if (n->firmware == NULL)
+        {
+            n->firmware = medium.firmware;
+        }
+
+        for (j = 0; j < medium.num; j++)
+        {
+            double dx = n->x - medium.node[j].x;
+            double dy = n->y - medium.node[j].y;
+            double d = sqrt(dx * dx + dy * dy);
+
+            *loss(i, j) = medium.pathloss_d0
+                          + 10 * medium.pathloss_exp * log10(d < 1 ? 1 : d);
+        }
+    }
+
+    for (i = 0; i < links_num; i++)
+    {
+        int a = links[i].a < 65536 ? medium.by_id[links[i].a] : -1;
+        int b = links[i].b < 65536 ? medium.by_id[links[i].b] : -1;
+
+        if (a < 0 || b < 0)
+        {
+            fprintf(stderr, "link %d-%d: unknown node\n", links[i].a,
+                    links[i].b);
+            free(links);
+            return -1;
+        }
+
+        *loss(a, b) = links[i].loss;
+
+        if (!links[i].asym)
+        {
+            *loss(b, a) = links[i].loss;
+        }
+    }
+
+    free(links);
+    return 0;
+
+error:
+    free(links);
+    fclose(f);
+    return -1;
+}
+
+/* ------------------------------------------------------------ */
+/* Nodes                                                        */
+/* ------------------------------------------------------------ */
+
+static int nodes_start(const char *log_dir)
+{
+    int i;
+
+    for (i = 0; i < medium.num; i++)
+    {
+        node_t *n = &medium.node[i];
+        char value[16];
+
+        n->fd = -1;
+        n->pid = -1;
+        n->locked = -1;
+        n->state = PHY_NATIVE_RADIO_SLEEP;
+        n->state_since = medium.start;
+
+        if (n->firmware == NULL)
+        {
+            printf("Waiting for node %u\n", n->id);
+            continue;
+        }
+
+        n->pid = fork();
+
+        if (n->pid < 0)
+        {
+            perror("fork");
+            return -1;
+        }
+
+        if (n->pid > 0)
+        {
+            medium.started++;
+            continue;
+        }
+
+        // Child, killed with the medium
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+
+        setenv(PHY_NATIVE_MEDIUM_ENV, medium.path, 1);
+        snprintf(value, sizeof(value), "%u", n->id);
+        setenv(PHY_NATIVE_NODE_ID_ENV, value, 1);
+
+        if (log_dir)
+        {
+            char file[512];
+            int fd;
+
+            snprintf(file, sizeof(file), "%s/node-%u.log", log_dir, n->id);
+            fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+            if (fd >= 0)
+            {
+                dup2(fd, STDOUT_FILENO);
+                dup2(fd, STDERR_FILENO);
+                close(fd);
+            }
+        }
+
+        execl(n->firmware, n->firmware, (char *) NULL);
+        perror(n->firmware);
+        _exit(1);
+    }
+
+    return 0;
+}
+
+static void node_send(node_t *n, phy_native_msg_t *msg)
+{
+    size_t length = PHY_NATIVE_MSG_HEADER_LENGTH;
+
+    if (msg->type == PHY_NATIVE_MSG_RX_END)
+    {
+        length += msg->length;
+    }
+
+    if (n->fd < 0
+            || send(n->fd, msg, length, MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+    {
+        n->dropped++;
+    }
+}
+
+static void node_set_state(node_t *n, phy_native_radio_t state, uint64_t now)
+{
+    n->state_time[n->state] += now - n->state_since;
+    n->state_since = now;
+    n->state = state;
+}
+
+/* Received power at a node from a transmitter, in dBm */
+static double rx_power(int tx, int rx)
+{
+    return medium.node[tx].tx.power - *loss(tx, rx);
+}
+
+/* Energy on a channel at a node, in mW, noise included, sender excluded */
+static double channel_energy(int rx, uint8_t channel, int exclude)
+{
+    double mw = dbm_to_mw(medium.noise_dbm);
+    int i;
+
+    for (i = 0; i < medium.num; i++)
+    {
+        node_t *t = &medium.node[i];
+
+        if (i != rx && i != exclude && t->tx.state == TX_ON_AIR
+                && t->tx.channel == channel)
+        {
+            mw += dbm_to_mw(rx_power(i, rx));
+        }
+    }
+
+    return mw;
+}
+
+/* Signal over interference and noise of the frame a node receives, in dB */
+static double node_sinr(int rx, int tx)
+{
+    return rx_power(tx, rx)
+           - mw_to_dbm(channel_energy(rx, medium.node[tx].tx.channel, tx));
+}
+
+/* Check the frames being received against a new interferer */
+static void check_interference(uint8_t channel)
+{
+    int i;
+
+    for (i = 0; i < medium.num; i++)
+    {
+        node_t *r = &medium.node[i];
+        double sinr;
+
+        if (r->locked < 0 || r->channel != channel)
+        {
+            continue;
+        }
+
+        sinr = node_sinr(i, r->locked);
+
+        if (sinr < r->min_sinr)
+        {
+            r->min_sinr = sinr;
+        }
+    }
+}
+
+/* End the reception of a frame, complete or not */
+static void rx_end(int rx, uint64_t now, int complete)
+{
+    node_t *r = &medium.node[rx];
+    node_t *t = &medium.node[r->locked];
+    phy_native_msg_t msg;
+    int crc_ok = complete && r->min_sinr >= medium.capture_db;
+    double lqi = (r->min_sinr - medium.capture_db) * 255 / 20;
+
+    memset(&msg, 0, PHY_NATIVE_MSG_HEADER_LENGTH);
+    msg.type = PHY_NATIVE_MSG_RX_END;
+    msg.channel = r->channel;
+    msg.seq = r->rx_seq;
+    msg.state = crc_ok;
+    msg.rssi = lround(rx_power(r->locked, rx));
+    msg.lqi = lqi < 0 ? 0 : lqi > 255 ? 255 : lround(lqi);
+    msg.time = t->tx.sfd;
+    msg.eop = now;
+    msg.length = t->tx.length;
+    memcpy(msg.data, t->tx.data, t->tx.length);
+    node_send(r, &msg);
+
+    if (crc_ok)
+    {
+        r->frames_rx++;
+    }
+    else
+    {
+        r->frames_crc++;
+    }
+
+    trace(now, r, crc_ok ? "rx" : "rx_crc", t, t->tx.length, msg.rssi);
+
+    // The radio goes idle at the end of the frame
+    r->locked = -1;
+    node_set_state(r, PHY_NATIVE_RADIO_IDLE, now);
+}
+
+/* Stop the frame a node sends, at its end or aborted */
+static void tx_stop(int tx, uint64_t now, int complete)
+{
+    node_t *t = &medium.node[tx];
+    int i;
+
+    if (t->tx.state == TX_ON_AIR)
+    {
+        for (i = 0; i < medium.num; i++)
+        {
+            if (medium.node[i].locked == tx)
+            {
+                rx_end(i, now, complete);
+            }
+        }
+
+        trace(now, t, t->tx.jam ? "jam_end" : "tx_end", NULL, t->tx.length,
+              t->tx.power);
+    }
+
+    t->tx.state = TX_NONE;
+}
+
+/* ------------------------------------------------------------ */
+/* Events                                                       */
+/* ------------------------------------------------------------ */
+
+static uint64_t next_event(int *index)
+{
+    uint64_t next = NO_TIME;
+    int i;
+
+    for (i = 0; i < medium.num; i++)
+    {
+        node_t *t = &medium.node[i];
+        uint64_t time = NO_TIME;
+
+        if (t->tx.state == TX_PENDING)
+        {
+            time = t->tx.start;
+        }
+        else if (t->tx.state == TX_ON_AIR && !t->tx.jam)
+        {
+            time = t->tx.sfd ? t->tx.sfd : t->tx.end;
+        }
+
+        if (time < next)
+        {
+            next = time;
+            *index = i;
+        }
+    }
+
+    return next;
+}
+
+static void handle_event(int tx)
+{
+    node_t *t = &medium.node[tx];
+    phy_native_msg_t msg;
+    int i;
+
+    if (t->tx.state == TX_PENDING)
+    {
+        // Start of the frame
+        t->tx.state = TX_ON_AIR;
+        t->frames_tx++;
+        node_set_state(t, PHY_NATIVE_RADIO_TX, t->tx.start);
+        trace(t->tx.start, t, "tx", NULL, t->tx.length, t->tx.power);
+
+        check_interference(t->tx.channel);
+    }
+    else if (t->tx.sfd)
+    {
+        // SFD, the listening nodes synchronize on the frame if they can
+        for (i = 0; i < medium.num; i++)
+        {
+            node_t *r = &medium.node[i];
+            double rssi = rx_power(tx, i);
+
+            if (i == tx || r->state != PHY_NATIVE_RADIO_RX || r->locked >= 0
+                    || r->channel != t->tx.channel
+                    || rssi < PHY_NATIVE_SENSITIVITY)
+            {
+                continue;
+            }
+
+            r->min_sinr = node_sinr(i, tx);
+
+            if (r->min_sinr < medium.capture_db)
+            {
+                continue;
+            }
+
+            r->locked = tx;
+
+            memset(&msg, 0, PHY_NATIVE_MSG_HEADER_LENGTH);
+            msg.type = PHY_NATIVE_MSG_RX_START;
+            msg.channel = r->channel;
+            msg.seq = r->rx_seq;
+            msg.rssi = lround(rssi);
+            msg.time = t->tx.sfd;
+            node_send(r, &msg);
+        }
+
+        t->tx.sfd = 0;
+    }
+    else
+    {
+        // End of the frame
+        memset(&msg, 0, PHY_NATIVE_MSG_HEADER_LENGTH);
+        msg.type = PHY_NATIVE_MSG_TX_END;
+        msg.channel = t->tx.channel;
+        msg.time = t->tx.start + PHY_NATIVE_SFD_NS;
+        msg.eop = t->tx.end;
+        node_send(t, &msg);
+
+        tx_stop(tx, t->tx.end, 1);
+        node_set_state(t, PHY_NATIVE_RADIO_IDLE, t->tx.end);
+    }
+}
+
+/* ------------------------------------------------------------ */
+/* Messages                                                     */
+/* ------------------------------------------------------------ */
+
+static void handle_msg(int index, const phy_native_msg_t *msg)
+{
+    node_t *n = &medium.node[index];
+    uint64_t now = now_ns();
+    phy_native_msg_t answer;
+    int8_t energy;
+
+    switch (msg->type)
+    {
+        case PHY_NATIVE_MSG_STATE:
+            // Aborts any frame sent or received
+            tx_stop(index, now, 0);
+
+            n->locked = -1;
+            n->channel = msg->channel;
+            n->rx_seq = msg->seq;
+            node_set_state(n, msg->state, now);
+            break;
+
+        case PHY_NATIVE_MSG_TX:
+        case PHY_NATIVE_MSG_JAM:
+            tx_stop(index, now, 0);
+            n->locked = -1;
+            node_set_state(n, PHY_NATIVE_RADIO_IDLE, now);
+
+            n->channel = msg->channel;
+            n->tx.channel = msg->channel;
+            n->tx.power = msg->power;
+            n->tx.jam = msg->type == PHY_NATIVE_MSG_JAM;
+            n->tx.length = msg->length;
+            memcpy(n->tx.data, msg->data, msg->length);
+
+            // A late frame starts now
+            n->tx.start = msg->time > now ? msg->time : now;
+            n->tx.sfd = n->tx.jam ? 0 : n->tx.start + PHY_NATIVE_SFD_NS;
+            n->tx.end = n->tx.jam ? NO_TIME
+                        : n->tx.start + PHY_NATIVE_AIRTIME_NS(msg->length);
+            n->tx.state = TX_PENDING;
+            break;
+
+        case PHY_NATIVE_MSG_SENSE:
+            energy = lround(mw_to_dbm(channel_energy(index, msg->channel,
+                                      -1)));
+
+            memset(&answer, 0, PHY_NATIVE_MSG_HEADER_LENGTH);
+            answer.type = PHY_NATIVE_MSG_SENSE_RESULT;
+            answer.channel = msg->channel;
+            answer.rssi = energy;
+            node_send(n, &answer);
+            break;
+
+        default:
+            fprintf(stderr, "Node %u: unknown message %x\n", n->id, msg->type);
+            break;
+    }
+}
+
+static void handle_hello(int fd)
+{
+    phy_native_msg_t msg;
+    ssize_t length = recv(fd, &msg, sizeof(msg), 0);
+    int i;
+
+    if (length <= 0 || msg.type != PHY_NATIVE_MSG_HELLO
+            || medium.by_id[msg.node] < 0
+            || medium.node[medium.by_id[msg.node]].fd >= 0)
+    {
+        fprintf(stderr, "Rejected node %u\n", length > 0 ? msg.node : 0);
+        close(fd);
+    }
+    else
+    {
+        medium.node[medium.by_id[msg.node]].fd = fd;
+    }
+
+    // No more pending
+    for (i = 0; i < medium.pending_num; i++)
+    {
+        if (medium.pending[i] == fd)
+        {
+            medium.pending[i] = medium.pending[--medium.pending_num];
+            break;
+        }
+    }
+}
+
+static void handle_node(int index)
+{
+    node_t *n = &medium.node[index];
+    phy_native_msg_t msg;
+    ssize_t length;
+
+    while ((length = recv(n->fd, &msg, sizeof(msg), MSG_DONTWAIT)) > 0)
+    {
+        handle_msg(index, &msg);
+    }
+
+    if (length == 0)
+    {
+        // The node exited
+        tx_stop(index, now_ns(), 0);
+        node_set_state(n, PHY_NATIVE_RADIO_SLEEP, now_ns());
+        close(n->fd);
+        n->fd = -1;
+    }
+}
+
+/* ------------------------------------------------------------ */
+/* Main loop                                                    */
+/* ------------------------------------------------------------ */
+
+static void run(uint64_t end)
+{
+    static struct pollfd fds[1 + 2 * MAX_NODES];
+    static int owner[1 + 2 * MAX_NODES];
+
+    while (!medium.stop)
+    {
+        uint64_t now = now_ns(), next;
+        struct timespec timeout;
+        int i, num, index = -1;
+
+        if (end && now >= end)
+        {
+            break;
+        }
+
+        // Handle the due events, then wait for the next one
+        while ((next = next_event(&index)) <= now)
+        {
+            handle_event(index);
+        }
+
+        if (end && end < next)
+        {
+            next = end;
+        }
+
+        if (next == NO_TIME)
+        {
+            next = now + 1000000000;
+        }
+
+        timeout.tv_sec = (next - now) / 1000000000;
+        timeout.tv_nsec = (next - now) % 1000000000;
+
+        fds[0].fd = medium.listener;
+        fds[0].events = POLLIN;
+        owner[0] = -1;
+        num = 1;
+
+        for (i = 0; i < medium.pending_num; i++, num++)
+        {
+            fds[num].fd = medium.pending[i];
+            fds[num].events = POLLIN;
+            owner[num] = -2;
+        }
+
+        for (i = 0; i < medium.num; i++)
+        {
+            if (medium.node[i].fd >= 0)
+            {
+                fds[num].fd = medium.node[i].fd;
+                fds[num].events = POLLIN;
+                owner[num++] = i;
+            }
+        }
+
+        if (ppoll(fds, num, &timeout, NULL) <= 0)
+        {
+            continue;
+        }
+
+        for (i = 0; i < num; i++)
+        {
+            if (!fds[i].revents)
+            {
+                continue;
+            }
+
+            if (owner[i] >= 0)
+            {
+                handle_node(owner[i]);
+            }
+            else if (owner[i] == -2)
+            {
+                handle_hello(fds[i].fd);
+            }
+            else
+            {
+                int fd = accept(medium.listener, NULL, NULL);
+
+                if (fd >= 0 && medium.pending_num < MAX_NODES)
+                {
+                    medium.pending[medium.pending_num++] = fd;
+                }
+                else if (fd >= 0)
+                {
+                    close(fd);
+                }
+            }
+        }
+
+        // Stop when all the started nodes are gone
+        if (medium.started && waitpid(-1, NULL, WNOHANG) < 0
+                && errno == ECHILD)
+        {
+            for (i = 0; i < medium.num && medium.node[i].fd < 0; i++)
+            {
+            }
+
+            if (i == medium.num)
+            {
+                break;
+            }
+        }
+    }
+}
+
+static void print_stats(uint64_t now)
+{
+    double total_energy = 0;
+    uint32_t total_tx = 0, total_rx = 0, total_crc = 0;
+    int i, s;
+
+    printf("node,tx,rx,rx_crc,dropped,sleep_ms,idle_ms,rx_ms,tx_ms,energy_mJ\n");
+
+    for (i = 0; i < medium.num; i++)
+    {
+        node_t *n = &medium.node[i];
+        double energy = 0;
+
+        node_set_state(n, n->state, now);
+
+        for (s = 0; s < 4; s++)
+        {
+            energy += VOLTAGE * current_ma[s] * n->state_time[s] / 1e9;
+        }
+
+        printf("%u,%u,%u,%u,%u,%.1f,%.1f,%.1f,%.1f,%.3f\n", n->id,
+               n->frames_tx, n->frames_rx, n->frames_crc, n->dropped,
+               n->state_time[PHY_NATIVE_RADIO_SLEEP] / 1e6,
+               n->state_time[PHY_NATIVE_RADIO_IDLE] / 1e6,
+               n->state_time[PHY_NATIVE_RADIO_RX] / 1e6,
+               n->state_time[PHY_NATIVE_RADIO_TX] / 1e6, energy);
+
+        total_energy += energy;
+        total_tx += n->frames_tx;
+        total_rx += n->frames_rx;
+        total_crc += n->frames_crc;
+    }
+
+    printf("# %d nodes, %.3f s, %u frames sent, %u received, %u corrupted, "
+           "%.3f mJ\n", medium.num, (now - medium.start) / 1e9, total_tx,
+           total_rx, total_crc, total_energy);
+}
+
+static void stop_handler(int signal)
+{
+    (void) signal;
+    medium.stop = 1;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-d seconds] [-o log_dir] [-t trace.csv] "
+            "[-s socket] topology\n", name);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    struct sockaddr_un addr;
+    const char *log_dir = NULL;
+    double duration = 0;
+    int opt, i;
+
+    snprintf(medium.path, sizeof(medium.path), "/tmp/openlab-medium-%d",
+             getpid());
+
+    while ((opt = getopt(argc, argv, "d:o:t:s:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'd':
+                duration = atof(optarg);
+                break;
+            case 'o':
+                log_dir = optarg;
+                break;
+            case 't':
+                medium.trace = fopen(optarg, "w");
+
+                if (medium.trace == NULL)
+                {
+                    perror(optarg);
+                    return 1;
+                }
+
+                fprintf(medium.trace, "time_ns,node,event,channel,peer,"
+                        "length,dbm\n");
+                break;
+            case 's':
+                snprintf(medium.path, sizeof(medium.path), "%s", optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (optind != argc - 1)
+    {
+        usage(argv[0]);
+    }
+
+    if (topology_load(argv[optind]) < 0)
+    {
+        return 1;
+    }
+
+    // Listen to the nodes
+    medium.listener = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, medium.path, sizeof(addr.sun_path) - 1);
+    unlink(medium.path);
+
+    if (medium.listener < 0
+            || bind(medium.listener, (struct sockaddr *) &addr,
+                    sizeof(addr)) < 0 || listen(medium.listener, 128) < 0)
+    {
+        perror(medium.path);
+        return 1;
+    }
+
+    signal(SIGINT, stop_handler);
+    signal(SIGTERM, stop_handler);
+
+    medium.start = now_ns();
+
+    if (nodes_start(log_dir) < 0)
+    {
+        medium.stop = 1;
+    }
+
+    run(duration > 0 ? medium.start + (uint64_t) (duration * 1e9) : 0);
+
+    // Stop the nodes
+    for (i = 0; i < medium.num; i++)
+    {
+        if (medium.node[i].pid > 0)
+        {
+            kill(medium.node[i].pid, SIGTERM);
+        }
+    }
+
+    while (wait(NULL) > 0)
+    {
+    }
+
+    print_stats(now_ns());
+
+    if (medium.trace)
+    {
+        fclose(medium.trace);
+    }
+
+    unlink(medium.path);
+    return 0;
+}
@@ -24,12 +24,21 @@
  * Author: Antoine Fraboulet <antoine.fraboulet.at.hikob.com>
  */
 
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+
 #include "platform.h"
+#include "native.h"
 #include "unique_id.h"
 #include "random.h"
 #include "printf.h"
 #include "debug.h"
 
+#include "phy_native/phy_native_medium.h"
+
 /* ------------------------------------------------------------ */
 /*                                                              */
 /* ------------------------------------------------------------ */
@@ -48,10 +57,21 @@ void platform_init(void)
     // Setup the libraries
     platform_lib_setup();
 
+    // Setup the network
+    platform_net_setup();
+
     // Feed the random number generator
     random_init(uid->uid32[2]);
 }
 
+uint16_t platform_uid()
+{
+    const char *id = getenv(PHY_NATIVE_NODE_ID_ENV);
+
+    // Given by the radio medium launching the nodes
+    return id ? strtoul(id, NULL, 0) : 0;
+}
+
 /* ------------------------------------------------------------ */
 /*                                                              */
 /* ------------------------------------------------------------ */
@@ -64,20 +84,161 @@ void platform_run()
 void platform_prevent_low_power() {}
 void platform_release_low_power() {}
 
+/* ------------------------------------------------------------ */
+/*                                                              */
+/* ------------------------------------------------------------ */
+
+/* Number of timers checks per tick, setting the timers resolution */
+#define TIMERS_CHECKS_PER_TICK 4
+
+static handler_t tick_handler;
+static handler_arg_t tick_handler_arg;
+
+/*
+ * SIGALRM handler, the interrupt of the native platform.
+ *
+ * The timers are checked several times per tick, for the soft timer alarms
+ * not to be late by a whole tick period.
+ */
+static void native_tick_signal(int signal)
+{
+    static uint32_t checks;
+
+    (void) signal;
+
+    vPortEnterInterrupt();
+
+    native_timers_handle_interrupt();
+
+    if (++checks == TIMERS_CHECKS_PER_TICK)
+    {
+        checks = 0;
+        tick_handler(tick_handler_arg);
+    }
+
+    vPortExitInterrupt();
+}
+
+void platform_start_freertos_tick(uint16_t frequency, handler_t handler,
+                                  handler_arg_t arg)
+{
+    struct sigaction action;
+    struct itimerval period;
+
+    tick_handler = handler;
+    tick_handler_arg = arg;
+
+    action.sa_handler = native_tick_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaddset(&action.sa_mask, SIGALRM);
+    sigaddset(&action.sa_mask, SIGIO);
+    sigaction(SIGALRM, &action, NULL);
+
+    period.it_interval.tv_sec = 0;
+    period.it_interval.tv_usec = 1000000 / frequency / TIMERS_CHECKS_PER_TICK;
+    period.it_value = period.it_interval;
+    setitimer(ITIMER_REAL, &period, NULL);
+}
+
+/* Number of file descriptors with an interrupt handler */
+#define FD_HANDLERS 4
+
+static struct
+{
+    handler_t handler;
+    handler_arg_t arg;
+} fd_handlers[FD_HANDLERS];
+static int fd_handlers_num;
+
+/* SIGIO handler, the interrupt of the file descriptors */
+static void native_io_signal(int signal)
+{
+    int i;
+
+    (void) signal;
+
+    vPortEnterInterrupt();
+
+    // Data may be available on any of them
+    for (i = 0; i < fd_handlers_num; i++)
+    {
+        fd_handlers[i].handler(fd_handlers[i].arg);
+    }
+
+    vPortExitInterrupt();
+}
+
+void native_set_fd_handler(int fd, handler_t handler, handler_arg_t arg)
+{
+    struct sigaction action;
+
+    if (fd_handlers_num == FD_HANDLERS)
+    {
+        log_error("Too many file descriptors handlers");
+        return;
+    }
+
+    fd_handlers[fd_handlers_num].arg = arg;
+    fd_handlers[fd_handlers_num].handler = handler;
+    fd_handlers_num++;
+
+    action.sa_handler = native_io_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaddset(&action.sa_mask, SIGALRM);
+    sigaddset(&action.sa_mask, SIGIO);
+    sigaction(SIGIO, &action, NULL);
+
+    // Signal the process when data is available
+    fcntl(fd, F_SETOWN, getpid());
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK | O_ASYNC);
+}
+
+void platform_enter_critical()
+{
+    vPortEnterCritical();
+}
+
+void platform_exit_critical()
+{
+    vPortExitCritical();
+}
+
+void vApplicationIdleHook()
+{
+    // Sleep until the next signal
+    pause();
+}
+
 
 
 /* ------------------------------------------------------------ */
 /*                                                              */
 /* ------------------------------------------------------------ */
 
-/* We cannot #include <stdio.h> due to local printf.h definitions
- * Since we only need the putchar() prototype, here it is ...
- */
-int putchar(int c);
+/* Output line buffer, written directly not to use stdio from the tasks */
+static char line[128];
+static int line_length;
 
 void xputc(char c)
 {
-    putchar(c);
+    platform_enter_critical();
+
+    line[line_length++] = c;
+
+    // Flushed by line, for the output not to be lost when the node is killed
+    if (c == '\n' || line_length == sizeof(line))
+    {
+        if (write(STDOUT_FILENO, line, line_length) < 0)
+        {
+            // Nowhere to report it
+        }
+
+        line_length = 0;
+    }
+
+    platform_exit_critical();
 }
 
 /* ------------------------------------------------------------ */
@@ -91,7 +252,7 @@ void vApplicationStackOverflowHook(xTaskHandle *pxTask,
 
     while (1)
     {
-        asm volatile("nop");
+        pause();
     }
 }
 
@@ -28,13 +28,25 @@
 #define _NATIVE_H_
 
 #include "timer.h"
+#include "handler.h"
 
-/* Drivers */
-extern openlab_timer_t tim3, tim6;
+/* Drivers, tim3 and tim6 declared in drivers.h */
 
 void platform_drivers_setup();
 void platform_leds_setup();
 void platform_periph_setup();
 void platform_lib_setup();
+void platform_net_setup();
+
+void native_timers_handle_interrupt();
+
+/**
+ * Set the interrupt handler of a file descriptor.
+ *
+ * The descriptor is made non blocking and the handler is called from the
+ * SIGIO signal, in interrupt context, when data may be available: it must
+ * read until no data is left.
+ */
+void native_set_fd_handler(int fd, handler_t handler, handler_arg_t arg);
 
 #endif /* _NATIVE_H_ */
@@ -27,30 +27,29 @@
 #include "platform.h"
 #include "unique_id.h"
 #include "timer_.h"
+#include "native.h"
 
 /* Timers instantiations */
-static _openlab_timer_t _tim1, _tim8;
-static _openlab_timer_t _tim2, _tim3, _tim4;
-static _openlab_timer_t _tim6, _tim7;
-static _openlab_timer_t _tim9, _tim10, _tim11;
+TIMER_INIT(_tim3);
+TIMER_INIT(_tim6);
 
 /* Timers declarations */
-openlab_timer_t TIM_1 = TIM_1, TIM_8  = TIM_8;
-openlab_timer_t TIM_2 = TIM_2, TIM_3  = TIM_3,   TIM_4 = TIM_4;
-openlab_timer_t TIM_6 = TIM_6, TIM_7  = TIM_7;
-openlab_timer_t TIM_9 = TIM_9, TIM_10 = TIM_10, TIM_11 = TIM_11;
+const openlab_timer_t tim3 = &_tim3, tim6 = &_tim6;
 
-/* unique ID */
-openlab_uid_t native_uuid;
+/* unique ID, of the unique_id driver */
+extern openlab_uid_t uuid;
 
 void native_uuid_init()
 {
     int i;
 
-    for (i = 0; i < sizeof(native_uuid); i++)
+    for (i = 0; i < sizeof(uuid); i++)
     {
-        native_uuid.uid8[i] = i;
+        uuid.uid8[i] = i;
     }
+
+    // Differ between the simulated nodes
+    uuid.uid32[2] += platform_uid();
 }
 
 /* ------------------------------------------------------------ */
@@ -60,6 +59,20 @@ void native_uuid_init()
 void platform_drivers_setup()
 {
     native_uuid_init();
+
+    // Enable the timers, TIM3 on the 32kHz clock as the soft timer
+    timer_enable(tim3);
+    timer_select_external_clock(tim3, 0);
+
+    timer_enable(tim6);
+    timer_select_internal_clock(tim6, 0);
+}
+
+/* Interrupt handlers, called periodically from the tick signal */
+void native_timers_handle_interrupt()
+{
+    timer_handle_interrupt(&_tim3);
+    timer_handle_interrupt(&_tim6);
 }
 
 /* ------------------------------------------------------------ */
@@ -24,7 +24,7 @@
  *  Author: Antoine Fraboulet <antoine.fraboulet.at.hikob.com>
  */
 
-#include <stdio.h>
+#include "printf.h"
 #include "platform.h"
 
 #define OFF 0
@@ -52,13 +52,13 @@ void leds_on(uint8_t leds)
     if (leds & LED_0)
     {
         _led0 = ON;
-        fprintf(stderr, "led 0 on\n");
+        printf("led 0 on\n");
     }
 
     if (leds & LED_1)
     {
         _led1 = ON;
-        fprintf(stderr, "led 1 on\n");
+        printf("led 1 on\n");
     }
 }
 
@@ -71,13 +71,13 @@ void leds_off(uint8_t leds)
     if (leds & LED_0)
     {
         _led0 = OFF;
-        fprintf(stderr, "led 0 off\n");
+        printf("led 0 off\n");
     }
 
     if (leds & LED_1)
     {
         _led1 = OFF;
-        fprintf(stderr, "led 1 off\n");
+        printf("led 1 off\n");
     }
 }
 
@@ -90,13 +90,13 @@ void leds_toggle(uint8_t leds)
     if (leds & LED_0)
     {
         _led0 = 1 - _led0;
-        fprintf(stderr, "led 0 toggle, switch to %s\n", _led0 ? "on" : "off");
+        printf("led 0 toggle, switch to %s\n", _led0 ? "on" : "off");
     }
 
     if (leds & LED_1)
     {
         _led1 = 1 - _led1;
-        fprintf(stderr, "led 1 toggle, switch to %s\n", _led1 ? "on" : "off");
+        printf("led 1 toggle, switch to %s\n", _led1 ? "on" : "off");
     }
 }
 
@@ -25,9 +25,21 @@
  */
 
 #include "platform.h"
+#include "native.h"
+
+#include "softtimer/soft_timer_.h"
+#include "event.h"
 
 void platform_lib_setup()
 {
+    // Setup the software timer
+    soft_timer_config(tim3, TIMER_CHANNEL_1);
+
+    // Start the TIM3 timer
+    timer_start(tim3, 0xFFFF, soft_timer_update, NULL);
+
+    // Setup the event library
+    event_init();
 }
 
 
@@ -0,0 +1,51 @@
+/*
+ * This file is part of HiKoB Openlab.
+ *
+ * HiKoB Openlab is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, version 3.
+ *
+ * HiKoB Openlab is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with HiKoB Openlab. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2013 HiKoB.
+ */
+
+/*
+ * native_net.c
+ *
+ * The simulated radio of the native platform.
+ */
+
+#include "platform.h"
+#include "native.h"
+
+#include "phy_native/phy_native.h"
+#include "mac_csma.h"
+#include "mac_tdma.h"
+
+/* Phy Instantiation */
+static phy_native_t phy_native;
+phy_t platform_phy = &phy_native;
+
+const mac_csma_config_t mac_csma_config =
+{
+    .phy = &phy_native,
+};
+
+const mac_tdma_config_t mac_tdma_config =
+{
+    .phy = &phy_native,
+};
+
+void platform_net_setup()
+{
+    // Setup the PHY library, on the soft timer timer
+    phy_native_init(&phy_native, tim3, TIMER_CHANNEL_2);
+}
@@ -0,0 +1,213 @@
+#!/usr/bin/env python
+#
+# This file is part of HiKoB Openlab.
+#
+# HiKoB Openlab is free software: you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public License
+# as published by the Free Software Foundation, version 3.
+#
+# HiKoB Openlab is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with HiKoB Openlab. If not, see
+# <http://www.gnu.org/licenses/>.
+#
+# Copyright (C) 2013 HiKoB.
+#
+
+"""
+Convert trace points dumps of lib/trace to a Chrome trace, to be opened in
+chrome://tracing or https://ui.perfetto.dev
+
+The dumps are either the serial output of trace_dump(), possibly mixed with
+other lines, or the trace_buffer variable dumped by a debugger:
+
+    (gdb) dump binary value trace.bin trace_buffer
+
+Each file is shown as a process, for the traces of several nodes to be
+compared. The cycle counter is unwrapped from a record to the next, which
+assumes that they are less than half a counter period apart.
+
+usage:
+    trace2chrome.py [-e firmware.elf] dump [dump ...] > trace.json
+"""
+
+from __future__ import print_function
+
+from optparse import OptionParser
+import json
+import os
+import re
+import struct
+import subprocess
+import sys
+
+TRACE_MAGIC = 0x45435254
+TRACE_KIND_SHIFT = 14
+TRACE_ID_MASK = (1 << TRACE_KIND_SHIFT) - 1
+
+KIND_POINT, KIND_BEGIN, KIND_END, KIND_VALUE = range(4)
+
+DEFAULT_HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                              "..", "lib", "trace.h")
+
+
+def log(message):
+    sys.stderr.write(message + "\n")
+
+
+def read_ids(headers):
+    """
+    Trace points names by id, from the TRACE_ID_ enum values, given as numbers
+    or as a previous id plus a number. The last headers take precedence.
+    """
+    ids = {}
+    values = {}
+    pattern = re.compile(r"TRACE_ID_(\w+)\s*=\s*"
+                         r"(?:(0x[0-9a-fA-F]+|\d+)|TRACE_ID_(\w+)"
+                         r"(?:\s*\+\s*(0x[0-9a-fA-F]+|\d+))?)")
+    for header in headers:
+        with open(header) as f:
+            for name, value, base, offset in pattern.findall(f.read()):
+                if base:
+                    value = values[base] + int(offset or "0", 0)
+                else:
+                    value = int(value, 0)
+                values[name] = value
+                ids[value] = name
+    return ids
+
+
+def read_symbols(elf, nm):
+    """ Functions names by address, without the thumb bit """
+    symbols = {}
+    output = subprocess.check_output([nm, elf]).decode()
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) == 3 and fields[1] in "tTwW":
+            symbols[int(fields[0], 16) & ~1] = fields[2]
+    return symbols
+
+
+def read_text_dump(data):
+    """ Records of the 'trace,' lines, the last header gives the frequency """
+    frequency = None
+    records = {}
+    for line in data.decode(errors="replace").splitlines():
+        fields = line.strip().split(",")
+        if fields[0] != "trace":
+            continue
+        try:
+            if len(fields) == 4:
+                frequency = int(fields[1])
+            elif len(fields) == 5:
+                records[int(fields[1])] = (int(fields[2]), int(fields[3], 16),
+                                           int(fields[4], 16))
+        except ValueError:
+            log("Skipping corrupted line: %s" % line.strip())
+    return frequency, [records[n] for n in sorted(records)]
+
+
+def read_binary_dump(data):
+    """ Records of a trace_buffer memory dump, from the oldest """
+    magic, frequency, length, count, paused = struct.unpack_from("<5I", data)
+    offset = struct.calcsize("<5I")
+    first = max(0, count - length)
+    records = []
+    for number in range(first, count):
+        cycles, arg, ident, low = struct.unpack_from(
+            "<IIHH", data, offset + 12 * (number % length))
+        # Dropped if interrupted while being written
+        if low == number & 0xFFFF:
+            records.append((cycles, ident, arg))
+    return frequency, records
+
+
+def convert(records, frequency, pid, ids, symbols):
+    events = []
+    tracks = {}
+    cycles = None
+    last = 0
+
+    for raw, ident, arg in records:
+        # Unwrap the 32 bits counter
+        delta = (raw - last) & 0xFFFFFFFF
+        if delta >= 0x80000000:
+            delta -= 0x100000000
+        cycles = raw if cycles is None else cycles + delta
+        last = raw
+
+        kind = ident >> TRACE_KIND_SHIFT
+        name = ids.get(ident & TRACE_ID_MASK, "ID_%x" % (ident & TRACE_ID_MASK))
+        track = name.split("_")[0].lower()
+        tid = tracks.setdefault(track, len(tracks) + 1)
+
+        event = {"pid": pid, "tid": tid, "ts": cycles * 1e6 / frequency}
+
+        if kind == KIND_VALUE:
+            event.update(ph="C", name=name, args={name: arg})
+        else:
+            symbol = symbols.get(arg & ~1)
+            event.update(name=symbol or name, args={"arg": "0x%x" % arg})
+            if symbol:
+                event["args"]["id"] = name
+            if kind == KIND_POINT:
+                event.update(ph="i", s="t")
+            else:
+                event["ph"] = "B" if kind == KIND_BEGIN else "E"
+        events.append(event)
+
+    for track, tid in tracks.items():
+        events.append({"pid": pid, "tid": tid, "ph": "M",
+                       "name": "thread_name", "args": {"name": track}})
+    return events
+
+
+def main():
+    parser = OptionParser(usage="%prog [options] dump [dump ...]")
+    parser.add_option("-i", "--ids", action="append", default=[],
+                      help="header of the applications TRACE_ID_ values")
+    parser.add_option("-e", "--elf",
+                      help="firmware to name the handlers arguments")
+    parser.add_option("--nm", default="arm-none-eabi-nm",
+                      help="nm of the firmware, default arm-none-eabi-nm")
+    parser.add_option("-f", "--frequency", type="int",
+                      help="cycle counter frequency, if not in the dump")
+    parser.add_option("-o", "--output", help="output file, default stdout")
+    options, args = parser.parse_args()
+
+    if not args:
+        parser.error("no dump given")
+
+    ids = read_ids([DEFAULT_HEADER] + options.ids)
+    symbols = read_symbols(options.elf, options.nm) if options.elf else {}
+
+    events = []
+    for pid, path in enumerate(args, 1):
+        with open(path, "rb") as f:
+            data = f.read()
+
+        if len(data) >= 4 and struct.unpack_from("<I", data)[0] == TRACE_MAGIC:
+            frequency, records = read_binary_dump(data)
+        else:
+            frequency, records = read_text_dump(data)
+
+        frequency = options.frequency or frequency
+        if not frequency:
+            parser.error("no frequency for %s, give it with -f" % path)
+
+        log("%s: %u records at %u Hz" % (path, len(records), frequency))
+        events += convert(records, frequency, pid, ids, symbols)
+        events.append({"pid": pid, "ph": "M", "name": "process_name",
+                       "args": {"name": os.path.basename(path)}})
+
+    output = open(options.output, "w") if options.output else sys.stdout
+    json.dump({"traceEvents": events, "displayTimeUnit": "ns"}, output)
+    output.write("\n")
+
+
+if __name__ == "__main__":
+    main()